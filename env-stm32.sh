@@ -46,6 +46,12 @@ function flash
 }
 export -f flash
 
+function rtt
+{
+    $owndir/rtt.sh "$@"
+}
+export -f rtt
+
 function hc05
 {
     if [ -z "$1" ]; then
@@ -82,6 +88,7 @@ Use '${STM32_GREEN}xcmake${STM32_NOMARK}' instead of 'cmake' in order to configu
 cross-compilation
 Use '${STM32_GREEN}flash${STM32_NOMARK}' to flash chip, see flash --help for details
 Use '${STM32_GREEN}ocmd${STM32_NOMARK} <commands>' to send any command to OpenOCD.
+Use '${STM32_GREEN}rtt${STM32_NOMARK}' to open a terminal to the RTT debug channel of the running chip.
 Use '${STM32_GREEN}ecmake${STM32_NOMARK}' instead of 'cmake' in order to configure project for emulation.
 The project should '${STM32_GREEN}include(stm32++-emulation)${STM32_NOMARK}'. It will use the native
 PC toolchain and build a PC executable. This can be used for development and
@@ -0,0 +1,27 @@
+#!/bin/bash
+# @author Alexander Vassilev
+# @copyright BSD License
+
+if [ "$1" == "--help" ]; then
+    echo -e "RTT debug channel terminal, see stm32++/include/stm32++/rtt.hpp. Usage:\n\
+    rtt.sh [ram-start ram-size [poll-interval-ms]]\n\
+    Starts OpenOCD via ocmd.sh if it's not running, and connects to the RTT\n\
+    control block in the target's RAM, without halting the target. Uses the\n\
+    rttread tool (stm32++/tools/rttread) if it's in PATH, otherwise the RTT\n\
+    server of OpenOCD (version 0.11 or later) on port 9090"
+    exit 0
+fi
+
+owndir=`echo "$(cd $(dirname "${BASH_SOURCE[0]}"); pwd)"`
+start=${1:-0x20000000}
+size=${2:-0x5000}
+
+# Any command starts OpenOCD if it's not running
+"$owndir/ocmd.sh" "version" > /dev/null
+
+if which rttread > /dev/null 2>&1; then
+    exec rttread "$start" "$size" $3
+fi
+
+"$owndir/ocmd.sh" "rtt setup $start $size {SEGGER RTT}; rtt start; rtt server start 9090 0"
+exec nc localhost 9090
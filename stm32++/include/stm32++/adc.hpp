@@ -20,13 +20,9 @@
 #include <stm32++/timeutl.hpp>
 #include <stm32++/common.hpp>
 #include <stm32++/xassert.hpp>
+#include <stm32++/log.hpp>
 
-//#define ADC_ENABLE_DEBUG
-#ifdef ADC_ENABLE_DEBUG
-#define ADC_LOG_DEBUG(fmt,...) tprintf("adc: " fmt "\n", ##__VA_ARGS__)
-#else
-#define ADC_LOG_DEBUG(fmt,...)
-#endif
+#define ADC_LOG_DEBUG(fmt,...) STM32PP_LOG(Adc, Debug, "adc: " fmt, ##__VA_ARGS__)
 
 namespace nsadc
 {
@@ -88,6 +84,7 @@ protected:
         ADC_LOG_DEBUG("Enabled reference and temperature channels");
     }
 public:
+    static constexpr uint8_t dmaWordSize() { return Self::kDmaWordSize; }
     uint32_t clockFreq() const { return mClockFreq; }
     bool isInitialized() const { return (mInitOpts & kOptNotInitialized) == 0; }
     void init(uint8_t opts, uint32_t adcClockFreq=12000000)
@@ -399,6 +396,24 @@ void rcc_clock_setup_in_hse_8mhz_out_56mhz()
 template <uint32_t ADC>
 class Adc: public dma::Rx<AdcNoDma<ADC>, dma::kAllMaxPrio>
 {
+public:
+    /** @brief Continuous sampling into the circular buffer \c buf, which is
+     * processed one half at a time - \c callback is called from the DMA
+     * interrupt with the half that has just been filled, while the DMA fills
+     * the other half. See dma::Rx::dmaRxStartStream(). The ADC must be
+     * initialized with kOptContConv, or be triggered by a timer via \c trig.
+     * The DMA interrupt handler must call \c dmaRxIsr()
+     * @param count The number of samples in \c buf, must be even
+     * @param callback Receives the data and the number of bytes (not samples)
+     */
+    void startStream(uint16_t* buf, uint16_t count, dma::StreamCallback callback,
+        void* userp=nullptr, uint32_t trig=ADC_CR2_EXTSEL_SWSTART)
+    {
+        xassert((this->mInitOpts & kOptContConv) || trig != ADC_CR2_EXTSEL_SWSTART);
+        ADC_LOG_DEBUG("Starting stream of % samples", count);
+        this->dmaRxStartStream(buf, count * sizeof(uint16_t), callback, userp, trig);
+    }
+    void stopStream() { this->dmaRxStop(); }
 };
 }
 
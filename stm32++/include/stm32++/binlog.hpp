@@ -0,0 +1,326 @@
+/**
+ * Deferred (binary) logging - formatting is done on the host
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_BINLOG_HPP
+#define STM32PP_BINLOG_HPP
+
+#include "tprintf.hpp"
+
+extern IPrintSink* gPrintSink;
+
+/** In deferred logging mode, the MCU doesn't format the log messages.
+ * Instead, each binlog::fprint() call (and tprintf() with a \c _fmt format
+ * string, if STM32PP_TPRINTF_DEFERRED is defined) emits a compact binary
+ * record to the print sink. The record contains the id of the format string
+ * and the raw bytes of the arguments, tagged with their type. The format
+ * strings themselves are placed in the \c binlog_fmt ELF section, which is
+ * not loaded on the chip (see binlog.ld), and their id is their offset in
+ * that section. The \c binlogdec host tool reads the format strings from
+ * the ELF image and reconstructs the text. Text output from regular tprintf()
+ * calls can be freely mixed with binary records, the decoder passes it through.
+ *
+ * Record format:
+ * kRecordStart, varint(length of the rest), varint(format string id), args...
+ * Each argument starts with a tag byte - the high nibble is the type and the
+ * low nibble is the size of the value in bytes. For formatting wrappers like
+ * IntFmt and FpFmt, the formatting parameters follow the tag, then the value.
+ * Multi-byte values are in little-endian.
+ * Placeholder specs (see FmtSpec) are part of the format string, so they
+ * are applied by the decoder and cost nothing on the chip.
+ */
+namespace binlog
+{
+enum: uint8_t { kRecordStart = 0x1e };
+enum: uint8_t
+{
+    kTagUInt = 0x00,    // value
+    kTagInt = 0x10,     // value
+    kTagFloat = 0x20,   // value
+    kTagChar = 0x30,    // value
+    kTagStr = 0x40,     // varint(length), chars
+    kTagPtr = 0x50,     // value
+    kTagIntFmt = 0x60,  // flags.2, minDigits.1, minLen.1, value
+    kTagFpFmt = 0x70,   // prec.1 (0 for kShortest), minDigits.1, value
+    kTagRptChar = 0x80, // count.2, char
+    kTagFixed = 0x90,   // decimals.1 (bit 7 set if signed), minDigits.1, value
+    kTagQ = 0xa0,       // fracBits.1 (bit 7 set if signed), prec.1, minDigits.1, value
+    kFixedSigned = 0x80,
+    kTagTypeMask = 0xf0,
+    kTagSizeMask = 0x0f
+};
+
+template <class Fmt>
+struct FmtStorage;
+
+/** Storage of a format string. gcc ignores the section attribute for template
+ * instantiations, but places each of them in a section named after its
+ * mangled symbol name, i.e. \c .rodata._ZN6binlog10FmtStorage... The linker
+ * script (binlog.ld) collects these into the \c binlog_fmt section, and
+ * defines \c __start_binlog_fmt at its start.
+ */
+template <char... Chars>
+struct FmtStorage<FmtString<Chars...>>
+{
+    static const char str[];
+};
+
+template <char... Chars>
+const char FmtStorage<FmtString<Chars...>>::str[] = { Chars..., 0 };
+
+extern "C" const char __start_binlog_fmt[];
+
+template <class Fmt>
+uint32_t fmtId() { return FmtStorage<Fmt>::str - __start_binlog_fmt; }
+
+static inline uint8_t varintLen(uint32_t val)
+{
+    uint8_t len = 1;
+    while (val >= 0x80)
+    {
+        val >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static inline char* writeVarint(char* buf, uint32_t val)
+{
+    while (val >= 0x80)
+    {
+        *(buf++) = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    *(buf++) = val;
+    return buf;
+}
+
+template <typename T>
+static inline char* writeRaw(char* buf, T val)
+{
+    memcpy(buf, &val, sizeof(T));
+    return buf + sizeof(T);
+}
+
+template <typename Val>
+typename std::enable_if<std::is_arithmetic<Val>::value, size_t>::type
+argSize(Val) { return 1 + sizeof(Val); }
+
+template <typename Val>
+typename std::enable_if<std::is_integral<Val>::value && !std::is_same<Val, char>::value, char*>::type
+writeArg(char* buf, Val val)
+{
+    *(buf++) = (std::is_signed<Val>::value ? kTagInt : kTagUInt) | sizeof(Val);
+    return writeRaw(buf, val);
+}
+
+template <typename Val>
+typename std::enable_if<std::is_floating_point<Val>::value, char*>::type
+writeArg(char* buf, Val val)
+{
+    *(buf++) = kTagFloat | sizeof(Val);
+    return writeRaw(buf, val);
+}
+
+static inline char* writeArg(char* buf, char val)
+{
+    *(buf++) = kTagChar | 1;
+    *(buf++) = val;
+    return buf;
+}
+
+static inline size_t argSize(const char* str)
+{
+    size_t len = strlen(str);
+    return 1 + varintLen(len) + len;
+}
+
+static inline char* writeArg(char* buf, const char* str)
+{
+    size_t len = strlen(str);
+    *(buf++) = kTagStr;
+    buf = writeVarint(buf, len);
+    memcpy(buf, str, len);
+    return buf + len;
+}
+
+template <class P>
+typename std::enable_if<std::is_pointer<P>::value && !is_char_ptr<P>::value, size_t>::type
+argSize(P) { return 1 + sizeof(P); }
+
+template <class P>
+typename std::enable_if<std::is_pointer<P>::value && !is_char_ptr<P>::value, char*>::type
+writeArg(char* buf, P ptr)
+{
+    *(buf++) = kTagPtr | sizeof(P);
+    return writeRaw(buf, ptr);
+}
+
+template <typename T, Flags fmtFlags>
+size_t argSize(IntFmt<T, fmtFlags>)
+{
+    return 5 + sizeof(typename IntFmt<T, fmtFlags>::ScalarType);
+}
+
+template <typename T, Flags fmtFlags>
+char* writeArg(char* buf, IntFmt<T, fmtFlags> num)
+{
+    *(buf++) = kTagIntFmt | sizeof(num.value);
+    buf = writeRaw<uint16_t>(buf, IntFmt<T, fmtFlags>::flags);
+    *(buf++) = num.minDigits;
+    *(buf++) = num.minLen;
+    return writeRaw(buf, num.value);
+}
+
+template <typename T, Flags fmtFlags>
+size_t argSize(FpFmt<T, fmtFlags>) { return 3 + sizeof(T); }
+
+template <typename T, Flags fmtFlags>
+char* writeArg(char* buf, FpFmt<T, fmtFlags> fp)
+{
+    *(buf++) = kTagFpFmt | sizeof(T);
+    *(buf++) = (fmtFlags & kShortest) ? 0 : FpFmt<T, fmtFlags>::prec;
+    *(buf++) = fp.minDigits;
+    return writeRaw(buf, fp.value);
+}
+
+template <uint8_t rptFlags>
+size_t argSize(RptChar<rptFlags>) { return 4; }
+
+template <uint8_t rptFlags>
+char* writeArg(char* buf, RptChar<rptFlags> val)
+{
+    *(buf++) = kTagRptChar | 1;
+    buf = writeRaw<uint16_t>(buf, val.count());
+    *(buf++) = val.ch();
+    return buf;
+}
+
+template <typename T, uint8_t decimals>
+size_t argSize(FixedFmt<T, decimals>) { return 3 + sizeof(T); }
+
+template <typename T, uint8_t decimals>
+char* writeArg(char* buf, FixedFmt<T, decimals> fp)
+{
+    *(buf++) = kTagFixed | sizeof(T);
+    *(buf++) = decimals | (std::is_signed<T>::value ? kFixedSigned : 0);
+    *(buf++) = fp.minDigits;
+    return writeRaw(buf, fp.value);
+}
+
+template <typename T, uint8_t fracBits, uint8_t prec>
+size_t argSize(QFmt<T, fracBits, prec>) { return 4 + sizeof(T); }
+
+template <typename T, uint8_t fracBits, uint8_t prec>
+char* writeArg(char* buf, QFmt<T, fracBits, prec> fp)
+{
+    *(buf++) = kTagQ | sizeof(T);
+    *(buf++) = fracBits | (std::is_signed<T>::value ? kFixedSigned : 0);
+    *(buf++) = prec;
+    *(buf++) = fp.minDigits;
+    return writeRaw(buf, fp.value);
+}
+
+static inline size_t argsSize() { return 0; }
+
+template <typename Val, typename... Args>
+size_t argsSize(Val val, Args... args) { return argSize(val) + argsSize(args...); }
+
+static inline char* writeArgs(char* buf) { return buf; }
+
+template <typename Val, typename... Args>
+char* writeArgs(char* buf, Val val, Args... args)
+{
+    return writeArgs(writeArg(buf, val), args...);
+}
+
+template <typename... Args>
+char* writeRecord(char* buf, uint32_t payloadLen, uint32_t id, Args... args)
+{
+    *(buf++) = kRecordStart;
+    buf = writeVarint(buf, payloadLen);
+    buf = writeVarint(buf, id);
+    return writeArgs(buf, args...);
+}
+
+/** @brief Emits a binary log record to the current print sink
+ * @return The size of the record, or 0 if it could not be allocated
+ */
+template <int InitialBufSize=64, char... Chars, typename... Args>
+size_t fprint(uint8_t fd, FmtString<Chars...>, Args... args)
+{
+    typedef FmtString<Chars...> Fmt;
+    static_assert(Fmt::placeholderCount() == sizeof...(Args),
+        "binlog: Number of placeholders in format string doesn't match number of arguments");
+    static_assert(Fmt::specsValid(), "binlog: Invalid placeholder spec, "
+        "must be %{[<|>][width][d|x|X|o|b[minDigits]][.prec]}");
+    uint32_t id = fmtId<Fmt>();
+    size_t payloadLen = varintLen(id) + argsSize(args...);
+    size_t size = 1 + varintLen(payloadLen) + payloadLen;
+    if (size > STM32PP_TPRINTF_MAX_DYNAMIC_BUFSIZE)
+    {
+        return 0;
+    }
+    char* buf;
+    if (gPrintSink->canFormatInPlace())
+    {
+        buf = gPrintSink->reserve(size);
+        if (!buf)
+        {
+            return 0;
+        }
+        char* end = writeRecord(buf, payloadLen, id, args...);
+        assert((size_t)(end - buf) == size);
+        gPrintSink->commit(buf, size);
+        return size;
+    }
+    auto async = gPrintSink->waitReady();
+    if (async)
+    {
+        if (!async->buf || async->bufSize < size)
+        {
+            buf = (char*)realloc((void*)async->buf, size);
+            if (!buf)
+            {
+                return 0;
+            }
+            async->buf = buf;
+            async->bufSize = size;
+        }
+        buf = (char*)async->buf;
+    }
+    else
+    {
+        buf = (size <= InitialBufSize) ? (char*)alloca(size) : (char*)malloc(size);
+        if (!buf)
+        {
+            return 0;
+        }
+    }
+    char* end = writeRecord(buf, payloadLen, id, args...);
+    assert((size_t)(end - buf) == size);
+    if (async)
+    {
+        gPrintSink->print(buf, size, async->bufSize);
+    }
+    else
+    {
+        gPrintSink->print(buf, size, fd);
+        if (size > InitialBufSize)
+        {
+            free(buf);
+        }
+    }
+    return size;
+}
+
+template <int InitialBufSize=64, char... Chars, typename... Args>
+size_t print(FmtString<Chars...> fmt, Args... args)
+{
+    return fprint<InitialBufSize>(1, fmt, args...);
+}
+}
+
+#endif
@@ -0,0 +1,421 @@
+/**
+ * Host-side decoder of deferred (binary) log records, see binlog.hpp
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_BINLOG_DECODER_HPP
+#define STM32PP_BINLOG_DECODER_HPP
+
+#include "binlog.hpp"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace binlog
+{
+/** @brief Reconstructs the text of binary log records, using the format strings
+ * from the \c binlog_fmt section of the firmware's ELF image. The same
+ * toString() functions as on the chip are used, so the text is identical
+ * to what tprintf() would have printed. Bytes that are not part of a valid
+ * record are passed through as text.
+ */
+class Decoder
+{
+protected:
+    enum: uint32_t { kMaxRecordLen = 10240 };
+    enum ParseResult: uint8_t { kOk, kIncomplete, kInvalid };
+    std::string mFmtStrings; // contents of the binlog_fmt section
+    typedef char*(*IntFormatter)(char*, size_t, uint64_t, uint8_t, uint8_t);
+    typedef char*(*FpFormatter)(char*, size_t, const uint8_t*, uint8_t, uint8_t);
+
+    template <typename T>
+    static T readLe(const uint8_t* data, uint8_t size)
+    {
+        T val = 0;
+        for (uint8_t i = 0; i < size; i++)
+        {
+            val |= ((T)data[i]) << (i * 8);
+        }
+        return val;
+    }
+    static ParseResult readVarint(const uint8_t*& pos, const uint8_t* end, uint32_t& val)
+    {
+        val = 0;
+        for (uint8_t shift = 0; shift < 35; shift += 7)
+        {
+            if (pos >= end)
+            {
+                return kIncomplete;
+            }
+            uint8_t byte = *(pos++);
+            val |= (uint32_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return kOk;
+            }
+        }
+        return kInvalid;
+    }
+    template <Flags flags>
+    static char* formatInt(char* buf, size_t bufsize, uint64_t val, uint8_t minDigits, uint8_t minLen)
+    {
+        return toString<flags>(buf, bufsize, val, minDigits, minLen);
+    }
+    static IntFormatter intFormatter(Flags flags)
+    {
+        if ((flags & kFlagsBaseMask) == 0)
+        {
+            flags |= 10;
+        }
+        switch (flags & (kFlagsBaseMask | kUpperCase | kNoPrefix))
+        {
+#define STM32PP_BINLOG_INT_CASE(base) \
+            case base: return formatInt<base>; \
+            case base | kUpperCase: return formatInt<base | kUpperCase>; \
+            case base | kNoPrefix: return formatInt<base | kNoPrefix>; \
+            case base | kUpperCase | kNoPrefix: return formatInt<base | kUpperCase | kNoPrefix>;
+            STM32PP_BINLOG_INT_CASE(2)
+            STM32PP_BINLOG_INT_CASE(8)
+            STM32PP_BINLOG_INT_CASE(10)
+            STM32PP_BINLOG_INT_CASE(16)
+#undef STM32PP_BINLOG_INT_CASE
+            default: return nullptr;
+        }
+    }
+    // Floats are not converted to double, so that the rounding is the same as on the chip
+    template <Flags prec>
+    static char* formatFp(char* buf, size_t bufsize, const uint8_t* data, uint8_t size, uint8_t minDigits)
+    {
+        if (size == sizeof(float))
+        {
+            float val;
+            memcpy(&val, data, sizeof(val));
+            return toString<prec>(buf, bufsize, val, minDigits);
+        }
+        else if (size == sizeof(double))
+        {
+            double val;
+            memcpy(&val, data, sizeof(val));
+            return toString<prec>(buf, bufsize, val, minDigits);
+        }
+        return nullptr;
+    }
+    static FpFormatter fpFormatter(uint8_t prec)
+    {
+        switch (prec)
+        {
+            case 0: return formatFp<kShortest>;
+            case 1: return formatFp<1>;
+            case 2: return formatFp<2>;
+            case 3: return formatFp<3>;
+            case 4: return formatFp<4>;
+            case 5: return formatFp<5>;
+            case 6: return formatFp<6>;
+            case 7: return formatFp<7>;
+            case 8: return formatFp<8>;
+            case 9: return formatFp<9>;
+            default: return nullptr;
+        }
+    }
+    /** @brief Formats an integer according to the number format of a placeholder spec.
+     * As on the chip, negative numbers are in two's complement in non-decimal bases
+     */
+    static char* formatIntSpec(char* buf, size_t bufsize, uint64_t raw, bool isSigned,
+        uint8_t size, const FmtSpec& spec)
+    {
+        auto formatter = intFormatter(fmtSpecBase(spec.type) | (spec.type == 'X' ? kUpperCase : 0));
+        uint8_t shift = 64 - size * 8;
+        if (isSigned && spec.type == 'd' && (int64_t)(raw << shift) < 0)
+        {
+            *buf = '-';
+            return formatter(buf + 1, bufsize - 1, -((int64_t)(raw << shift) >> shift), spec.minDigits, 0);
+        }
+        return formatter(buf, bufsize, raw, spec.minDigits, 0);
+    }
+    /** @brief Decodes one argument and appends its text to \c out.
+     * The number format and precision of \c spec are applied, but not the width
+     */
+    static bool formatArg(const uint8_t*& pos, const uint8_t* end, const FmtSpec& spec, std::string& out)
+    {
+        if (pos >= end)
+        {
+            return false;
+        }
+        uint8_t tag = *(pos++);
+        uint8_t size = tag & kTagSizeMask;
+        uint8_t type = tag & kTagTypeMask;
+        size_t hdrLen = (type == kTagIntFmt) ? 4
+            : (type == kTagQ) ? 3
+            : (type == kTagFpFmt || type == kTagRptChar || type == kTagFixed) ? 2 : 0;
+        if ((type != kTagStr) && (size > 8 || (size_t)(end - pos) < hdrLen + size))
+        {
+            return false;
+        }
+        char buf[128];
+        char* ret;
+        switch (type)
+        {
+        case kTagUInt:
+        case kTagInt:
+        {
+            if (!size)
+            {
+                return false;
+            }
+            uint64_t raw = readLe<uint64_t>(pos, size);
+            uint8_t shift = 64 - size * 8;
+            if (spec.type)
+            {
+                ret = formatIntSpec(buf, sizeof(buf), raw, type == kTagInt, size, spec);
+            }
+            else if (type == kTagInt)
+            {
+                ret = toString(buf, sizeof(buf), (int64_t)(raw << shift) >> shift);
+            }
+            else
+            {
+                ret = toString(buf, sizeof(buf), raw);
+            }
+            break;
+        }
+        case kTagFloat:
+            ret = spec.prec
+                ? fpFormatter(spec.prec)(buf, sizeof(buf), pos, size, 0)
+                : formatFp<6>(buf, sizeof(buf), pos, size, 0);
+            break;
+        case kTagChar:
+            if (size != 1)
+            {
+                return false;
+            }
+            out += (char)*pos;
+            pos++;
+            return true;
+        case kTagStr:
+        {
+            uint32_t len;
+            if (readVarint(pos, end, len) != kOk || (size_t)(end - pos) < len)
+            {
+                return false;
+            }
+            out.append((const char*)pos, len);
+            pos += len;
+            return true;
+        }
+        case kTagPtr:
+            ret = toString<16>(buf, sizeof(buf), readLe<uint64_t>(pos, size), size * 2);
+            break;
+        case kTagIntFmt:
+        {
+            auto formatter = intFormatter(readLe<uint16_t>(pos, 2));
+            if (!formatter)
+            {
+                return false;
+            }
+            ret = formatter(buf, sizeof(buf), readLe<uint64_t>(pos + 4, size), pos[2], pos[3]);
+            break;
+        }
+        case kTagFpFmt:
+        {
+            auto formatter = fpFormatter(pos[0]);
+            if (!formatter)
+            {
+                return false;
+            }
+            ret = formatter(buf, sizeof(buf), pos + 2, size, pos[1]);
+            break;
+        }
+        case kTagFixed:
+        case kTagQ:
+        {
+            uint8_t valOffset = (type == kTagQ) ? 3 : 2;
+            uint8_t decimals = (type == kTagQ) ? pos[1] : (pos[0] & ~kFixedSigned);
+            uint8_t fracBits = pos[0] & ~kFixedSigned;
+            if (!size || decimals > 9 || (type == kTagQ && (fracBits > 32 || fracBits >= size * 8)))
+            {
+                return false;
+            }
+            uint64_t mag = readLe<uint64_t>(pos + valOffset, size);
+            bool neg = false;
+            if (pos[0] & kFixedSigned)
+            {
+                uint8_t shift = 64 - size * 8;
+                mag = magnitude((int64_t)(mag << shift) >> shift, neg);
+            }
+            uint32_t frac;
+            uint64_t whole = (type == kTagQ)
+                ? fixedSplitQ(mag, fracBits, pow10(decimals), frac)
+                : fixedSplitDec(mag, pow10(decimals), frac);
+            ret = toStringFixed(buf, sizeof(buf), neg, whole, frac, decimals, pos[valOffset - 1]);
+            break;
+        }
+        case kTagRptChar:
+            if (size != 1)
+            {
+                return false;
+            }
+            out.append(readLe<uint16_t>(pos, 2), (char)pos[2]);
+            pos += 3;
+            return true;
+        default:
+            return false;
+        }
+        if (!ret)
+        {
+            return false;
+        }
+        out.append(buf, ret - buf);
+        pos += hdrLen + size;
+        return true;
+    }
+    bool decodeRecord(const uint8_t* pos, const uint8_t* end, std::string& out)
+    {
+        uint32_t id;
+        if (readVarint(pos, end, id) != kOk || id >= mFmtStrings.size())
+        {
+            return false;
+        }
+        std::string text;
+        const char* fmt = mFmtStrings.c_str();
+        for (size_t i = id; fmt[i];)
+        {
+            if (fmt[i] != '%')
+            {
+                text += fmt[i++];
+                continue;
+            }
+            FmtSpec spec = fmtSpecParse(fmt, i, mFmtStrings.size());
+            size_t start = text.size();
+            if (!formatArg(pos, end, spec, text))
+            {
+                return false;
+            }
+            size_t len = text.size() - start;
+            if (len < spec.width)
+            {
+                text.insert(spec.leftAlign ? text.size() : start, spec.width - len, ' ');
+            }
+            i = spec.end;
+        }
+        if (pos != end)
+        {
+            return false;
+        }
+        out += text;
+        return true;
+    }
+public:
+    bool hasFmtStrings() const { return !mFmtStrings.empty(); }
+    void setFmtStrings(const char* data, size_t len) { mFmtStrings.assign(data, len); }
+    /** @brief Loads the format strings from an in-memory ELF image.
+     * Both 32-bit (the firmware) and 64-bit (host tests) little-endian
+     * images are supported
+     */
+    bool loadElf(const char* image, size_t size)
+    {
+        auto data = (const uint8_t*)image;
+        if (size < 0x40 || memcmp(data, "\x7f" "ELF", 4) || data[5] != 1)
+        {
+            return false;
+        }
+        bool is64 = (data[4] == 2);
+        uint64_t shoff = is64 ? readLe<uint64_t>(data + 0x28, 8) : readLe<uint32_t>(data + 0x20, 4);
+        uint16_t shentsize = readLe<uint16_t>(data + (is64 ? 0x3a : 0x2e), 2);
+        uint16_t shnum = readLe<uint16_t>(data + (is64 ? 0x3c : 0x30), 2);
+        uint16_t shstrndx = readLe<uint16_t>(data + (is64 ? 0x3e : 0x32), 2);
+        if (shstrndx >= shnum || shoff + (uint64_t)shnum * shentsize > size)
+        {
+            return false;
+        }
+        auto section = [&](uint16_t idx, uint32_t& name, uint64_t& offset, uint64_t& len)
+        {
+            const uint8_t* hdr = data + shoff + idx * shentsize;
+            name = readLe<uint32_t>(hdr, 4);
+            offset = is64 ? readLe<uint64_t>(hdr + 0x18, 8) : readLe<uint32_t>(hdr + 0x10, 4);
+            len = is64 ? readLe<uint64_t>(hdr + 0x20, 8) : readLe<uint32_t>(hdr + 0x14, 4);
+            return offset + len <= size;
+        };
+        uint32_t name;
+        uint64_t strOffset, strLen;
+        if (!section(shstrndx, name, strOffset, strLen))
+        {
+            return false;
+        }
+        for (uint16_t i = 0; i < shnum; i++)
+        {
+            uint64_t offset, len;
+            if (!section(i, name, offset, len) || (uint64_t)name + sizeof("binlog_fmt") > strLen)
+            {
+                continue;
+            }
+            if (memcmp(image + strOffset + name, "binlog_fmt", sizeof("binlog_fmt")) == 0)
+            {
+                setFmtStrings(image + offset, len);
+                return true;
+            }
+        }
+        return false;
+    }
+    bool loadElf(const char* fname)
+    {
+        FILE* file = fopen(fname, "rb");
+        if (!file)
+        {
+            return false;
+        }
+        std::vector<char> image;
+        char buf[4096];
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), file)) > 0)
+        {
+            image.insert(image.end(), buf, buf + len);
+        }
+        fclose(file);
+        return loadElf(image.data(), image.size());
+    }
+    /** @brief Decodes a chunk of the log stream and appends the text to \c out
+     * @return The number of bytes consumed. Bytes of a record that is not yet
+     * complete are not consumed - they must be passed again, together with
+     * the next chunk
+     */
+    size_t decode(const char* data, size_t len, std::string& out)
+    {
+        auto start = (const uint8_t*)data;
+        auto end = start + len;
+        auto pos = start;
+        while (pos < end)
+        {
+            if (*pos != kRecordStart)
+            {
+                out += (char)*(pos++);
+                continue;
+            }
+            auto recPos = pos + 1;
+            uint32_t recLen;
+            auto result = readVarint(recPos, end, recLen);
+            if (result == kIncomplete)
+            {
+                break;
+            }
+            if (result == kOk && recLen <= kMaxRecordLen)
+            {
+                if ((size_t)(end - recPos) < recLen)
+                {
+                    break;
+                }
+                if (decodeRecord(recPos, recPos + recLen, out))
+                {
+                    pos = recPos + recLen;
+                    continue;
+                }
+            }
+            // not a valid record
+            out += (char)*(pos++);
+        }
+        return pos - start;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * Lock-free single-producer single-consumer byte FIFO
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_BYTE_FIFO_HPP
+#define STM32PP_BYTE_FIFO_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/** @brief Statically allocated byte FIFO, for passing a byte stream between
+ * the main code and an interrupt handler, i.e. to an interrupt-driven
+ * transmitter. One side may write and the other may read concurrently,
+ * without disabling interrupts. Multiple writers (or readers) must be
+ * serialized by the caller.
+ * @param Size The size of the buffer in bytes. A power of 2 of up to 32768,
+ * so that the 16-bit counters wrap at a multiple of it
+ */
+template <uint32_t Size>
+class ByteFifo
+{
+protected:
+    static_assert((Size & (Size - 1)) == 0, "ByteFifo size must be a power of 2");
+    static_assert(Size >= 2 && Size <= 32768, "ByteFifo size must be in the range 2 - 32768");
+    char mBuf[Size];
+    // Total bytes written and read, wrapping at 2^16. Their difference is the
+    // fill level, so a full FIFO is told apart from an empty one without
+    // sacrificing a byte. Each side publishes its counter with release
+    // semantics only after it has copied the data, and reads the other's with
+    // acquire semantics, so the data is never accessed by both sides at once
+    uint16_t mHead = 0; // owned by the writer
+    uint16_t mTail = 0; // owned by the reader
+
+    static uint16_t load(const uint16_t& var) { return __atomic_load_n(&var, __ATOMIC_ACQUIRE); }
+    static void store(uint16_t& var, uint16_t val) { __atomic_store_n(&var, val, __ATOMIC_RELEASE); }
+public:
+    enum: uint32_t { kSize = Size };
+    uint16_t size() const { return (uint16_t)(load(mHead) - load(mTail)); }
+    uint16_t bytesFree() const { return Size - size(); }
+    bool isEmpty() const { return load(mHead) == load(mTail); }
+    /** @brief Appends as much of \c data as fits
+     * @return The number of bytes appended
+     */
+    size_t write(const char* data, size_t len)
+    {
+        uint16_t head = mHead;
+        size_t avail = Size - (uint16_t)(head - load(mTail));
+        if (len > avail)
+        {
+            len = avail;
+        }
+        uint32_t offset = head & (Size - 1);
+        size_t chunk = Size - offset;
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        memcpy(mBuf + offset, data, chunk);
+        memcpy(mBuf, data + chunk, len - chunk);
+        store(mHead, head + len);
+        return len;
+    }
+    /** @brief Removes the oldest byte
+     * @return false if the FIFO is empty
+     */
+    bool pop(char& ch)
+    {
+        uint16_t tail = mTail;
+        if (tail == load(mHead))
+        {
+            return false;
+        }
+        ch = mBuf[tail & (Size - 1)];
+        store(mTail, tail + 1);
+        return true;
+    }
+};
+
+#endif
@@ -40,6 +40,14 @@ struct PeriphInfo;
     #define STM32PP_PERIPH_INFO(periphId) __STM32PP_PERIPH_INFO(periphId);
 #endif
 
+#ifndef STM32PP_NOT_EMBEDDED
+/** @brief The address of a buffer as seen by the DMA controller. The
+ * simulated peripherals (see emu/sim/periphSim.hpp) provide their own, which
+ * maps host pointers to 32-bit addresses
+ */
+static inline uint32_t busAddress(const volatile void* ptr) { return (uint32_t)ptr; }
+#endif
+
 template <uint32_t Port, uint16_t Pin>
 struct PinDesc
 {
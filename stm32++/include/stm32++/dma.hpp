@@ -10,18 +10,14 @@
 #include <libopencm3/stm32/dma.h>
 #include "xassert.hpp"
 #include "common.hpp"
+#include "utils.hpp"
+#include "dmaQueue.hpp"
+#include "dmaRegistry.hpp"
 
-//#define DMA_ENABLE_DEBUG
+#include "log.hpp"
 
-#if defined(DMA_ENABLE_DEBUG) || !defined(NDEBUG)
-    #include "tprintf.hpp"
-    #define DMA_LOG_DEBUG(fmt,...) tprintf("%(%): " fmt "\n", Base::periphName(), DmaInfo::periphName(), ##__VA_ARGS__)
-#else
-   #define DMA_LOG_DEBUG(fmt,...)
-#endif
-
-TYPE_SUPPORTS(HasTxDma, &std::remove_reference<T>::type::dmaTxStop);
-TYPE_SUPPORTS(HasRxDma, &std::remove_reference<T>::type::dmaRxStop);
+#define DMA_LOG_DEBUG(fmt,...) \
+    STM32PP_LOG(Dma, Debug, "%(%): " fmt, Base::periphName(), DmaInfo::periphName(), ##__VA_ARGS__)
 
 namespace dma
 {
@@ -63,10 +59,17 @@ enum: uint8_t {
     kDmaDontEnableClock = 0x10, // In case the DMA controller clock is already enabled
     kDmaNoDoneIntr      = 0x20, // Disable dma complete interrupt
     kDmaCircularMode    = 0x40,
+    kDmaSharedChannel   = 0x80, // The channel is time-shared with other peripherals, see dma::ChannelLock
     kDefaultOpts = kIrqPrioMedium | kPrioMedium,
     kAllMaxPrio = kPrioVeryHigh | kIrqPrioVeryHigh
 };
 
+/** @brief Callback of a circular DMA stream, see dma::Rx::dmaRxStartStream().
+ * Called from the DMA interrupt handler with the half of the buffer that has
+ * just been filled, and its size in bytes
+ */
+typedef void(*StreamCallback)(const void* data, uint16_t size, void* userp);
+
 bool dmaChannelIsBusy(uint32_t dma, uint8_t chan)
 {
     return (DMA_CCR(dma, chan) & DMA_CCR_EN);
@@ -75,24 +78,66 @@ bool dmaChannelIsBusy(uint32_t dma, uint8_t chan)
 /** Mixin to support Tx DMA. Base is a peripheral, which is derived from
  *  PeriphInfo<Periph>, where Periph is the actual peripheral id (such as ADC1)
  *  for which DMA is to be supported. No method should conflict with one in dma::Rx
+ *  QueueDepth is the max number of transfers that can be queued, see dmaTxQueue()
  */
-template <class Base, uint8_t Opts=kDefaultOpts>
+template <class Base, uint8_t Opts=kDefaultOpts, uint8_t QueueDepth=2>
 class Tx: public Base
 {
 private:
-    typedef Tx<Base, Opts> Self;
+    typedef Tx<Base, Opts, QueueDepth> Self;
     typedef PeriphInfo<Base::kDmaTxId> DmaInfo;
-    typedef void(*FreeFunc)(void*);
-    volatile bool mTxBusy = false;
+    typedef ChannelLock<Base::kDmaTxId, Base::kDmaTxChannel> TxLock;
+    XferQueue<QueueDepth> mTxQueue;
 protected:
     enum: uint8_t { kDmaTxIrq = DmaInfo::dmaIrqForChannel(Base::kDmaTxChannel) };
-public:
-    template <typename... Args>
-    void init(Args... args)
+    // Configures the channel for this peripheral. Done once by init(), or
+    // every time the channel is acquired, if it's shared
+    void dmaTxConfig()
     {
         enum: uint8_t { chan = Self::kDmaTxChannel };
         enum: uint32_t { dma = Self::kDmaTxId };
+        dma_channel_reset(dma, chan);
+        dma_set_peripheral_address(dma, chan, Base::dmaTxDataRegister());
+        dma_set_peripheral_size(dma, chan, periphSizeCode(this->dmaWordSize()));
+        dma_disable_peripheral_increment_mode(dma, chan);
 
+        dma_set_read_from_memory(dma, chan);
+        dma_enable_memory_increment_mode(dma, chan);
+        dma_set_priority(dma, chan, ((Opts & kPrioMask) >> kPrioShift) << DMA_CCR_PL_SHIFT);
+    }
+    bool dmaTxTryAcquire()
+    {
+        if ((Opts & kDmaSharedChannel) == 0)
+        {
+            return true;
+        }
+        if (!TxLock::tryAcquire(this))
+        {
+            return false;
+        }
+        dmaTxConfig();
+        return true;
+    }
+    // The channel must be disabled
+    void dmaTxArm(const void* data, uint16_t size)
+    {
+        enum: uint8_t { chan = Self::kDmaTxChannel };
+        enum: uint32_t { dma = Self::kDmaTxId };
+        dma_set_memory_address(dma, chan, busAddress(data));
+        dma_set_number_of_data(dma, chan, size / this->dmaWordSize());
+        dma_set_memory_size(dma, chan, memSizeCode(this->dmaWordSize()));
+        if ((Opts & kDmaNoDoneIntr) == 0)
+        {
+            dma_enable_transfer_complete_interrupt(dma, chan);
+            nvic_enable_irq(kDmaTxIrq);
+        }
+        dma_enable_channel(dma, chan);
+    }
+public:
+    static constexpr bool kDmaTxShared = (Opts & kDmaSharedChannel) != 0;
+    template <typename... Args>
+    void init(Args... args)
+    {
         Base::init(args...);
         DMA_LOG_DEBUG("Tx: Initializing channel %, irq %, opts: %",
             (int)Base::kDmaTxChannel, (int)kDmaTxIrq, fmtHex(Opts));
@@ -103,14 +148,10 @@ public:
             DMA_LOG_DEBUG("Tx: Enabled clock");
         }
 
-        dma_channel_reset(dma, chan);
-        dma_set_peripheral_address(dma, chan, Base::dmaTxDataRegister());
-        dma_set_peripheral_size(dma, chan, periphSizeCode(this->dmaWordSize()));
-        dma_disable_peripheral_increment_mode(dma, chan);
-
-        dma_set_read_from_memory(dma, chan);
-        dma_enable_memory_increment_mode(dma, chan);
-        dma_set_priority(dma, chan, ((Opts & kPrioMask) >> kPrioShift) << DMA_CCR_PL_SHIFT);
+        if ((Opts & kDmaSharedChannel) == 0)
+        {
+            dmaTxConfig();
+        }
         if ((Opts & kDmaNoDoneIntr) == 0)
         {
             nvic_set_priority(kDmaTxIrq, (Opts & kIrqPrioMask) >> kIrqPrioShift);
@@ -119,88 +160,130 @@ public:
     }
     /** @brief Initiates a DMA transfer of the buffer specified
      * by the \c data and \c size paremeters.
-     * When the transfer is complete and the specified \c freeFunc
-     * is not \c nullptr, that function will be called with the \c data
-     * param to free it. It can be used also as a completion callback.
-     * @note Note that \c freeFunc will be called from an interrupt.
-     * If there is already a transfer in progress, \c dmaWrite() blocks until
-     * the previous transfer completes (and the previous buffer is freed,
-     * in case \c freeFunc was provided for the previous transfer).
+     * When the transfer is complete and the specified \c callback
+     * is not \c nullptr, it is called with the \c data and \c userp
+     * params, i.e. to free the buffer.
+     * @note Note that \c callback will be called from an interrupt.
+     * If there is already a transfer in progress, \c dmaTxStart() blocks until
+     * all queued transfers complete (and their callbacks are called). If the
+     * channel is shared, it also blocks until the channel is released
+     * by the peripheral that is using it.
      */
-    template <typename... Args>
-    void dmaTxStart(const void* data, uint16_t size, Args... args)
+    void dmaTxStart(const void* data, uint16_t size, XferCallback callback=nullptr, void* userp=nullptr)
     {
-        enum: uint8_t { chan = Self::kDmaTxChannel };
-        enum: uint32_t { dma = Self::kDmaTxId };
         xassert(size % this->dmaWordSize() == 0);
-
-        while(mTxBusy);
-        mTxBusy = true;
-
-        dma_set_memory_address(dma, chan, (uint32_t)data);
-        dma_set_number_of_data(dma, chan, size / this->dmaWordSize());
-        dma_set_memory_size(dma, chan, memSizeCode(this->dmaWordSize()));
-        if ((Opts & kDmaNoDoneIntr) == 0)
+        while(txBusy());
+        while(!dmaTxTryAcquire());
+        mTxQueue.push(data, size, callback, userp);
+        dmaTxArm(data, size);
+        //have to enable DMA for peripheral at the upper level and the transfer should start
+        Base::dmaStartPeripheralTx();
+    }
+    /** @brief Queues a transfer without blocking. If a transfer is in progress,
+     * the new one is started by the transfer complete interrupt handler of
+     * that one (ping-pong mode), and the caller can prepare the next buffer in
+     * the meantime. The gap between the buffers is the latency of that
+     * interrupt, as the F1 DMA can't chain transfers by itself.
+     * Up to \c QueueDepth transfers can be queued, and each can have its own
+     * completion \c callback, see dmaTxStart().
+     * The peripheral's DMA request is kept enabled between queued transfers, so
+     * this is suitable for peripherals that don't need per-transfer setup, such
+     * as USART and SPI. Can be called from an interrupt handler.
+     * @return false if the queue is full, or if the channel is shared and
+     * is currently used by another peripheral
+     */
+    bool dmaTxQueue(const void* data, uint16_t size, XferCallback callback=nullptr, void* userp=nullptr)
+    {
+        static_assert((Opts & kDmaNoDoneIntr) == 0,
+            "Queued DMA transfers need the transfer complete interrupt");
+        xassert(size % this->dmaWordSize() == 0);
+        IntrDisable intrDisable;
+        if (mTxQueue.isFull() || (mTxQueue.isEmpty() && !dmaTxTryAcquire()))
         {
-            dma_enable_transfer_complete_interrupt(dma, chan);
-            nvic_enable_irq(kDmaTxIrq);
+            return false;
         }
-        dma_enable_channel(dma, chan);
-        //have to enable DMA for peripheral at the upper level and the transfer should start
-        Base::dmaStartPeripheralTx(args...);
+        if (mTxQueue.push(data, size, callback, userp))
+        {
+            dmaTxArm(data, size);
+            Base::dmaStartPeripheralTx();
+        }
+        return true;
     }
-    volatile bool txBusy() const { return mTxBusy; }
+    volatile bool txBusy() const { return !mTxQueue.isEmpty(); }
+    /** @brief The number of transfers completed so far */
+    uint32_t dmaTxCompleted() const { return mTxQueue.completed(); }
     void dmaTxIsr()
     {
+        if ((Opts & kDmaSharedChannel) && !TxLock::isOwner(this))
+        {
+            return; // the interrupt is for another peripheral that shares the channel
+        }
         // check if transfer complete flag is set
         // if it is not set, assume something is wrong and bail out
         if ((DMA_ISR(Base::kDmaTxId) & DMA_ISR_TCIF(Base::kDmaTxChannel)) == 0)
             return;
 
-        // TODO: Maybe move clearing the TCIF flag just before starting a new transfer
-        // and use it for txBusy() status
-
         // Clear transfer-complete interrupt flag
         DMA_IFCR(Base::kDmaTxId) |= DMA_IFCR_CTCIF(Base::kDmaTxChannel);
-        dmaTxStop();
+        typename XferQueue<QueueDepth>::Xfer done;
+        auto next = mTxQueue.pop(done);
+        if (next)
+        {
+            // Re-arm the channel right away, the peripheral's DMA request stays enabled
+            dma_disable_channel(Base::kDmaTxId, Base::kDmaTxChannel);
+            dmaTxArm(next->data, next->size);
+        }
+        else
+        {
+            dmaTxStop();
+        }
+        if (done.callback)
+        {
+            done.callback(done.data, done.userp);
+        }
     }
+    /** @brief Aborts all transfers. Their callbacks are not called.
+     * A shared channel is released
+     */
     void dmaTxStop() // this is called from an ISR
     {
+        if ((Opts & kDmaSharedChannel) && !TxLock::isOwner(this))
+        {
+            mTxQueue.clear();
+            return;
+        }
         dma_disable_transfer_complete_interrupt(Base::kDmaTxId, Base::kDmaTxChannel);
         Base::dmaStopPeripheralTx();
         dma_disable_channel(Base::kDmaTxId, Base::kDmaTxChannel);
-        mTxBusy = false;
+        mTxQueue.clear();
+        if (Opts & kDmaSharedChannel)
+        {
+            TxLock::release(this);
+        }
     }
 };
 /** Mixin to support Rx DMA. Base is derived from DmaInfo<Periph>,
  * where Periph is the actual peripheral for which DMA is to be supported
+ * QueueDepth is the max number of transfers that can be queued, see dmaRxQueue()
  */
-template <class Base, uint8_t Opts=kDefaultOpts>
+template <class Base, uint8_t Opts=kDefaultOpts, uint8_t QueueDepth=2>
 class Rx: public Base
 {
 private:
-    volatile bool mRxBusy = false;
-    typedef Rx<Base, Opts> Self;
+    typedef Rx<Base, Opts, QueueDepth> Self;
     typedef PeriphInfo<Base::kDmaRxId> DmaInfo;
+    typedef ChannelLock<Base::kDmaRxId, Base::kDmaRxChannel> RxLock;
+    XferQueue<QueueDepth> mRxQueue;
+    StreamCallback mStreamCallback = nullptr; // set while streaming
+    void* mStreamUserp = nullptr;
 public:
     enum: uint8_t { kDmaRxIrq = DmaInfo::dmaIrqForChannel(Self::kDmaRxChannel) };
-    volatile bool dmaRxBusy() const { return mRxBusy; }
-    template<typename... Args>
-    void init(Args... args)
+protected:
+    // Configures the channel for this peripheral, see dma::Tx::dmaTxConfig()
+    void dmaRxConfig()
     {
-        Base::init(args...);
-        DMA_LOG_DEBUG("Rx: Initializing channel %, irq %, opts: %",
-            (int)Base::kDmaRxChannel, (int)kDmaRxIrq, fmtHex(Opts));
-
         enum: uint8_t { chan = Base::kDmaRxChannel };
         enum: uint32_t { dma = Base::kDmaRxId };
-
-        if (!HasTxDma<Base>::value)
-        {
-            rcc_periph_clock_enable(DmaInfo::kDmaClockId);
-            DMA_LOG_DEBUG("Rx: Enabled clock");
-        }
-
         dma_disable_channel(dma, chan);
         dma_channel_reset(dma, chan);
         dma_set_peripheral_address(dma, chan, (uint32_t)Base::dmaRxDataRegister());
@@ -214,48 +297,200 @@ public:
         {
             dma_enable_circular_mode(dma, chan);
         }
-        else if ((Opts & kDmaNoDoneIntr) == 0) // Interrupt when transfer complete
+    }
+    bool dmaRxTryAcquire()
+    {
+        if ((Opts & kDmaSharedChannel) == 0)
         {
-            nvic_set_priority(kDmaRxIrq, (Opts & kIrqPrioMask) >> kIrqPrioShift);
-            DMA_LOG_DEBUG("Rx: Enabled transfer complete interrupt");
+            return true;
+        }
+        if (!RxLock::tryAcquire(this))
+        {
+            return false;
         }
+        dmaRxConfig();
+        return true;
     }
-    template <typename... Args>
-    void dmaRxStart(const void* data, uint16_t size, Args... args)
+    // The channel must be disabled
+    void dmaRxArm(const void* data, uint16_t size)
     {
-        xassert(size % this->dmaWordSize() == 0);
         enum: uint32_t { dma = Base::kDmaRxId };
         enum: uint8_t { chan = Base::kDmaRxChannel };
-        while(mRxBusy);
-        mRxBusy = true;
-
-        dma_set_memory_address(dma, chan, (uint32_t)data);
+        dma_set_memory_address(dma, chan, busAddress(data));
         dma_set_memory_size(dma, chan, memSizeCode(this->dmaWordSize()));
         dma_set_number_of_data(dma, chan, size / this->dmaWordSize());
-        dma_enable_channel(dma, chan);
         if ((Opts & kDmaNoDoneIntr) == 0)
         {
             dma_enable_transfer_complete_interrupt(dma, chan);
             nvic_enable_irq(kDmaRxIrq);
         }
+        dma_enable_channel(dma, chan);
+    }
+public:
+    static constexpr bool kDmaRxShared = (Opts & kDmaSharedChannel) != 0;
+    volatile bool dmaRxBusy() const { return !mRxQueue.isEmpty(); }
+    template<typename... Args>
+    void init(Args... args)
+    {
+        Base::init(args...);
+        DMA_LOG_DEBUG("Rx: Initializing channel %, irq %, opts: %",
+            (int)Base::kDmaRxChannel, (int)kDmaRxIrq, fmtHex(Opts));
+
+        if (!HasTxDma<Base>::value)
+        {
+            rcc_periph_clock_enable(DmaInfo::kClockId);
+            DMA_LOG_DEBUG("Rx: Enabled clock");
+        }
+        if ((Opts & kDmaSharedChannel) == 0)
+        {
+            dmaRxConfig();
+        }
+        if ((Opts & kDmaCircularMode) == 0 && (Opts & kDmaNoDoneIntr) == 0) // Interrupt when transfer complete
+        {
+            nvic_set_priority(kDmaRxIrq, (Opts & kIrqPrioMask) >> kIrqPrioShift);
+            DMA_LOG_DEBUG("Rx: Enabled transfer complete interrupt");
+        }
+    }
+    template <typename... Args>
+    void dmaRxStart(const void* data, uint16_t size, Args... args)
+    {
+        xassert(size % this->dmaWordSize() == 0);
+        while(dmaRxBusy());
+        while(!dmaRxTryAcquire());
+        mRxQueue.push(data, size);
+        dmaRxArm(data, size);
         Base::dmaStartPeripheralRx(args...);
     }
+    /** @brief Starts continuous reception into \c buf, in circular mode. When
+     * half of the buffer is filled (half transfer interrupt), \c callback is
+     * called with the first half, and when the whole buffer is filled (transfer
+     * complete interrupt) - with the second half, while the DMA continues to
+     * fill the first half. The callback is called from the interrupt handler,
+     * and must process (or copy) its half of the buffer before the DMA wraps
+     * around to it. The stream runs until dmaRxStop() is called.
+     * @param size The size of the buffer in bytes, must be a multiple of two
+     * DMA words
+     */
+    template <typename... Args>
+    void dmaRxStartStream(void* buf, uint16_t size, StreamCallback callback, void* userp, Args... args)
+    {
+        enum: uint32_t { dma = Base::kDmaRxId };
+        enum: uint8_t { chan = Base::kDmaRxChannel };
+        xassert(size % (2 * this->dmaWordSize()) == 0);
+        xassert(callback);
+        while(dmaRxBusy());
+        while(!dmaRxTryAcquire());
+        mRxQueue.push(buf, size);
+        mStreamCallback = callback;
+        mStreamUserp = userp;
+        dma_enable_circular_mode(dma, chan);
+        dma_enable_half_transfer_interrupt(dma, chan);
+        dma_enable_transfer_complete_interrupt(dma, chan);
+        nvic_set_priority(kDmaRxIrq, (Opts & kIrqPrioMask) >> kIrqPrioShift);
+        nvic_enable_irq(kDmaRxIrq);
+        dmaRxArm(buf, size);
+        Base::dmaStartPeripheralRx(args...);
+    }
+    bool dmaRxIsStreaming() const { return mStreamCallback != nullptr; }
+    /** @brief Queues a receive buffer without blocking, see dma::Tx::dmaTxQueue().
+     * Buffers are filled in the order they were queued. The consumer is
+     * notified via \c callback, called from the interrupt handler, or can
+     * poll dmaRxCompleted() to find out which buffers are ready.
+     * @return false if the queue is full, or if the channel is shared and
+     * is currently used by another peripheral
+     */
+    bool dmaRxQueue(void* data, uint16_t size, XferCallback callback=nullptr, void* userp=nullptr)
+    {
+        static_assert((Opts & (kDmaNoDoneIntr | kDmaCircularMode)) == 0,
+            "Queued DMA transfers need the transfer complete interrupt, and no circular mode");
+        xassert(size % this->dmaWordSize() == 0);
+        IntrDisable intrDisable;
+        if (mRxQueue.isFull() || (mRxQueue.isEmpty() && !dmaRxTryAcquire()))
+        {
+            return false;
+        }
+        if (mRxQueue.push(data, size, callback, userp))
+        {
+            dmaRxArm(data, size);
+            Base::dmaStartPeripheralRx();
+        }
+        return true;
+    }
+    /** @brief The number of receive transfers completed so far */
+    uint32_t dmaRxCompleted() const { return mRxQueue.completed(); }
     void dmaRxIsr()
     {
+        enum: uint32_t { dma = Base::kDmaRxId };
+        enum: uint8_t { chan = Base::kDmaRxChannel };
+        if ((Opts & kDmaSharedChannel) && !RxLock::isOwner(this))
+        {
+            return; // the interrupt is for another peripheral that shares the channel
+        }
+        if (mStreamCallback)
+        {
+            // If the interrupt was delayed, both flags may be set. The
+            // first half was filled first
+            uint32_t flags = DMA_ISR(dma);
+            auto& xfer = mRxQueue.front();
+            uint16_t half = xfer.size / 2;
+            if (flags & DMA_ISR_HTIF(chan))
+            {
+                DMA_IFCR(dma) = DMA_IFCR_CHTIF(chan);
+                mStreamCallback(xfer.data, half, mStreamUserp);
+            }
+            if (flags & DMA_ISR_TCIF(chan))
+            {
+                DMA_IFCR(dma) = DMA_IFCR_CTCIF(chan);
+                mStreamCallback((const char*)xfer.data + half, half, mStreamUserp);
+            }
+            return;
+        }
         if ((DMA_ISR(Base::kDmaRxId) & DMA_ISR_TCIF(Self::kDmaRxChannel)) == 0)
         {
             return;
         }
         DMA_IFCR(Base::kDmaRxId) |= DMA_IFCR_CTCIF(Self::kDmaRxChannel);
-        dmaRxStop();
+        typename XferQueue<QueueDepth>::Xfer done;
+        auto next = mRxQueue.pop(done);
+        if (next)
+        {
+            dma_disable_channel(Base::kDmaRxId, Base::kDmaRxChannel);
+            dmaRxArm(next->data, next->size);
+        }
+        else
+        {
+            dmaRxStop();
+        }
+        if (done.callback)
+        {
+            done.callback(done.data, done.userp);
+        }
     }
     void dmaRxStop()
     {
+        if ((Opts & kDmaSharedChannel) && !RxLock::isOwner(this))
+        {
+            mRxQueue.clear();
+            return;
+        }
         nvic_disable_irq(kDmaRxIrq);
         dma_disable_transfer_complete_interrupt(Base::kDmaRxId, Base::kDmaRxChannel);
         Base::dmaStopPeripheralRx();
         dma_disable_channel(Base::kDmaRxId, Base::kDmaRxChannel);
-        mRxBusy = false;
+        if (mStreamCallback)
+        {
+            dma_disable_half_transfer_interrupt(Base::kDmaRxId, Base::kDmaRxChannel);
+            if ((Opts & kDmaCircularMode) == 0)
+            {
+                DMA_CCR(Base::kDmaRxId, Base::kDmaRxChannel) &= ~DMA_CCR_CIRC;
+            }
+            mStreamCallback = nullptr;
+        }
+        mRxQueue.clear();
+        if (Opts & kDmaSharedChannel)
+        {
+            RxLock::release(this);
+        }
     }
 };
 }
@@ -0,0 +1,227 @@
+/**
+ * Memory-to-memory DMA copies and fills
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_DMA_MEM_COPY_HPP
+#define STM32PP_DMA_MEM_COPY_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "dmaQueue.hpp"
+
+#if !defined(STM32PP_NOT_EMBEDDED) || defined(STM32PP_PERIPH_SIM)
+#include "dma.hpp"
+#endif
+
+namespace dma
+{
+/** @brief Bulk memory copies and fills, done by a DMA channel in MEM2MEM mode,
+ * while the CPU continues working. Operations are queued, and executed
+ * one after the other by the transfer complete interrupt handler, which
+ * then calls their completion callbacks with the destination buffer.
+ * The interrupt handler of the channel must call \c isr().
+ * The buffers must not be accessed until the operation completes.
+ * The channel runs with the lowest DMA priority, so that it doesn't delay
+ * peripheral transfers, and must not be used by any peripheral - list the
+ * MemCopy type in the application's dma::ChannelRegistry to check that.
+ * When compiled with STM32PP_NOT_EMBEDDED and without the simulated
+ * peripherals (STM32PP_PERIPH_SIM), the operations are done
+ * synchronously with memcpy()/memset(), and the callback is called before
+ * copy()/fill() returns, so that callers stay portable.
+ * @param Chan The DMA channel
+ * @param DmaNum The DMA controller, 1 for DMA1 and 2 for DMA2
+ * @param QueueDepth The max number of queued operations
+ */
+template <uint8_t Chan, uint8_t DmaNum=1, uint8_t QueueDepth=4>
+class MemCopy
+{
+protected:
+    static_assert(DmaNum == 1 || DmaNum == 2, "DmaNum must be 1 or 2");
+    static_assert(QueueDepth >= 1 && QueueDepth <= 128, "MemCopy queue depth must be in the range 1 - 128");
+    struct Op
+    {
+        void* dst;
+        const void* src; // nullptr for a fill
+        uint32_t pattern; // the fill value, repeated in each byte
+        uint16_t size;
+        XferCallback callback;
+        void* userp;
+    };
+#if !defined(STM32PP_NOT_EMBEDDED) || defined(STM32PP_PERIPH_SIM)
+public:
+    enum: uint32_t { kDmaMemId = (DmaNum == 1) ? DMA1 : DMA2 };
+protected:
+    typedef PeriphInfo<kDmaMemId> DmaInfo;
+    enum: uint8_t { kIrq = DmaInfo::dmaIrqForChannel(Chan) };
+    Op mOps[QueueDepth];
+    uint8_t mFront = 0;
+    volatile uint8_t mCount = 0;
+    static uint8_t wordSize(const Op& op)
+    {
+        uintptr_t bits = (uintptr_t)op.dst | op.size | (uintptr_t)op.src;
+        return (bits & 3) == 0 ? 4 : ((bits & 1) == 0 ? 2 : 1);
+    }
+    // The channel must be disabled
+    void arm(Op& op)
+    {
+        enum: uint32_t { dma = kDmaMemId };
+        uint8_t size = wordSize(op);
+        // In MEM2MEM mode, the "peripheral" address is the source
+        dma_set_peripheral_address(dma, Chan, op.src ? busAddress(op.src) : busAddress(&op.pattern));
+        if (op.src)
+        {
+            dma_enable_peripheral_increment_mode(dma, Chan);
+        }
+        else
+        {
+            dma_disable_peripheral_increment_mode(dma, Chan);
+        }
+        dma_set_memory_address(dma, Chan, busAddress(op.dst));
+        dma_set_peripheral_size(dma, Chan, periphSizeCode(size));
+        dma_set_memory_size(dma, Chan, memSizeCode(size));
+        dma_set_number_of_data(dma, Chan, op.size / size);
+        dma_enable_channel(dma, Chan);
+    }
+    bool push(void* dst, const void* src, uint32_t pattern, uint16_t size,
+        XferCallback callback, void* userp)
+    {
+        if (!size)
+        {
+            if (callback)
+            {
+                callback(dst, userp);
+            }
+            return true;
+        }
+        IntrDisable intrDisable;
+        if (mCount == QueueDepth)
+        {
+            return false;
+        }
+        Op& op = mOps[(mFront + mCount) % QueueDepth];
+        op.dst = dst;
+        op.src = src;
+        op.pattern = pattern;
+        op.size = size;
+        op.callback = callback;
+        op.userp = userp;
+        if (++mCount == 1)
+        {
+            arm(op);
+        }
+        return true;
+    }
+public:
+    enum: uint8_t { kDmaMemChannel = Chan };
+    static constexpr bool kDmaMemShared = false;
+    void init()
+    {
+        enum: uint32_t { dma = kDmaMemId };
+        rcc_periph_clock_enable(DmaInfo::kClockId);
+        dma_channel_reset(dma, Chan);
+        dma_enable_mem2mem_mode(dma, Chan);
+        dma_set_read_from_peripheral(dma, Chan);
+        dma_enable_memory_increment_mode(dma, Chan);
+        dma_set_priority(dma, Chan, DMA_CCR_PL_LOW);
+        dma_enable_transfer_complete_interrupt(dma, Chan);
+        dma_enable_transfer_error_interrupt(dma, Chan);
+        nvic_set_priority(kIrq, kIrqPrioMedium >> kIrqPrioShift);
+        nvic_enable_irq(kIrq);
+    }
+    bool busy() const { return mCount != 0; }
+    void isr()
+    {
+        enum: uint32_t { dma = kDmaMemId };
+        uint32_t flags = DMA_ISR(dma);
+        if ((flags & (DMA_ISR_TCIF(Chan) | DMA_ISR_TEIF(Chan))) == 0)
+        {
+            return;
+        }
+        DMA_IFCR(dma) = DMA_IFCR_CGIF(Chan);
+        dma_disable_channel(dma, Chan);
+        if (!mCount)
+        {
+            return;
+        }
+        if (flags & DMA_ISR_TEIF(Chan))
+        {
+            // Bus error - the buffer addresses are invalid
+            STM32PP_LOG(Dma, Error, "MemCopy: Transfer error on channel %, aborting all operations", (int)Chan);
+            mCount = 0;
+            return;
+        }
+        Op done = mOps[mFront];
+        mFront = (mFront + 1) % QueueDepth;
+        if (--mCount)
+        {
+            arm(mOps[mFront]);
+        }
+        if (done.callback)
+        {
+            done.callback(done.dst, done.userp);
+        }
+    }
+    /** @brief Aborts the current and all queued operations. Their callbacks
+     * are not called
+     */
+    void stop()
+    {
+        IntrDisable intrDisable;
+        dma_disable_channel(kDmaMemId, Chan);
+        mCount = 0;
+    }
+#else
+    bool push(void* dst, const void* src, uint32_t pattern, uint16_t size,
+        XferCallback callback, void* userp)
+    {
+        if (src)
+        {
+            memcpy(dst, src, size);
+        }
+        else
+        {
+            memset(dst, pattern & 0xff, size);
+        }
+        if (callback)
+        {
+            callback(dst, userp);
+        }
+        return true;
+    }
+public:
+    enum: uint32_t { kDmaMemId = DmaNum };
+    enum: uint8_t { kDmaMemChannel = Chan };
+    static constexpr bool kDmaMemShared = false;
+    void init() {}
+    bool busy() const { return false; }
+    void isr() {}
+    void stop() {}
+#endif
+    /** @brief Queues a copy of \c size bytes from \c src to \c dst, which must
+     * not overlap. The copy is done in 32-bit words if the addresses and the
+     * size are multiples of 4, otherwise in 16-bit words or bytes.
+     * @return false if the queue is full
+     */
+    bool copy(void* dst, const void* src, uint16_t size, XferCallback callback=nullptr, void* userp=nullptr)
+    {
+        assert(src);
+        return push(dst, src, 0, size, callback, userp);
+    }
+    /** @brief Queues setting \c size bytes at \c dst to \c value
+     * @return false if the queue is full
+     */
+    bool fill(void* dst, uint8_t value, uint16_t size, XferCallback callback=nullptr, void* userp=nullptr)
+    {
+        return push(dst, nullptr, value * 0x01010101u, size, callback, userp);
+    }
+    /** @brief Waits till all queued operations complete */
+    void wait() const
+    {
+        while(busy());
+    }
+};
+}
+#endif
@@ -2,6 +2,7 @@
 #define DMA_PRINT_HPP
 
 #include "printSink.hpp"
+#include "logRing.hpp"
 namespace dma
 {
 template <class DmaDevice>
@@ -20,6 +21,99 @@ class PrintSink: public DmaDevice, public AsyncPrintSink
         DmaDevice::dmaTxStart((const void*)str, len);
     }
 };
+
+/** @brief Print sink that never blocks and can be used from interrupt handlers.
+ * Printed strings are appended to a statically allocated lock-free ring
+ * buffer (see \c LogRing), which is drained by chained DMA transfers, one per
+ * printed string. If the ring buffer is full, the string is dropped.
+ * tprintf() calls whose output length is known in advance format directly
+ * into the ring buffer, without an intermediate buffer.
+ * The DMA Tx interrupt handler of the device must call \c dmaTxIsr() of the
+ * sink, rather than that of the device.
+ * @param DmaDevice A peripheral with the dma::Tx mixin
+ * @param Size The size of the ring buffer. Must be a power of 2
+ */
+template <class DmaDevice, uint32_t Size=1024>
+class RingPrintSink: public DmaDevice, public IPrintSink
+{
+protected:
+    LogRing<Size> mRing;
+    uint32_t mDraining = 0; // set while a DMA transfer from the ring is in progress
+    bool tryStartDrain()
+    {
+        uint32_t expected = 0;
+        return __atomic_compare_exchange_n(&mDraining, &expected, 1, false,
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+    // Must be called only by the owner of the mDraining flag
+    void drainNext()
+    {
+        for (;;)
+        {
+            uint16_t len;
+            const char* data = mRing.peek(len);
+            if (data)
+            {
+                DmaDevice::dmaTxStart(data, len);
+                return;
+            }
+            __atomic_store_n(&mDraining, 0, __ATOMIC_SEQ_CST);
+            // A record may have been published after peek(), by a writer that
+            // saw mDraining still set and relied on us to transfer it
+            if (!mRing.hasData() || !tryStartDrain())
+            {
+                return;
+            }
+        }
+    }
+    void kickDrain()
+    {
+        if (tryStartDrain())
+        {
+            drainNext();
+        }
+    }
+public:
+    const LogRing<Size>& ring() const { return mRing; }
+    uint32_t dropped() const { return mRing.dropped(); }
+    virtual IPrintSink::BufferInfo* waitReady() { return nullptr; }
+    virtual void print(const char* str, size_t len, int)
+    {
+        // Even if our record is dropped, we may have published records of
+        // interrupt handlers that preempted us, so always kick the drain
+        mRing.write(str, len);
+        kickDrain();
+    }
+    /** tprintf() formats directly into the ring buffer, while the DMA may
+     * still be transferring previous records
+     */
+    virtual bool canFormatInPlace() const { return true; }
+    virtual char* reserve(size_t len)
+    {
+        char* buf = mRing.reserve(len);
+        if (!buf)
+        {
+            kickDrain(); // see print()
+        }
+        return buf;
+    }
+    virtual void commit(char* buf, size_t len)
+    {
+        mRing.commit(buf, len);
+        kickDrain();
+    }
+    /** @brief Must be called by the DMA Tx channel interrupt handler */
+    void dmaTxIsr()
+    {
+        DmaDevice::dmaTxIsr();
+        if (DmaDevice::txBusy())
+        {
+            return; // not a transfer complete interrupt
+        }
+        mRing.pop();
+        drainNext();
+    }
+};
 }
 
 #endif
@@ -0,0 +1,99 @@
+/**
+ * Queue of DMA transfers
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_DMA_QUEUE_HPP
+#define STM32PP_DMA_QUEUE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+namespace dma
+{
+/** @brief Completion callback of a DMA transfer. Called from the DMA interrupt
+ * handler, with the buffer of the transfer and the user pointer that was
+ * given when the transfer was queued. It can be used to free the buffer.
+ */
+typedef void(*XferCallback)(const void* data, void* userp);
+
+/** @brief Fixed-size queue of transfer descriptors of a DMA channel. The
+ * transfer at the front is the one in progress. When it completes, the
+ * interrupt handler pops it, starts the next one first, so that the gap
+ * between the transfers is only the latency of the interrupt, and then
+ * invokes the completion callback of the finished one. With the default depth of 2, this is
+ * ping-pong (double) buffering. Deeper queues allow the caller to
+ * fire-and-forget several transfers.
+ * The queue is modified both by the code that enqueues transfers and by the
+ * interrupt handler, so the former must disable interrupts while calling
+ * push(). This class doesn't access hardware registers, so it can be tested
+ * on the host.
+ */
+template <uint8_t Depth=2>
+class XferQueue
+{
+public:
+    struct Xfer
+    {
+        const void* data;
+        uint16_t size;
+        XferCallback callback;
+        void* userp;
+    };
+protected:
+    static_assert(Depth >= 1 && Depth <= 128, "XferQueue depth must be in the range 1 - 128");
+    Xfer mXfers[Depth];
+    uint8_t mFront = 0;
+    volatile uint8_t mCount = 0;
+    volatile uint32_t mCompleted = 0;
+public:
+    enum: uint8_t { kDepth = Depth };
+    bool isEmpty() const { return mCount == 0; }
+    bool isFull() const { return mCount == Depth; }
+    uint8_t count() const { return mCount; }
+    /** @brief The number of transfers completed so far. Since transfers complete
+     * in the order in which they were queued, the consumer of received data
+     * can use it to find out which buffers are ready
+     */
+    uint32_t completed() const { return mCompleted; }
+    const Xfer& front() const { assert(mCount); return mXfers[mFront]; }
+    /** @brief Appends a transfer. The queue must not be full
+     * @return true if the transfer is at the front of the queue, i.e. the
+     * channel is idle and the caller must start the transfer
+     */
+    bool push(const void* data, uint16_t size, XferCallback callback=nullptr, void* userp=nullptr)
+    {
+        assert(!isFull());
+        Xfer& xfer = mXfers[(mFront + mCount) % Depth];
+        xfer.data = data;
+        xfer.size = size;
+        xfer.callback = callback;
+        xfer.userp = userp;
+        return ++mCount == 1;
+    }
+    /** @brief Removes the completed transfer at the front. Called by the
+     * transfer complete interrupt handler
+     * @param done Receives a copy of the completed transfer, so that its
+     * callback can be invoked after the next transfer is started
+     * @return The next transfer, which must be started immediately, or
+     * nullptr if the queue is empty
+     */
+    const Xfer* pop(Xfer& done)
+    {
+        assert(mCount);
+        done = mXfers[mFront];
+        mFront = (mFront + 1) % Depth;
+        mCompleted++;
+        return (--mCount) ? &mXfers[mFront] : nullptr;
+    }
+    /** @brief Removes all transfers, i.e. when the channel is stopped */
+    void clear()
+    {
+        mCount = 0;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,146 @@
+/**
+ * Detection of DMA channel conflicts between peripherals, and time-sharing
+ * of DMA channels
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_DMA_REGISTRY_HPP
+#define STM32PP_DMA_REGISTRY_HPP
+
+#include <stdint.h>
+#include <type_traits>
+
+/** @brief Whether a peripheral type has the dma::Tx mixin */
+template <class T, class=void>
+struct HasTxDma: std::false_type {};
+template <class T>
+struct HasTxDma<T, decltype((void)&std::remove_reference<T>::type::dmaTxStop)>: std::true_type {};
+
+/** @brief Whether a peripheral type has the dma::Rx mixin */
+template <class T, class=void>
+struct HasRxDma: std::false_type {};
+template <class T>
+struct HasRxDma<T, decltype((void)&std::remove_reference<T>::type::dmaRxStop)>: std::true_type {};
+
+/** @brief Whether a type uses a DMA channel for memory-to-memory transfers,
+ * see dma::MemCopy
+ */
+template <class T, class=void>
+struct HasMemDma: std::false_type {};
+template <class T>
+struct HasMemDma<T, decltype((void)std::remove_reference<T>::type::kDmaMemChannel)>: std::true_type {};
+
+/** On the F1, the DMA request of each peripheral is hardwired to a specific
+ * channel, and several peripherals map to the same channel, i.e. DMA1
+ * channels 4 and 5 are used by USART1, I2C2 and SPI2. If two peripherals
+ * with DMA mixins use the same channel at the same time, the result is silent
+ * data corruption. The application can list all its DMA-enabled peripheral
+ * types in a ChannelRegistry, which fails to compile if any two of them
+ * use the same channel:
+ * \code template struct dma::ChannelRegistry<Usart1Dev, SpiDisplayDev, Adc1Dev>; \endcode
+ * Peripherals that really need to use the same channel can time-share it, by
+ * adding the kDmaSharedChannel option to their DMA mixins. The mixins then
+ * acquire the channel via a ChannelLock before each transfer and release it
+ * when done, and reconfigure the channel for their peripheral. The DMA
+ * interrupt handler of the channel must call the ISR method of all sharing
+ * mixins - only the one that owns the channel handles the interrupt.
+ */
+namespace dma
+{
+struct ChannelClaim
+{
+    uint32_t dma;
+    uint8_t chan;
+    bool shared;
+};
+
+template <class D>
+constexpr ChannelClaim txClaim(std::true_type) { return { D::kDmaTxId, D::kDmaTxChannel, D::kDmaTxShared }; }
+template <class D>
+constexpr ChannelClaim txClaim(std::false_type) { return { 0, 0, false }; }
+template <class D>
+constexpr ChannelClaim rxClaim(std::true_type) { return { D::kDmaRxId, D::kDmaRxChannel, D::kDmaRxShared }; }
+template <class D>
+constexpr ChannelClaim rxClaim(std::false_type) { return { 0, 0, false }; }
+template <class D>
+constexpr ChannelClaim memClaim(std::true_type) { return { D::kDmaMemId, D::kDmaMemChannel, D::kDmaMemShared }; }
+template <class D>
+constexpr ChannelClaim memClaim(std::false_type) { return { 0, 0, false }; }
+
+/** @brief Whether any two of the DMA channels used by \c Devices are the same,
+ * and are not both marked as shared
+ */
+template <class... Devices>
+constexpr bool channelsConflict()
+{
+    const ChannelClaim claims[] = {
+        txClaim<Devices>(HasTxDma<Devices>())...,
+        rxClaim<Devices>(HasRxDma<Devices>())...,
+        memClaim<Devices>(HasMemDma<Devices>())...,
+        { 0, 0, false }
+    };
+    const uint16_t count = sizeof(claims) / sizeof(claims[0]);
+    for (uint16_t i = 0; i < count; i++)
+    {
+        if (!claims[i].dma)
+        {
+            continue;
+        }
+        for (uint16_t j = i + 1; j < count; j++)
+        {
+            if (claims[j].dma == claims[i].dma && claims[j].chan == claims[i].chan &&
+                !(claims[i].shared && claims[j].shared))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+template <class... Devices>
+struct ChannelRegistry
+{
+    static_assert(!channelsConflict<Devices...>(), "Two peripherals use the same DMA "
+        "channel. If they don't use it at the same time, add the kDmaSharedChannel "
+        "option to the DMA mixins of both");
+};
+
+/** @brief Arbiter of a DMA channel that is time-shared by several
+ * peripherals. The owner is identified by an arbitrary pointer, i.e.
+ * to the mixin instance. The lock is not recursive - acquiring it again
+ * by the owner succeeds, and a single release() frees it.
+ */
+template <uint32_t Dma, uint8_t Chan>
+struct ChannelLock
+{
+    static void* owner;
+    static bool tryAcquire(void* who)
+    {
+        void* expected = nullptr;
+        return __atomic_compare_exchange_n(&owner, &expected, who, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) || expected == who;
+    }
+    /** @brief Waits till the channel is released by its current owner.
+     * Must not be called from an interrupt that has a higher priority
+     * than the DMA interrupt that would release it
+     */
+    static void acquire(void* who)
+    {
+        while (!tryAcquire(who));
+    }
+    static void release(void* who)
+    {
+        void* expected = who;
+        __atomic_compare_exchange_n(&owner, &expected, nullptr, false,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+    static bool isOwner(void* who) { return __atomic_load_n(&owner, __ATOMIC_ACQUIRE) == who; }
+};
+
+template <uint32_t Dma, uint8_t Chan>
+void* ChannelLock<Dma, Chan>::owner = nullptr;
+}
+
+#endif
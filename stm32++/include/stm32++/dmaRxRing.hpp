@@ -0,0 +1,148 @@
+/**
+ * Consumer side of a circular DMA receive buffer
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_DMA_RX_RING_HPP
+#define STM32PP_DMA_RX_RING_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace dma
+{
+/** @brief Buffer of a DMA channel running in circular mode, and tracking of
+ * the data that the DMA has written to it. The DMA doesn't provide a write
+ * pointer, so the write position is derived from the remaining transfer
+ * count (CNDTR), via update(). update() must be called often enough that the
+ * DMA can't wrap around the whole buffer in between - i.e. on the half and
+ * full transfer interrupts, and on the idle line interrupt of a USART, so
+ * that the end of a burst is published without waiting for the buffer to
+ * fill. update() must not be called concurrently with itself, and all other
+ * methods must be called by a single reader. If the reader falls behind by
+ * more than the buffer size, the oldest half of the buffer is discarded and
+ * \c overruns() is incremented.
+ * This class doesn't access hardware registers, so it can be tested on the host.
+ * @param Size The size of the buffer in bytes, which is also the transfer
+ * count of the circular DMA. A power of 2, so that the position derived from
+ * CNDTR can be masked
+ */
+template <uint16_t Size>
+class RxRing
+{
+protected:
+    static_assert((Size & (Size - 1)) == 0, "RxRing size must be a power of 2");
+    static_assert(Size >= 4, "RxRing size must be at least 4");
+    char mBuf[Size];
+    // Total bytes received and consumed. The DMA doesn't stop when the buffer
+    // is full, so mHead may get more than Size ahead of mTail - the reader
+    // detects this in acquireHead() and skips the overwritten data
+    uint32_t mHead = 0; // advanced only by update(), with release semantics
+    uint32_t mTail = 0; // owned by the reader
+    uint16_t mLastPos = 0;
+    uint32_t mOverruns = 0;
+    bool mSkipLf = false;
+
+    static bool isEol(char ch) { return ch == '\r' || ch == '\n'; }
+    uint32_t acquireHead()
+    {
+        uint32_t head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+        if (head - mTail > Size)
+        {
+            mTail = head - Size / 2;
+            mOverruns++;
+            mSkipLf = false;
+        }
+        return head;
+    }
+public:
+    enum: uint16_t { kSize = Size };
+    char* buffer() { return mBuf; }
+    uint32_t overruns() const { return mOverruns; }
+    /** @brief Publishes the data written by the DMA so far
+     * @param remaining The value of the CNDTR register of the channel
+     */
+    void update(uint16_t remaining)
+    {
+        uint16_t pos = (Size - remaining) & (Size - 1);
+        __atomic_store_n(&mHead, mHead + ((pos - mLastPos) & (Size - 1)), __ATOMIC_RELEASE);
+        mLastPos = pos;
+    }
+    /** @brief Resets the buffer, when the DMA is restarted */
+    void reset()
+    {
+        mHead = mTail = 0;
+        mLastPos = 0;
+        mSkipLf = false;
+    }
+    size_t available() { return acquireHead() - mTail; }
+    /** @brief Reads up to \c bufsize bytes, without blocking
+     * @return The number of bytes read
+     */
+    size_t read(char* buf, size_t bufsize)
+    {
+        uint32_t head = acquireHead();
+        size_t len = head - mTail;
+        if (len > bufsize)
+        {
+            len = bufsize;
+        }
+        uint16_t offset = mTail & (Size - 1);
+        size_t chunk = Size - offset;
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        memcpy(buf, mBuf + offset, chunk);
+        memcpy(buf + chunk, mBuf, len - chunk);
+        mTail += len;
+        mSkipLf = false;
+        return len;
+    }
+    /** @brief Reads a line terminated by \c '\\r', \c '\\n' or \c "\r\n", without
+     * blocking. The terminator is not stored, and the line is null-terminated.
+     * A line that doesn't fit in the buffer is returned in parts.
+     * @return The length of the line, or -1 if no complete line has been received
+     */
+    int readLine(char* buf, size_t bufsize)
+    {
+        uint32_t head = acquireHead();
+        if (mSkipLf && mTail != head)
+        {
+            // The '\n' of a "\r\n" terminator may arrive after the line was returned
+            if (mBuf[mTail & (Size - 1)] == '\n')
+            {
+                mTail++;
+            }
+            mSkipLf = false;
+        }
+        size_t avail = head - mTail;
+        size_t maxLen = bufsize - 1;
+        size_t len = 0;
+        for (; len < avail && len < maxLen; len++)
+        {
+            if (isEol(mBuf[(mTail + len) & (Size - 1)]))
+            {
+                break;
+            }
+        }
+        char term = (len < avail) ? mBuf[(mTail + len) & (Size - 1)] : 0;
+        if (!isEol(term) && len < maxLen)
+        {
+            return -1;
+        }
+        read(buf, len);
+        buf[len] = 0;
+        if (isEol(term))
+        {
+            mTail++;
+            mSkipLf = (term == '\r');
+        }
+        return len;
+    }
+};
+}
+
+#endif
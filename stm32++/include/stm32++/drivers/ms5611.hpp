@@ -3,7 +3,8 @@
 
 #include <stdint.h>
 #include <string.h> //for memcpy
-#include <stm32++/timeutl.h>
+#include <stm32++/timeutl.hpp>
+#include <stm32++/i2c.hpp>
 
 template <class IO>
 class MS5611
@@ -68,46 +69,25 @@ protected:
     }
     bool loadCalibrationData()
     {
-        uint16_t reserved;
-        uint16_t crc;
-        uint8_t* ptr = (uint8_t*)mCalData;
+        // The PROM consists of 8 words: reserved, the 6 calibration
+        // coefficients and the CRC, read back-to-back as one transaction list
+        uint8_t cmds[8];
+        uint8_t prom[8][2];
+        nsi2c::Step steps[8];
         for (uint8_t idx = 0; idx < 8; idx++)
         {
-            if (!sendCmd(kCmdPromReadBase + (idx * 2)))
-                return false;
-            if (!mIo.startRecv(mAddr, true))
-                return false;
-            uint8_t* dest;
-            if (idx == 0)
-            {
-                dest = (uint8_t*)(&reserved);
-            }
-            else if (idx == 7)
-            {
-                dest = (uint8_t*)(&crc);
-            }
-            else
-            {
-                dest = ptr;
-                ptr += 2;
-            }
-            //sensor sends data in big endian format
-            uint16_t ret = mIo.recvByteTimeout();
-            if (ret == 0xffff)
-                return false;
-            dest[1] = ret;
-            ret = mIo.recvByteTimeout();
-            if (ret == 0xffff)
-                return false;
-            dest[0] = ret;
-            if (!mIo.stopTimeout())
-                return false;
+            cmds[idx] = kCmdPromReadBase + (idx * 2);
+            steps[idx] = { mAddr, cmds + idx, 1, prom[idx], 2, 0 };
         }
-        assert(ptr == (uint8_t*)mCalData+12);
+        if (!mIo.transfer(steps, 8))
+            return false;
+        //sensor sends data in big endian format
         uint16_t crcBuf[8];
-        memcpy(crcBuf+1, mCalData, sizeof(mCalData));
-        crcBuf[0] = reserved;
-        crcBuf[7] = crc;
+        for (uint8_t idx = 0; idx < 8; idx++)
+        {
+            crcBuf[idx] = (prom[idx][0] << 8) | prom[idx][1];
+        }
+        memcpy(mCalData, crcBuf+1, sizeof(mCalData));
         return crc4(crcBuf);
     }
     uint16_t usNeededForOsr(uint8_t osr)
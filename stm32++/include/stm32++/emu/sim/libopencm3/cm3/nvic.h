@@ -0,0 +1,2 @@
+/* Shadows the libopencm3 header in simulated peripheral builds, see periphSim.hpp */
+#include <stm32++/emu/sim/periphSim.hpp>
@@ -0,0 +1,108 @@
+/**
+ * Simulated STM32F1 peripherals for host tests of the peripheral drivers.
+ *
+ * The models implement the registers of the DMA controllers, USARTs, SPI and
+ * I2C controllers and ADCs behind a libopencm3-compatible API, so that the
+ * unmodified driver headers (usart.hpp, dma.hpp, i2c.hpp etc.) can be
+ * compiled and run on the host. Register macros evaluate to proxies that
+ * forward the accesses to the models, DMA transfers move real data between
+ * the peripherals and the application's buffers, and the interrupt handlers
+ * (usart1_isr() etc., or ones installed by sim::setIrqHandler()) are called
+ * when the enabled interrupt lines are asserted, honoring the NVIC priorities
+ * and PRIMASK.
+ *
+ * To use it, compile with STM32PP_NOT_EMBEDDED and STM32PP_PERIPH_SIM defined,
+ * and with this directory (include/stm32++/emu/sim) in the include path
+ * before any libopencm3 headers, so that its libopencm3/ subdirectory
+ * shadows them.
+ *
+ * The simulation is single-threaded and deterministic: the simulated time
+ * advances by a few CPU cycles on each register access, and by sim::run() and
+ * sim::runUntil(). Interrupts are taken only at these points, so a busy loop
+ * that polls only RAM (i.e. waiting for a flag set by an ISR) must call
+ * sim::runUntil() instead of spinning.
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_PERIPH_SIM_HPP
+#define STM32PP_PERIPH_SIM_HPP
+
+#include "simKernel.hpp"
+#include "simSystem.hpp"
+#include "simDma.hpp"
+#include "simUsart.hpp"
+#include "simSpi.hpp"
+#include "simI2c.hpp"
+#include "simAdc.hpp"
+
+namespace sim
+{
+/** @brief The simulated chip, with all peripheral models attached to the
+ * kernel. Accessed via sim::board()
+ */
+struct Board
+{
+    Kernel kernel;
+    Gpio gpioA{"GPIOA", GPIOA};
+    Gpio gpioB{"GPIOB", GPIOB};
+    Gpio gpioC{"GPIOC", GPIOC};
+    Dwt dwt;
+    Dma dma1{"DMA1", DMA1, 7, dma1Irqs()};
+    Dma dma2{"DMA2", DMA2, 5, dma2Irqs()};
+    Usart usart1{"USART1", USART1, NVIC_USART1_IRQ, DMA_CHANNEL4, DMA_CHANNEL5};
+    Usart usart2{"USART2", USART2, NVIC_USART2_IRQ, DMA_CHANNEL7, DMA_CHANNEL6};
+    Usart usart3{"USART3", USART3, NVIC_USART3_IRQ, DMA_CHANNEL2, DMA_CHANNEL3};
+    Spi spi1{"SPI1", SPI1, NVIC_SPI1_IRQ, DMA_CHANNEL3, DMA_CHANNEL2};
+    Spi spi2{"SPI2", SPI2, NVIC_SPI2_IRQ, DMA_CHANNEL5, DMA_CHANNEL4};
+    I2c i2c1{"I2C1", I2C1, NVIC_I2C1_EV_IRQ, NVIC_I2C1_ER_IRQ, DMA_CHANNEL6, DMA_CHANNEL7};
+    I2c i2c2{"I2C2", I2C2, NVIC_I2C2_EV_IRQ, NVIC_I2C2_ER_IRQ, DMA_CHANNEL4, DMA_CHANNEL5};
+    Adc adc1{"ADC1", ADC1, NVIC_ADC1_2_IRQ, DMA1, DMA_CHANNEL1};
+    Adc adc2{"ADC2", ADC2, NVIC_ADC1_2_IRQ, 0, 0};
+    Adc adc3{"ADC3", ADC3, NVIC_ADC3_IRQ, DMA2, DMA_CHANNEL5};
+    static const uint8_t* dma1Irqs()
+    {
+        static const uint8_t irqs[] = {
+            NVIC_DMA1_CHANNEL1_IRQ, NVIC_DMA1_CHANNEL2_IRQ, NVIC_DMA1_CHANNEL3_IRQ,
+            NVIC_DMA1_CHANNEL4_IRQ, NVIC_DMA1_CHANNEL5_IRQ, NVIC_DMA1_CHANNEL6_IRQ,
+            NVIC_DMA1_CHANNEL7_IRQ
+        };
+        return irqs;
+    }
+    static const uint8_t* dma2Irqs()
+    {
+        static const uint8_t irqs[] = {
+            NVIC_DMA2_CHANNEL1_IRQ, NVIC_DMA2_CHANNEL2_IRQ, NVIC_DMA2_CHANNEL3_IRQ,
+            NVIC_DMA2_CHANNEL4_5_IRQ, NVIC_DMA2_CHANNEL5_IRQ
+        };
+        return irqs;
+    }
+    Board()
+    {
+        Periph* periphs[] = { &gpioA, &gpioB, &gpioC, &dwt, &dma1, &dma2, &usart1,
+            &usart2, &usart3, &spi1, &spi2, &i2c1, &i2c2, &adc1, &adc2, &adc3 };
+        for (auto periph: periphs)
+        {
+            kernel.add(*periph);
+        }
+    }
+    /** @brief Resets all peripherals, the NVIC and the simulated clocks, i.e.
+     * between test cases
+     */
+    void reset()
+    {
+        kernel.reset();
+        RccState<>::clocksEnabled = 0;
+        rcc_clock_setup_in_hse_8mhz_out_72mhz();
+    }
+};
+
+inline Board& board()
+{
+    static Board theBoard;
+    return theBoard;
+}
+inline Kernel& kernel() { return board().kernel; }
+}
+
+#endif
@@ -0,0 +1,304 @@
+/**
+ * Simulated ADCs, with the libopencm3 API
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_SIM_ADC_HPP
+#define STM32PP_SIM_ADC_HPP
+
+#include "simDma.hpp"
+
+#define ADC1_BASE               (PERIPH_BASE_APB2 + 0x2400)
+#define ADC2_BASE               (PERIPH_BASE_APB2 + 0x2800)
+#define ADC3_BASE               (PERIPH_BASE_APB2 + 0x3c00)
+#define ADC1 ADC1_BASE
+#define ADC2 ADC2_BASE
+#define ADC3 ADC3_BASE
+
+#define ADC_SR(adc)             MMIO32((adc) + 0x00)
+#define ADC_CR1(adc)            MMIO32((adc) + 0x04)
+#define ADC_CR2(adc)            MMIO32((adc) + 0x08)
+#define ADC_SMPR1(adc)          MMIO32((adc) + 0x0c)
+#define ADC_SMPR2(adc)          MMIO32((adc) + 0x10)
+#define ADC_SQR1(adc)           MMIO32((adc) + 0x2c)
+#define ADC_SQR2(adc)           MMIO32((adc) + 0x30)
+#define ADC_SQR3(adc)           MMIO32((adc) + 0x34)
+#define ADC_DR(adc)             MMIO32((adc) + 0x4c)
+#define ADC1_CR1                ADC_CR1(ADC1)
+#define ADC1_CR2                ADC_CR2(ADC1)
+#define ADC1_DR                 ADC_DR(ADC1)
+#define ADC2_DR                 ADC_DR(ADC2)
+#define ADC3_DR                 ADC_DR(ADC3)
+
+#define ADC_SR_AWD              (1 << 0)
+#define ADC_SR_EOC              (1 << 1)
+#define ADC_SR_JEOC             (1 << 2)
+#define ADC_SR_JSTRT            (1 << 3)
+#define ADC_SR_STRT             (1 << 4)
+
+#define ADC_CR1_EOCIE           (1 << 5)
+#define ADC_CR1_AWDIE           (1 << 6)
+#define ADC_CR1_JEOCIE          (1 << 7)
+#define ADC_CR1_SCAN            (1 << 8)
+#define ADC_CR1_DUALMOD_SHIFT   16
+#define ADC_CR1_DUALMOD_MASK    (0xf << ADC_CR1_DUALMOD_SHIFT)
+#define ADC_CR1_DUALMOD_IND     (0x0 << ADC_CR1_DUALMOD_SHIFT)
+
+#define ADC_CR2_ADON            (1 << 0)
+#define ADC_CR2_CONT            (1 << 1)
+#define ADC_CR2_CAL             (1 << 2)
+#define ADC_CR2_RSTCAL          (1 << 3)
+#define ADC_CR2_DMA             (1 << 8)
+#define ADC_CR2_ALIGN           (1 << 11)
+#define ADC_CR2_EXTSEL_SHIFT    17
+#define ADC_CR2_EXTSEL_MASK     (0x7 << ADC_CR2_EXTSEL_SHIFT)
+#define ADC_CR2_EXTSEL_TIM1_CC1 (0x0 << ADC_CR2_EXTSEL_SHIFT)
+#define ADC_CR2_EXTSEL_TIM3_TRGO (0x4 << ADC_CR2_EXTSEL_SHIFT)
+#define ADC_CR2_EXTSEL_SWSTART  (0x7 << ADC_CR2_EXTSEL_SHIFT)
+#define ADC_CR2_EXTTRIG         (1 << 20)
+#define ADC_CR2_JSWSTART        (1 << 21)
+#define ADC_CR2_SWSTART         (1 << 22)
+#define ADC_CR2_TSVREFE         (1 << 23)
+
+#define ADC_SMPR_SMP_1DOT5CYC   0x0
+#define ADC_SMPR_SMP_7DOT5CYC   0x1
+#define ADC_SMPR_SMP_13DOT5CYC  0x2
+#define ADC_SMPR_SMP_28DOT5CYC  0x3
+#define ADC_SMPR_SMP_41DOT5CYC  0x4
+#define ADC_SMPR_SMP_55DOT5CYC  0x5
+#define ADC_SMPR_SMP_71DOT5CYC  0x6
+#define ADC_SMPR_SMP_239DOT5CYC 0x7
+
+#define ADC_CHANNEL0            0x00
+#define ADC_CHANNEL1            0x01
+#define ADC_CHANNEL2            0x02
+#define ADC_CHANNEL3            0x03
+#define ADC_CHANNEL_TEMP        0x10
+#define ADC_CHANNEL_VREF        0x11
+
+static inline void adc_power_on(uint32_t adc) { ADC_CR2(adc) |= ADC_CR2_ADON; }
+static inline void adc_power_off(uint32_t adc) { ADC_CR2(adc) &= ~ADC_CR2_ADON; }
+static inline void adc_start_conversion_direct(uint32_t adc)
+{
+    if (ADC_CR2(adc) & ADC_CR2_ADON)
+    {
+        ADC_CR2(adc) |= ADC_CR2_ADON;
+    }
+}
+static inline void adc_start_conversion_regular(uint32_t adc)
+{
+    ADC_CR2(adc) |= ADC_CR2_SWSTART;
+    while (ADC_CR2(adc) & ADC_CR2_SWSTART);
+}
+static inline void adc_set_right_aligned(uint32_t adc) { ADC_CR2(adc) &= ~ADC_CR2_ALIGN; }
+static inline void adc_set_left_aligned(uint32_t adc) { ADC_CR2(adc) |= ADC_CR2_ALIGN; }
+static inline void adc_set_dual_mode(uint32_t mode) { ADC1_CR1 = (ADC1_CR1 & ~ADC_CR1_DUALMOD_MASK) | mode; }
+static inline void adc_set_continuous_conversion_mode(uint32_t adc) { ADC_CR2(adc) |= ADC_CR2_CONT; }
+static inline void adc_set_single_conversion_mode(uint32_t adc) { ADC_CR2(adc) &= ~ADC_CR2_CONT; }
+static inline void adc_enable_scan_mode(uint32_t adc) { ADC_CR1(adc) |= ADC_CR1_SCAN; }
+static inline void adc_disable_scan_mode(uint32_t adc) { ADC_CR1(adc) &= ~ADC_CR1_SCAN; }
+static inline void adc_enable_temperature_sensor(void) { ADC1_CR2 |= ADC_CR2_TSVREFE; }
+static inline void adc_disable_temperature_sensor(void) { ADC1_CR2 &= ~ADC_CR2_TSVREFE; }
+static inline void adc_enable_external_trigger_regular(uint32_t adc, uint32_t trigger)
+{
+    ADC_CR2(adc) = (ADC_CR2(adc) & ~ADC_CR2_EXTSEL_MASK) | trigger | ADC_CR2_EXTTRIG;
+}
+static inline void adc_disable_external_trigger_regular(uint32_t adc) { ADC_CR2(adc) &= ~ADC_CR2_EXTTRIG; }
+static inline void adc_enable_dma(uint32_t adc) { ADC_CR2(adc) |= ADC_CR2_DMA; }
+static inline void adc_disable_dma(uint32_t adc) { ADC_CR2(adc) &= ~ADC_CR2_DMA; }
+static inline void adc_enable_eoc_interrupt(uint32_t adc) { ADC_CR1(adc) |= ADC_CR1_EOCIE; }
+static inline void adc_disable_eoc_interrupt(uint32_t adc) { ADC_CR1(adc) &= ~ADC_CR1_EOCIE; }
+static inline void adc_reset_calibration(uint32_t adc)
+{
+    ADC_CR2(adc) |= ADC_CR2_RSTCAL;
+    while (ADC_CR2(adc) & ADC_CR2_RSTCAL);
+}
+static inline void adc_calibrate(uint32_t adc)
+{
+    ADC_CR2(adc) |= ADC_CR2_CAL;
+    while (ADC_CR2(adc) & ADC_CR2_CAL);
+}
+static inline bool adc_eoc(uint32_t adc) { return (ADC_SR(adc) & ADC_SR_EOC) != 0; }
+static inline uint32_t adc_read_regular(uint32_t adc) { return ADC_DR(adc); }
+static inline void adc_set_sample_time(uint32_t adc, uint8_t channel, uint8_t time)
+{
+    if (channel < 10)
+    {
+        uint8_t shift = channel * 3;
+        ADC_SMPR2(adc) = (ADC_SMPR2(adc) & ~(7 << shift)) | (time << shift);
+    }
+    else
+    {
+        uint8_t shift = (channel - 10) * 3;
+        ADC_SMPR1(adc) = (ADC_SMPR1(adc) & ~(7 << shift)) | (time << shift);
+    }
+}
+static inline void adc_set_regular_sequence(uint32_t adc, uint8_t length, uint8_t channel[])
+{
+    uint32_t sqr[3] = { 0, 0, 0 };
+    if (length > 16)
+    {
+        return;
+    }
+    for (uint8_t i = 0; i < length; i++)
+    {
+        sqr[i / 6] |= (channel[i] & 0x1f) << ((i % 6) * 5);
+    }
+    ADC_SQR3(adc) = sqr[0];
+    ADC_SQR2(adc) = sqr[1];
+    ADC_SQR1(adc) = sqr[2] | ((uint32_t)(length - 1) << 20);
+}
+
+namespace sim
+{
+/** @brief ADC, converting the regular sequence in single or continuous,
+ * and scan or single-channel mode, started by software. The conversion time
+ * follows the sample times and the ADC prescaler in RCC_CFGR. The converted
+ * values are given by the \c source function, or else by setValue().
+ * External triggers and injected channels are not modelled
+ */
+class Adc: public Periph
+{
+public:
+    std::function<uint16_t(uint8_t chan)> source;
+protected:
+    uint8_t mIrq;
+    uint32_t mDma;
+    uint8_t mDmaChan;
+    uint32_t mSr = 0;
+    uint32_t mCr1 = 0;
+    uint32_t mCr2 = 0;
+    uint32_t mSmpr[2] = { 0, 0 };
+    uint32_t mSqr[3] = { 0, 0, 0 };
+    uint16_t mDr = 0;
+    bool mDrFull = false;
+    uint8_t mSeqIdx = 0;
+    uint64_t mEventAt = kNever;
+    uint16_t mValues[18] = {};
+    uint32_t mConversions = 0;
+    uint8_t seqLen() const { return ((mSqr[0] >> 20) & 0xf) + 1; }
+    uint8_t seqChannel(uint8_t idx) const { return (mSqr[2 - idx / 6] >> ((idx % 6) * 5)) & 0x1f; }
+    uint64_t conversionTime(uint8_t chan) const
+    {
+        static const uint16_t halfCycles[] = { 3, 15, 27, 57, 83, 111, 143, 479 };
+        uint8_t code = (chan < 10) ? (mSmpr[1] >> (chan * 3)) & 7 : (mSmpr[0] >> ((chan - 10) * 3)) & 7;
+        uint32_t pre = (kernel().busRead(RCC_BASE + 0x04) & RCC_CFGR_ADCPRE) >> RCC_CFGR_ADCPRE_SHIFT;
+        uint32_t adcFreq = Clocks<>::apb2 / ((pre + 1) * 2);
+        // Sample time + 12.5 cycles, in half cycles
+        return Clocks<>::toCpuCycles(halfCycles[code] + 25, adcFreq * 2);
+    }
+    void startConversion()
+    {
+        mSr |= ADC_SR_STRT;
+        mEventAt = kernel().now() + conversionTime(seqChannel(mSeqIdx));
+    }
+public:
+    Adc(const char* aName, uint32_t aBase, uint8_t irq, uint32_t dma, uint8_t dmaChan)
+    : Periph(aName, aBase, 0x400), mIrq(irq), mDma(dma), mDmaChan(dmaChan)
+    {}
+    void setValue(uint8_t chan, uint16_t value) { mValues[chan] = value & 0xfff; }
+    /** @brief The number of conversions done so far */
+    uint32_t conversions() const { return mConversions; }
+    virtual void reset()
+    {
+        mSr = mCr1 = mCr2 = 0;
+        mSmpr[0] = mSmpr[1] = 0;
+        mSqr[0] = mSqr[1] = mSqr[2] = 0;
+        mDr = 0;
+        mDrFull = false;
+        mSeqIdx = 0;
+        mEventAt = kNever;
+        memset(mValues, 0, sizeof(mValues));
+        mConversions = 0;
+    }
+    virtual uint32_t read(uint32_t offset)
+    {
+        switch (offset)
+        {
+            case 0x00: return mSr;
+            case 0x04: return mCr1;
+            case 0x08: return mCr2;
+            case 0x0c: return mSmpr[0];
+            case 0x10: return mSmpr[1];
+            case 0x2c: return mSqr[0];
+            case 0x30: return mSqr[1];
+            case 0x34: return mSqr[2];
+            case 0x4c:
+                mSr &= ~ADC_SR_EOC;
+                mDrFull = false;
+                return mDr;
+            default: return 0;
+        }
+    }
+    virtual void write(uint32_t offset, uint32_t val)
+    {
+        switch (offset)
+        {
+            case 0x00: mSr &= val; break; // flags are cleared by writing 0
+            case 0x04: mCr1 = val; break;
+            case 0x08:
+            {
+                bool wasOn = mCr2 & ADC_CR2_ADON;
+                // Calibration completes instantly
+                mCr2 = val & ~(ADC_CR2_CAL | ADC_CR2_RSTCAL | ADC_CR2_SWSTART | ADC_CR2_JSWSTART);
+                if (!(mCr2 & ADC_CR2_ADON))
+                {
+                    mEventAt = kNever;
+                    mSr &= ~ADC_SR_STRT;
+                    break;
+                }
+                bool swStart = (val & ADC_CR2_SWSTART) && (mCr2 & ADC_CR2_EXTTRIG) &&
+                    (mCr2 & ADC_CR2_EXTSEL_MASK) == ADC_CR2_EXTSEL_SWSTART;
+                // Writing ADON when already on starts a conversion
+                bool direct = wasOn && (val & ADC_CR2_ADON) &&
+                    !(val & (ADC_CR2_CAL | ADC_CR2_RSTCAL | ADC_CR2_SWSTART));
+                if ((swStart || direct) && mEventAt == kNever)
+                {
+                    mSeqIdx = 0;
+                    startConversion();
+                }
+                break;
+            }
+            case 0x0c: mSmpr[0] = val; break;
+            case 0x10: mSmpr[1] = val; break;
+            case 0x2c: mSqr[0] = val; break;
+            case 0x30: mSqr[1] = val; break;
+            case 0x34: mSqr[2] = val; break;
+            default: break;
+        }
+    }
+    virtual uint64_t nextEvent() const { return mEventAt; }
+    virtual void onEvent(uint64_t)
+    {
+        uint8_t chan = seqChannel(mSeqIdx);
+        uint16_t value = source ? source(chan) : mValues[chan];
+        value &= 0xfff;
+        mDr = (mCr2 & ADC_CR2_ALIGN) ? (value << 4) : value;
+        mDrFull = true;
+        mSr |= ADC_SR_EOC;
+        mConversions++;
+        mEventAt = kNever;
+        bool scan = mCr1 & ADC_CR1_SCAN;
+        if (scan && ++mSeqIdx < seqLen())
+        {
+            startConversion();
+            return;
+        }
+        mSeqIdx = 0;
+        if (mCr2 & ADC_CR2_CONT)
+        {
+            startConversion();
+        }
+    }
+    virtual uint64_t irqs() const
+    {
+        return ((mCr1 & ADC_CR1_EOCIE) && (mSr & ADC_SR_EOC)) ? (1ull << mIrq) : 0;
+    }
+    virtual bool dmaRequest(uint32_t dma, uint8_t chan) const
+    {
+        return dma == mDma && chan == mDmaChan && (mCr2 & ADC_CR2_DMA) && mDrFull;
+    }
+};
+}
+#endif
@@ -0,0 +1,393 @@
+/**
+ * Simulated DMA controllers, with the libopencm3 API
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_SIM_DMA_HPP
+#define STM32PP_SIM_DMA_HPP
+
+#include "simSystem.hpp"
+
+#define DMA1_BASE               (PERIPH_BASE_AHB + 0x08000)
+#define DMA2_BASE               (PERIPH_BASE_AHB + 0x08400)
+#define DMA1 DMA1_BASE
+#define DMA2 DMA2_BASE
+
+#define DMA_CHANNEL1 1
+#define DMA_CHANNEL2 2
+#define DMA_CHANNEL3 3
+#define DMA_CHANNEL4 4
+#define DMA_CHANNEL5 5
+#define DMA_CHANNEL6 6
+#define DMA_CHANNEL7 7
+
+#define DMA_ISR(port)           MMIO32((port) + 0x00)
+#define DMA_IFCR(port)          MMIO32((port) + 0x04)
+#define DMA_CCR(port, ch)       MMIO32((port) + 0x08 + (0x14 * ((ch) - 1)))
+#define DMA_CNDTR(port, ch)     MMIO32((port) + 0x0c + (0x14 * ((ch) - 1)))
+#define DMA_CPAR(port, ch)      MMIO32((port) + 0x10 + (0x14 * ((ch) - 1)))
+#define DMA_CMAR(port, ch)      MMIO32((port) + 0x14 + (0x14 * ((ch) - 1)))
+
+#define DMA_FLAG_OFFSET(ch)     (4 * ((ch) - 1))
+#define DMA_GIF                 (1 << 0)
+#define DMA_TCIF                (1 << 1)
+#define DMA_HTIF                (1 << 2)
+#define DMA_TEIF                (1 << 3)
+#define DMA_ISR_GIF(ch)         (DMA_GIF << DMA_FLAG_OFFSET(ch))
+#define DMA_ISR_TCIF(ch)        (DMA_TCIF << DMA_FLAG_OFFSET(ch))
+#define DMA_ISR_HTIF(ch)        (DMA_HTIF << DMA_FLAG_OFFSET(ch))
+#define DMA_ISR_TEIF(ch)        (DMA_TEIF << DMA_FLAG_OFFSET(ch))
+#define DMA_IFCR_CGIF(ch)       (DMA_GIF << DMA_FLAG_OFFSET(ch))
+#define DMA_IFCR_CTCIF(ch)      (DMA_TCIF << DMA_FLAG_OFFSET(ch))
+#define DMA_IFCR_CHTIF(ch)      (DMA_HTIF << DMA_FLAG_OFFSET(ch))
+#define DMA_IFCR_CTEIF(ch)      (DMA_TEIF << DMA_FLAG_OFFSET(ch))
+
+#define DMA_CCR_EN              (1 << 0)
+#define DMA_CCR_TCIE            (1 << 1)
+#define DMA_CCR_HTIE            (1 << 2)
+#define DMA_CCR_TEIE            (1 << 3)
+#define DMA_CCR_DIR             (1 << 4)
+#define DMA_CCR_CIRC            (1 << 5)
+#define DMA_CCR_PINC            (1 << 6)
+#define DMA_CCR_MINC            (1 << 7)
+#define DMA_CCR_PSIZE_SHIFT     8
+#define DMA_CCR_PSIZE_MASK      (3 << DMA_CCR_PSIZE_SHIFT)
+#define DMA_CCR_PSIZE_8BIT      (0 << DMA_CCR_PSIZE_SHIFT)
+#define DMA_CCR_PSIZE_16BIT     (1 << DMA_CCR_PSIZE_SHIFT)
+#define DMA_CCR_PSIZE_32BIT     (2 << DMA_CCR_PSIZE_SHIFT)
+#define DMA_CCR_MSIZE_SHIFT     10
+#define DMA_CCR_MSIZE_MASK      (3 << DMA_CCR_MSIZE_SHIFT)
+#define DMA_CCR_MSIZE_8BIT      (0 << DMA_CCR_MSIZE_SHIFT)
+#define DMA_CCR_MSIZE_16BIT     (1 << DMA_CCR_MSIZE_SHIFT)
+#define DMA_CCR_MSIZE_32BIT     (2 << DMA_CCR_MSIZE_SHIFT)
+#define DMA_CCR_PL_SHIFT        12
+#define DMA_CCR_PL_MASK         (3 << DMA_CCR_PL_SHIFT)
+#define DMA_CCR_PL_LOW          (0 << DMA_CCR_PL_SHIFT)
+#define DMA_CCR_PL_MEDIUM       (1 << DMA_CCR_PL_SHIFT)
+#define DMA_CCR_PL_HIGH         (2 << DMA_CCR_PL_SHIFT)
+#define DMA_CCR_PL_VERY_HIGH    (3 << DMA_CCR_PL_SHIFT)
+#define DMA_CCR_MEM2MEM         (1 << 14)
+
+static inline void dma_channel_reset(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) = 0;
+    DMA_CNDTR(dma, channel) = 0;
+    DMA_CPAR(dma, channel) = 0;
+    DMA_CMAR(dma, channel) = 0;
+    DMA_IFCR(dma) = DMA_IFCR_CGIF(channel);
+}
+static inline void dma_clear_interrupt_flags(uint32_t dma, uint8_t channel, uint32_t interrupts)
+{
+    DMA_IFCR(dma) = (interrupts << DMA_FLAG_OFFSET(channel));
+}
+static inline bool dma_get_interrupt_flag(uint32_t dma, uint8_t channel, uint32_t interrupts)
+{
+    return (DMA_ISR(dma) & (interrupts << DMA_FLAG_OFFSET(channel))) != 0;
+}
+static inline void dma_enable_mem2mem_mode(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_MEM2MEM;
+    DMA_CCR(dma, channel) &= ~DMA_CCR_CIRC;
+}
+static inline void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio)
+{
+    DMA_CCR(dma, channel) = (DMA_CCR(dma, channel) & ~DMA_CCR_PL_MASK) | prio;
+}
+static inline void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size)
+{
+    DMA_CCR(dma, channel) = (DMA_CCR(dma, channel) & ~DMA_CCR_MSIZE_MASK) | mem_size;
+}
+static inline void dma_set_peripheral_size(uint32_t dma, uint8_t channel, uint32_t peripheral_size)
+{
+    DMA_CCR(dma, channel) = (DMA_CCR(dma, channel) & ~DMA_CCR_PSIZE_MASK) | peripheral_size;
+}
+static inline void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) |= DMA_CCR_MINC; }
+static inline void dma_disable_memory_increment_mode(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) &= ~DMA_CCR_MINC; }
+static inline void dma_enable_peripheral_increment_mode(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) |= DMA_CCR_PINC; }
+static inline void dma_disable_peripheral_increment_mode(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) &= ~DMA_CCR_PINC; }
+static inline void dma_enable_circular_mode(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_CIRC;
+    DMA_CCR(dma, channel) &= ~DMA_CCR_MEM2MEM;
+}
+static inline void dma_set_read_from_peripheral(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) &= ~DMA_CCR_DIR; }
+static inline void dma_set_read_from_memory(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) |= DMA_CCR_DIR; }
+static inline void dma_enable_transfer_error_interrupt(uint32_t dma, uint8_t channel)
+{
+    DMA_IFCR(dma) = DMA_IFCR_CTEIF(channel);
+    DMA_CCR(dma, channel) |= DMA_CCR_TEIE;
+}
+static inline void dma_disable_transfer_error_interrupt(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) &= ~DMA_CCR_TEIE; }
+static inline void dma_enable_half_transfer_interrupt(uint32_t dma, uint8_t channel)
+{
+    DMA_IFCR(dma) = DMA_IFCR_CHTIF(channel);
+    DMA_CCR(dma, channel) |= DMA_CCR_HTIE;
+}
+static inline void dma_disable_half_transfer_interrupt(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) &= ~DMA_CCR_HTIE; }
+static inline void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t channel)
+{
+    DMA_IFCR(dma) = DMA_IFCR_CTCIF(channel);
+    DMA_CCR(dma, channel) |= DMA_CCR_TCIE;
+}
+static inline void dma_disable_transfer_complete_interrupt(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) &= ~DMA_CCR_TCIE; }
+static inline void dma_enable_channel(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) |= DMA_CCR_EN; }
+static inline void dma_disable_channel(uint32_t dma, uint8_t channel) { DMA_CCR(dma, channel) &= ~DMA_CCR_EN; }
+static inline void dma_set_peripheral_address(uint32_t dma, uint8_t channel, uint32_t address)
+{
+    if (!(DMA_CCR(dma, channel) & DMA_CCR_EN))
+    {
+        DMA_CPAR(dma, channel) = address;
+    }
+}
+static inline void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address)
+{
+    if (!(DMA_CCR(dma, channel) & DMA_CCR_EN))
+    {
+        DMA_CMAR(dma, channel) = address;
+    }
+}
+static inline uint16_t dma_get_number_of_data(uint32_t dma, uint8_t channel) { return DMA_CNDTR(dma, channel); }
+static inline void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number) { DMA_CNDTR(dma, channel) = number; }
+
+namespace sim
+{
+/** @brief DMA controller. Peripheral-to-memory and memory-to-peripheral
+ * transfers are done instantly when the peripheral asserts its DMA request,
+ * so a channel sees its requests in the order in which the peripheral
+ * models generate them. Memory-to-memory transfers take \c mem2memCycles
+ * per item. Channel arbitration by priority is not modelled - the channels
+ * are serviced in channel number order. Accessing an address that is
+ * neither a peripheral register nor a buffer mapped by busAddress() causes
+ * a transfer error
+ */
+class Dma: public Periph
+{
+public:
+    struct Channel
+    {
+        uint32_t ccr = 0;
+        uint16_t cndtr = 0;
+        uint32_t cpar = 0;
+        uint32_t cmar = 0;
+        // Internal state, latched when the channel is enabled
+        uint16_t reload = 0;
+        uint32_t curPeriph = 0;
+        uint32_t curMem = 0;
+        uint64_t nextMem2Mem = kNever;
+        uint32_t transfers = 0;
+    };
+    uint32_t mem2memCycles = 4;
+protected:
+    uint8_t mNumChannels;
+    uint8_t mIrqs[7];
+    Channel mChans[7];
+    uint32_t mIsr = 0;
+    static uint8_t sizeOf(uint32_t code) { return 1 << (code & 3); }
+    void setFlags(uint8_t chan, uint32_t flags) { mIsr |= ((flags | DMA_GIF) << DMA_FLAG_OFFSET(chan)); }
+    void enable(uint8_t chan)
+    {
+        auto& ch = mChans[chan - 1];
+        ch.reload = ch.cndtr;
+        ch.curPeriph = ch.cpar;
+        ch.curMem = ch.cmar;
+        ch.nextMem2Mem = (ch.ccr & DMA_CCR_MEM2MEM) ? kernel().now() + mem2memCycles : kNever;
+    }
+    bool isActive(const Channel& ch) const { return (ch.ccr & DMA_CCR_EN) && ch.cndtr; }
+    // Transfers one item
+    void transfer(uint8_t chan)
+    {
+        auto& ch = mChans[chan - 1];
+        uint8_t psize = sizeOf(ch.ccr >> DMA_CCR_PSIZE_SHIFT);
+        uint8_t msize = sizeOf(ch.ccr >> DMA_CCR_MSIZE_SHIFT);
+        bool fromMem = ch.ccr & DMA_CCR_DIR;
+        uint32_t val;
+        bool ok = fromMem
+            ? (kernel().dmaRead(ch.curMem, msize, val) && kernel().dmaWrite(ch.curPeriph, psize, val))
+            : (kernel().dmaRead(ch.curPeriph, psize, val) && kernel().dmaWrite(ch.curMem, msize, val));
+        if (!ok)
+        {
+            ch.ccr &= ~DMA_CCR_EN;
+            setFlags(chan, DMA_TEIF);
+            return;
+        }
+        ch.transfers++;
+        if (ch.ccr & DMA_CCR_PINC)
+        {
+            ch.curPeriph += psize;
+        }
+        if (ch.ccr & DMA_CCR_MINC)
+        {
+            ch.curMem += msize;
+        }
+        ch.cndtr--;
+        if (ch.cndtr == ch.reload - ch.reload / 2)
+        {
+            setFlags(chan, DMA_HTIF);
+        }
+        if (ch.cndtr == 0)
+        {
+            setFlags(chan, DMA_TCIF);
+            if (ch.ccr & DMA_CCR_CIRC)
+            {
+                ch.cndtr = ch.reload;
+                ch.curPeriph = ch.cpar;
+                ch.curMem = ch.cmar;
+            }
+        }
+    }
+public:
+    Dma(const char* aName, uint32_t aBase, uint8_t numChannels, const uint8_t* irqs)
+    : Periph(aName, aBase, 0x400), mNumChannels(numChannels)
+    {
+        memcpy(mIrqs, irqs, numChannels);
+    }
+    const Channel& channel(uint8_t chan) const { return mChans[chan - 1]; }
+    /** @brief The number of items transferred by the channel so far */
+    uint32_t transfers(uint8_t chan) const { return mChans[chan - 1].transfers; }
+    virtual void reset()
+    {
+        for (auto& ch: mChans)
+        {
+            ch = Channel();
+        }
+        mIsr = 0;
+    }
+    virtual uint32_t read(uint32_t offset)
+    {
+        if (offset == 0x00)
+        {
+            return mIsr;
+        }
+        if (offset < 0x08)
+        {
+            return 0;
+        }
+        uint8_t chan = (offset - 0x08) / 0x14 + 1;
+        if (chan > mNumChannels)
+        {
+            return 0;
+        }
+        auto& ch = mChans[chan - 1];
+        switch ((offset - 0x08) % 0x14)
+        {
+            case 0x00: return ch.ccr;
+            case 0x04: return ch.cndtr;
+            case 0x08: return ch.cpar;
+            case 0x0c: return ch.cmar;
+            default: return 0;
+        }
+    }
+    virtual void write(uint32_t offset, uint32_t val)
+    {
+        if (offset == 0x04)
+        {
+            // Clearing GIF clears all flags of the channel
+            for (uint8_t chan = 1; chan <= mNumChannels; chan++)
+            {
+                if (val & DMA_IFCR_CGIF(chan))
+                {
+                    val |= (0xf << DMA_FLAG_OFFSET(chan));
+                }
+            }
+            mIsr &= ~val;
+            // Keep GIF set while any other flag of the channel is set
+            for (uint8_t chan = 1; chan <= mNumChannels; chan++)
+            {
+                if (mIsr & (0xe << DMA_FLAG_OFFSET(chan)))
+                {
+                    mIsr |= DMA_ISR_GIF(chan);
+                }
+            }
+            return;
+        }
+        if (offset < 0x08)
+        {
+            return;
+        }
+        uint8_t chan = (offset - 0x08) / 0x14 + 1;
+        if (chan > mNumChannels)
+        {
+            return;
+        }
+        auto& ch = mChans[chan - 1];
+        bool enabled = ch.ccr & DMA_CCR_EN;
+        switch ((offset - 0x08) % 0x14)
+        {
+            case 0x00:
+                ch.ccr = val & 0x7fff;
+                if (!enabled && (val & DMA_CCR_EN))
+                {
+                    enable(chan);
+                }
+                else if (!(val & DMA_CCR_EN))
+                {
+                    ch.nextMem2Mem = kNever;
+                }
+                break;
+            // CNDTR, CPAR and CMAR are read-only while the channel is enabled
+            case 0x04: if (!enabled) ch.cndtr = val; break;
+            case 0x08: if (!enabled) ch.cpar = val; break;
+            case 0x0c: if (!enabled) ch.cmar = val; break;
+            default: break;
+        }
+    }
+    virtual void service()
+    {
+        for (bool again = true; again; )
+        {
+            again = false;
+            for (uint8_t chan = 1; chan <= mNumChannels; chan++)
+            {
+                auto& ch = mChans[chan - 1];
+                if (isActive(ch) && !(ch.ccr & DMA_CCR_MEM2MEM) &&
+                    kernel().dmaRequestActive(base, chan))
+                {
+                    transfer(chan);
+                    again = true;
+                }
+            }
+        }
+    }
+    virtual uint64_t nextEvent() const
+    {
+        uint64_t next = kNever;
+        for (uint8_t chan = 1; chan <= mNumChannels; chan++)
+        {
+            auto& ch = mChans[chan - 1];
+            if (isActive(ch) && ch.nextMem2Mem < next)
+            {
+                next = ch.nextMem2Mem;
+            }
+        }
+        return next;
+    }
+    virtual void onEvent(uint64_t now)
+    {
+        for (uint8_t chan = 1; chan <= mNumChannels; chan++)
+        {
+            auto& ch = mChans[chan - 1];
+            if (isActive(ch) && ch.nextMem2Mem <= now)
+            {
+                transfer(chan);
+                ch.nextMem2Mem = ch.cndtr ? now + mem2memCycles : kNever;
+            }
+        }
+    }
+    virtual uint64_t irqs() const
+    {
+        uint64_t irqs = 0;
+        for (uint8_t chan = 1; chan <= mNumChannels; chan++)
+        {
+            uint32_t flags = (mIsr >> DMA_FLAG_OFFSET(chan)) & 0xe;
+            uint32_t enabled = mChans[chan - 1].ccr & (DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE);
+            if (flags & enabled)
+            {
+                irqs |= (1ull << mIrqs[chan - 1]);
+            }
+        }
+        return irqs;
+    }
+};
+}
+#endif
@@ -0,0 +1,649 @@
+/**
+ * Simulated I2C controllers and slave devices, with the libopencm3 API
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_SIM_I2C_HPP
+#define STM32PP_SIM_I2C_HPP
+
+#include "simDma.hpp"
+#include <vector>
+
+#define I2C1_BASE               (PERIPH_BASE_APB1 + 0x5400)
+#define I2C2_BASE               (PERIPH_BASE_APB1 + 0x5800)
+#define I2C1 I2C1_BASE
+#define I2C2 I2C2_BASE
+
+#define I2C_CR1(i2c_base)       MMIO32((i2c_base) + 0x00)
+#define I2C_CR2(i2c_base)       MMIO32((i2c_base) + 0x04)
+#define I2C_OAR1(i2c_base)      MMIO32((i2c_base) + 0x08)
+#define I2C_OAR2(i2c_base)      MMIO32((i2c_base) + 0x0c)
+#define I2C_DR(i2c_base)        MMIO32((i2c_base) + 0x10)
+#define I2C_SR1(i2c_base)       MMIO32((i2c_base) + 0x14)
+#define I2C_SR2(i2c_base)       MMIO32((i2c_base) + 0x18)
+#define I2C_CCR(i2c_base)       MMIO32((i2c_base) + 0x1c)
+#define I2C_TRISE(i2c_base)     MMIO32((i2c_base) + 0x20)
+#define I2C1_DR                 I2C_DR(I2C1)
+#define I2C2_DR                 I2C_DR(I2C2)
+
+#define I2C_CR1_PE              (1 << 0)
+#define I2C_CR1_SMBUS           (1 << 1)
+#define I2C_CR1_ENGC            (1 << 6)
+#define I2C_CR1_NOSTRETCH       (1 << 7)
+#define I2C_CR1_START           (1 << 8)
+#define I2C_CR1_STOP            (1 << 9)
+#define I2C_CR1_ACK             (1 << 10)
+#define I2C_CR1_POS             (1 << 11)
+#define I2C_CR1_PEC             (1 << 12)
+#define I2C_CR1_ALERT           (1 << 13)
+#define I2C_CR1_SWRST           (1 << 15)
+
+#define I2C_CR2_FREQ_MASK       0x3f
+#define I2C_CR2_ITERREN         (1 << 8)
+#define I2C_CR2_ITEVTEN         (1 << 9)
+#define I2C_CR2_ITBUFEN         (1 << 10)
+#define I2C_CR2_DMAEN           (1 << 11)
+#define I2C_CR2_LAST            (1 << 12)
+
+#define I2C_OAR1_ADDMODE        (1 << 15)
+#define I2C_OAR1_ADDMODE_7BIT   0
+
+#define I2C_SR1_SB              (1 << 0)
+#define I2C_SR1_ADDR            (1 << 1)
+#define I2C_SR1_BTF             (1 << 2)
+#define I2C_SR1_ADD10           (1 << 3)
+#define I2C_SR1_STOPF           (1 << 4)
+#define I2C_SR1_RxNE            (1 << 6)
+#define I2C_SR1_TxE             (1 << 7)
+#define I2C_SR1_BERR            (1 << 8)
+#define I2C_SR1_ARLO            (1 << 9)
+#define I2C_SR1_AF              (1 << 10)
+#define I2C_SR1_OVR             (1 << 11)
+#define I2C_SR1_PECERR          (1 << 12)
+#define I2C_SR1_TIMEOUT         (1 << 14)
+#define I2C_SR1_SMBALERT        (1 << 15)
+
+#define I2C_SR2_MSL             (1 << 0)
+#define I2C_SR2_BUSY            (1 << 1)
+#define I2C_SR2_TRA             (1 << 2)
+#define I2C_SR2_GENCALL         (1 << 4)
+
+#define I2C_CCR_FS              (1 << 15)
+#define I2C_CCR_DUTY            (1 << 14)
+#define I2C_CCR_CCR_MASK        0xfff
+#define I2C_CCR_DUTY_DIV2       0
+#define I2C_CCR_DUTY_16_DIV_9   1
+
+#define I2C_WRITE               0
+#define I2C_READ                1
+
+static inline void i2c_reset(uint32_t i2c)
+{
+    I2C_CR1(i2c) = I2C_CR1_SWRST;
+    I2C_CR1(i2c) = 0;
+}
+static inline void i2c_peripheral_enable(uint32_t i2c) { I2C_CR1(i2c) |= I2C_CR1_PE; }
+static inline void i2c_peripheral_disable(uint32_t i2c) { I2C_CR1(i2c) &= ~I2C_CR1_PE; }
+static inline void i2c_send_start(uint32_t i2c) { I2C_CR1(i2c) |= I2C_CR1_START; }
+static inline void i2c_send_stop(uint32_t i2c) { I2C_CR1(i2c) |= I2C_CR1_STOP; }
+static inline void i2c_clear_stop(uint32_t i2c) { I2C_CR1(i2c) &= ~I2C_CR1_STOP; }
+static inline void i2c_set_own_7bit_slave_address(uint32_t i2c, uint8_t slave)
+{
+    I2C_OAR1(i2c) = (uint16_t)(slave << 1) | (1 << 14);
+}
+static inline void i2c_set_clock_frequency(uint32_t i2c, uint8_t freq)
+{
+    I2C_CR2(i2c) = (I2C_CR2(i2c) & ~I2C_CR2_FREQ_MASK) | freq;
+}
+static inline void i2c_send_data(uint32_t i2c, uint8_t data) { I2C_DR(i2c) = data; }
+static inline uint8_t i2c_get_data(uint32_t i2c) { return I2C_DR(i2c) & 0xff; }
+static inline void i2c_set_fast_mode(uint32_t i2c) { I2C_CCR(i2c) |= I2C_CCR_FS; }
+static inline void i2c_set_standard_mode(uint32_t i2c) { I2C_CCR(i2c) &= ~I2C_CCR_FS; }
+static inline void i2c_set_ccr(uint32_t i2c, uint16_t freq)
+{
+    I2C_CCR(i2c) = (I2C_CCR(i2c) & ~I2C_CCR_CCR_MASK) | freq;
+}
+static inline void i2c_set_dutycycle(uint32_t i2c, uint32_t dutycycle)
+{
+    if (dutycycle == I2C_CCR_DUTY_DIV2)
+    {
+        I2C_CCR(i2c) &= ~I2C_CCR_DUTY;
+    }
+    else
+    {
+        I2C_CCR(i2c) |= I2C_CCR_DUTY;
+    }
+}
+static inline void i2c_set_trise(uint32_t i2c, uint16_t trise) { I2C_TRISE(i2c) = trise; }
+static inline void i2c_send_7bit_address(uint32_t i2c, uint8_t slave, uint8_t readwrite)
+{
+    I2C_DR(i2c) = (uint8_t)((slave << 1) | readwrite);
+}
+static inline void i2c_enable_interrupt(uint32_t i2c, uint32_t interrupt) { I2C_CR2(i2c) |= interrupt; }
+static inline void i2c_disable_interrupt(uint32_t i2c, uint32_t interrupt) { I2C_CR2(i2c) &= ~interrupt; }
+static inline void i2c_enable_ack(uint32_t i2c) { I2C_CR1(i2c) |= I2C_CR1_ACK; }
+static inline void i2c_disable_ack(uint32_t i2c) { I2C_CR1(i2c) &= ~I2C_CR1_ACK; }
+static inline void i2c_nack_next(uint32_t i2c) { I2C_CR1(i2c) |= I2C_CR1_POS; }
+static inline void i2c_nack_current(uint32_t i2c) { I2C_CR1(i2c) &= ~I2C_CR1_POS; }
+static inline void i2c_enable_dma(uint32_t i2c) { I2C_CR2(i2c) |= I2C_CR2_DMAEN; }
+static inline void i2c_disable_dma(uint32_t i2c) { I2C_CR2(i2c) &= ~I2C_CR2_DMAEN; }
+static inline void i2c_set_dma_last_transfer(uint32_t i2c) { I2C_CR2(i2c) |= I2C_CR2_LAST; }
+static inline void i2c_clear_dma_last_transfer(uint32_t i2c) { I2C_CR2(i2c) &= ~I2C_CR2_LAST; }
+
+namespace sim
+{
+/** @brief A slave device on a simulated I2C bus */
+class I2cSlave
+{
+public:
+    uint8_t address;
+    I2cSlave(uint8_t aAddress): address(aAddress) {}
+    virtual ~I2cSlave() {}
+    /** @brief Start or repeated start condition */
+    virtual void onStart() {}
+    /** @brief The device was addressed
+     * @return Whether to ACK the address
+     */
+    virtual bool onAddress(bool) { return true; }
+    /** @brief The master wrote a byte
+     * @return Whether to ACK it
+     */
+    virtual bool onWrite(uint8_t) { return true; }
+    /** @brief The master starts reading a byte */
+    virtual uint8_t onRead() { return 0xff; }
+    virtual void onStop() {}
+};
+
+/** @brief A typical register-based I2C device, i.e. a sensor or an EEPROM.
+ * The first byte written after a start selects the register, and further
+ * written bytes are stored in consecutive registers. Reads return
+ * consecutive registers, starting from the selected one
+ */
+class I2cMemSlave: public I2cSlave
+{
+public:
+    uint8_t regs[256] = {};
+    uint8_t regAddr = 0;
+    uint32_t bytesWritten = 0;
+    uint32_t bytesRead = 0;
+    uint32_t stops = 0;
+protected:
+    bool mAddrPhase = false;
+public:
+    I2cMemSlave(uint8_t aAddress): I2cSlave(aAddress) {}
+    virtual void onStart() { mAddrPhase = true; }
+    virtual bool onWrite(uint8_t data)
+    {
+        bytesWritten++;
+        if (mAddrPhase)
+        {
+            regAddr = data;
+            mAddrPhase = false;
+        }
+        else
+        {
+            regs[regAddr++] = data;
+        }
+        return true;
+    }
+    virtual uint8_t onRead()
+    {
+        bytesRead++;
+        return regs[regAddr++];
+    }
+    virtual void onStop() { stops++; }
+};
+
+/** @brief I2C controller in master mode, with the slave devices attached
+ * via attach(). Implements the F1 master sequences: SB/ADDR/BTF, ADDR cleared
+ * by reading SR1 and SR2, the clock stretching (BTF) when received data is
+ * not read, ACK/NACK of received bytes by the ACK and POS bits, or
+ * automatic NACK of the last DMA transfer when LAST is set, STOP and repeated
+ * START generated after the current byte, and AF when the slave NACKs
+ */
+class I2c: public Periph
+{
+protected:
+    enum Phase: uint8_t
+    {
+        kIdle, kStarting, kStartDone, kAddr, kAddrDone, kTx, kRx, kNacked, kStopping
+    };
+    uint8_t mEvIrq;
+    uint8_t mErIrq;
+    uint8_t mDmaTxChan;
+    uint8_t mDmaRxChan;
+    std::vector<I2cSlave*> mSlaves;
+    uint32_t mCr1 = 0;
+    uint32_t mCr2 = 0;
+    uint32_t mOar1 = 0;
+    uint32_t mCcr = 0;
+    uint32_t mTrise = 0;
+    uint32_t mSr1 = 0;
+    uint32_t mSr2 = 0;
+    uint32_t mSr1Seen = 0;
+    Phase mPhase = kIdle;
+    uint64_t mEventAt = kNever;
+    I2cSlave* mSlave = nullptr;
+    bool mRead = false;
+    uint8_t mAddrByte = 0;
+    uint8_t mDr = 0;
+    int mTdr = -1;
+    int mShift = -1; // byte being transferred
+    int mRxHeld = -1; // received byte waiting in the shift register
+    bool mRxAck = false;
+    bool mLastAck = false;
+    uint32_t mTransactions = 0;
+    bool mBusStuck = false;
+    uint32_t mPendingCr1Writes = 0;
+    uint64_t bitTime() const
+    {
+        uint32_t ccr = mCcr & I2C_CCR_CCR_MASK;
+        uint32_t periphCycles;
+        if (!ccr)
+        {
+            periphCycles = Clocks<>::apb1 / 100000;
+        }
+        else if (mCcr & I2C_CCR_FS)
+        {
+            periphCycles = ccr * ((mCcr & I2C_CCR_DUTY) ? 25 : 3);
+        }
+        else
+        {
+            periphCycles = ccr * 2;
+        }
+        return Clocks<>::toCpuCycles(periphCycles, Clocks<>::apb1);
+    }
+    void schedule(uint64_t bits) { mEventAt = kernel().now() + bits * bitTime(); }
+    bool byteInProgress() const { return mShift >= 0; }
+    uint16_t dmaRemaining() const
+    {
+        auto dma = static_cast<Dma*>(kernel().find(DMA1));
+        return dma ? dma->channel(mDmaRxChan).cndtr : 0;
+    }
+    bool ackNow() const
+    {
+        if (!(mCr1 & I2C_CR1_ACK))
+        {
+            return false;
+        }
+        return !((mCr2 & I2C_CR2_DMAEN) && (mCr2 & I2C_CR2_LAST) && dmaRemaining() <= 1);
+    }
+    void startRxByte()
+    {
+        mShift = mSlave->onRead();
+        if (mCr1 & I2C_CR1_POS)
+        {
+            mRxAck = ackNow();
+        }
+        schedule(9);
+    }
+    void clearTransferFlags()
+    {
+        mSr1 &= ~(I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_BTF | I2C_SR1_TxE | I2C_SR1_RxNE);
+        mTdr = mShift = mRxHeld = -1;
+    }
+    // Generates a pending STOP or repeated START, if no byte is in progress
+    bool checkStopStart()
+    {
+        if (byteInProgress())
+        {
+            return false;
+        }
+        if (mCr1 & I2C_CR1_STOP)
+        {
+            // Data waiting in the shift register can still be read
+            mSr1 &= ~(I2C_SR1_TxE | I2C_SR1_BTF | I2C_SR1_SB | I2C_SR1_ADDR);
+            mTdr = mShift = -1;
+            mPhase = kStopping;
+            schedule(1);
+            return true;
+        }
+        if (mCr1 & I2C_CR1_START)
+        {
+            clearTransferFlags();
+            mPhase = kStarting;
+            schedule(1);
+            return true;
+        }
+        return false;
+    }
+    void dataPhase()
+    {
+        if (mRead)
+        {
+            mPhase = kRx;
+            startRxByte();
+        }
+        else
+        {
+            mPhase = kTx;
+            mSr1 |= I2C_SR1_TxE;
+        }
+    }
+    void txByte(uint8_t data)
+    {
+        mSr1 &= ~I2C_SR1_BTF;
+        if (mShift < 0)
+        {
+            mShift = data;
+            schedule(9);
+        }
+        else
+        {
+            mTdr = data;
+            mSr1 &= ~I2C_SR1_TxE;
+        }
+    }
+public:
+    I2c(const char* aName, uint32_t aBase, uint8_t evIrq, uint8_t erIrq,
+        uint8_t dmaTxChan, uint8_t dmaRxChan)
+    : Periph(aName, aBase, 0x400), mEvIrq(evIrq), mErIrq(erIrq),
+      mDmaTxChan(dmaTxChan), mDmaRxChan(dmaRxChan)
+    {}
+    void attach(I2cSlave& slave) { mSlaves.push_back(&slave); }
+    void detach(I2cSlave& slave)
+    {
+        for (auto it = mSlaves.begin(); it != mSlaves.end(); ++it)
+        {
+            if (*it == &slave)
+            {
+                mSlaves.erase(it);
+                return;
+            }
+        }
+    }
+    /** @brief The number of transactions ended by a STOP condition */
+    uint32_t transactions() const { return mTransactions; }
+    bool busBusy() const { return mSr2 & I2C_SR2_BUSY; }
+    /** @brief Simulates a slave holding the bus low: no bus condition or
+     * byte transfer completes until it is released. Not cleared by reset(),
+     * as it's a state of the bus, not of the controller
+     */
+    void setBusStuck(bool stuck) { mBusStuck = stuck; }
+    /** @brief The number of CR1 writes while a START or STOP was pending,
+     * which the reference manual forbids, as they may generate a second one
+     */
+    uint32_t pendingCr1Writes() const { return mPendingCr1Writes; }
+    virtual void reset()
+    {
+        mCr1 = mCr2 = mOar1 = mCcr = mTrise = 0;
+        mSr1 = mSr2 = mSr1Seen = 0;
+        mPhase = kIdle;
+        mEventAt = kNever;
+        mSlave = nullptr;
+        mTdr = mShift = mRxHeld = -1;
+        mTransactions = 0;
+        mPendingCr1Writes = 0;
+    }
+    virtual uint32_t read(uint32_t offset)
+    {
+        switch (offset)
+        {
+            case 0x00: return mCr1;
+            case 0x04: return mCr2;
+            case 0x08: return mOar1;
+            case 0x10:
+            {
+                uint8_t data = mDr;
+                if (mSr1 & I2C_SR1_RxNE)
+                {
+                    mSr1 &= ~I2C_SR1_RxNE;
+                    if (mRxHeld >= 0)
+                    {
+                        mDr = mRxHeld;
+                        mRxHeld = -1;
+                        mSr1 = (mSr1 & ~I2C_SR1_BTF) | I2C_SR1_RxNE;
+                        if (mPhase == kRx && mLastAck && !checkStopStart())
+                        {
+                            startRxByte();
+                        }
+                    }
+                }
+                return data;
+            }
+            case 0x14:
+                mSr1Seen = mSr1;
+                return mSr1;
+            case 0x18:
+                if (mSr1Seen & mSr1 & I2C_SR1_ADDR)
+                {
+                    mSr1 &= ~I2C_SR1_ADDR;
+                    mSr1Seen = 0;
+                    uint32_t sr2 = mSr2;
+                    dataPhase();
+                    return sr2;
+                }
+                mSr1Seen = 0;
+                return mSr2;
+            case 0x1c: return mCcr;
+            case 0x20: return mTrise;
+            default: return 0;
+        }
+    }
+    virtual void write(uint32_t offset, uint32_t val)
+    {
+        switch (offset)
+        {
+            case 0x00:
+            {
+                if (val & I2C_CR1_SWRST)
+                {
+                    reset();
+                    mCr1 = I2C_CR1_SWRST;
+                    return;
+                }
+                if (mCr1 & (I2C_CR1_START | I2C_CR1_STOP))
+                {
+                    mPendingCr1Writes++;
+                }
+                mCr1 = val & 0xbfff;
+                if (!(mCr1 & I2C_CR1_PE))
+                {
+                    mCr1 &= ~(I2C_CR1_START | I2C_CR1_STOP);
+                    mSr1 = mSr2 = 0;
+                    mPhase = kIdle;
+                    mEventAt = kNever;
+                    mTdr = mShift = mRxHeld = -1;
+                    return;
+                }
+                if (mCr1 & (I2C_CR1_START | I2C_CR1_STOP))
+                {
+                    if (mPhase == kIdle)
+                    {
+                        if (mCr1 & I2C_CR1_START)
+                        {
+                            mPhase = kStarting;
+                            schedule(1);
+                        }
+                        mCr1 &= ~I2C_CR1_STOP;
+                    }
+                    else if (mPhase == kAddrDone || mPhase == kTx || mPhase == kRx || mPhase == kNacked)
+                    {
+                        checkStopStart();
+                    }
+                }
+                break;
+            }
+            case 0x04: mCr2 = val & 0x1fff; break;
+            case 0x08: mOar1 = val; break;
+            case 0x10:
+                if (mPhase == kStartDone)
+                {
+                    mSr1 &= ~I2C_SR1_SB;
+                    mAddrByte = val;
+                    mPhase = kAddr;
+                    schedule(9);
+                }
+                else if (mPhase == kTx)
+                {
+                    txByte(val);
+                }
+                break;
+            case 0x14:
+                // The error flags are cleared by writing 0
+                mSr1 &= (val | 0xff);
+                break;
+            case 0x1c: mCcr = val; break;
+            case 0x20: mTrise = val; break;
+            default: break;
+        }
+    }
+    virtual uint64_t nextEvent() const { return mBusStuck ? kNever : mEventAt; }
+    virtual void onEvent(uint64_t)
+    {
+        mEventAt = kNever;
+        switch (mPhase)
+        {
+            case kStarting:
+                mCr1 &= ~I2C_CR1_START;
+                mSr1 |= I2C_SR1_SB;
+                mSr2 = (mSr2 & ~I2C_SR2_TRA) | I2C_SR2_MSL | I2C_SR2_BUSY;
+                mPhase = kStartDone;
+                for (auto slave: mSlaves)
+                {
+                    slave->onStart();
+                }
+                break;
+            case kAddr:
+            {
+                mRead = mAddrByte & 1;
+                mSlave = nullptr;
+                for (auto slave: mSlaves)
+                {
+                    if (slave->address == (mAddrByte >> 1))
+                    {
+                        mSlave = slave;
+                        break;
+                    }
+                }
+                if (mSlave && mSlave->onAddress(mRead))
+                {
+                    mSr1 |= I2C_SR1_ADDR;
+                    if (mRead)
+                    {
+                        mSr2 &= ~I2C_SR2_TRA;
+                    }
+                    else
+                    {
+                        mSr2 |= I2C_SR2_TRA;
+                    }
+                    mPhase = kAddrDone;
+                }
+                else
+                {
+                    mSlave = nullptr;
+                    mSr1 |= I2C_SR1_AF;
+                    mPhase = kNacked;
+                    checkStopStart();
+                }
+                break;
+            }
+            case kTx:
+            {
+                bool ack = mSlave->onWrite(mShift);
+                mShift = -1;
+                if (!ack)
+                {
+                    mSr1 |= I2C_SR1_AF;
+                    mSr1 &= ~I2C_SR1_TxE;
+                    mTdr = -1;
+                    mPhase = kNacked;
+                }
+                else if (mTdr >= 0)
+                {
+                    mShift = mTdr;
+                    mTdr = -1;
+                    mSr1 |= I2C_SR1_TxE;
+                    schedule(9);
+                    break;
+                }
+                else
+                {
+                    mSr1 |= I2C_SR1_BTF;
+                }
+                checkStopStart();
+                break;
+            }
+            case kRx:
+            {
+                uint8_t data = mShift;
+                mShift = -1;
+                mLastAck = (mCr1 & I2C_CR1_POS) ? mRxAck : ackNow();
+                if (mSr1 & I2C_SR1_RxNE)
+                {
+                    mRxHeld = data;
+                    mSr1 |= I2C_SR1_BTF;
+                }
+                else
+                {
+                    mDr = data;
+                    mSr1 |= I2C_SR1_RxNE;
+                }
+                if (!checkStopStart() && mLastAck && mRxHeld < 0)
+                {
+                    startRxByte();
+                }
+                break;
+            }
+            case kStopping:
+                mCr1 &= ~I2C_CR1_STOP;
+                mSr2 &= ~(I2C_SR2_MSL | I2C_SR2_BUSY | I2C_SR2_TRA);
+                mPhase = kIdle;
+                mTransactions++;
+                for (auto slave: mSlaves)
+                {
+                    slave->onStop();
+                }
+                if (mCr1 & I2C_CR1_START)
+                {
+                    mPhase = kStarting;
+                    schedule(1);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    virtual uint64_t irqs() const
+    {
+        uint64_t irqs = 0;
+        if (!(mCr1 & I2C_CR1_PE))
+        {
+            return 0;
+        }
+        if (mCr2 & I2C_CR2_ITEVTEN)
+        {
+            if ((mSr1 & (I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_BTF | I2C_SR1_STOPF)) ||
+                ((mCr2 & I2C_CR2_ITBUFEN) && !(mCr2 & I2C_CR2_DMAEN) &&
+                    (mSr1 & (I2C_SR1_TxE | I2C_SR1_RxNE))))
+            {
+                irqs |= (1ull << mEvIrq);
+            }
+        }
+        if ((mCr2 & I2C_CR2_ITERREN) &&
+            (mSr1 & (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR | I2C_SR1_TIMEOUT)))
+        {
+            irqs |= (1ull << mErIrq);
+        }
+        return irqs;
+    }
+    virtual bool dmaRequest(uint32_t dma, uint8_t chan) const
+    {
+        if (dma != DMA1 || !(mCr1 & I2C_CR1_PE) || !(mCr2 & I2C_CR2_DMAEN))
+        {
+            return false;
+        }
+        if (chan == mDmaTxChan)
+        {
+            return mPhase == kTx && (mSr1 & I2C_SR1_TxE);
+        }
+        if (chan == mDmaRxChan)
+        {
+            return mSr1 & I2C_SR1_RxNE;
+        }
+        return false;
+    }
+};
+}
+#endif
@@ -0,0 +1,507 @@
+/**
+ * Core of the simulated peripheral backend: simulated time, register bus,
+ * DMA-visible memory and NVIC
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_SIM_KERNEL_HPP
+#define STM32PP_SIM_KERNEL_HPP
+
+#ifndef STM32PP_NOT_EMBEDDED
+    #error "The simulated peripherals are for host builds, STM32PP_NOT_EMBEDDED must be defined"
+#endif
+#ifndef STM32PP_PERIPH_SIM
+    #define STM32PP_PERIPH_SIM 1
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <functional>
+
+#define MMIO32(addr) sim::Reg(addr)
+
+namespace sim
+{
+class Kernel;
+inline Kernel& kernel();
+
+/** @brief The address of a register, as obtained by taking the address of
+ * a register macro, i.e. \c &USART1_DR
+ */
+struct BusAddr
+{
+    uint32_t addr;
+    explicit operator uint32_t() const { return addr; }
+};
+
+/** @brief Proxy of a peripheral register, which the register macros evaluate
+ * to. Reads and writes are forwarded to the peripheral model, and advance
+ * the simulated time. As with a volatile register, an expression whose value
+ * is discarded, i.e. \c (void)USART_DR(USART1), still reads the register -
+ * done by the destructor, if the proxy was not otherwise used
+ */
+class Reg
+{
+protected:
+    uint32_t mAddr;
+    mutable bool mUsed = false;
+public:
+    explicit Reg(uint32_t addr): mAddr(addr) {}
+    Reg(const Reg& other): mAddr(other.mAddr) { other.mUsed = true; }
+    inline ~Reg();
+    inline operator uint32_t() const;
+    inline Reg& operator=(uint32_t val);
+    Reg& operator=(const Reg& other) { return *this = (uint32_t)other; }
+    Reg& operator|=(uint32_t val) { return *this = (uint32_t)*this | val; }
+    Reg& operator&=(uint32_t val) { return *this = (uint32_t)*this & val; }
+    Reg& operator^=(uint32_t val) { return *this = (uint32_t)*this ^ val; }
+    BusAddr operator&() const
+    {
+        mUsed = true;
+        return BusAddr{mAddr};
+    }
+};
+
+/** @brief Clock frequencies, as set by the rcc_clock_setup_xxx() functions.
+ * Unlike on the real chip, the default is 72 MHz, so that tests don't need to
+ * set up the clocks
+ */
+template <class T=void>
+struct Clocks
+{
+    static uint32_t ahb;
+    static uint32_t apb1;
+    static uint32_t apb2;
+    /** @brief Converts peripheral clock cycles to CPU (AHB) cycles */
+    static uint64_t toCpuCycles(uint64_t cycles, uint32_t periphFreq)
+    {
+        return (cycles * ahb + periphFreq - 1) / periphFreq;
+    }
+};
+template <class T> uint32_t Clocks<T>::ahb = 72000000;
+template <class T> uint32_t Clocks<T>::apb1 = 36000000;
+template <class T> uint32_t Clocks<T>::apb2 = 72000000;
+
+enum: uint64_t { kNever = UINT64_MAX };
+
+/** @brief Base of the peripheral models. A model occupies an address range on
+ * the register bus, can schedule a single pending event in simulated time,
+ * drives interrupt lines and DMA request lines
+ */
+class Periph
+{
+public:
+    const char* name;
+    uint32_t base;
+    uint32_t size;
+    Periph(const char* aName, uint32_t aBase, uint32_t aSize)
+    : name(aName), base(aBase), size(aSize) {}
+    virtual ~Periph() {}
+    /** @brief Register read by the CPU or the DMA, with the side effects of the
+     * real register, i.e. clearing of status flags
+     */
+    virtual uint32_t read(uint32_t offset) = 0;
+    virtual void write(uint32_t offset, uint32_t val) = 0;
+    /** @brief The time of the next event, or kNever */
+    virtual uint64_t nextEvent() const { return kNever; }
+    virtual void onEvent(uint64_t) {}
+    /** @brief Bit mask of the NVIC interrupt lines that are asserted */
+    virtual uint64_t irqs() const { return 0; }
+    /** @brief Whether the peripheral requests a transfer from the specified
+     * DMA channel
+     */
+    virtual bool dmaRequest(uint32_t, uint8_t) const { return false; }
+    /** @brief Called when the simulation settles, i.e. by DMA controllers
+     * to perform requested transfers
+     */
+    virtual void service() {}
+    virtual void reset() {}
+};
+
+typedef void(*IsrFunc)(void);
+static inline IsrFunc vector(uint8_t irq);
+
+class Kernel
+{
+public:
+    enum: uint8_t { kNumIrqs = 64 };
+    enum: uint32_t {
+        kMemBase = 0x20000000, // bus addresses of host memory regions
+        kMemRegionSize = 0x100000,
+        kMemRegionCount = 0x20000000 / kMemRegionSize,
+        kMaxIsrsPerSettle = 1000000
+    };
+    /** @brief CPU cycles consumed by each register access of the CPU */
+    uint32_t accessCycles = 2;
+protected:
+    std::vector<Periph*> mPeriphs;
+    std::map<uint32_t, uint32_t> mPlainRegs; // registers of peripherals that are not modelled
+    uint64_t mNow = 0;
+    // NVIC
+    uint64_t mIrqEnabled = 0;
+    uint64_t mIrqSetPending = 0;
+    uint8_t mIrqPrio[kNumIrqs] = {};
+    std::function<void()> mHandlers[kNumIrqs];
+    uint32_t mIsrCount[kNumIrqs] = {};
+    bool mPrimask = false;
+    int mRunningPrio = 0x100; // 0x100 in thread mode
+    int mActiveIrq = -1;
+    // Host memory regions visible to the DMA
+    std::vector<const volatile char*> mMemRegions;
+    uint32_t mNextRegion = 0;
+    static int preemptPrio(uint8_t prio) { return prio >> 4; }
+public:
+    void add(Periph& periph) { mPeriphs.push_back(&periph); }
+    const std::vector<Periph*>& periphs() const { return mPeriphs; }
+    uint64_t now() const { return mNow; }
+    Periph* find(uint32_t addr) const
+    {
+        for (auto periph: mPeriphs)
+        {
+            if (addr >= periph->base && addr - periph->base < periph->size)
+            {
+                return periph;
+            }
+        }
+        return nullptr;
+    }
+    // Register access without advancing the time, i.e. by the DMA
+    uint32_t busRead(uint32_t addr)
+    {
+        auto periph = find(addr);
+        if (periph)
+        {
+            return periph->read(addr - periph->base);
+        }
+        auto it = mPlainRegs.find(addr);
+        return (it == mPlainRegs.end()) ? 0 : it->second;
+    }
+    void busWrite(uint32_t addr, uint32_t val)
+    {
+        auto periph = find(addr);
+        if (periph)
+        {
+            periph->write(addr - periph->base, val);
+        }
+        else
+        {
+            mPlainRegs[addr] = val;
+        }
+    }
+    // Register access by the CPU
+    uint32_t cpuRead(uint32_t addr)
+    {
+        advance(accessCycles);
+        return busRead(addr);
+    }
+    void cpuWrite(uint32_t addr, uint32_t val)
+    {
+        busWrite(addr, val);
+        settle();
+        advance(accessCycles);
+    }
+    /** @brief Maps a host pointer to a 32-bit bus address, which the DMA
+     * controller model maps back. Pointers within the first half of an
+     * existing region reuse it, so that repeated transfers don't exhaust
+     * the regions
+     */
+    uint32_t busAddress(const volatile void* ptr)
+    {
+        auto cptr = (const volatile char*)ptr;
+        for (uint32_t i = 0; i < mMemRegions.size(); i++)
+        {
+            auto base = mMemRegions[i];
+            if (cptr >= base && (size_t)(cptr - base) < kMemRegionSize / 2)
+            {
+                return kMemBase + i * kMemRegionSize + (uint32_t)(cptr - base);
+            }
+        }
+        uint32_t idx;
+        if (mMemRegions.size() < kMemRegionCount)
+        {
+            idx = mMemRegions.size();
+            mMemRegions.push_back(cptr);
+        }
+        else
+        {
+            idx = mNextRegion;
+            mNextRegion = (mNextRegion + 1) % kMemRegionCount;
+            mMemRegions[idx] = cptr;
+        }
+        return kMemBase + idx * kMemRegionSize;
+    }
+    /** @brief Maps a bus address of host memory back to a pointer
+     * @return nullptr if the address is not in a mapped region
+     */
+    volatile char* hostPtr(uint32_t addr) const
+    {
+        if (addr < kMemBase)
+        {
+            return nullptr;
+        }
+        uint32_t idx = (addr - kMemBase) / kMemRegionSize;
+        if (idx >= mMemRegions.size())
+        {
+            return nullptr;
+        }
+        return (volatile char*)mMemRegions[idx] + (addr - kMemBase) % kMemRegionSize;
+    }
+    static bool isMemAddr(uint32_t addr) { return addr >= kMemBase && addr < kMemBase + 0x20000000; }
+    /** @brief Reads from memory or a peripheral register, on behalf of the DMA
+     * @return false on bus error
+     */
+    bool dmaRead(uint32_t addr, uint8_t size, uint32_t& val)
+    {
+        if (!isMemAddr(addr))
+        {
+            val = busRead(addr);
+            return true;
+        }
+        auto ptr = hostPtr(addr);
+        if (!ptr)
+        {
+            return false;
+        }
+        val = 0;
+        memcpy(&val, (const void*)ptr, size);
+        return true;
+    }
+    bool dmaWrite(uint32_t addr, uint8_t size, uint32_t val)
+    {
+        if (!isMemAddr(addr))
+        {
+            busWrite(addr, val);
+            return true;
+        }
+        auto ptr = hostPtr(addr);
+        if (!ptr)
+        {
+            return false;
+        }
+        memcpy((void*)ptr, &val, size);
+        return true;
+    }
+    bool dmaRequestActive(uint32_t dma, uint8_t chan) const
+    {
+        for (auto periph: mPeriphs)
+        {
+            if (periph->dmaRequest(dma, chan))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    // NVIC
+    void irqEnable(uint8_t irq) { mIrqEnabled |= (1ull << irq); settle(); }
+    void irqDisable(uint8_t irq) { mIrqEnabled &= ~(1ull << irq); }
+    bool irqIsEnabled(uint8_t irq) const { return mIrqEnabled & (1ull << irq); }
+    void irqSetPending(uint8_t irq) { mIrqSetPending |= (1ull << irq); settle(); }
+    void irqClearPending(uint8_t irq) { mIrqSetPending &= ~(1ull << irq); }
+    void irqSetPriority(uint8_t irq, uint8_t prio) { mIrqPrio[irq] = prio; }
+    uint64_t irqsAsserted() const
+    {
+        uint64_t irqs = mIrqSetPending;
+        for (auto periph: mPeriphs)
+        {
+            irqs |= periph->irqs();
+        }
+        return irqs;
+    }
+    /** @brief Installs an interrupt handler, which overrides the vector
+     * function (i.e. \c usart1_isr()) defined by the application
+     */
+    void setIrqHandler(uint8_t irq, std::function<void()> handler) { mHandlers[irq] = handler; }
+    /** @brief The number of times the handler of \c irq was called */
+    uint32_t isrCount(uint8_t irq) const { return mIsrCount[irq]; }
+    int activeIrq() const { return mActiveIrq; }
+    void resetStats() { memset(mIsrCount, 0, sizeof(mIsrCount)); }
+    void setPrimask(bool masked)
+    {
+        mPrimask = masked;
+        if (!masked)
+        {
+            settle();
+        }
+    }
+    bool primask() const { return mPrimask; }
+    int nextIrq() const
+    {
+        if (mPrimask)
+        {
+            return -1;
+        }
+        uint64_t active = irqsAsserted() & mIrqEnabled;
+        int best = -1;
+        int bestPrio = mRunningPrio;
+        for (uint8_t irq = 0; active; irq++, active >>= 1)
+        {
+            if ((active & 1) && preemptPrio(mIrqPrio[irq]) < bestPrio)
+            {
+                best = irq;
+                bestPrio = preemptPrio(mIrqPrio[irq]);
+            }
+        }
+        return best;
+    }
+    void runIsr(uint8_t irq)
+    {
+        mIrqSetPending &= ~(1ull << irq);
+        int prevPrio = mRunningPrio;
+        int prevIrq = mActiveIrq;
+        mRunningPrio = preemptPrio(mIrqPrio[irq]);
+        mActiveIrq = irq;
+        mIsrCount[irq]++;
+        if (mHandlers[irq])
+        {
+            mHandlers[irq]();
+        }
+        else if (vector(irq))
+        {
+            vector(irq)();
+        }
+        else
+        {
+            fprintf(stderr, "sim: Unhandled interrupt %d\n", irq);
+            abort();
+        }
+        mRunningPrio = prevPrio;
+        mActiveIrq = prevIrq;
+    }
+    /** @brief Performs the pending DMA transfers and runs the handlers of the
+     * pending interrupts, until there is nothing more to do at this moment
+     */
+    void settle()
+    {
+        for (uint32_t count = 0; ; count++)
+        {
+            for (auto periph: mPeriphs)
+            {
+                periph->service();
+            }
+            int irq = nextIrq();
+            if (irq < 0)
+            {
+                return;
+            }
+            if (count >= kMaxIsrsPerSettle)
+            {
+                fprintf(stderr, "sim: Interrupt storm on irq %d, the handler doesn't clear the interrupt\n", irq);
+                abort();
+            }
+            runIsr(irq);
+        }
+    }
+    /** @brief Advances the simulated time by \c cycles CPU cycles, processing
+     * all peripheral events in the meantime
+     */
+    void advance(uint64_t cycles)
+    {
+        uint64_t target = mNow + cycles;
+        settle();
+        for (;;)
+        {
+            Periph* next = nullptr;
+            uint64_t when = kNever;
+            for (auto periph: mPeriphs)
+            {
+                uint64_t t = periph->nextEvent();
+                if (t <= target && t < when)
+                {
+                    next = periph;
+                    when = t;
+                }
+            }
+            if (!next)
+            {
+                break;
+            }
+            if (when > mNow)
+            {
+                mNow = when;
+            }
+            next->onEvent(mNow);
+            settle();
+        }
+        if (target > mNow)
+        {
+            mNow = target;
+        }
+    }
+    /** @brief Advances the time until \c pred returns true
+     * @return false if \c maxCycles elapsed before that
+     */
+    template <class F>
+    bool runUntil(F pred, uint64_t maxCycles=1000000000)
+    {
+        uint64_t end = mNow + maxCycles;
+        while (!pred())
+        {
+            if (mNow >= end)
+            {
+                return false;
+            }
+            advance(16);
+        }
+        return true;
+    }
+    void reset()
+    {
+        for (auto periph: mPeriphs)
+        {
+            periph->reset();
+        }
+        mPlainRegs.clear();
+        mIrqEnabled = mIrqSetPending = 0;
+        memset(mIrqPrio, 0, sizeof(mIrqPrio));
+        for (auto& handler: mHandlers)
+        {
+            handler = nullptr;
+        }
+        resetStats();
+        mPrimask = false;
+        mRunningPrio = 0x100;
+        mActiveIrq = -1;
+    }
+};
+
+Reg::~Reg()
+{
+    if (!mUsed)
+    {
+        kernel().cpuRead(mAddr);
+    }
+}
+Reg::operator uint32_t() const
+{
+    mUsed = true;
+    return kernel().cpuRead(mAddr);
+}
+Reg& Reg::operator=(uint32_t val)
+{
+    mUsed = true;
+    kernel().cpuWrite(mAddr, val);
+    return *this;
+}
+
+/** @brief Convenience wrappers of the kernel methods */
+static inline uint64_t now() { return kernel().now(); }
+static inline void run(uint64_t cycles) { kernel().advance(cycles); }
+template <class F>
+static inline bool runUntil(F pred, uint64_t maxCycles=1000000000) { return kernel().runUntil(pred, maxCycles); }
+static inline uint32_t isrCount(uint8_t irq) { return kernel().isrCount(irq); }
+static inline void setIrqHandler(uint8_t irq, std::function<void()> handler)
+{
+    kernel().setIrqHandler(irq, handler);
+}
+}
+
+/** @brief The address of a buffer as seen by the DMA controller */
+static inline uint32_t busAddress(const volatile void* ptr) { return sim::kernel().busAddress(ptr); }
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ * Simulated SPI controllers, with the libopencm3 API
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_SIM_SPI_HPP
+#define STM32PP_SIM_SPI_HPP
+
+#include "simDma.hpp"
+#include <vector>
+
+#define SPI1_BASE               (PERIPH_BASE_APB2 + 0x3000)
+#define SPI2_BASE               (PERIPH_BASE_APB1 + 0x3800)
+#define SPI1 SPI1_BASE
+#define SPI2 SPI2_BASE
+
+#define SPI_CR1(spi_base)       MMIO32((spi_base) + 0x00)
+#define SPI_CR2(spi_base)       MMIO32((spi_base) + 0x04)
+#define SPI_SR(spi_base)        MMIO32((spi_base) + 0x08)
+#define SPI_DR(spi_base)        MMIO32((spi_base) + 0x0c)
+#define SPI1_DR                 SPI_DR(SPI1_BASE)
+#define SPI2_DR                 SPI_DR(SPI2_BASE)
+
+#define SPI_CR1_CPHA            (1 << 0)
+#define SPI_CR1_CPOL            (1 << 1)
+#define SPI_CR1_MSTR            (1 << 2)
+#define SPI_CR1_BR_SHIFT        3
+#define SPI_CR1_SPE             (1 << 6)
+#define SPI_CR1_LSBFIRST        (1 << 7)
+#define SPI_CR1_MSBFIRST        0
+#define SPI_CR1_SSI             (1 << 8)
+#define SPI_CR1_SSM             (1 << 9)
+#define SPI_CR1_RXONLY          (1 << 10)
+#define SPI_CR1_DFF             (1 << 11)
+#define SPI_CR1_DFF_8BIT        0
+#define SPI_CR1_DFF_16BIT       SPI_CR1_DFF
+#define SPI_CR1_CRCNEXT         (1 << 12)
+#define SPI_CR1_CRCEN           (1 << 13)
+#define SPI_CR1_BIDIOE          (1 << 14)
+#define SPI_CR1_BIDIMODE        (1 << 15)
+#define SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE 0
+#define SPI_CR1_CPOL_CLK_TO_1_WHEN_IDLE SPI_CR1_CPOL
+#define SPI_CR1_CPHA_CLK_TRANSITION_1 0
+#define SPI_CR1_CPHA_CLK_TRANSITION_2 SPI_CR1_CPHA
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_2   (0x00 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_4   (0x01 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_8   (0x02 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_16  (0x03 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_32  (0x04 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_64  (0x05 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_128 (0x06 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_256 (0x07 << 3)
+
+#define SPI_CR2_RXDMAEN         (1 << 0)
+#define SPI_CR2_TXDMAEN         (1 << 1)
+#define SPI_CR2_SSOE            (1 << 2)
+#define SPI_CR2_ERRIE           (1 << 5)
+#define SPI_CR2_RXNEIE          (1 << 6)
+#define SPI_CR2_TXEIE           (1 << 7)
+
+#define SPI_SR_RXNE             (1 << 0)
+#define SPI_SR_TXE              (1 << 1)
+#define SPI_SR_UDR              (1 << 3)
+#define SPI_SR_CRCERR           (1 << 4)
+#define SPI_SR_MODF             (1 << 5)
+#define SPI_SR_OVR              (1 << 6)
+#define SPI_SR_BSY              (1 << 7)
+
+static inline void spi_reset(uint32_t spi)
+{
+    SPI_CR1(spi) = 0;
+    SPI_CR2(spi) = 0;
+}
+static inline int spi_init_master(uint32_t spi, uint32_t br, uint32_t cpol, uint32_t cpha,
+    uint32_t dff, uint32_t lsbfirst)
+{
+    uint32_t reg32 = SPI_CR1(spi) & (SPI_CR1_SPE | SPI_CR1_CRCEN | SPI_CR1_CRCNEXT);
+    reg32 |= SPI_CR1_MSTR | br | cpol | cpha | dff | lsbfirst;
+    SPI_CR2(spi) |= SPI_CR2_SSOE;
+    SPI_CR1(spi) = reg32;
+    return 0;
+}
+static inline void spi_enable(uint32_t spi) { SPI_CR1(spi) |= SPI_CR1_SPE; }
+static inline void spi_disable(uint32_t spi) { SPI_CR1(spi) &= ~SPI_CR1_SPE; }
+static inline void spi_write(uint32_t spi, uint16_t data) { SPI_DR(spi) = data; }
+static inline void spi_send(uint32_t spi, uint16_t data)
+{
+    while (!(SPI_SR(spi) & SPI_SR_TXE));
+    SPI_DR(spi) = data;
+}
+static inline uint16_t spi_read(uint32_t spi)
+{
+    while (!(SPI_SR(spi) & SPI_SR_RXNE));
+    return SPI_DR(spi);
+}
+static inline uint16_t spi_xfer(uint32_t spi, uint16_t data)
+{
+    spi_write(spi, data);
+    return spi_read(spi);
+}
+static inline void spi_enable_ss_output(uint32_t spi) { SPI_CR2(spi) |= SPI_CR2_SSOE; }
+static inline void spi_disable_ss_output(uint32_t spi) { SPI_CR2(spi) &= ~SPI_CR2_SSOE; }
+static inline void spi_enable_software_slave_management(uint32_t spi) { SPI_CR1(spi) |= SPI_CR1_SSM; }
+static inline void spi_set_nss_high(uint32_t spi) { SPI_CR1(spi) |= SPI_CR1_SSI; }
+static inline void spi_enable_tx_dma(uint32_t spi) { SPI_CR2(spi) |= SPI_CR2_TXDMAEN; }
+static inline void spi_disable_tx_dma(uint32_t spi) { SPI_CR2(spi) &= ~SPI_CR2_TXDMAEN; }
+static inline void spi_enable_rx_dma(uint32_t spi) { SPI_CR2(spi) |= SPI_CR2_RXDMAEN; }
+static inline void spi_disable_rx_dma(uint32_t spi) { SPI_CR2(spi) &= ~SPI_CR2_RXDMAEN; }
+static inline void spi_enable_rx_buffer_not_empty_interrupt(uint32_t spi) { SPI_CR2(spi) |= SPI_CR2_RXNEIE; }
+static inline void spi_enable_tx_buffer_empty_interrupt(uint32_t spi) { SPI_CR2(spi) |= SPI_CR2_TXEIE; }
+
+namespace sim
+{
+/** @brief SPI controller in master mode. The frames sent by the master are
+ * collected in mosi(), and the slave's response to each of them is given by
+ * the \c slave function, or is 0xff (0xffff for 16-bit frames) if it is not
+ * set
+ */
+class Spi: public Periph
+{
+public:
+    std::function<uint16_t(uint16_t mosi)> slave;
+protected:
+    uint8_t mIrq;
+    uint8_t mDmaTxChan;
+    uint8_t mDmaRxChan;
+    bool mOnApb2;
+    uint32_t mCr1 = 0;
+    uint32_t mCr2 = 0;
+    uint32_t mSr = SPI_SR_TXE;
+    uint16_t mRdr = 0;
+    int mTdr = -1;
+    int mShift = -1;
+    uint64_t mDone = kNever;
+    std::vector<uint16_t> mMosi;
+    bool enabled() const { return (mCr1 & (SPI_CR1_SPE | SPI_CR1_MSTR)) == (SPI_CR1_SPE | SPI_CR1_MSTR); }
+    uint64_t frameTime() const
+    {
+        uint32_t div = 2 << ((mCr1 >> SPI_CR1_BR_SHIFT) & 7);
+        uint32_t bits = (mCr1 & SPI_CR1_DFF) ? 16 : 8;
+        return Clocks<>::toCpuCycles(bits * div, mOnApb2 ? Clocks<>::apb2 : Clocks<>::apb1);
+    }
+    void startFrame(uint16_t data)
+    {
+        mShift = data;
+        mDone = kernel().now() + frameTime();
+        mSr |= SPI_SR_BSY;
+    }
+public:
+    Spi(const char* aName, uint32_t aBase, uint8_t irq, uint8_t dmaTxChan, uint8_t dmaRxChan)
+    : Periph(aName, aBase, 0x400), mIrq(irq), mDmaTxChan(dmaTxChan), mDmaRxChan(dmaRxChan),
+      mOnApb2(aBase == SPI1_BASE)
+    {}
+    /** @brief The frames sent by the master so far */
+    const std::vector<uint16_t>& mosi() const { return mMosi; }
+    void clearMosi() { mMosi.clear(); }
+    virtual void reset()
+    {
+        mCr1 = mCr2 = 0;
+        mSr = SPI_SR_TXE;
+        mRdr = 0;
+        mTdr = mShift = -1;
+        mDone = kNever;
+        mMosi.clear();
+    }
+    virtual uint32_t read(uint32_t offset)
+    {
+        switch (offset)
+        {
+            case 0x00: return mCr1;
+            case 0x04: return mCr2;
+            case 0x08: return mSr;
+            case 0x0c:
+                mSr &= ~(SPI_SR_RXNE | SPI_SR_OVR);
+                return mRdr;
+            default: return 0;
+        }
+    }
+    virtual void write(uint32_t offset, uint32_t val)
+    {
+        switch (offset)
+        {
+            case 0x00:
+                mCr1 = val & 0xffff;
+                if (!(mCr1 & SPI_CR1_SPE))
+                {
+                    mTdr = mShift = -1;
+                    mDone = kNever;
+                    mSr = (mSr & ~SPI_SR_BSY) | SPI_SR_TXE;
+                }
+                break;
+            case 0x04: mCr2 = val & 0xff; break;
+            case 0x0c:
+                if (!enabled())
+                {
+                    break;
+                }
+                val &= (mCr1 & SPI_CR1_DFF) ? 0xffff : 0xff;
+                if (mShift < 0)
+                {
+                    startFrame(val);
+                }
+                else
+                {
+                    mTdr = val;
+                    mSr &= ~SPI_SR_TXE;
+                }
+                break;
+            default: break;
+        }
+    }
+    virtual uint64_t nextEvent() const { return mDone; }
+    virtual void onEvent(uint64_t)
+    {
+        mMosi.push_back(mShift);
+        uint16_t miso = slave ? slave(mShift) : ((mCr1 & SPI_CR1_DFF) ? 0xffff : 0xff);
+        if (mSr & SPI_SR_RXNE)
+        {
+            mSr |= SPI_SR_OVR;
+        }
+        else
+        {
+            mRdr = miso;
+            mSr |= SPI_SR_RXNE;
+        }
+        mShift = -1;
+        mDone = kNever;
+        if (mTdr >= 0)
+        {
+            startFrame(mTdr);
+            mTdr = -1;
+            mSr |= SPI_SR_TXE;
+        }
+        else
+        {
+            mSr &= ~SPI_SR_BSY;
+        }
+    }
+    virtual uint64_t irqs() const
+    {
+        bool active = ((mCr2 & SPI_CR2_TXEIE) && (mSr & SPI_SR_TXE)) ||
+            ((mCr2 & SPI_CR2_RXNEIE) && (mSr & SPI_SR_RXNE)) ||
+            ((mCr2 & SPI_CR2_ERRIE) && (mSr & SPI_SR_OVR));
+        return (enabled() && active) ? (1ull << mIrq) : 0;
+    }
+    virtual bool dmaRequest(uint32_t dma, uint8_t chan) const
+    {
+        if (dma != DMA1 || !enabled())
+        {
+            return false;
+        }
+        if (chan == mDmaTxChan)
+        {
+            return (mCr2 & SPI_CR2_TXDMAEN) && (mSr & SPI_SR_TXE);
+        }
+        if (chan == mDmaRxChan)
+        {
+            return (mCr2 & SPI_CR2_RXDMAEN) && (mSr & SPI_SR_RXNE);
+        }
+        return false;
+    }
+};
+}
+#endif
@@ -0,0 +1,416 @@
+/**
+ * Simulated core peripherals (NVIC, PRIMASK, DWT), RCC, flash interface
+ * and GPIO, with the libopencm3 API
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_SIM_SYSTEM_HPP
+#define STM32PP_SIM_SYSTEM_HPP
+
+#include "simKernel.hpp"
+
+// Base addresses
+#define PERIPH_BASE             0x40000000U
+#define PERIPH_BASE_APB1        (PERIPH_BASE + 0x00000)
+#define PERIPH_BASE_APB2        (PERIPH_BASE + 0x10000)
+#define PERIPH_BASE_AHB         (PERIPH_BASE + 0x18000)
+#define GPIO_PORT_A_BASE        (PERIPH_BASE_APB2 + 0x0800)
+#define GPIO_PORT_B_BASE        (PERIPH_BASE_APB2 + 0x0c00)
+#define GPIO_PORT_C_BASE        (PERIPH_BASE_APB2 + 0x1000)
+#define GPIO_PORT_D_BASE        (PERIPH_BASE_APB2 + 0x1400)
+#define GPIO_PORT_E_BASE        (PERIPH_BASE_APB2 + 0x1800)
+#define GPIO_PORT_F_BASE        (PERIPH_BASE_APB2 + 0x1c00)
+#define GPIO_PORT_G_BASE        (PERIPH_BASE_APB2 + 0x2000)
+#define RCC_BASE                (PERIPH_BASE_AHB + 0x9000)
+#define FLASH_MEM_INTERFACE_BASE (PERIPH_BASE_AHB + 0xa000)
+#define DWT_BASE                0xE0001000U
+
+// NVIC
+#define NVIC_WWDG_IRQ 0
+#define NVIC_DMA1_CHANNEL1_IRQ 11
+#define NVIC_DMA1_CHANNEL2_IRQ 12
+#define NVIC_DMA1_CHANNEL3_IRQ 13
+#define NVIC_DMA1_CHANNEL4_IRQ 14
+#define NVIC_DMA1_CHANNEL5_IRQ 15
+#define NVIC_DMA1_CHANNEL6_IRQ 16
+#define NVIC_DMA1_CHANNEL7_IRQ 17
+#define NVIC_ADC1_2_IRQ 18
+#define NVIC_TIM2_IRQ 28
+#define NVIC_TIM3_IRQ 29
+#define NVIC_TIM4_IRQ 30
+#define NVIC_I2C1_EV_IRQ 31
+#define NVIC_I2C1_ER_IRQ 32
+#define NVIC_I2C2_EV_IRQ 33
+#define NVIC_I2C2_ER_IRQ 34
+#define NVIC_SPI1_IRQ 35
+#define NVIC_SPI2_IRQ 36
+#define NVIC_USART1_IRQ 37
+#define NVIC_USART2_IRQ 38
+#define NVIC_USART3_IRQ 39
+#define NVIC_ADC3_IRQ 47
+#define NVIC_DMA2_CHANNEL1_IRQ 56
+#define NVIC_DMA2_CHANNEL2_IRQ 57
+#define NVIC_DMA2_CHANNEL3_IRQ 58
+#define NVIC_DMA2_CHANNEL4_5_IRQ 59
+#define NVIC_DMA2_CHANNEL5_IRQ 60
+
+// Interrupt vectors, defined by the application as with libopencm3
+extern "C" {
+void wwdg_isr(void) __attribute__((weak));
+void pvd_isr(void) __attribute__((weak));
+void tamper_isr(void) __attribute__((weak));
+void rtc_isr(void) __attribute__((weak));
+void flash_isr(void) __attribute__((weak));
+void rcc_isr(void) __attribute__((weak));
+void exti0_isr(void) __attribute__((weak));
+void exti1_isr(void) __attribute__((weak));
+void exti2_isr(void) __attribute__((weak));
+void exti3_isr(void) __attribute__((weak));
+void exti4_isr(void) __attribute__((weak));
+void dma1_channel1_isr(void) __attribute__((weak));
+void dma1_channel2_isr(void) __attribute__((weak));
+void dma1_channel3_isr(void) __attribute__((weak));
+void dma1_channel4_isr(void) __attribute__((weak));
+void dma1_channel5_isr(void) __attribute__((weak));
+void dma1_channel6_isr(void) __attribute__((weak));
+void dma1_channel7_isr(void) __attribute__((weak));
+void adc1_2_isr(void) __attribute__((weak));
+void usb_hp_can_tx_isr(void) __attribute__((weak));
+void usb_lp_can_rx0_isr(void) __attribute__((weak));
+void can_rx1_isr(void) __attribute__((weak));
+void can_sce_isr(void) __attribute__((weak));
+void exti9_5_isr(void) __attribute__((weak));
+void tim1_brk_isr(void) __attribute__((weak));
+void tim1_up_isr(void) __attribute__((weak));
+void tim1_trg_com_isr(void) __attribute__((weak));
+void tim1_cc_isr(void) __attribute__((weak));
+void tim2_isr(void) __attribute__((weak));
+void tim3_isr(void) __attribute__((weak));
+void tim4_isr(void) __attribute__((weak));
+void i2c1_ev_isr(void) __attribute__((weak));
+void i2c1_er_isr(void) __attribute__((weak));
+void i2c2_ev_isr(void) __attribute__((weak));
+void i2c2_er_isr(void) __attribute__((weak));
+void spi1_isr(void) __attribute__((weak));
+void spi2_isr(void) __attribute__((weak));
+void usart1_isr(void) __attribute__((weak));
+void usart2_isr(void) __attribute__((weak));
+void usart3_isr(void) __attribute__((weak));
+void exti15_10_isr(void) __attribute__((weak));
+void rtc_alarm_isr(void) __attribute__((weak));
+void usb_wakeup_isr(void) __attribute__((weak));
+void tim8_brk_isr(void) __attribute__((weak));
+void tim8_up_isr(void) __attribute__((weak));
+void tim8_trg_com_isr(void) __attribute__((weak));
+void tim8_cc_isr(void) __attribute__((weak));
+void adc3_isr(void) __attribute__((weak));
+void fsmc_isr(void) __attribute__((weak));
+void sdio_isr(void) __attribute__((weak));
+void tim5_isr(void) __attribute__((weak));
+void spi3_isr(void) __attribute__((weak));
+void uart4_isr(void) __attribute__((weak));
+void uart5_isr(void) __attribute__((weak));
+void tim6_isr(void) __attribute__((weak));
+void tim7_isr(void) __attribute__((weak));
+void dma2_channel1_isr(void) __attribute__((weak));
+void dma2_channel2_isr(void) __attribute__((weak));
+void dma2_channel3_isr(void) __attribute__((weak));
+void dma2_channel4_5_isr(void) __attribute__((weak));
+void dma2_channel5_isr(void) __attribute__((weak));
+}
+
+namespace sim
+{
+static inline IsrFunc vector(uint8_t irq)
+{
+    static const IsrFunc vectors[] = {
+        wwdg_isr, pvd_isr, tamper_isr, rtc_isr, flash_isr, rcc_isr, exti0_isr,
+        exti1_isr, exti2_isr, exti3_isr, exti4_isr, dma1_channel1_isr,
+        dma1_channel2_isr, dma1_channel3_isr, dma1_channel4_isr, dma1_channel5_isr,
+        dma1_channel6_isr, dma1_channel7_isr, adc1_2_isr, usb_hp_can_tx_isr,
+        usb_lp_can_rx0_isr, can_rx1_isr, can_sce_isr, exti9_5_isr, tim1_brk_isr,
+        tim1_up_isr, tim1_trg_com_isr, tim1_cc_isr, tim2_isr, tim3_isr, tim4_isr,
+        i2c1_ev_isr, i2c1_er_isr, i2c2_ev_isr, i2c2_er_isr, spi1_isr, spi2_isr,
+        usart1_isr, usart2_isr, usart3_isr, exti15_10_isr, rtc_alarm_isr,
+        usb_wakeup_isr, tim8_brk_isr, tim8_up_isr, tim8_trg_com_isr, tim8_cc_isr,
+        adc3_isr, fsmc_isr, sdio_isr, tim5_isr, spi3_isr, uart4_isr, uart5_isr,
+        tim6_isr, tim7_isr, dma2_channel1_isr, dma2_channel2_isr, dma2_channel3_isr,
+        dma2_channel4_5_isr, dma2_channel5_isr
+    };
+    return (irq < sizeof(vectors) / sizeof(vectors[0])) ? vectors[irq] : nullptr;
+}
+}
+
+static inline void nvic_enable_irq(uint8_t irqn) { sim::kernel().irqEnable(irqn); }
+static inline void nvic_disable_irq(uint8_t irqn) { sim::kernel().irqDisable(irqn); }
+static inline uint8_t nvic_get_irq_enabled(uint8_t irqn) { return sim::kernel().irqIsEnabled(irqn); }
+static inline void nvic_set_pending_irq(uint8_t irqn) { sim::kernel().irqSetPending(irqn); }
+static inline void nvic_clear_pending_irq(uint8_t irqn) { sim::kernel().irqClearPending(irqn); }
+static inline void nvic_set_priority(uint8_t irqn, uint8_t priority) { sim::kernel().irqSetPriority(irqn, priority); }
+
+// PRIMASK
+static inline void cm_disable_interrupts(void) { sim::kernel().setPrimask(true); }
+static inline void cm_enable_interrupts(void) { sim::kernel().setPrimask(false); }
+static inline bool cm_is_masked_interrupts(void) { return sim::kernel().primask(); }
+
+// DWT
+#define DWT_CTRL                MMIO32(DWT_BASE + 0x00)
+#define DWT_CYCCNT              MMIO32(DWT_BASE + 0x04)
+#define DWT_CTRL_CYCCNTENA      (1 << 0)
+static inline bool dwt_enable_cycle_counter(void) { return true; }
+static inline uint32_t dwt_read_cycle_counter(void) { return DWT_CYCCNT; }
+
+// RCC
+#define rcc_ahb_frequency sim::Clocks<>::ahb
+#define rcc_apb1_frequency sim::Clocks<>::apb1
+#define rcc_apb2_frequency sim::Clocks<>::apb2
+
+#define RCC_CR                  MMIO32(RCC_BASE + 0x00)
+#define RCC_CFGR                MMIO32(RCC_BASE + 0x04)
+#define RCC_CFGR_SW_SYSCLKSEL_HSICLK 0x0
+#define RCC_CFGR_SW_SYSCLKSEL_HSECLK 0x1
+#define RCC_CFGR_SW_SYSCLKSEL_PLLCLK 0x2
+#define RCC_CFGR_HPRE_SYSCLK_NODIV 0x0
+#define RCC_CFGR_PPRE1_HCLK_NODIV 0x0
+#define RCC_CFGR_PPRE1_HCLK_DIV2 0x4
+#define RCC_CFGR_PPRE2_HCLK_NODIV 0x0
+#define RCC_CFGR_PPRE2_HCLK_DIV2 0x4
+#define RCC_CFGR_ADCPRE_SHIFT   14
+#define RCC_CFGR_ADCPRE         (3 << RCC_CFGR_ADCPRE_SHIFT)
+#define RCC_CFGR_ADCPRE_PCLK2_DIV2 0x0
+#define RCC_CFGR_ADCPRE_PCLK2_DIV4 0x1
+#define RCC_CFGR_ADCPRE_PCLK2_DIV6 0x2
+#define RCC_CFGR_ADCPRE_PCLK2_DIV8 0x3
+#define RCC_CFGR_PLLSRC_HSI_CLK_DIV2 0x0
+#define RCC_CFGR_PLLSRC_HSE_CLK 0x1
+#define RCC_CFGR_PLLXTPRE_HSE_CLK 0x0
+#define RCC_CFGR_PLLXTPRE_HSE_CLK_DIV2 0x1
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL7 0x5
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL9 0x7
+
+enum rcc_osc { RCC_PLL, RCC_HSE, RCC_HSI, RCC_LSE, RCC_LSI };
+enum rcc_periph_clken {
+    RCC_DMA1, RCC_DMA2, RCC_SRAM, RCC_FLTF, RCC_CRC, RCC_FSMC, RCC_SDIO,
+    RCC_AFIO, RCC_GPIOA, RCC_GPIOB, RCC_GPIOC, RCC_GPIOD, RCC_GPIOE, RCC_GPIOF,
+    RCC_GPIOG, RCC_ADC1, RCC_ADC2, RCC_TIM1, RCC_SPI1, RCC_TIM8, RCC_USART1,
+    RCC_ADC3, RCC_TIM2, RCC_TIM3, RCC_TIM4, RCC_TIM5, RCC_TIM6, RCC_TIM7,
+    RCC_WWDG, RCC_SPI2, RCC_SPI3, RCC_USART2, RCC_USART3, RCC_UART4, RCC_UART5,
+    RCC_I2C1, RCC_I2C2, RCC_USB, RCC_CAN, RCC_BKP, RCC_PWR, RCC_DAC,
+    kRccNumClocks
+};
+enum rcc_periph_rst {
+    RST_AFIO, RST_GPIOA, RST_GPIOB, RST_GPIOC, RST_GPIOD, RST_GPIOE, RST_GPIOF,
+    RST_GPIOG, RST_ADC1, RST_ADC2, RST_TIM1, RST_SPI1, RST_TIM8, RST_USART1,
+    RST_ADC3, RST_TIM2, RST_TIM3, RST_TIM4, RST_SPI2, RST_USART2, RST_USART3,
+    RST_I2C1, RST_I2C2
+};
+
+namespace sim
+{
+template <class T=void>
+struct RccState
+{
+    static uint64_t clocksEnabled;
+};
+template <class T> uint64_t RccState<T>::clocksEnabled = 0;
+
+/** @brief Whether the application has enabled the clock of a peripheral */
+static inline bool clockEnabled(rcc_periph_clken clken) { return RccState<>::clocksEnabled & (1ull << clken); }
+}
+
+static inline void rcc_periph_clock_enable(rcc_periph_clken clken) { sim::RccState<>::clocksEnabled |= (1ull << clken); }
+static inline void rcc_periph_clock_disable(rcc_periph_clken clken) { sim::RccState<>::clocksEnabled &= ~(1ull << clken); }
+static inline void rcc_periph_reset_pulse(rcc_periph_rst) {}
+static inline void rcc_osc_on(rcc_osc) {}
+static inline void rcc_osc_off(rcc_osc) {}
+static inline void rcc_wait_for_osc_ready(rcc_osc) {}
+static inline void rcc_set_sysclk_source(uint32_t) {}
+static inline void rcc_set_hpre(uint32_t) {}
+static inline void rcc_set_ppre1(uint32_t) {}
+static inline void rcc_set_ppre2(uint32_t) {}
+static inline void rcc_set_pll_multiplication_factor(uint32_t) {}
+static inline void rcc_set_pll_source(uint32_t) {}
+static inline void rcc_set_pllxtpre(uint32_t) {}
+static inline void rcc_set_adcpre(uint32_t adcpre)
+{
+    RCC_CFGR = (RCC_CFGR & ~RCC_CFGR_ADCPRE) | (adcpre << RCC_CFGR_ADCPRE_SHIFT);
+}
+static inline void rcc_clock_setup_in_hse_8mhz_out_72mhz(void)
+{
+    rcc_ahb_frequency = 72000000;
+    rcc_apb1_frequency = 36000000;
+    rcc_apb2_frequency = 72000000;
+}
+static inline void rcc_clock_setup_in_hsi_out_48mhz(void)
+{
+    rcc_ahb_frequency = 48000000;
+    rcc_apb1_frequency = 24000000;
+    rcc_apb2_frequency = 48000000;
+}
+
+// Flash interface
+#define FLASH_ACR               MMIO32(FLASH_MEM_INTERFACE_BASE + 0x00)
+#define FLASH_ACR_LATENCY_0WS   0x00
+#define FLASH_ACR_LATENCY_1WS   0x01
+#define FLASH_ACR_LATENCY_2WS   0x02
+static inline void flash_set_ws(uint32_t ws) { FLASH_ACR = ws; }
+
+// GPIO
+#define GPIOA GPIO_PORT_A_BASE
+#define GPIOB GPIO_PORT_B_BASE
+#define GPIOC GPIO_PORT_C_BASE
+#define GPIOD GPIO_PORT_D_BASE
+#define GPIOE GPIO_PORT_E_BASE
+#define GPIOF GPIO_PORT_F_BASE
+#define GPIOG GPIO_PORT_G_BASE
+#define GPIO_CRL(port)          MMIO32((port) + 0x00)
+#define GPIO_CRH(port)          MMIO32((port) + 0x04)
+#define GPIO_IDR(port)          MMIO32((port) + 0x08)
+#define GPIO_ODR(port)          MMIO32((port) + 0x0c)
+#define GPIO_BSRR(port)         MMIO32((port) + 0x10)
+#define GPIO_BRR(port)          MMIO32((port) + 0x14)
+#define GPIO0 (1 << 0)
+#define GPIO1 (1 << 1)
+#define GPIO2 (1 << 2)
+#define GPIO3 (1 << 3)
+#define GPIO4 (1 << 4)
+#define GPIO5 (1 << 5)
+#define GPIO6 (1 << 6)
+#define GPIO7 (1 << 7)
+#define GPIO8 (1 << 8)
+#define GPIO9 (1 << 9)
+#define GPIO10 (1 << 10)
+#define GPIO11 (1 << 11)
+#define GPIO12 (1 << 12)
+#define GPIO13 (1 << 13)
+#define GPIO14 (1 << 14)
+#define GPIO15 (1 << 15)
+#define GPIO_ALL 0xffff
+#define GPIO_MODE_INPUT         0x00
+#define GPIO_MODE_OUTPUT_10_MHZ 0x01
+#define GPIO_MODE_OUTPUT_2_MHZ  0x02
+#define GPIO_MODE_OUTPUT_50_MHZ 0x03
+#define GPIO_CNF_INPUT_ANALOG   0x00
+#define GPIO_CNF_INPUT_FLOAT    0x01
+#define GPIO_CNF_INPUT_PULL_UPDOWN 0x02
+#define GPIO_CNF_OUTPUT_PUSHPULL 0x00
+#define GPIO_CNF_OUTPUT_OPENDRAIN 0x01
+#define GPIO_CNF_OUTPUT_ALTFN_PUSHPULL 0x02
+#define GPIO_CNF_OUTPUT_ALTFN_OPENDRAIN 0x03
+#define GPIO_USART1_TX GPIO9
+#define GPIO_USART1_RX GPIO10
+#define GPIO_USART2_TX GPIO2
+#define GPIO_USART2_RX GPIO3
+#define GPIO_USART3_TX GPIO10
+#define GPIO_USART3_RX GPIO11
+#define GPIO_SPI1_NSS GPIO4
+#define GPIO_SPI1_SCK GPIO5
+#define GPIO_SPI1_MISO GPIO6
+#define GPIO_SPI1_MOSI GPIO7
+#define GPIO_SPI2_NSS GPIO12
+#define GPIO_SPI2_SCK GPIO13
+#define GPIO_SPI2_MISO GPIO14
+#define GPIO_SPI2_MOSI GPIO15
+#define GPIO_I2C1_SCL GPIO6
+#define GPIO_I2C1_SDA GPIO7
+#define GPIO_I2C2_SCL GPIO10
+#define GPIO_I2C2_SDA GPIO11
+
+static inline void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios)
+{
+    uint32_t crl = GPIO_CRL(gpioport);
+    uint32_t crh = GPIO_CRH(gpioport);
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        if ((gpios & (1 << i)) == 0)
+        {
+            continue;
+        }
+        uint32_t& reg = (i < 8) ? crl : crh;
+        uint8_t shift = (i % 8) * 4;
+        reg = (reg & ~(0xf << shift)) | (((cnf << 2) | mode) << shift);
+    }
+    GPIO_CRL(gpioport) = crl;
+    GPIO_CRH(gpioport) = crh;
+}
+static inline void gpio_set(uint32_t gpioport, uint16_t gpios) { GPIO_BSRR(gpioport) = gpios; }
+static inline void gpio_clear(uint32_t gpioport, uint16_t gpios) { GPIO_BSRR(gpioport) = (gpios << 16); }
+static inline uint16_t gpio_get(uint32_t gpioport, uint16_t gpios) { return GPIO_IDR(gpioport) & gpios; }
+static inline void gpio_toggle(uint32_t gpioport, uint16_t gpios)
+{
+    uint32_t port = GPIO_ODR(gpioport);
+    GPIO_BSRR(gpioport) = ((port & gpios) << 16) | (~port & gpios);
+}
+
+namespace sim
+{
+/** @brief GPIO port. Output pins are read back in IDR, and the levels of
+ * input pins are set by the test via setInput()
+ */
+class Gpio: public Periph
+{
+protected:
+    uint32_t mCr[2];
+    uint16_t mOdr = 0;
+    uint16_t mInput = 0;
+    bool isOutput(uint8_t pin) const { return (mCr[pin / 8] >> ((pin % 8) * 4)) & 0x3; }
+public:
+    Gpio(const char* aName, uint32_t aBase): Periph(aName, aBase, 0x400) { reset(); }
+    virtual void reset() { mCr[0] = mCr[1] = 0x44444444; mOdr = mInput = 0; }
+    void setInput(uint16_t pins, bool high)
+    {
+        mInput = high ? (mInput | pins) : (mInput & ~pins);
+    }
+    uint16_t output() const { return mOdr; }
+    uint16_t idr() const
+    {
+        uint16_t val = 0;
+        for (uint8_t pin = 0; pin < 16; pin++)
+        {
+            uint16_t mask = 1 << pin;
+            if (isOutput(pin) ? (mOdr & mask) : (mInput & mask))
+            {
+                val |= mask;
+            }
+        }
+        return val;
+    }
+    virtual uint32_t read(uint32_t offset)
+    {
+        switch (offset)
+        {
+            case 0x00: return mCr[0];
+            case 0x04: return mCr[1];
+            case 0x08: return idr();
+            case 0x0c: return mOdr;
+            default: return 0;
+        }
+    }
+    virtual void write(uint32_t offset, uint32_t val)
+    {
+        switch (offset)
+        {
+            case 0x00: mCr[0] = val; break;
+            case 0x04: mCr[1] = val; break;
+            case 0x0c: mOdr = val; break;
+            case 0x10: mOdr = (mOdr | (val & 0xffff)) & ~(val >> 16); break;
+            case 0x14: mOdr &= ~val; break;
+            default: break;
+        }
+    }
+};
+
+/** @brief DWT cycle counter, which returns the simulated time */
+class Dwt: public Periph
+{
+public:
+    Dwt(): Periph("DWT", DWT_BASE, 0x1000) {}
+    virtual uint32_t read(uint32_t offset)
+    {
+        return (offset == 0x04) ? (uint32_t)kernel().now() : DWT_CTRL_CYCCNTENA;
+    }
+    virtual void write(uint32_t, uint32_t) {}
+};
+}
+#endif
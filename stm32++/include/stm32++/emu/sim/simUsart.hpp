@@ -0,0 +1,374 @@
+/**
+ * Simulated USARTs, with the libopencm3 API
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_SIM_USART_HPP
+#define STM32PP_SIM_USART_HPP
+
+#include "simDma.hpp"
+#include <deque>
+#include <string>
+
+#define USART1_BASE             (PERIPH_BASE_APB2 + 0x3800)
+#define USART2_BASE             (PERIPH_BASE_APB1 + 0x4400)
+#define USART3_BASE             (PERIPH_BASE_APB1 + 0x4800)
+#define USART1 USART1_BASE
+#define USART2 USART2_BASE
+#define USART3 USART3_BASE
+
+#define USART_SR(usart_base)    MMIO32((usart_base) + 0x00)
+#define USART_DR(usart_base)    MMIO32((usart_base) + 0x04)
+#define USART_BRR(usart_base)   MMIO32((usart_base) + 0x08)
+#define USART_CR1(usart_base)   MMIO32((usart_base) + 0x0c)
+#define USART_CR2(usart_base)   MMIO32((usart_base) + 0x10)
+#define USART_CR3(usart_base)   MMIO32((usart_base) + 0x14)
+#define USART1_SR               USART_SR(USART1_BASE)
+#define USART1_DR               USART_DR(USART1_BASE)
+#define USART2_SR               USART_SR(USART2_BASE)
+#define USART2_DR               USART_DR(USART2_BASE)
+#define USART3_SR               USART_SR(USART3_BASE)
+#define USART3_DR               USART_DR(USART3_BASE)
+
+#define USART_SR_PE             (1 << 0)
+#define USART_SR_FE             (1 << 1)
+#define USART_SR_NE             (1 << 2)
+#define USART_SR_ORE            (1 << 3)
+#define USART_SR_IDLE           (1 << 4)
+#define USART_SR_RXNE           (1 << 5)
+#define USART_SR_TC             (1 << 6)
+#define USART_SR_TXE            (1 << 7)
+#define USART_SR_LBD            (1 << 8)
+#define USART_SR_CTS            (1 << 9)
+
+#define USART_CR1_SBK           (1 << 0)
+#define USART_CR1_RWU           (1 << 1)
+#define USART_CR1_RE            (1 << 2)
+#define USART_CR1_TE            (1 << 3)
+#define USART_CR1_IDLEIE        (1 << 4)
+#define USART_CR1_RXNEIE        (1 << 5)
+#define USART_CR1_TCIE          (1 << 6)
+#define USART_CR1_TXEIE         (1 << 7)
+#define USART_CR1_PEIE          (1 << 8)
+#define USART_CR1_PS            (1 << 9)
+#define USART_CR1_PCE           (1 << 10)
+#define USART_CR1_WAKE          (1 << 11)
+#define USART_CR1_M             (1 << 12)
+#define USART_CR1_UE            (1 << 13)
+
+#define USART_CR2_STOPBITS_MASK (3 << 12)
+
+#define USART_CR3_EIE           (1 << 0)
+#define USART_CR3_DMAR          (1 << 6)
+#define USART_CR3_DMAT          (1 << 7)
+#define USART_CR3_RTSE          (1 << 8)
+#define USART_CR3_CTSE          (1 << 9)
+
+#define USART_MODE_RX           USART_CR1_RE
+#define USART_MODE_TX           USART_CR1_TE
+#define USART_MODE_TX_RX        (USART_CR1_RE | USART_CR1_TE)
+#define USART_MODE_MASK         (USART_CR1_RE | USART_CR1_TE)
+#define USART_PARITY_NONE       0x00
+#define USART_PARITY_EVEN       USART_CR1_PCE
+#define USART_PARITY_ODD        (USART_CR1_PS | USART_CR1_PCE)
+#define USART_PARITY_MASK       (USART_CR1_PS | USART_CR1_PCE)
+#define USART_STOPBITS_1        (0x00 << 12)
+#define USART_STOPBITS_0_5      (0x01 << 12)
+#define USART_STOPBITS_2        (0x02 << 12)
+#define USART_STOPBITS_1_5      (0x03 << 12)
+#define USART_FLOWCONTROL_NONE  0x00
+#define USART_FLOWCONTROL_RTS   USART_CR3_RTSE
+#define USART_FLOWCONTROL_CTS   USART_CR3_CTSE
+#define USART_FLOWCONTROL_RTS_CTS (USART_CR3_RTSE | USART_CR3_CTSE)
+#define USART_FLOWCONTROL_MASK  (USART_CR3_RTSE | USART_CR3_CTSE)
+
+static inline void usart_set_baudrate(uint32_t usart, uint32_t baud)
+{
+    uint32_t clock = (usart == USART1) ? rcc_apb2_frequency : rcc_apb1_frequency;
+    USART_BRR(usart) = (clock + baud / 2) / baud;
+}
+static inline void usart_set_databits(uint32_t usart, uint32_t bits)
+{
+    if (bits == 8)
+    {
+        USART_CR1(usart) &= ~USART_CR1_M;
+    }
+    else
+    {
+        USART_CR1(usart) |= USART_CR1_M;
+    }
+}
+static inline void usart_set_stopbits(uint32_t usart, uint32_t stopbits)
+{
+    USART_CR2(usart) = (USART_CR2(usart) & ~USART_CR2_STOPBITS_MASK) | stopbits;
+}
+static inline void usart_set_parity(uint32_t usart, uint32_t parity)
+{
+    USART_CR1(usart) = (USART_CR1(usart) & ~USART_PARITY_MASK) | parity;
+}
+static inline void usart_set_mode(uint32_t usart, uint32_t mode)
+{
+    USART_CR1(usart) = (USART_CR1(usart) & ~USART_MODE_MASK) | mode;
+}
+static inline void usart_set_flow_control(uint32_t usart, uint32_t flowcontrol)
+{
+    USART_CR3(usart) = (USART_CR3(usart) & ~USART_FLOWCONTROL_MASK) | flowcontrol;
+}
+static inline void usart_enable(uint32_t usart) { USART_CR1(usart) |= USART_CR1_UE; }
+static inline void usart_disable(uint32_t usart) { USART_CR1(usart) &= ~USART_CR1_UE; }
+static inline void usart_send(uint32_t usart, uint16_t data) { USART_DR(usart) = data & 0x1ff; }
+static inline uint16_t usart_recv(uint32_t usart) { return USART_DR(usart) & 0x1ff; }
+static inline void usart_wait_send_ready(uint32_t usart) { while ((USART_SR(usart) & USART_SR_TXE) == 0); }
+static inline void usart_wait_recv_ready(uint32_t usart) { while ((USART_SR(usart) & USART_SR_RXNE) == 0); }
+static inline void usart_send_blocking(uint32_t usart, uint16_t data)
+{
+    usart_wait_send_ready(usart);
+    usart_send(usart, data);
+}
+static inline uint16_t usart_recv_blocking(uint32_t usart)
+{
+    usart_wait_recv_ready(usart);
+    return usart_recv(usart);
+}
+static inline void usart_enable_rx_dma(uint32_t usart) { USART_CR3(usart) |= USART_CR3_DMAR; }
+static inline void usart_disable_rx_dma(uint32_t usart) { USART_CR3(usart) &= ~USART_CR3_DMAR; }
+static inline void usart_enable_tx_dma(uint32_t usart) { USART_CR3(usart) |= USART_CR3_DMAT; }
+static inline void usart_disable_tx_dma(uint32_t usart) { USART_CR3(usart) &= ~USART_CR3_DMAT; }
+static inline void usart_enable_rx_interrupt(uint32_t usart) { USART_CR1(usart) |= USART_CR1_RXNEIE; }
+static inline void usart_disable_rx_interrupt(uint32_t usart) { USART_CR1(usart) &= ~USART_CR1_RXNEIE; }
+static inline void usart_enable_tx_interrupt(uint32_t usart) { USART_CR1(usart) |= USART_CR1_TXEIE; }
+static inline void usart_disable_tx_interrupt(uint32_t usart) { USART_CR1(usart) &= ~USART_CR1_TXEIE; }
+static inline bool usart_get_flag(uint32_t usart, uint32_t flag) { return (USART_SR(usart) & flag) != 0; }
+
+namespace sim
+{
+/** @brief USART. Transmitted characters are collected in output(), and
+ * received ones are injected by the test via inject(). Characters take one
+ * frame time (start bit, data bits, parity and stop bit) on the line, so
+ * the timing of TXE, TC, RXNE, ORE and IDLE follows the baud rate. Received
+ * characters that are not read before the next one arrives are lost, and
+ * set ORE
+ */
+class Usart: public Periph
+{
+protected:
+    uint8_t mIrq;
+    uint8_t mDmaTxChan;
+    uint8_t mDmaRxChan;
+    bool mOnApb2;
+    uint32_t mSr = USART_SR_TXE | USART_SR_TC;
+    uint32_t mSrSeen = 0; // flags seen by a SR read, which a following DR read clears
+    uint32_t mBrr = 0;
+    uint32_t mCr1 = 0;
+    uint32_t mCr2 = 0;
+    uint32_t mCr3 = 0;
+    // Transmitter
+    int mTdr = -1;
+    int mTxShift = -1;
+    uint64_t mTxDone = kNever;
+    std::string mOutput;
+    // Receiver
+    uint16_t mRdr = 0;
+    std::deque<uint8_t> mRxLine;
+    uint64_t mRxNext = kNever;
+    uint64_t mIdleAt = kNever;
+    bool enabled() const { return mCr1 & USART_CR1_UE; }
+    uint64_t frameTime() const
+    {
+        uint32_t bits = 1 + ((mCr1 & USART_CR1_M) ? 9 : 8) + 1;
+        return Clocks<>::toCpuCycles((uint64_t)bits * (mBrr ? mBrr : 1),
+            mOnApb2 ? Clocks<>::apb2 : Clocks<>::apb1);
+    }
+    void startTx(uint8_t data)
+    {
+        mTxShift = data;
+        mTxDone = kernel().now() + frameTime();
+        mSr &= ~USART_SR_TC;
+    }
+public:
+    Usart(const char* aName, uint32_t aBase, uint8_t irq, uint8_t dmaTxChan, uint8_t dmaRxChan)
+    : Periph(aName, aBase, 0x400), mIrq(irq), mDmaTxChan(dmaTxChan), mDmaRxChan(dmaRxChan),
+      mOnApb2(aBase == USART1_BASE)
+    {}
+    /** @brief The characters transmitted so far */
+    const std::string& output() const { return mOutput; }
+    void clearOutput() { mOutput.clear(); }
+    /** @brief Starts the reception of \c data, as sent by the remote end
+     * right now, or after the previously injected data
+     */
+    void inject(const char* data, size_t len)
+    {
+        if (mRxLine.empty())
+        {
+            mRxNext = kernel().now() + frameTime();
+        }
+        mRxLine.insert(mRxLine.end(), data, data + len);
+        mIdleAt = kNever;
+    }
+    void inject(const char* str) { inject(str, strlen(str)); }
+    /** @brief Whether all injected data was received */
+    bool rxDone() const { return mRxLine.empty(); }
+    virtual void reset()
+    {
+        mSr = USART_SR_TXE | USART_SR_TC;
+        mSrSeen = mBrr = mCr1 = mCr2 = mCr3 = 0;
+        mTdr = mTxShift = -1;
+        mTxDone = mRxNext = mIdleAt = kNever;
+        mOutput.clear();
+        mRxLine.clear();
+        mRdr = 0;
+    }
+    virtual uint32_t read(uint32_t offset)
+    {
+        switch (offset)
+        {
+            case 0x00:
+                mSrSeen = mSr;
+                return mSr;
+            case 0x04:
+                mSr &= ~(USART_SR_RXNE | (mSrSeen & (USART_SR_IDLE | USART_SR_ORE)));
+                mSrSeen = 0;
+                return mRdr;
+            case 0x08: return mBrr;
+            case 0x0c: return mCr1;
+            case 0x10: return mCr2;
+            case 0x14: return mCr3;
+            default: return 0;
+        }
+    }
+    virtual void write(uint32_t offset, uint32_t val)
+    {
+        switch (offset)
+        {
+            case 0x00:
+                // RXNE and TC are cleared by writing 0
+                mSr &= (val | ~(USART_SR_RXNE | USART_SR_TC));
+                break;
+            case 0x04:
+                if (!enabled() || !(mCr1 & USART_CR1_TE))
+                {
+                    break;
+                }
+                if (mTxShift < 0)
+                {
+                    startTx(val);
+                }
+                else
+                {
+                    mTdr = val & 0xff;
+                    mSr &= ~USART_SR_TXE;
+                }
+                break;
+            case 0x08: mBrr = val & 0xffff; break;
+            case 0x0c:
+                mCr1 = val & 0x3fff;
+                if (!enabled())
+                {
+                    mTdr = mTxShift = -1;
+                    mTxDone = kNever;
+                    mSr |= USART_SR_TXE | USART_SR_TC;
+                }
+                break;
+            case 0x10: mCr2 = val; break;
+            case 0x14: mCr3 = val; break;
+            default: break;
+        }
+    }
+    virtual uint64_t nextEvent() const
+    {
+        uint64_t next = mTxDone;
+        if (mRxNext < next)
+        {
+            next = mRxNext;
+        }
+        if (mIdleAt < next)
+        {
+            next = mIdleAt;
+        }
+        return next;
+    }
+    virtual void onEvent(uint64_t now)
+    {
+        if (mTxDone <= now)
+        {
+            mOutput.push_back((char)mTxShift);
+            mTxShift = -1;
+            mTxDone = kNever;
+            if (mTdr >= 0)
+            {
+                startTx(mTdr);
+                mTdr = -1;
+                mSr |= USART_SR_TXE;
+            }
+            else
+            {
+                mSr |= USART_SR_TC;
+            }
+        }
+        if (mRxNext <= now)
+        {
+            uint8_t data = mRxLine.front();
+            mRxLine.pop_front();
+            if (enabled() && (mCr1 & USART_CR1_RE))
+            {
+                if (mSr & USART_SR_RXNE)
+                {
+                    mSr |= USART_SR_ORE;
+                }
+                else
+                {
+                    mRdr = data;
+                    mSr |= USART_SR_RXNE;
+                }
+            }
+            if (mRxLine.empty())
+            {
+                mRxNext = kNever;
+                mIdleAt = now + frameTime();
+            }
+            else
+            {
+                mRxNext = now + frameTime();
+            }
+        }
+        if (mIdleAt <= now)
+        {
+            mIdleAt = kNever;
+            if (enabled() && (mCr1 & USART_CR1_RE))
+            {
+                mSr |= USART_SR_IDLE;
+            }
+        }
+    }
+    virtual uint64_t irqs() const
+    {
+        if (!enabled())
+        {
+            return 0;
+        }
+        bool active = ((mCr1 & USART_CR1_TXEIE) && (mSr & USART_SR_TXE)) ||
+            ((mCr1 & USART_CR1_TCIE) && (mSr & USART_SR_TC)) ||
+            ((mCr1 & USART_CR1_RXNEIE) && (mSr & (USART_SR_RXNE | USART_SR_ORE))) ||
+            ((mCr1 & USART_CR1_IDLEIE) && (mSr & USART_SR_IDLE));
+        return active ? (1ull << mIrq) : 0;
+    }
+    virtual bool dmaRequest(uint32_t dma, uint8_t chan) const
+    {
+        if (dma != DMA1 || !enabled())
+        {
+            return false;
+        }
+        if (chan == mDmaTxChan)
+        {
+            return (mCr3 & USART_CR3_DMAT) && (mCr1 & USART_CR1_TE) && (mSr & USART_SR_TXE);
+        }
+        if (chan == mDmaRxChan)
+        {
+            return (mCr3 & USART_CR3_DMAR) && (mSr & USART_SR_RXNE);
+        }
+        return false;
+    }
+};
+}
+#endif
@@ -11,23 +11,16 @@
     #endif
     #include <libopencm3/stm32/flash.h>
     #include <libopencm3/stm32/desig.h>
-
-    #ifdef STM32PP_FLASH_DEBUG
-        #include <stm32++/tprintf.hpp>
-        #define STM32PP_FLASH_LOG(fmtString,...) tprintf("FLASH: " fmtString "\n", ##__VA_ARGS__)
-    #else
-        #define STM32PP_FLASH_LOG(fmtString,...)
-    #endif
 #else
     #include <assert.h>
     #include <memory.h>
     #include <stdio.h>
-    #define STM32PP_FLASH_LOG(fmtString,...) printf("FLASH: " fmtString "\n", ##__VA_ARGS__)
 #endif
+#include <stm32++/log.hpp>
 
-#define STM32PP_FLASH_LOG_ERROR(fmtString,...) STM32PP_FLASH_LOG("ERROR: " fmtString, ##__VA_ARGS__)
-#define STM32PP_FLASH_LOG_WARNING(fmtString,...) STM32PP_FLASH_LOG("WARN: " fmtString, ##__VA_ARGS__)
-#define STM32PP_FLASH_LOG_DEBUG(fmtString,...) STM32PP_FLASH_LOG("DEBUG: " fmtString, ##__VA_ARGS__)
+#define STM32PP_FLASH_LOG_ERROR(fmtString,...) STM32PP_LOG(Flash, Error, "FLASH: ERROR: " fmtString, ##__VA_ARGS__)
+#define STM32PP_FLASH_LOG_WARNING(fmtString,...) STM32PP_LOG(Flash, Warning, "FLASH: WARN: " fmtString, ##__VA_ARGS__)
+#define STM32PP_FLASH_LOG_DEBUG(fmtString,...) STM32PP_LOG(Flash, Debug, "FLASH: DEBUG: " fmtString, ##__VA_ARGS__)
 
 namespace flash
 {
@@ -0,0 +1,177 @@
+/**
+ * Compile-time format strings for the tprintf family
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_FMTSTRING_HPP
+#define STM32PP_FMTSTRING_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+/** @brief Formatting parameters of a placeholder. A placeholder is either a
+ * bare \c %, or has a spec in curly braces:
+ * \code %{[<|>][width][d|x|X|o|b[minDigits]][.prec]} \endcode
+ * - \c < or \c > - align left or right (the default) within \c width
+ * - \c width - the minimum number of chars, padded with spaces
+ * - \c d, \c x, \c X, \c o, \c b - integers only: format in decimal, hex
+ *   (lower or upper case), octal or binary, with at least \c minDigits digits
+ * - \c .prec - floating point only: digits after the decimal point, 1-9
+ *
+ * For example \c %{8}, \c %{<6}, \c %{x4}, \c %{10.3}
+ */
+struct FmtSpec
+{
+    size_t end = 0;        // position after the placeholder
+    bool valid = true;
+    bool leftAlign = false;
+    uint8_t width = 0;
+    char type = 0;         // 0 if not specified
+    uint8_t minDigits = 0;
+    uint8_t prec = 0;      // 0 if not specified
+};
+
+/** @brief The numeric base for a FmtSpec type */
+constexpr uint8_t fmtSpecBase(char type)
+{
+    return (type == 'x' || type == 'X') ? 16 : (type == 'o') ? 8 : (type == 'b') ? 2 : 10;
+}
+
+constexpr uint8_t fmtSpecParseNum(const char* str, size_t& pos, size_t len, bool& valid)
+{
+    unsigned num = 0;
+    for (; pos < len && str[pos] >= '0' && str[pos] <= '9'; pos++)
+    {
+        num = num * 10 + (str[pos] - '0');
+        if (num > 255)
+        {
+            valid = false;
+        }
+    }
+    return num;
+}
+
+/** @brief Parses the placeholder at \c pos, which must point to a \c %.
+ * Used at compile time by FmtString, and at runtime by the binary log decoder.
+ * If the spec is invalid, \c valid is false and the placeholder is
+ * considered to be only the \c % char
+ */
+constexpr FmtSpec fmtSpecParse(const char* str, size_t pos, size_t len)
+{
+    FmtSpec spec;
+    spec.end = ++pos;
+    if (pos >= len || str[pos] != '{')
+    {
+        return spec;
+    }
+    pos++;
+    if (pos < len && (str[pos] == '<' || str[pos] == '>'))
+    {
+        spec.leftAlign = (str[pos++] == '<');
+    }
+    spec.width = fmtSpecParseNum(str, pos, len, spec.valid);
+    if (pos < len && (str[pos] == 'd' || str[pos] == 'x' || str[pos] == 'X' ||
+                      str[pos] == 'o' || str[pos] == 'b'))
+    {
+        spec.type = str[pos++];
+        spec.minDigits = fmtSpecParseNum(str, pos, len, spec.valid);
+    }
+    if (pos < len && str[pos] == '.')
+    {
+        pos++;
+        spec.prec = fmtSpecParseNum(str, pos, len, spec.valid);
+        if (spec.prec < 1 || spec.prec > 9)
+        {
+            spec.valid = false;
+        }
+    }
+    if (!spec.valid || pos >= len || str[pos] != '}')
+    {
+        FmtSpec invalid;
+        invalid.valid = false;
+        invalid.end = spec.end;
+        return invalid;
+    }
+    spec.end = pos + 1;
+    return spec;
+}
+
+/** @brief A format string whose contents are encoded in its type.
+ * It is created with the \c _fmt string literal suffix:
+ * \code tprintf("temp = %, press = %\n"_fmt, temp, press); \endcode
+ * Since the string is known at compile time, splitting it into literal
+ * segments and placeholders is done by the compiler, and at runtime
+ * only known-length block copies and \c toString() calls remain.
+ * Placeholders can have a spec with width, alignment and number format
+ * (see FmtSpec), which is also parsed at compile time:
+ * \code tprintf("%{<8}|%{8.2}|%{X4}\n"_fmt, name, temp, reg); \endcode
+ */
+template <char... Chars>
+struct FmtString
+{
+    static constexpr size_t kLen = sizeof...(Chars);
+    static constexpr char kStr[] = { Chars..., 0 };
+    static constexpr const char* str() { return kStr; }
+    /** @brief Returns the position of the first placeholder at or after
+     * \c from, or \c kLen if there is no such placeholder
+     */
+    static constexpr size_t findPlaceholder(size_t from)
+    {
+        for (; from < kLen; from++)
+        {
+            if (kStr[from] == '%')
+                return from;
+        }
+        return kLen;
+    }
+    /** @brief Returns the spec of the placeholder at \c pos */
+    static constexpr FmtSpec spec(size_t pos) { return fmtSpecParse(kStr, pos, kLen); }
+    static constexpr size_t placeholderCount()
+    {
+        size_t count = 0;
+        for (size_t pos = findPlaceholder(0); pos < kLen; pos = findPlaceholder(spec(pos).end))
+        {
+            count++;
+        }
+        return count;
+    }
+    static constexpr bool specsValid()
+    {
+        for (size_t pos = findPlaceholder(0); pos < kLen; pos = findPlaceholder(spec(pos).end))
+        {
+            if (!spec(pos).valid)
+                return false;
+        }
+        return true;
+    }
+    /** @brief Length of the output, excluding the values of the placeholders */
+    static constexpr size_t literalLen()
+    {
+        size_t len = kLen;
+        for (size_t pos = findPlaceholder(0); pos < kLen; pos = findPlaceholder(spec(pos).end))
+        {
+            len -= spec(pos).end - pos;
+        }
+        return len;
+    }
+};
+
+template <char... Chars>
+constexpr char FmtString<Chars...>::kStr[];
+
+template <class T>
+struct is_fmt_string: std::false_type {};
+
+template <char... Chars>
+struct is_fmt_string<FmtString<Chars...>>: std::true_type {};
+
+// String literal operator templates are a GNU extension, supported by gcc and clang
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+template <typename C, C... Chars>
+constexpr FmtString<Chars...> operator"" _fmt() { return {}; }
+#pragma GCC diagnostic pop
+
+#endif
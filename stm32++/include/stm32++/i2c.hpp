@@ -10,9 +10,9 @@
 #include <libopencm3/stm32/i2c.h>
 #include <libopencm3/cm3/nvic.h>
 #include <stm32++/timeutl.hpp>
-#include <stm32++/snprint.hpp>
 #include <stm32++/semihosting.hpp>
 #include <stm32++/dma.hpp>
+#include <stm32++/utils.hpp>
 namespace dma
 {
 }
@@ -28,6 +28,23 @@ enum { kTimeoutMs = 10 };
 enum: bool { kTxMode = true, kRxMode = false,
              kAckEnable = true, kAckDisable = false };
 
+/** @brief A step of a transaction list, see I2c::transfer() and
+ * IntrMaster::queueSteps(). \c txLen bytes from \c txData are written to
+ * the device, then \c rxLen bytes are read into \c rxData after a repeated
+ * start, and the step ends with a STOP. Either of the lengths can be zero.
+ * The next step starts \c delayUs microseconds later, i.e. to wait for a
+ * conversion started by this step
+ */
+struct Step
+{
+    uint8_t addr;
+    const uint8_t* txData;
+    uint16_t txLen;
+    uint8_t* rxData;
+    uint16_t rxLen;
+    uint16_t delayUs;
+};
+
 template <uint32_t I2C>
 class I2c: public PeriphInfo<I2C>
 {
@@ -108,6 +125,35 @@ bool startRecv(uint8_t address, bool ack=false)
 /* Private functions */
 bool start(uint8_t address, bool tx, bool ack)
 {
+    if (!sendAddress(address, tx, ack))
+        return false;
+    xassert(!(I2C_SR1(I2C) & I2C_SR1_SB));
+    (volatile uint32_t)I2C_SR2(I2C);
+
+#ifndef NDEBUG
+    uint32_t sr2 = I2C_SR2(I2C);
+    if (tx)
+        xassert(sr2 & I2C_SR2_TRA);
+    else
+        xassert(!(sr2 & I2C_SR2_TRA));
+#endif
+
+    xassert((I2C_SR1(I2C) & I2C_SR1_ADDR) == 0);
+    return true;
+}
+
+/** @brief The address phase of start(), without clearing ADDR, which starts
+ * the data phase
+ */
+bool sendAddress(uint8_t address, bool tx, bool ack)
+{
+    // Setting START while the STOP of the previous transaction is pending
+    // is forbidden
+    if (!waitStopDone())
+        return false;
+    // A NACK of a previous address, i.e. by isDeviceConnected(), would end
+    // the ADDR wait below
+    I2C_SR1(I2C) = ~I2C_SR1_AF;
 	/* Generate I2C start pulse */
     i2c_send_start(I2C);
     ElapsedTimer timer;
@@ -128,25 +174,8 @@ bool start(uint8_t address, bool tx, bool ack)
     /* Send destination address. */
     i2c_send_7bit_address(I2C, address, tx ? I2C_WRITE : I2C_READ);
 
-    /* Waiting for address to be transferred. */
-    while (!(I2C_SR1(I2C) & I2C_SR1_ADDR))
-    {
-        if (timer.msElapsed() > kTimeoutMs)
-            return false;
-    }
-    xassert(!(I2C_SR1(I2C) & I2C_SR1_SB));
-    (volatile uint32_t)I2C_SR2(I2C);
-
-#ifndef NDEBUG
-    uint32_t sr2 = I2C_SR2(I2C);
-    if (tx)
-        xassert(sr2 & I2C_SR2_TRA);
-    else
-        xassert(!(sr2 & I2C_SR2_TRA));
-#endif
-
-    xassert((I2C_SR1(I2C) & I2C_SR1_ADDR) == 0);
-    return true;
+    /* Waiting for address to be transferred, or NACKed */
+    return waitSr1(I2C_SR1_ADDR);
 }
 
 bool sendByteTimeout(uint8_t data)
@@ -303,6 +332,132 @@ bool stopTimeout()
     return true;
 }
 
+/** @brief Executes a list of transactions back-to-back, see Step. Received
+ * bytes are NACKed and the STOP is programmed according to the F1 reference
+ * manual's sequences for 1, 2 and N > 2 bytes, so that no extra bytes are
+ * read from the device
+ * @return false if a step failed, i.e. the device didn't acknowledge or
+ * didn't respond in time. The remaining steps are not executed
+ */
+bool transfer(const Step* steps, uint8_t count)
+{
+    for (const Step* end = steps + count; steps < end; steps++)
+    {
+        // Writing CR1 (e.g. POS) while the STOP of the previous step is
+        // pending may generate a second STOP or START
+        if (!waitStopDone())
+            return false;
+        if (!transferStep(*steps))
+        {
+            // Release the bus and clean up a failed address or data phase
+            I2C_SR1(I2C) = ~I2C_SR1_AF;
+            I2C_CR1(I2C) = (I2C_CR1(I2C) & ~(I2C_CR1_POS | I2C_CR1_ACK)) | I2C_CR1_STOP;
+            return false;
+        }
+        if (steps->delayUs)
+        {
+            usDelay(steps->delayUs);
+        }
+    }
+    return true;
+}
+
+bool waitStopDone()
+{
+    ElapsedTimer timer;
+    while (I2C_CR1(I2C) & I2C_CR1_STOP)
+    {
+        if (timer.msElapsed() > kTimeoutMs)
+            return false;
+    }
+    return true;
+}
+
+bool waitSr1(uint32_t flags)
+{
+    ElapsedTimer timer;
+    while (!(I2C_SR1(I2C) & flags))
+    {
+        if ((I2C_SR1(I2C) & I2C_SR1_AF) || timer.msElapsed() > kTimeoutMs)
+            return false;
+    }
+    return true;
+}
+
+bool transferStep(const Step& step)
+{
+    if (step.txLen || !step.rxLen)
+    {
+        if (!startSend(step.addr))
+            return false;
+        for (uint16_t i = 0; i < step.txLen; i++)
+        {
+            if (!waitSr1(I2C_SR1_TxE))
+                return false;
+            i2c_send_data(I2C, step.txData[i]);
+        }
+        if (!waitSr1(I2C_SR1_BTF | (step.txLen ? 0 : I2C_SR1_TxE)))
+            return false;
+        if (!step.rxLen)
+        {
+            i2c_send_stop(I2C);
+            return true;
+        }
+    }
+    uint16_t count = step.rxLen;
+    uint8_t* buf = step.rxData;
+    if (count == 1)
+    {
+        // NACK the byte, and program the STOP right after ADDR is cleared,
+        // before the byte is received
+        if (!sendAddress(step.addr, kRxMode, kAckDisable))
+            return false;
+        IntrDisable intrDisable;
+        // Reading SR1 followed by SR2 clears ADDR
+        (volatile uint32_t)I2C_SR1(I2C);
+        (volatile uint32_t)I2C_SR2(I2C);
+        i2c_send_stop(I2C);
+    }
+    else if (count == 2)
+    {
+        // With POS, ACK applies to the next byte: ACK the first, NACK the second
+        I2C_CR1(I2C) |= I2C_CR1_POS;
+        if (!startRecv(step.addr, kAckEnable))
+            return false;
+        i2c_disable_ack(I2C);
+        // Wait for both bytes: the first in DR, the second in the shift register
+        if (!waitSr1(I2C_SR1_BTF))
+            return false;
+        I2C_CR1(I2C) = (I2C_CR1(I2C) & ~I2C_CR1_POS) | I2C_CR1_STOP;
+        *(buf++) = I2C_DR(I2C);
+    }
+    else
+    {
+        if (!startRecv(step.addr, kAckEnable))
+            return false;
+        for (; count > 3; count--)
+        {
+            if (!waitSr1(I2C_SR1_RxNE))
+                return false;
+            *(buf++) = I2C_DR(I2C);
+        }
+        // Byte N-2 in DR and N-1 in the shift register. Byte N starts when
+        // N-2 is read, so the NACK must be programmed before that
+        if (!waitSr1(I2C_SR1_BTF))
+            return false;
+        i2c_disable_ack(I2C);
+        *(buf++) = I2C_DR(I2C);
+        if (!waitSr1(I2C_SR1_BTF))
+            return false;
+        i2c_send_stop(I2C);
+        *(buf++) = I2C_DR(I2C);
+    }
+    if (!waitSr1(I2C_SR1_RxNE))
+        return false;
+    *buf = I2C_DR(I2C);
+    return true;
+}
+
 bool isDeviceConnected(uint8_t address)
 {
     /* Try to start, function will return 0 in case device will send ACK */
@@ -321,24 +476,555 @@ uint8_t findFirstDevice(uint8_t from=0)
     return 0xff;
 }
 void dmaStartPeripheralTx() { i2c_enable_dma(I2C); }
-void dmaStartPeripheralRx() { i2c_enable_dma(I2C); }
+/** @brief Called by dma::Rx after the channel is armed. Must be called
+ * before ADDR of the read is cleared, i.e. before startRecv(), see
+ * dmaReadRegs(). The received bytes are ACKed, except the last one:
+ * with LAST set, the controller NACKs the byte of the last DMA transfer,
+ * so that the slave releases the bus. LAST relies on the DMA's EOT-1
+ * signal, which doesn't occur for a single byte, so in that case ACK is
+ * just disabled.
+ */
+void dmaStartPeripheralRx()
+{
+    if (DMA_CNDTR(this->kDmaRxId, this->kDmaRxChannel) > 1)
+    {
+        i2c_enable_ack(I2C);
+    }
+    else
+    {
+        i2c_disable_ack(I2C);
+    }
+    i2c_set_dma_last_transfer(I2C);
+    i2c_enable_dma(I2C);
+}
 //WARNING: The dmaStopPerpheralXX can be called from an ISR
 void dmaStopPeripheralTx()
 {
     i2c_disable_dma(I2C);
     this->stop();
 }
+/** @brief Called by dma::Rx when the transfer is complete or aborted. The
+ * last byte has already been received and NACKed, so the STOP is programmed
+ * immediately - there is no BTF or TxE to wait for in receive mode
+ */
 void dmaStopPeripheralRx()
 {
     i2c_disable_dma(I2C);
-    this->stop();
+    i2c_clear_dma_last_transfer(I2C);
+    i2c_disable_ack(I2C);
+    i2c_send_stop(I2C);
+}
+};
+
+/** @brief Reads a block of consecutive registers of a device by DMA: writes
+ * the register address, and reads \c size bytes after a repeated start.
+ * Only the address phases are polled - the data is received by DMA, and
+ * \c callback is called from the DMA interrupt handler when the transfer
+ * is complete and the STOP is programmed. Alternatively, dmaRxBusy() can be
+ * polled.
+ * @param i2c A dma::Rx<nsi2c::I2c<...>>, without circular mode
+ * @return false if the device didn't acknowledge, in which case the bus is
+ * released, or if a previous read is still in progress, in which case the bus
+ * is not touched. The callback is not called
+ */
+template <class Dev>
+bool dmaReadRegs(Dev& i2c, uint8_t addr, uint8_t reg, void* buf, uint16_t size,
+                 dma::XferCallback callback=nullptr, void* userp=nullptr)
+{
+    enum: uint32_t { I2C = Dev::kPeriphId };
+    xassert(size);
+    if (i2c.dmaRxBusy())
+    {
+        return false; // a previous read is in progress, don't disturb it
+    }
+    if (!i2c.startSend(addr) || !i2c.sendByteTimeout(reg))
+    {
+        I2C_SR1(I2C) = ~I2C_SR1_AF;
+        i2c_send_stop(I2C);
+        return false;
+    }
+    if (!i2c.dmaRxQueue(buf, size, callback, userp))
+    {
+        i2c_send_stop(I2C);
+        return false;
+    }
+    // Clearing ADDR of the read starts the reception
+    if (!i2c.startRecv(addr, size > 1))
+    {
+        I2C_SR1(I2C) = ~I2C_SR1_AF;
+        i2c.dmaRxStop();
+        return false;
+    }
+    return true;
 }
+
+/** @brief Completion status of an asynchronous transaction, see IntrMaster */
+enum: uint8_t
+{
+    kXferOk = 0,
+    kXferNack = 1,     // The slave didn't acknowledge its address or a written byte
+    kXferBusError = 2, // Misplaced start or stop condition
+    kXferArbLost = 3,  // Another master took over the bus
+    kXferTimeout = 4   // The transaction didn't complete in time, see IntrMaster::poll()
+};
+/** @brief Completion callback of an asynchronous transaction. Called from
+ * the I2C interrupt handler (or from IntrMaster::poll() on timeout), with the
+ * status of the transaction and the user pointer that was given when it was
+ * queued. The next queued transaction is already started when it is called
+ */
+typedef void(*DoneCallback)(uint8_t status, void* userp);
+
+/** @brief Mixin for interrupt-driven, non-blocking master transactions.
+ * Write, read and write-then-read (with a repeated start, i.e. register reads)
+ * transactions, and lists of them (see queueSteps()), are queued and executed
+ * one after another by the event and error interrupt handlers, so the CPU is
+ * not stalled for the duration of the transfer. Completion is signalled by a
+ * callback, or can be polled with busy(). Received bytes are read according
+ * to the F1 reference manual's sequences for 1, 2 and N > 2 bytes, so that
+ * the NACK and STOP after the last byte are generated in time, without
+ * depending on the interrupt latency.
+ * The event interrupt handler must call \c evIsr(), and the error interrupt
+ * handler - \c erIsr(). Both interrupts are enabled in the NVIC by init().
+ * Hardware doesn't detect a hung bus (i.e. a slave stretching the clock
+ * forever), so poll() must be called periodically from the main loop, to
+ * abort transactions that took too long and reset the controller. The
+ * interrupt handlers never wait for the bus for more than kStopWaitUs.
+ * The blocking methods of the base class can be used only while busy() is false.
+ * @param QueueDepth The max number of queued transactions, including the one
+ * in progress
+ */
+template <class Base, uint8_t QueueDepth=4>
+class IntrMaster: public Base
+{
+public:
+    struct Xfer
+    {
+        const Step* steps;
+        uint8_t count;
+        DoneCallback callback;
+        void* userp;
+        Step single; // the step of a transaction queued by queue()
+    };
+protected:
+    typedef Base Self;
+    enum: uint32_t { kIntrFlags = I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN };
+    Xfer mXfers[QueueDepth];
+    uint8_t mFront = 0;
+    volatile uint8_t mCount = 0;
+    // State of the transaction in progress
+    uint8_t mStep = 0;
+    bool mDelaying = false; // waiting for the delay after a step, see poll()
+    bool mReading = false;
+    bool mStarting = false; // a (repeated) START is pending
+    bool mStartDeferred = false; // the START waits for the previous STOP, see poll()
+    uint16_t mPos = 0; // bytes transferred in the current direction
+    uint32_t mTsStart = 0; // start of the step, or of the delay after it
+    uint32_t mTimeoutTicks = 0; // or the duration of the delay
+    uint16_t mTimeoutMs = kTimeoutMs;
+    static void sendStop()
+    {
+        // POS must not stay set after a 2-byte read, as it would affect the
+        // ACK of the next transaction. Setting both bits in one write avoids
+        // a read-modify-write of CR1 while the STOP is pending
+        I2C_CR1(Self::kPeriphId) = (I2C_CR1(Self::kPeriphId) & ~I2C_CR1_POS) | I2C_CR1_STOP;
+    }
+    // Saturates at the range of the 32-bit cycle counter, ~59 s at 72 MHz
+    static uint32_t msToTicks(uint32_t ms)
+    {
+        uint64_t ticks = (uint64_t)ms * (rcc_ahb_frequency / 1000);
+        return (ticks > 0xffffffff) ? 0xffffffff : ticks;
+    }
+    const Step& curStep() const { return mXfers[mFront].steps[mStep]; }
+    void push(Xfer& xfer, const Step* steps, uint8_t count, DoneCallback callback, void* userp)
+    {
+        xfer.steps = steps;
+        xfer.count = count;
+        xfer.callback = callback;
+        xfer.userp = userp;
+        if (++mCount == 1)
+        {
+            startStep();
+        }
+    }
+    void startStep()
+    {
+        const Step& step = curStep();
+        mDelaying = false;
+        mReading = (step.txLen == 0 && step.rxLen != 0);
+        mPos = 0;
+        // Allow the time to transfer the data at 100 kHz, ~0.1 ms per byte
+        mTimeoutTicks = msToTicks(mTimeoutMs + (step.txLen + step.rxLen) / 10 + 1);
+        mTsStart = DwtCounter::ticks();
+        // A STOP of the previous transaction is generated after its last
+        // byte, which has already been received, so it normally takes a bit
+        // time. Writing CR1 while the STOP is pending is not allowed. Wait
+        // briefly, and if the STOP is still pending (i.e. the bus is held
+        // low), leave the START to poll(), which also times it out
+        uint32_t maxWait = kStopWaitUs * (rcc_ahb_frequency / 1000000);
+        while (I2C_CR1(Self::kPeriphId) & I2C_CR1_STOP)
+        {
+            if ((uint32_t)(DwtCounter::ticks() - mTsStart) > maxWait)
+            {
+                mStartDeferred = true;
+                return;
+            }
+        }
+        sendStart();
+    }
+    void sendStart()
+    {
+        mStartDeferred = false;
+        mStarting = true;
+        i2c_enable_interrupt(Self::kPeriphId, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+        i2c_send_start(Self::kPeriphId);
+    }
+    /* Releases the controller from a hung transaction by a software reset,
+     * which also clears a pending START or STOP, and restores the
+     * configuration done by init()
+     */
+    static void resetController()
+    {
+        enum: uint32_t { I2C = Self::kPeriphId };
+        uint32_t cr2 = I2C_CR2(I2C) & ~(kIntrFlags | I2C_CR2_DMAEN | I2C_CR2_LAST);
+        uint32_t oar1 = I2C_OAR1(I2C);
+        uint32_t ccr = I2C_CCR(I2C);
+        uint32_t trise = I2C_TRISE(I2C);
+        I2C_CR1(I2C) = I2C_CR1_SWRST;
+        I2C_CR1(I2C) = 0;
+        I2C_CR2(I2C) = cr2;
+        I2C_OAR1(I2C) = oar1;
+        I2C_CCR(I2C) = ccr;
+        I2C_TRISE(I2C) = trise;
+        i2c_peripheral_enable(I2C);
+    }
+    // Called with interrupts disabled, or from the I2C interrupt
+    void stepDone()
+    {
+        const Xfer& xfer = mXfers[mFront];
+        uint16_t delayUs = xfer.steps[mStep].delayUs;
+        if (++mStep == xfer.count)
+        {
+            finish(kXferOk);
+        }
+        else if (delayUs)
+        {
+            // The next step is started by poll()
+            i2c_disable_interrupt(Self::kPeriphId, kIntrFlags);
+            mDelaying = true;
+            mTimeoutTicks = delayUs * (rcc_ahb_frequency / 1000000);
+            mTsStart = DwtCounter::ticks();
+        }
+        else
+        {
+            startStep();
+        }
+    }
+    void finish(uint8_t status)
+    {
+        Xfer done = mXfers[mFront];
+        mFront = (mFront + 1) % QueueDepth;
+        mStep = 0;
+        mDelaying = false;
+        mStartDeferred = false;
+        if (--mCount)
+        {
+            startStep();
+        }
+        else
+        {
+            i2c_disable_interrupt(Self::kPeriphId, kIntrFlags);
+        }
+        if (done.callback)
+        {
+            done.callback(status, done.userp);
+        }
+    }
+    void onRecv(const Step& step, uint32_t sr1)
+    {
+        enum: uint32_t { I2C = Self::kPeriphId };
+        uint16_t remaining = step.rxLen - mPos;
+        if (step.rxLen == 1)
+        {
+            // NACK and STOP were programmed at ADDR
+            if (sr1 & I2C_SR1_RxNE)
+            {
+                step.rxData[mPos++] = I2C_DR(I2C);
+                stepDone();
+            }
+        }
+        else if (remaining > 3)
+        {
+            if (sr1 & (I2C_SR1_RxNE | I2C_SR1_BTF))
+            {
+                step.rxData[mPos++] = I2C_DR(I2C);
+                if (remaining == 4)
+                {
+                    // Wait for BTF: byte N-2 in DR and N-1 in the shift register
+                    i2c_disable_interrupt(I2C, I2C_CR2_ITBUFEN);
+                }
+            }
+        }
+        else if (sr1 & I2C_SR1_BTF)
+        {
+            if (remaining == 3)
+            {
+                // NACK byte N, which starts when N-2 is read
+                i2c_disable_ack(I2C);
+                step.rxData[mPos++] = I2C_DR(I2C);
+            }
+            else
+            {
+                // Bytes N-1 and N are received, the latter was NACKed
+                sendStop();
+                step.rxData[mPos++] = I2C_DR(I2C);
+                step.rxData[mPos++] = I2C_DR(I2C);
+                stepDone();
+            }
+        }
+    }
+public:
+    enum: uint8_t { kDepth = QueueDepth };
+    /** @brief Max time to wait for the STOP of the previous transaction,
+     * before starting the next one from the interrupt handler. Beyond that,
+     * the start is left to poll()
+     */
+    enum: uint16_t { kStopWaitUs = 50 };
+    template <typename... Args>
+    void init(Args... args)
+    {
+        Base::init(args...);
+        nvic_enable_irq(Self::kEvIrq);
+        nvic_enable_irq(Self::kErIrq);
+    }
+    /** @brief Sets the timeout of subsequent transactions, in addition to the
+     * time needed to transfer their data. The default is kTimeoutMs. The
+     * total is limited to the range of the 32-bit DWT cycle counter, ~59 s
+     * at 72 MHz
+     */
+    void setTimeout(uint16_t ms) { mTimeoutMs = ms; }
+    /** @brief Whether there are transactions queued or in progress */
+    bool busy() const { return mCount != 0; }
+    /** @brief Queues a transaction without blocking. \c txLen bytes from
+     * \c txData are written to the device with address \c addr, then
+     * \c rxLen bytes are read into \c rxData, after a repeated start. Either
+     * of the lengths can be zero. The buffers must remain valid until the
+     * callback is called
+     * @return false if the queue is full
+     */
+    bool queue(uint8_t addr, const void* txData, uint16_t txLen, void* rxData, uint16_t rxLen,
+               DoneCallback callback=nullptr, void* userp=nullptr)
+    {
+        IntrDisable intrDisable;
+        if (mCount == QueueDepth)
+        {
+            return false;
+        }
+        Xfer& xfer = mXfers[(mFront + mCount) % QueueDepth];
+        xfer.single = { addr, (const uint8_t*)txData, txLen, (uint8_t*)rxData, rxLen, 0 };
+        push(xfer, &xfer.single, 1, callback, userp);
+        return true;
+    }
+    /** @brief Queues a list of transactions, which are executed back-to-back,
+     * see Step. The callback is called once, when all of them are done, or
+     * when one fails. The delays between the steps are timed by poll(), so
+     * their accuracy depends on how often it is called. The list must remain
+     * valid until the callback is called
+     * @return false if the queue is full
+     */
+    bool queueSteps(const Step* steps, uint8_t count, DoneCallback callback=nullptr, void* userp=nullptr)
+    {
+        xassert(count);
+        IntrDisable intrDisable;
+        if (mCount == QueueDepth)
+        {
+            return false;
+        }
+        push(mXfers[(mFront + mCount) % QueueDepth], steps, count, callback, userp);
+        return true;
+    }
+    bool write(uint8_t addr, const void* data, uint16_t len, DoneCallback callback=nullptr, void* userp=nullptr)
+    {
+        return queue(addr, data, len, nullptr, 0, callback, userp);
+    }
+    bool read(uint8_t addr, void* buf, uint16_t len, DoneCallback callback=nullptr, void* userp=nullptr)
+    {
+        return queue(addr, nullptr, 0, buf, len, callback, userp);
+    }
+    bool writeRead(uint8_t addr, const void* txData, uint16_t txLen, void* rxData, uint16_t rxLen,
+                   DoneCallback callback=nullptr, void* userp=nullptr)
+    {
+        return queue(addr, txData, txLen, rxData, rxLen, callback, userp);
+    }
+    /** @brief Aborts the transaction in progress with kXferTimeout, if it
+     * has taken too long, starts the next step of a transaction list after
+     * its delay, and starts a transaction that waits for the STOP of the
+     * previous one. Must be called periodically from the main loop.
+     * On timeout, the controller is reset, as it may be stuck with a pending
+     * START or STOP, i.e. when a slave holds the bus low
+     */
+    void poll()
+    {
+        IntrDisable intrDisable;
+        if (!mCount)
+        {
+            return;
+        }
+        bool expired = (uint32_t)(DwtCounter::ticks() - mTsStart) >= mTimeoutTicks;
+        if (mDelaying)
+        {
+            if (expired)
+            {
+                startStep();
+            }
+        }
+        else if (expired)
+        {
+            i2c_disable_interrupt(Self::kPeriphId, kIntrFlags);
+            resetController();
+            finish(kXferTimeout);
+        }
+        else if (mStartDeferred && !(I2C_CR1(Self::kPeriphId) & I2C_CR1_STOP))
+        {
+            sendStart();
+        }
+    }
+    void evIsr()
+    {
+        enum: uint32_t { I2C = Self::kPeriphId };
+        if (!mCount || mDelaying || mStartDeferred)
+        {
+            i2c_disable_interrupt(I2C, kIntrFlags);
+            return;
+        }
+        const Step& step = curStep();
+        uint32_t sr1 = I2C_SR1(I2C);
+        if (sr1 & I2C_SR1_SB)
+        {
+            mStarting = false;
+            if (mReading)
+            {
+                // For 2 bytes, ACK the first and NACK the second, see onRecv()
+                uint32_t cr1 = I2C_CR1(I2C) & ~(I2C_CR1_POS | I2C_CR1_ACK);
+                if (step.rxLen == 2)
+                {
+                    cr1 |= I2C_CR1_POS | I2C_CR1_ACK;
+                }
+                else if (step.rxLen > 2)
+                {
+                    cr1 |= I2C_CR1_ACK;
+                }
+                I2C_CR1(I2C) = cr1;
+            }
+            i2c_send_7bit_address(I2C, step.addr, mReading ? I2C_READ : I2C_WRITE);
+            return;
+        }
+        if (mStarting)
+        {
+            // BTF of the write phase stays set until the repeated START is
+            // generated, don't mistake it for received data
+            return;
+        }
+        if (sr1 & I2C_SR1_ADDR)
+        {
+            // Reading SR2 after SR1 clears ADDR, and the data phase starts
+            (void)I2C_SR2(I2C);
+            if (!mReading)
+            {
+                if (step.txLen == 0)
+                {
+                    sendStop(); // address-only write, i.e. probe
+                    stepDone();
+                    return;
+                }
+                i2c_send_data(I2C, step.txData[mPos++]);
+                if (mPos < step.txLen)
+                {
+                    i2c_enable_interrupt(I2C, I2C_CR2_ITBUFEN);
+                }
+            }
+            else if (step.rxLen == 1)
+            {
+                sendStop();
+                i2c_enable_interrupt(I2C, I2C_CR2_ITBUFEN);
+            }
+            else if (step.rxLen == 2)
+            {
+                // The first byte is already ACKed, because of POS
+                i2c_disable_ack(I2C);
+            }
+            else if (step.rxLen > 3)
+            {
+                i2c_enable_interrupt(I2C, I2C_CR2_ITBUFEN);
+            }
+            return;
+        }
+        if (mReading)
+        {
+            onRecv(step, sr1);
+            return;
+        }
+        if (mPos < step.txLen)
+        {
+            if (sr1 & (I2C_SR1_TxE | I2C_SR1_BTF))
+            {
+                i2c_send_data(I2C, step.txData[mPos++]);
+                if (mPos == step.txLen)
+                {
+                    i2c_disable_interrupt(I2C, I2C_CR2_ITBUFEN); // wait for BTF
+                }
+            }
+        }
+        else if (sr1 & I2C_SR1_BTF)
+        {
+            if (step.rxLen)
+            {
+                mReading = true;
+                mStarting = true;
+                mPos = 0;
+                i2c_send_start(I2C);
+            }
+            else
+            {
+                sendStop();
+                stepDone();
+            }
+        }
+    }
+    void erIsr()
+    {
+        enum: uint32_t { I2C = Self::kPeriphId };
+        uint32_t sr1 = I2C_SR1(I2C);
+        // The error flags are cleared by writing 0 to them
+        I2C_SR1(I2C) = ~(sr1 & (I2C_SR1_AF | I2C_SR1_ARLO | I2C_SR1_BERR | I2C_SR1_OVR));
+        if (!mCount || mDelaying || mStartDeferred)
+        {
+            return;
+        }
+        uint8_t status;
+        if (sr1 & I2C_SR1_ARLO)
+        {
+            // The controller has already switched to slave mode
+            status = kXferArbLost;
+        }
+        else if (sr1 & (I2C_SR1_AF | I2C_SR1_BERR))
+        {
+            sendStop();
+            status = (sr1 & I2C_SR1_AF) ? kXferNack : kXferBusError;
+        }
+        else
+        {
+            return;
+        }
+        i2c_disable_interrupt(I2C, kIntrFlags);
+        finish(status);
+    }
 };
 }
 STM32PP_PERIPH_INFO(I2C1)
     enum: uint32_t { kPortId = GPIOB };
     enum: uint16_t { kPinScl = GPIO_I2C1_SCL, kPinSda = GPIO_I2C1_SDA };
     static constexpr rcc_periph_clken kClockId = RCC_I2C1;
+    enum: uint8_t { kEvIrq = NVIC_I2C1_EV_IRQ, kErIrq = NVIC_I2C1_ER_IRQ };
     enum: uint32_t { kDmaTxId = DMA1, kDmaRxId = DMA1 };
     enum: uint8_t {
         kDmaTxChannel = DMA_CHANNEL6,
@@ -353,6 +1039,7 @@ STM32PP_PERIPH_INFO(I2C2)
     enum: uint32_t { kPortId = GPIOB };
     enum: uint16_t { kPinScl = GPIO_I2C2_SCL, kPinSda = GPIO_I2C2_SDA };
     static constexpr rcc_periph_clken kClockId = RCC_I2C2;
+    enum: uint8_t { kEvIrq = NVIC_I2C2_EV_IRQ, kErIrq = NVIC_I2C2_ER_IRQ };
     enum: uint32_t { kDmaTxId = DMA1, kDmaRxId = DMA1 };
     enum: uint8_t {
         kDmaTxChannel = DMA_CHANNEL4,
@@ -0,0 +1,208 @@
+/**
+ * Leveled logging with per-module compile-time and runtime filtering
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_LOG_HPP
+#define STM32PP_LOG_HPP
+
+#include "tprintf.hpp"
+
+/** Logging is done via the STM32PP_LOG() macro, i.e.
+ * \code STM32PP_LOG(Dma, Debug, "Enabled clock"); \endcode
+ * Each message belongs to a module and has a severity level. Each module has
+ * a compile-time threshold - calls with a less severe level are removed
+ * completely, including their format strings, even in unoptimized builds. This
+ * is possible because the format string is a compile-time \c _fmt string,
+ * which is a type and gets into the firmware only if the call is instantiated.
+ * The arguments of removed calls are not evaluated.
+ * The compile-time thresholds are set with the following defines:
+ * - \c STM32PP_LOG_LEVEL - the default for all modules. If not defined, it is
+ *   \c Warning in debug builds, and \c None in release (NDEBUG) builds
+ * - \c STM32PP_LOG_LEVEL_<MODULE> - the threshold of a specific module, i.e.
+ *   \c STM32PP_LOG_LEVEL_DMA
+ *
+ * The levels are None = 0, Error = 1, Warning = 2, Info = 3, Debug = 4, Verbose = 5,
+ * i.e. -DSTM32PP_LOG_LEVEL_DMA=4 enables the debug log of the DMA module.
+ * Messages that are compiled in can be further filtered at runtime with
+ * nslog::setLevel(), i.e. to silence a module during a time-critical phase.
+ * Each message is terminated with a newline.
+ */
+
+#ifndef STM32PP_LOG_LEVEL
+    #ifdef NDEBUG
+        #define STM32PP_LOG_LEVEL 0
+    #else
+        #define STM32PP_LOG_LEVEL 2
+    #endif
+#endif
+
+// The module-specific debug defines from before the unified logging enable
+// the debug level of their module
+#ifndef STM32PP_LOG_LEVEL_APP
+    #define STM32PP_LOG_LEVEL_APP STM32PP_LOG_LEVEL
+#endif
+#ifndef STM32PP_LOG_LEVEL_DMA
+    #ifdef DMA_ENABLE_DEBUG
+        #define STM32PP_LOG_LEVEL_DMA 4
+    #else
+        #define STM32PP_LOG_LEVEL_DMA STM32PP_LOG_LEVEL
+    #endif
+#endif
+#ifndef STM32PP_LOG_LEVEL_USART
+    #ifdef STM32PP_USART_DEBUG
+        #define STM32PP_LOG_LEVEL_USART 4
+    #else
+        #define STM32PP_LOG_LEVEL_USART STM32PP_LOG_LEVEL
+    #endif
+#endif
+#ifndef STM32PP_LOG_LEVEL_FLASH
+    #ifdef STM32PP_FLASH_DEBUG
+        #define STM32PP_LOG_LEVEL_FLASH 4
+    #else
+        #define STM32PP_LOG_LEVEL_FLASH STM32PP_LOG_LEVEL
+    #endif
+#endif
+#ifndef STM32PP_LOG_LEVEL_ADC
+    #ifdef ADC_ENABLE_DEBUG
+        #define STM32PP_LOG_LEVEL_ADC 4
+    #else
+        #define STM32PP_LOG_LEVEL_ADC STM32PP_LOG_LEVEL
+    #endif
+#endif
+#ifndef STM32PP_LOG_LEVEL_I2C
+    #define STM32PP_LOG_LEVEL_I2C STM32PP_LOG_LEVEL
+#endif
+
+#if defined(STM32PP_LOG_TIMESTAMP) && !defined(STM32PP_LOG_CLOCK)
+    #include "timeutl.hpp"
+    #define STM32PP_LOG_CLOCK TimeClockNoWrap<true, DwtCounter>
+#endif
+
+namespace nslog
+{
+enum Level: uint8_t
+{
+    kLevelNone = 0, kLevelError = 1, kLevelWarning = 2,
+    kLevelInfo = 3, kLevelDebug = 4, kLevelVerbose = 5
+};
+
+enum Module: uint8_t
+{
+    kModApp, kModDma, kModUsart, kModFlash, kModAdc, kModI2c, kModuleCount
+};
+
+constexpr uint8_t compiledLevel(Module mod)
+{
+    return (mod == kModApp) ? STM32PP_LOG_LEVEL_APP
+        : (mod == kModDma) ? STM32PP_LOG_LEVEL_DMA
+        : (mod == kModUsart) ? STM32PP_LOG_LEVEL_USART
+        : (mod == kModFlash) ? STM32PP_LOG_LEVEL_FLASH
+        : (mod == kModAdc) ? STM32PP_LOG_LEVEL_ADC
+        : (mod == kModI2c) ? STM32PP_LOG_LEVEL_I2C
+        : 0;
+}
+
+template <Module mod, Level level>
+constexpr bool isCompiledIn() { return level != kLevelNone && level <= compiledLevel(mod); }
+
+// A template, so that a header-only definition results in a single copy in the firmware
+template <class T=void>
+struct RuntimeLevels
+{
+    static uint8_t levels[kModuleCount];
+};
+
+template <class T>
+uint8_t RuntimeLevels<T>::levels[kModuleCount] = {
+    kLevelVerbose, kLevelVerbose, kLevelVerbose, kLevelVerbose, kLevelVerbose, kLevelVerbose
+};
+
+/** @brief Sets the runtime threshold of a module. Messages less severe than
+ * \c level are not printed. It can't enable messages that are above the
+ * compile-time threshold of the module
+ */
+static inline void setLevel(Module mod, Level level) { RuntimeLevels<>::levels[mod] = level; }
+static inline Level level(Module mod) { return (Level)RuntimeLevels<>::levels[mod]; }
+
+static inline bool isEnabled(Module mod, Level lvl) { return lvl <= RuntimeLevels<>::levels[mod]; }
+
+template <bool compiledIn, class Fmt, typename... Args>
+typename std::enable_if<compiledIn, void>::type
+print(Fmt fmt, Args... args)
+{
+    tprintf(fmt, args...);
+}
+
+// The format string and the arguments are never used, so nothing of the call remains
+template <bool compiledIn, class Fmt, typename... Args>
+typename std::enable_if<!compiledIn, void>::type
+print(Fmt, Args...) {}
+
+#ifdef STM32PP_LOG_TIMESTAMP
+/** Record header. With STM32PP_LOG_TIMESTAMP defined, each message is prefixed
+ * with the time and the active exception number (IPSR), i.e.
+ * \code [    123456  15] message \endcode
+ * where 0 means thread mode, 15 is SysTick, 16+ are the external interrupts.
+ * Both are captured when the log call is made, so they are accurate even if
+ * the message is transmitted much later by an async print sink, or is
+ * formatted by the host (deferred logging).
+ * - STM32PP_LOG_TIMESTAMP=1 - the timestamp is in CPU cycles
+ * - STM32PP_LOG_TIMESTAMP=2 - the timestamp is in microseconds
+ *
+ * The time source is a TimeClockNoWrap<true, DwtCounter>, so the application
+ * must enable the DWT cycle counter. It can be replaced by defining
+ * STM32PP_LOG_CLOCK to a class with ticks() and microtime() methods
+ */
+template <class T=void>
+struct LogClock
+{
+    static STM32PP_LOG_CLOCK clock;
+};
+
+template <class T>
+STM32PP_LOG_CLOCK LogClock<T>::clock;
+
+static inline int64_t timestamp()
+{
+    return (STM32PP_LOG_TIMESTAMP == 2) ? LogClock<>::clock.microtime() : LogClock<>::clock.ticks();
+}
+
+/** @brief The number of the active exception, 0 in thread mode. Can be
+ * overridden with STM32PP_LOG_IPSR(), i.e. for host tests
+ */
+static inline uint16_t isrNumber()
+{
+#if defined(STM32PP_LOG_IPSR)
+    return STM32PP_LOG_IPSR();
+#elif defined(STM32PP_NOT_EMBEDDED)
+    return 0;
+#else
+    uint32_t ipsr;
+    asm volatile("mrs %0, ipsr" : "=r"(ipsr));
+    return ipsr & 0x1ff;
+#endif
+}
+#define STM32PP_LOG_HDR_FMT "[%{10} %{3}] "
+#define STM32PP_LOG_HDR_ARGS , nslog::timestamp(), nslog::isrNumber()
+#else
+#define STM32PP_LOG_HDR_FMT
+#define STM32PP_LOG_HDR_ARGS
+#endif
+}
+
+/** @brief Logs a message, see the description of log.hpp
+ * @param module The module name, i.e. \c Dma, \c Flash, \c App
+ * @param level The severity level name, i.e. \c Error, \c Debug
+ * @param fmtString A string literal, or concatenated string literals
+ */
+#define STM32PP_LOG(module, level, fmtString, ...)                                          \
+    do {                                                                                    \
+        if (nslog::isCompiledIn<nslog::kMod##module, nslog::kLevel##level>() &&             \
+            nslog::isEnabled(nslog::kMod##module, nslog::kLevel##level))                    \
+            nslog::print<nslog::isCompiledIn<nslog::kMod##module, nslog::kLevel##level>()>( \
+                STM32PP_LOG_HDR_FMT fmtString "\n"_fmt STM32PP_LOG_HDR_ARGS, ##__VA_ARGS__); \
+    } while(0)
+
+#endif
@@ -0,0 +1,198 @@
+/**
+ * Lock-free multi-producer ring buffer of log records
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_LOG_RING_HPP
+#define STM32PP_LOG_RING_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+/** Allows host tests to simulate an interrupt at the points where a writer
+ * can be preempted. Expands to nothing by default
+ */
+#ifndef STM32PP_LOGRING_PREEMPT_POINT
+    #define STM32PP_LOGRING_PREEMPT_POINT()
+#endif
+
+/** @brief Statically allocated ring buffer of variable-length records, which
+ * can be written concurrently by the main code and interrupt handlers of any
+ * priority, without blocking and without disabling interrupts. The atomic
+ * operations compile to LDREX/STREX on Cortex-M3.
+ *
+ * A writer first reserves space for a record, then writes the record
+ * contents and commits it. Committed records become visible to the reader
+ * when the outermost writer commits - writers that preempted it have already
+ * completed by then. This makes the scheme suitable for a single core
+ * with nested interrupts, but not for multiple cores.
+ * Record payloads are always contiguous in memory - if a record doesn't fit
+ * at the end of the buffer, the rest of the buffer is skipped and the record
+ * is placed at the start. This allows payloads to be directly transferred by
+ * DMA, and to be formatted in-place.
+ * If there is no space for a record, it is dropped and \c dropped() is
+ * incremented.
+ * There must be only one reader at a time.
+ * @param Size The size of the buffer in bytes. Must be a power of 2
+ */
+template <uint32_t Size>
+class LogRing
+{
+protected:
+    static_assert((Size & (Size - 1)) == 0, "LogRing size must be a power of 2");
+    static_assert(Size >= 16 && Size <= 32768, "LogRing size must be in the range 16 - 32768");
+    enum: uint16_t { kLenSkip = 0xffff };
+    enum: uint32_t { kAlign = 4 };
+    struct Header
+    {
+        uint16_t size; // size of the whole record, including header and alignment
+        uint16_t len;  // length of the payload, or kLenSkip for a padding record
+    };
+    alignas(kAlign) char mBuf[Size];
+    // Free-running counters. Their value modulo Size is the buffer offset
+    uint32_t mHead = 0;      // end of reserved space
+    uint32_t mCommitted = 0; // end of space visible to the reader
+    uint32_t mTail = 0;      // start of space not yet consumed by the reader
+    uint32_t mWriters = 0;   // number of writers that have reserved, but not yet committed
+    uint32_t mDropped = 0;
+
+    static uint32_t load(const uint32_t& var) { return __atomic_load_n(&var, __ATOMIC_SEQ_CST); }
+    static void store(uint32_t& var, uint32_t val) { __atomic_store_n(&var, val, __ATOMIC_SEQ_CST); }
+    static bool cas(uint32_t& var, uint32_t expected, uint32_t desired)
+    {
+        return __atomic_compare_exchange_n(&var, &expected, desired, false,
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+    Header* headerAt(uint32_t pos) { return (Header*)(mBuf + (pos & (Size - 1))); }
+    void leave()
+    {
+        if (__atomic_sub_fetch(&mWriters, 1, __ATOMIC_SEQ_CST) != 0)
+        {
+            return; // we preempted another writer, it will publish our record
+        }
+        // We are the outermost writer. Any writer that preempted us has
+        // already committed, so everything reserved so far is complete.
+        // An interrupt may publish a newer head meanwhile, so we only move
+        // the committed position forward
+        for (;;)
+        {
+            uint32_t committed = load(mCommitted);
+            STM32PP_LOGRING_PREEMPT_POINT();
+            uint32_t head = load(mHead);
+            if (committed == head || cas(mCommitted, committed, head))
+            {
+                return;
+            }
+        }
+    }
+public:
+    enum: uint32_t { kSize = Size };
+    /** @brief The max payload length of a single record */
+    static constexpr uint16_t maxLen() { return Size - sizeof(Header); }
+    uint32_t dropped() const { return load(mDropped); }
+    /** @brief Reserves space for a record with a payload of \c len bytes
+     * @return Pointer to the payload, or nullptr if there is not enough space.
+     * The record must then be committed with commit(), even if it ends up
+     * being empty, otherwise records from other writers will not be published.
+     */
+    char* reserve(size_t len)
+    {
+        if (len > maxLen())
+        {
+            __atomic_add_fetch(&mDropped, 1, __ATOMIC_SEQ_CST);
+            return nullptr;
+        }
+        uint32_t recSize = (sizeof(Header) + len + kAlign - 1) & ~(kAlign - 1);
+        __atomic_add_fetch(&mWriters, 1, __ATOMIC_SEQ_CST);
+        uint32_t head, pad;
+        for (;;)
+        {
+            head = load(mHead);
+            uint32_t offset = head & (Size - 1);
+            pad = (offset + recSize > Size) ? Size - offset : 0;
+            if (head + pad + recSize - load(mTail) > Size)
+            {
+                __atomic_add_fetch(&mDropped, 1, __ATOMIC_SEQ_CST);
+                leave();
+                return nullptr;
+            }
+            STM32PP_LOGRING_PREEMPT_POINT();
+            if (cas(mHead, head, head + pad + recSize))
+            {
+                break;
+            }
+        }
+        if (pad)
+        {
+            Header* padHdr = headerAt(head);
+            padHdr->size = pad;
+            padHdr->len = kLenSkip;
+        }
+        Header* hdr = headerAt(head + pad);
+        hdr->size = recSize;
+        hdr->len = len;
+        return (char*)(hdr + 1);
+    }
+    /** @brief Commits a record that was reserved with reserve()
+     * @param len The actual payload length, which may be less than the reserved
+     */
+    void commit(char* payload, size_t len)
+    {
+        Header* hdr = ((Header*)payload) - 1;
+        assert(len <= hdr->len);
+        hdr->len = len;
+        STM32PP_LOGRING_PREEMPT_POINT();
+        leave();
+    }
+    /** @brief Copies \c data into a new record
+     * @return false if there was not enough space and the record was dropped
+     */
+    bool write(const char* data, size_t len)
+    {
+        char* payload = reserve(len);
+        if (!payload)
+        {
+            return false;
+        }
+        STM32PP_LOGRING_PREEMPT_POINT();
+        memcpy(payload, data, len);
+        STM32PP_LOGRING_PREEMPT_POINT();
+        commit(payload, len);
+        return true;
+    }
+    bool hasData() const { return load(mTail) != load(mCommitted); }
+    /** @brief Returns the payload of the oldest committed record, skipping
+     * padding and empty records, or nullptr if there is no committed record.
+     * The record remains in the buffer until pop() is called
+     */
+    const char* peek(uint16_t& len)
+    {
+        for (;;)
+        {
+            uint32_t tail = load(mTail);
+            if (tail == load(mCommitted))
+            {
+                return nullptr;
+            }
+            Header* hdr = headerAt(tail);
+            if (hdr->len != kLenSkip && hdr->len != 0)
+            {
+                len = hdr->len;
+                return (const char*)(hdr + 1);
+            }
+            store(mTail, tail + hdr->size);
+        }
+    }
+    /** @brief Frees the record returned by peek() */
+    void pop()
+    {
+        uint32_t tail = load(mTail);
+        assert(tail != load(mCommitted));
+        store(mTail, tail + headerAt(tail)->size);
+    }
+};
+
+#endif
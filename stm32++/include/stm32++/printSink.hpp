@@ -36,6 +36,27 @@ struct IPrintSink
      * the buffer, that contains the string (\c len may be less than the buffer size)
      */
     virtual void print(const char* str, size_t len, int info) = 0;
+    /**
+     * @brief Whether the sink supports formatting directly into its transmit
+     * memory, via reserve() and commit()
+     */
+    virtual bool canFormatInPlace() const { return false; }
+    /**
+     * @brief reserve Reserves a region of \c len bytes in the sink's transmit memory
+     * @return Pointer to the region, or nullptr if there is no space, in which case
+     * the output is dropped. If not null, the region must be passed to commit()
+     */
+    virtual char* reserve(size_t /*len*/) { return nullptr; }
+    /**
+     * @brief commit Outputs the first \c len bytes of a region returned by reserve().
+     * \c len may be less than the reserved size, including zero
+     */
+    virtual void commit(char* /*buf*/, size_t /*len*/) {}
+    /**
+     * @brief flush Outputs any data that the sink has buffered. Called before
+     * halting, i.e. on assertion failure, and when switching sinks
+     */
+    virtual void flush() {}
 };
 
 struct AsyncPrintSink: public IPrintSink
@@ -47,6 +68,7 @@ protected:
 static inline IPrintSink* setPrintSink(IPrintSink* newSink)
 {
     extern IPrintSink* gPrintSink;
+    gPrintSink->flush();
     IPrintSink::BufferInfo* currSinkBufInfo = gPrintSink->waitReady();
     bool isAsync = (currSinkBufInfo != nullptr);
     if (isAsync)
@@ -65,7 +87,7 @@ static inline IPrintSink* setPrintSink(IPrintSink* newSink)
             }
             else // newSink is synchronous, and we have an async buffer, free it
             {
-                free(currSinkBufInfo);
+                free((void*)currSinkBufInfo->buf);
                 currSinkBufInfo->clear();
             }
         }
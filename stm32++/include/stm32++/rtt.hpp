@@ -0,0 +1,214 @@
+/**
+ * Debug channel via ring buffers in RAM, compatible with SEGGER RTT
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_RTT_HPP
+#define STM32PP_RTT_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include "printSink.hpp"
+#include "utils.hpp"
+
+/** The target side of a memory-ring debug channel. A control block in RAM
+ * describes a set of ring buffers - "up" buffers, written by the target and
+ * read by the debugger, and "down" buffers, written by the debugger. The
+ * debugger finds the control block by searching the RAM for its id string,
+ * and then polls the buffers via the debug port, without halting the core.
+ * The layout is the one of SEGGER RTT, so OpenOCD's \c rtt commands, and
+ * other RTT-capable tools can be used on the host side (see rtt.sh).
+ * A reader that works on any memory access interface is in rttReader.hpp.
+ */
+namespace rtt
+{
+/** @brief Behavior when an up buffer doesn't have enough free space */
+enum: uint32_t
+{
+    kModeNoBlockSkip = 0, // drop the whole string
+    kModeNoBlockTrim = 1, // write as much as fits
+    kModeBlockIfFull = 2  // wait until the host reads enough data
+};
+
+/** @brief Descriptor of a ring buffer. One byte is always left unused, to
+ * distinguish a full from an empty buffer. The writer updates only \c wrOff,
+ * the reader updates only \c rdOff
+ */
+struct BufferDesc
+{
+    const char* name;
+    char* buf;
+    uint32_t size;
+    uint32_t wrOff;
+    uint32_t rdOff;
+    uint32_t flags;
+
+    void init(const char* aName, char* aBuf, uint32_t aSize, uint32_t aFlags)
+    {
+        name = aName;
+        buf = aBuf;
+        size = aSize;
+        wrOff = rdOff = 0;
+        flags = aFlags;
+    }
+    static uint32_t load(const uint32_t& var) { return __atomic_load_n(&var, __ATOMIC_ACQUIRE); }
+    static void store(uint32_t& var, uint32_t val) { __atomic_store_n(&var, val, __ATOMIC_RELEASE); }
+    uint32_t bytesFree(uint32_t rd, uint32_t wr) const
+    {
+        return (rd > wr) ? rd - wr - 1 : size - (wr - rd) - 1;
+    }
+    /** @brief Copies \c len bytes at the write position, which must be free,
+     * and then publishes them to the reader
+     */
+    void put(const char* data, uint32_t len)
+    {
+        uint32_t wr = wrOff;
+        uint32_t chunk = size - wr;
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        memcpy(buf + wr, data, chunk);
+        memcpy(buf, data + chunk, len - chunk);
+        wr += len;
+        if (wr >= size)
+        {
+            wr -= size;
+        }
+        store(wrOff, wr);
+    }
+    /** @brief Writes to an up buffer, according to the mode in \c flags
+     * @return The number of bytes written
+     */
+    uint32_t write(const char* data, uint32_t len)
+    {
+        uint32_t written = 0;
+        for (;;)
+        {
+            uint32_t avail = bytesFree(load(rdOff), wrOff);
+            if (avail >= len)
+            {
+                put(data, len);
+                return written + len;
+            }
+            if (flags == kModeNoBlockSkip)
+            {
+                return 0;
+            }
+            put(data, avail);
+            if (flags == kModeNoBlockTrim)
+            {
+                return avail;
+            }
+            written += avail;
+            data += avail;
+            len -= avail;
+        }
+    }
+    /** @brief Reads from a down buffer
+     * @return The number of bytes read
+     */
+    uint32_t read(char* data, uint32_t len)
+    {
+        uint32_t rd = rdOff;
+        uint32_t wr = load(wrOff);
+        uint32_t avail = (wr >= rd) ? wr - rd : size - rd + wr;
+        if (len > avail)
+        {
+            len = avail;
+        }
+        uint32_t chunk = size - rd;
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        memcpy(data, buf + rd, chunk);
+        memcpy(data + chunk, buf, len - chunk);
+        rd += len;
+        if (rd >= size)
+        {
+            rd -= size;
+        }
+        store(rdOff, rd);
+        return len;
+    }
+};
+
+template <uint8_t NumUp, uint8_t NumDown>
+struct ControlBlock
+{
+    char id[16];
+    int32_t maxNumUpBuffers;
+    int32_t maxNumDownBuffers;
+    BufferDesc up[NumUp];
+    BufferDesc down[NumDown];
+    /** @brief Sets the id string last, so that the host doesn't find a
+     * partially initialized control block. The id is assembled from parts,
+     * so that it doesn't appear as a whole in the flash image or in RAM
+     * initialization data, where the host could find it by mistake
+     */
+    void setId()
+    {
+        memset(id, 0, sizeof(id));
+        memcpy(id + 7, "RTT", 3);
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        memcpy(id, "SEGGER", 6);
+        id[6] = ' ';
+    }
+};
+
+/** @brief Print sink that writes to up buffer 0 of an RTT control block.
+ * Writing never halts the core. In the default mode, if the host doesn't
+ * read fast enough (or no host is attached), strings that don't fit are
+ * dropped and counted in \c dropped(). Down buffer 0 receives input from
+ * the host, see read(). The sink can be used from interrupt handlers.
+ * @param UpSize The size of the up buffer, i.e. the max data that can be
+ * written between two host polls
+ * @param Mode One of kModeNoBlockSkip, kModeNoBlockTrim, kModeBlockIfFull.
+ * kModeBlockIfFull blocks forever if no host is attached
+ */
+template <uint32_t UpSize=1024, uint32_t DownSize=16, uint32_t Mode=kModeNoBlockSkip>
+class PrintSink: public IPrintSink
+{
+protected:
+    ControlBlock<1, 1> mCb;
+    char mUpBuf[UpSize];
+    char mDownBuf[DownSize];
+    uint32_t mDropped = 0;
+public:
+    PrintSink()
+    {
+        mCb.maxNumUpBuffers = 1;
+        mCb.maxNumDownBuffers = 1;
+        mCb.up[0].init("Terminal", mUpBuf, UpSize, Mode);
+        mCb.down[0].init("Terminal", mDownBuf, DownSize, kModeNoBlockSkip);
+        mCb.setId();
+    }
+    const ControlBlock<1, 1>& controlBlock() const { return mCb; }
+    uint32_t dropped() const { return mDropped; }
+    virtual BufferInfo* waitReady() { return nullptr; }
+    virtual void print(const char* str, size_t len, int)
+    {
+#ifndef STM32PP_NOT_EMBEDDED
+        IntrDisable intrDisable;
+#endif
+        if (mCb.up[0].write(str, len) < len)
+        {
+            mDropped++;
+        }
+    }
+    /** @brief Reads input sent by the host
+     * @return The number of bytes read, 0 if there is no input
+     */
+    size_t read(char* buf, size_t bufsize)
+    {
+#ifndef STM32PP_NOT_EMBEDDED
+        IntrDisable intrDisable;
+#endif
+        return mCb.down[0].read(buf, bufsize);
+    }
+};
+}
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * Host-side reader of the RTT memory-ring debug channel, see rtt.hpp
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_RTT_READER_HPP
+#define STM32PP_RTT_READER_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace rtt
+{
+/** @brief Access to the memory of the target, i.e. via the debugger */
+class IMemory
+{
+public:
+    virtual bool read(uint64_t addr, void* buf, size_t len) = 0;
+    /** @brief Must write 4-byte aligned 32-bit values with a single access,
+     * because the target may read them concurrently
+     */
+    virtual bool write(uint64_t addr, const void* data, size_t len) = 0;
+    virtual ~IMemory() {}
+};
+
+/** @brief Finds the RTT control block in the memory of the target, reads the
+ * up buffers and writes to the down buffers. All accesses go through an
+ * IMemory interface, so the same code works with a debugger connection
+ * (the \c rttread tool) and with a memory image (the unit test).
+ * The pointer size of the target is a parameter, because the layout of
+ * the control block depends on it.
+ */
+class Reader
+{
+protected:
+    enum: uint8_t { kHdrSize = 24 }; // id[16], maxNumUpBuffers, maxNumDownBuffers
+    struct Desc
+    {
+        uint64_t addr;
+        uint64_t buf;
+        uint32_t size;
+        uint32_t wrOff;
+        uint32_t rdOff;
+    };
+    IMemory& mMem;
+    uint8_t mPtrSize;
+    uint64_t mCbAddr = 0;
+    int32_t mNumUp = 0;
+    int32_t mNumDown = 0;
+
+    uint32_t descSize() const { return 2 * mPtrSize + 16; }
+    static bool isId(const char* data)
+    {
+        return memcmp(data, "SEGGER RTT", 10) == 0;
+    }
+    bool readDesc(bool up, uint8_t channel, Desc& desc)
+    {
+        if (!mCbAddr || channel >= (up ? mNumUp : mNumDown))
+        {
+            return false;
+        }
+        desc.addr = mCbAddr + kHdrSize + (up ? channel : mNumUp + channel) * descSize();
+        uint8_t data[32];
+        if (!mMem.read(desc.addr, data, descSize()))
+        {
+            return false;
+        }
+        const uint8_t* pos = data + mPtrSize; // skip the name
+        desc.buf = 0;
+        for (uint8_t i = 0; i < mPtrSize; i++)
+        {
+            desc.buf |= (uint64_t)pos[i] << (i * 8);
+        }
+        pos += mPtrSize;
+        memcpy(&desc.size, pos, 4);
+        memcpy(&desc.wrOff, pos + 4, 4);
+        memcpy(&desc.rdOff, pos + 8, 4);
+        return desc.buf && desc.size > 1 && desc.wrOff < desc.size && desc.rdOff < desc.size;
+    }
+    uint64_t wrOffAddr(const Desc& desc) const { return desc.addr + 2 * mPtrSize + 4; }
+    uint64_t rdOffAddr(const Desc& desc) const { return desc.addr + 2 * mPtrSize + 8; }
+public:
+    Reader(IMemory& mem, uint8_t ptrSize=4): mMem(mem), mPtrSize(ptrSize) {}
+    uint64_t address() const { return mCbAddr; }
+    int32_t numUpBuffers() const { return mNumUp; }
+    int32_t numDownBuffers() const { return mNumDown; }
+    /** @brief Uses the control block at the specified address, after
+     * verifying its id
+     */
+    bool attach(uint64_t addr)
+    {
+        char hdr[kHdrSize];
+        mCbAddr = 0;
+        if (!mMem.read(addr, hdr, kHdrSize) || !isId(hdr))
+        {
+            return false;
+        }
+        memcpy(&mNumUp, hdr + 16, 4);
+        memcpy(&mNumDown, hdr + 20, 4);
+        if (mNumUp < 0 || mNumUp > 16 || mNumDown < 0 || mNumDown > 16)
+        {
+            return false;
+        }
+        mCbAddr = addr;
+        return true;
+    }
+    /** @brief Searches the specified memory range for the control block.
+     * The range is read in chunks, which overlap by the size of the id
+     */
+    bool find(uint64_t start, uint64_t size, uint32_t chunkSize=1024)
+    {
+        std::vector<char> chunk(chunkSize);
+        uint64_t end = start + size;
+        for (uint64_t addr = start; addr + 10 <= end; addr += chunkSize - 10)
+        {
+            uint32_t len = (end - addr < chunkSize) ? end - addr : chunkSize;
+            if (!mMem.read(addr, chunk.data(), len))
+            {
+                return false;
+            }
+            for (uint32_t i = 0; i + 10 <= len; i++)
+            {
+                if (isId(chunk.data() + i) && attach(addr + i))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    /** @brief Appends the data available in an up buffer to \c data, and
+     * releases the space to the target
+     * @return false if the buffer could not be accessed
+     */
+    bool read(uint8_t channel, std::string& data)
+    {
+        Desc desc;
+        if (!readDesc(true, channel, desc))
+        {
+            return false;
+        }
+        if (desc.wrOff == desc.rdOff)
+        {
+            return true;
+        }
+        uint32_t rd = desc.rdOff;
+        uint32_t chunk = (desc.wrOff > rd) ? desc.wrOff - rd : desc.size - rd;
+        size_t pos = data.size();
+        data.resize(pos + chunk);
+        if (!mMem.read(desc.buf + rd, &data[pos], chunk))
+        {
+            data.resize(pos);
+            return false;
+        }
+        if (desc.wrOff < rd && desc.wrOff)
+        {
+            pos = data.size();
+            data.resize(pos + desc.wrOff);
+            if (!mMem.read(desc.buf, &data[pos], desc.wrOff))
+            {
+                data.resize(pos);
+                return false;
+            }
+        }
+        return mMem.write(rdOffAddr(desc), &desc.wrOff, 4);
+    }
+    /** @brief Writes to a down buffer as much of \c data as fits
+     * @return The number of bytes written, or -1 on error
+     */
+    int write(uint8_t channel, const char* data, size_t len)
+    {
+        Desc desc;
+        if (!readDesc(false, channel, desc))
+        {
+            return -1;
+        }
+        uint32_t wr = desc.wrOff;
+        uint32_t avail = (desc.rdOff > wr) ? desc.rdOff - wr - 1 : desc.size - (wr - desc.rdOff) - 1;
+        if (len > avail)
+        {
+            len = avail;
+        }
+        uint32_t chunk = desc.size - wr;
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        if (!mMem.write(desc.buf + wr, data, chunk) ||
+            (len > chunk && !mMem.write(desc.buf, data + chunk, len - chunk)))
+        {
+            return -1;
+        }
+        wr += len;
+        if (wr >= desc.size)
+        {
+            wr -= desc.size;
+        }
+        return mMem.write(wrOffAddr(desc), &wr, 4) ? (int)len : -1;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * Buffered semihosting print sink
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_SHOST_PRINT_HPP
+#define STM32PP_SHOST_PRINT_HPP
+
+#include "printSink.hpp"
+#include "semihosting.hpp"
+#include "utils.hpp"
+#include <string.h>
+
+/** The size of the buffer of the default print sink */
+#ifndef STM32PP_SHOST_BUFSIZE
+    #define STM32PP_SHOST_BUFSIZE 256
+#endif
+
+/** The buffer of the default print sink is flushed when a newline is printed
+ * and the buffer contains at least that many bytes. 0 flushes at every
+ * newline, i.e. line buffering. STM32PP_SHOST_BUFSIZE flushes only when
+ * the buffer is full, or on an explicit flush()
+ */
+#ifndef STM32PP_SHOST_FLUSH_WATERMARK
+    #define STM32PP_SHOST_FLUSH_WATERMARK 0
+#endif
+
+namespace shost
+{
+/** @brief Print sink that coalesces the output in a RAM buffer, and sends it
+ * with a single SYS_WRITE semihosting call. Each semihosting call halts the
+ * core for a round trip through the debugger, which usually takes milliseconds,
+ * regardless of the amount of data. The buffer is flushed:
+ * - when a newline is printed, and the buffer contains at least \c Watermark bytes
+ * - when the buffer can't hold the next string
+ * - on an explicit flush(), i.e. by xassert() before halting
+ * - when printing to a different file descriptor than the buffered output
+ *
+ * Strings longer than the buffer are written directly. The buffer is accessed
+ * with interrupts disabled, so printing from interrupt handlers is safe.
+ */
+template <uint16_t Size=STM32PP_SHOST_BUFSIZE, uint16_t Watermark=STM32PP_SHOST_FLUSH_WATERMARK>
+class BufferedPrintSink: public IPrintSink
+{
+protected:
+    static_assert(Watermark <= Size, "Flush watermark can't be larger than the buffer size");
+    char mBuf[Size];
+    uint16_t mLen = 0;
+    int mFd = 1;
+    void doFlush()
+    {
+        if (mLen)
+        {
+            write(mBuf, mLen, mFd);
+            mLen = 0;
+        }
+    }
+public:
+    virtual BufferInfo* waitReady() { return nullptr; }
+    virtual void print(const char* str, size_t len, int fd)
+    {
+#ifndef STM32PP_NOT_EMBEDDED
+        IntrDisable intrDisable;
+#endif
+        if (fd != mFd)
+        {
+            doFlush();
+            mFd = fd;
+        }
+        if (mLen + len > Size)
+        {
+            doFlush();
+            if (len > Size)
+            {
+                write(str, len, fd);
+                return;
+            }
+        }
+        memcpy(mBuf + mLen, str, len);
+        mLen += len;
+        if (mLen >= Watermark && memchr(str, '\n', len))
+        {
+            doFlush();
+        }
+    }
+    virtual void flush()
+    {
+#ifndef STM32PP_NOT_EMBEDDED
+        IntrDisable intrDisable;
+#endif
+        doFlush();
+    }
+};
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <math.h> //for padding calculation we need log10
+#include <string.h> //for strlen
 
 static_assert(sizeof(size_t) == sizeof(void*), "size_t is not same size as void*");
 static_assert(sizeof(size_t) == sizeof(ptrdiff_t), "size_t is not same size as ptrdiff_t");
@@ -23,7 +24,9 @@ enum: uint16_t {
     kFlagsBaseMask = 0xff,
     kFlagsPrecMask = 0xff,
     kLowerCase = 0x0, kUpperCase = 0x1000,
-    kDontNullTerminate = 0x0200, kNoPrefix = 0x0400
+    kDontNullTerminate = 0x0200, kNoPrefix = 0x0400,
+    // Floating point: the shortest digits that convert back to the same value
+    kShortest = 0x0800
 };
 
 typedef uint16_t Flags;
@@ -80,11 +83,209 @@ struct DigitConverter<8, flags>
     static char toDigit(uint8_t digit) { return '0'+digit; }
 };
 
+/** Lookup tables for the decimal conversion. A template, so that a header-only
+ * definition results in a single copy in the firmware
+ */
+template <class T=void>
+struct DecTables
+{
+    static const char kDigitPairs[201]; // "00".."99", plus the string literal's null terminator
+    static const uint32_t kPow10[10];
+};
+
+template <class T>
+const char DecTables<T>::kDigitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+template <class T>
+const uint32_t DecTables<T>::kPow10[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+/** @brief Number of decimal digits of \c val, without a loop and with
+ * a single table lookup: the bit length, multiplied by log10(2) ~ 1233/4096,
+ * gives the digit count or one less
+ */
+static inline uint8_t decDigitCount(uint32_t val)
+{
+    val |= 1; // zero has one digit, and clz(0) is undefined
+    uint8_t approx = ((32 - __builtin_clz(val)) * 1233) >> 12;
+    return approx + 1 - (val < DecTables<>::kPow10[approx]);
+}
+
+/** @brief Exact for the whole uint32_t range. Written explicitly, as a
+ * single UMULL on Cortex-M3, rather than relying on the optimizer, which
+ * is disabled in debug builds
+ */
+static inline uint32_t div100(uint32_t val)
+{
+    return ((uint64_t)val * 0x51EB851F) >> 37;
+}
+
+/** @brief Writes the decimal digits of \c val, two at a time,
+ * backwards from \c end
+ */
+static inline void putDecDigits(char* end, uint32_t val)
+{
+    const char* pairs = DecTables<>::kDigitPairs;
+    while (val >= 100)
+    {
+        uint32_t quot = div100(val);
+        end -= 2;
+        memcpy(end, pairs + (val - quot * 100) * 2, 2); // a single halfword copy
+        val = quot;
+    }
+    if (val >= 10)
+    {
+        memcpy(end - 2, pairs + val * 2, 2);
+    }
+    else
+    {
+        *(end - 1) = '0' + val;
+    }
+}
+
+/** @brief Writes exactly 9 decimal digits of \c val, including leading
+ * zeros, backwards from \c end
+ */
+static inline void putDec9Digits(char* end, uint32_t val)
+{
+    const char* pairs = DecTables<>::kDigitPairs;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        uint32_t quot = div100(val);
+        end -= 2;
+        memcpy(end, pairs + (val - quot * 100) * 2, 2);
+        val = quot;
+    }
+    *(end - 1) = '0' + val;
+}
+
+/** @brief The high 64 bits of the 128-bit product, with 32-bit multiplies
+ * only (UMULL on Cortex-M3), so that no libgcc helper is called
+ */
+static inline uint64_t mulHigh64(uint64_t a, uint64_t b)
+{
+    uint64_t aLo = (uint32_t)a, aHi = a >> 32;
+    uint64_t bLo = (uint32_t)b, bHi = b >> 32;
+    uint64_t loLo = aLo * bLo;
+    uint64_t hiLo = aHi * bLo;
+    uint64_t loHi = aLo * bHi;
+    // can't overflow: at most 2 * (2^32 - 1) + (2^32 - 1)^2 = 2^64 - 1
+    uint64_t cross = (loLo >> 32) + (uint32_t)hiLo + loHi;
+    return aHi * bHi + (hiLo >> 32) + (cross >> 32);
+}
+
+/** @brief Division by 10^9 via multiplication by the reciprocal, exact for
+ * the whole uint64_t range. A plain division would call the software
+ * __aeabi_uldivmod on Cortex-M3. 10^9 = 2^9 * 1953125, so the value is
+ * pre-shifted by 9 bits, which allows a 55-bit magic number
+ */
+static inline uint64_t div1e9(uint64_t val)
+{
+    return mulHigh64(val >> 9, 0x44B82FA09B5A53ULL) >> 11;
+}
+
+/** @brief Writes the padding of a decimal number with \c numDigits digits
+ * @return Pointer to where the digits should be written, or nullptr if
+ * the number doesn't fit in the buffer
+ */
+template<Flags flags>
+char* putDecPadding(char* buf, size_t bufsize, uint8_t numDigits, uint8_t minDigits, uint16_t minLen)
+{
+    assert(buf);
+    assert(bufsize);
+
+    if ((flags & kDontNullTerminate) == 0)
+        bufsize--;
+    size_t padLen = (minDigits > numDigits) ? minDigits - numDigits : 0;
+    size_t totalLen = padLen + numDigits;
+    if (bufsize < ((totalLen < minLen) ? minLen : totalLen))
+    {
+        *buf = 0;
+        return nullptr;
+    }
+    for (; totalLen < minLen; totalLen++)
+    {
+        *(buf++) = ' ';
+    }
+    for(;padLen; padLen--)
+    {
+        *(buf++) = '0';
+    }
+    return buf;
+}
+
+/** @brief Base-10 conversion of values up to 32 bits. The digit count is
+ * known upfront, so the digits are written directly to their final position,
+ * without a staging buffer
+ */
+template<Flags flags=10>
+char* toStringDec(char* buf, size_t bufsize, uint32_t val, uint8_t minDigits=0, uint16_t minLen=0)
+{
+    uint8_t numDigits = decDigitCount(val);
+    buf = putDecPadding<flags>(buf, bufsize, numDigits, minDigits, minLen);
+    if (!buf)
+        return nullptr;
+    buf += numDigits;
+    putDecDigits(buf, val);
+    if ((flags & kDontNullTerminate) == 0)
+        *buf = 0;
+    return buf;
+}
+
+/** @brief Base-10 conversion of 64-bit values. The value is split into
+ * 9-digit chunks by one or two divisions by 10^9, and the chunks are
+ * converted with 32-bit arithmetic
+ */
+template<Flags flags=10>
+char* toStringDec64(char* buf, size_t bufsize, uint64_t val, uint8_t minDigits=0, uint16_t minLen=0)
+{
+    if (val <= 0xffffffff)
+        return toStringDec<flags>(buf, bufsize, (uint32_t)val, minDigits, minLen);
+
+    uint64_t high = div1e9(val);
+    uint32_t low = val - high * 1000000000;
+    uint32_t top = 0, mid; // val = top * 10^18 + mid * 10^9 + low
+    uint8_t numDigits;
+    if (high >= 1000000000)
+    {
+        top = div1e9(high); // at most 18
+        mid = high - (uint64_t)top * 1000000000;
+        numDigits = 18 + decDigitCount(top);
+    }
+    else
+    {
+        mid = high;
+        numDigits = 9 + decDigitCount(mid);
+    }
+    buf = putDecPadding<flags>(buf, bufsize, numDigits, minDigits, minLen);
+    if (!buf)
+        return nullptr;
+    buf += numDigits;
+    putDec9Digits(buf, low);
+    if (top)
+    {
+        putDec9Digits(buf - 9, mid);
+        putDecDigits(buf - 18, top);
+    }
+    else
+    {
+        putDecDigits(buf - 9, mid);
+    }
+    if ((flags & kDontNullTerminate) == 0)
+        *buf = 0;
+    return buf;
+}
+
+/** @brief Conversion in any base supported by DigitConverter, one digit
+ * at a time via a staging buffer. Used for non-decimal bases
+ */
 template<Flags flags=10, typename Val>
 typename std::enable_if<std::is_unsigned<Val>::value
                      && std::is_integral<Val>::value
                      && !std::is_same<Val, char>::value, char*>::type
-toString(char* buf, size_t bufsize, Val val, uint8_t minDigits=0, uint16_t minLen=0)
+toStringGeneric(char* buf, size_t bufsize, Val val, uint8_t minDigits=0, uint16_t minLen=0)
 {
     assert(buf);
     assert(bufsize);
@@ -116,7 +317,7 @@ toString(char* buf, size_t bufsize, Val val, uint8_t minDigits=0, uint16_t minLe
     if (((flags & kNoPrefix) == 0) && (digitConv.prefixLen != 0))
     {
         totalLen = digitConv.prefixLen+padLen+numDigits;
-        if (bufsize < totalLen)
+        if (bufsize < ((totalLen < minLen) ? minLen : totalLen))
         {
             *buf = 0;
             return nullptr;
@@ -126,7 +327,7 @@ toString(char* buf, size_t bufsize, Val val, uint8_t minDigits=0, uint16_t minLe
     else
     {
         totalLen = padLen + numDigits;
-        if (bufsize < totalLen)
+        if (bufsize < ((totalLen < minLen) ? minLen : totalLen))
         {
             *buf = 0;
             return nullptr;
@@ -157,6 +358,19 @@ toString(char* buf, size_t bufsize, Val val, uint8_t minDigits=0, uint16_t minLe
     return buf;
 }
 
+template<Flags flags=10, typename Val>
+typename std::enable_if<std::is_unsigned<Val>::value
+                     && std::is_integral<Val>::value
+                     && !std::is_same<Val, char>::value, char*>::type
+toString(char* buf, size_t bufsize, Val val, uint8_t minDigits=0, uint16_t minLen=0)
+{
+    if (baseFromFlags(flags) != 10)
+        return toStringGeneric<flags>(buf, bufsize, val, minDigits, minLen);
+    return (sizeof(Val) <= sizeof(uint32_t))
+        ? toStringDec<flags>(buf, bufsize, (uint32_t)val, minDigits, minLen)
+        : toStringDec64<flags>(buf, bufsize, val, minDigits, minLen);
+}
+
 template<Flags flags=10, typename Val>
 typename std::enable_if<std::is_integral<Val>::value
     && std::is_signed<Val>::value
@@ -236,6 +450,39 @@ struct NumLenForBase
 {
   enum: uint8_t { value = sizeof(T)*(uint8_t)(log10f(256)/log10f(base)+0.9) };
 };
+
+/** The toStringMaxLen() overloads return an upper bound of the number of
+ * chars that toString() produces for the given value, excluding the
+ * terminating null. The bound is a compile-time constant for numeric types,
+ * and the exact length for strings. It is used by tprintf() to allocate
+ * its buffer only once.
+ */
+template<typename Val>
+constexpr typename std::enable_if<std::is_integral<Val>::value
+    && !std::is_same<Val, char>::value, size_t>::type
+toStringMaxLen(Val)
+{
+    return NumLenForBase<Val, 10>::value + std::is_signed<Val>::value;
+}
+
+template<typename Val>
+constexpr typename std::enable_if<std::is_same<Val, char>::value, size_t>::type
+toStringMaxLen(Val) { return 1; }
+
+template <typename T, Flags flags>
+size_t toStringMaxLen(IntFmt<T, flags> num)
+{
+    typedef IntFmt<T, flags> Fmt;
+    typedef DigitConverter<Fmt::base, flags> Conv;
+    size_t len = (num.minDigits > NumLenForBase<typename Fmt::ScalarType, Fmt::base>::value)
+        ? num.minDigits
+        : (size_t)NumLenForBase<typename Fmt::ScalarType, Fmt::base>::value;
+    if ((flags & kNoPrefix) == 0)
+    {
+        len += Conv::prefixLen;
+    }
+    return (len > num.minLen) ? len : num.minLen;
+}
 /**
  * @param flags
  * - The lower 8 bits are the numeric base for the conversion, i.e.
@@ -293,6 +540,15 @@ toString(char *buf, size_t bufsize, P ptr)
     return toString(buf, bufsize, fmtPtr(ptr));
 }
 
+template <class P>
+constexpr typename std::enable_if<std::is_pointer<P>::value && !is_char_ptr<P>::value, size_t>::type
+toStringMaxLen(P)
+{
+    return DigitConverter<16>::prefixLen + sizeof(void*) * 2;
+}
+
+static inline size_t toStringMaxLen(const char* str) { return strlen(str); }
+
 template<Flags flags=0, Flags fmtFlags, typename Val>
 char* toString(char *buf, size_t bufsize, IntFmt<Val, fmtFlags> num)
 {
@@ -366,78 +622,74 @@ toString(char* buf, size_t bufsize, Val val)
         return nullptr;
     }
 }
-template <size_t base, uint8_t p>
-struct Pow
-{  enum: size_t { value = base * Pow<base, p-1>::value  }; };
+/** @brief Decimal digits of a floating point number, as produced by fpToDecimal() */
+struct FpDecimal
+{
+    enum: uint8_t { kFinite, kInf, kNan };
+    char digits[20];
+    uint8_t len;
+    int16_t pointPos; // position of the decimal point, relative to the first digit
+    bool neg;
+    uint8_t kind;
+};
+
+enum: uint8_t
+{
+    // Numbers with more digits before the decimal point are formatted in
+    // scientific notation. Same on all platforms, so that the binary log
+    // decoder produces the same output
+    kFpMaxWholeDigits = 12,
+    kFpShortestMaxLen = 24
+};
 
-template <size_t base>
-struct Pow<base, 1>
-{ enum: size_t { value = base }; };
+/** @brief Converts to the shortest decimal digits that convert back to
+ * \c val, using integer arithmetic only (Grisu2). Defined in fpconv.cpp.
+ * Defining STM32PP_FPCONV_SMALL_TABLE when compiling it reduces the table of
+ * powers of 10 from 870 to 120 bytes, by covering only the range of float.
+ * In that case, doubles outside that range are converted to 0 or infinity
+ */
+void fpToDecimal(float val, FpDecimal& dec);
+void fpToDecimal(double val, FpDecimal& dec);
+
+/** @brief Formats the digits with \c prec digits after the decimal point,
+ * rounded half-up, and a whole part zero-padded to \c minDigits.
+ * Numbers with more than kFpMaxWholeDigits digits before the decimal point
+ * are formatted in scientific notation
+ */
+char* fpPutFixed(char* buf, size_t bufsize, const FpDecimal& dec, uint8_t prec,
+    uint8_t minDigits, bool nullTerminate);
 
+/** @brief Formats the digits as they are, in fixed notation if the number is not
+ * too large or small, i.e. 0.1, 1234.5, 100.0, otherwise in scientific notation,
+ * i.e. 1.5e+20, 1e-07
+ */
+char* fpPutShortest(char* buf, size_t bufsize, const FpDecimal& dec, bool nullTerminate);
+
+/** @brief Converts a floating point number to string. Only integer arithmetic
+ * is used, so soft-float code is not pulled in on chips without an FPU.
+ * @param flags The lower 8 bits are the number of digits after the decimal
+ * point (6 if zero). With kShortest, the shortest representation that converts
+ * back to the same value is printed instead, and \c minDigits is ignored
+ * @param minDigits The minimum number of digits of the whole part
+ */
 template<Flags flags=6, typename Val>
 typename std::enable_if<std::is_floating_point<Val>::value, char*>::type
 toString(char* buf, size_t bufsize, Val val, uint8_t minDigits=0)
 {
-    enum: uint8_t { prec = precFromFlags(flags) };
-    if (!bufsize)
-        return nullptr;
-    char* bufRealEnd = buf+bufsize;
-    if ((flags & kDontNullTerminate) == 0)
-        bufsize--;
-
-    char* bufend = buf+bufsize;
-    if (val < 0)
-    {
-        if (bufsize < 4) //at least '-0.0'
-        {
-            *buf = 0;
-            return nullptr;
-        }
-        *(buf++) = '-';
-        val = -val;
-    }
-    else
-    {
-        if (bufsize < 3)
-        {
-            *buf = 0;
-            return nullptr;
-        }
-    }
-    size_t whole = (size_t)(val);
-
-    // value to multiply the fractional part so that it becomes an int
-    enum: uint32_t { mult = Pow<10, prec>::value };
-    size_t fractional = (val - whole) * mult + 0.5;
-    if (fractional >= mult) //the part after the dot overflows to >= 1 due to rounding
-    {
-        //move the overflowed unit to the whole part and subtract it from
-        //the decimal
-        whole++;
-        fractional -= mult;
-    }
-    //we have some minimum space for null termination even if buffer is not enough
-    buf = toString<(flags&~kFlagsBaseMask)|10>(buf, bufRealEnd-buf, whole, minDigits);
-    if (!buf)
-    {
-        assert(*(bufRealEnd-1)==0); //assert null termination
-        return nullptr;
-    }
-    assert(buf < bufRealEnd);
-    if (bufend-buf < 2) //must have space at least for '.0' and optional null terminator
-    {
-        *buf = 0;
-        return nullptr;
-    }
-    *(buf++) = '.';
-    return toString(buf, bufRealEnd-buf, fractional, prec);
+    // long double is formatted as double
+    typedef typename std::conditional<sizeof(Val) == sizeof(float), float, double>::type FpType;
+    FpDecimal dec;
+    fpToDecimal((FpType)val, dec);
+    return (flags & kShortest)
+        ? fpPutShortest(buf, bufsize, dec, (flags & kDontNullTerminate) == 0)
+        : fpPutFixed(buf, bufsize, dec, precFromFlags(flags), minDigits, (flags & kDontNullTerminate) == 0);
 }
 
 template <class T, Flags aFlags>
 struct FpFmt
 {
     enum: uint8_t { prec = precFromFlags(aFlags) };
-    constexpr static Flags flags = aFlags & kFlagsPrecMask;
+    constexpr static Flags flags = aFlags & (kFlagsPrecMask | kShortest);
     T value;
     uint8_t minDigits;
     FpFmt(T aVal, uint8_t aMinDigits): value(aVal), minDigits(aMinDigits){}
@@ -459,6 +711,23 @@ auto fmtFp(T val, uint8_t minDigits=0)
     return FpFmt<T, aFlags>(val, minDigits);
 }
 
+template<typename Val>
+constexpr typename std::enable_if<std::is_floating_point<Val>::value, size_t>::type
+toStringMaxLen(Val, uint8_t minDigits=0, uint8_t prec=precFromFlags(0))
+{
+    // sign, whole part, decimal point, fractional part. Larger numbers are
+    // in scientific notation, which is shorter
+    return 1 + ((minDigits > kFpMaxWholeDigits) ? minDigits : (uint8_t)kFpMaxWholeDigits) + 1 + prec;
+}
+
+template <class T, Flags flags>
+size_t toStringMaxLen(FpFmt<T, flags> fp)
+{
+    return (flags & kShortest)
+        ? (size_t)kFpShortestMaxLen
+        : toStringMaxLen(fp.value, fp.minDigits, FpFmt<T, flags>::prec);
+}
+
 template <Flags generalFlags, Flags fpFlags, typename Val>
 char* toString(char *buf, size_t bufsize, FpFmt<Val, fpFlags> fp)
 {
@@ -468,6 +737,195 @@ char* toString(char *buf, size_t bufsize, FpFmt<Val, fpFlags> fp)
     return toString<fp.flags | (generalFlags & ~kFlagsPrecMask), Val>(buf, bufsize, fp.value, fp.minDigits);
 }
 
+constexpr uint32_t pow10(uint8_t exp) { return exp ? 10 * pow10(exp - 1) : 1; }
+
+/** @brief Splits a value with \c decimals decimal places into its whole and
+ * fractional parts. \c scale must be 10^decimals
+ */
+template <typename UVal>
+UVal fixedSplitDec(UVal mag, uint32_t scale, uint32_t& frac)
+{
+    UVal whole = mag / scale;
+    frac = mag - whole * scale;
+    return whole;
+}
+
+/** @brief Splits a Q-format value with \c fracBits fractional bits into its
+ * whole part and its fractional part, rounded to the decimal places of \c scale,
+ * which is 10^prec. Only integer multiplication and shifts are used
+ */
+template <typename UVal>
+UVal fixedSplitQ(UVal mag, uint8_t fracBits, uint32_t scale, uint32_t& frac)
+{
+    if (!fracBits)
+    {
+        frac = 0;
+        return mag;
+    }
+    UVal whole = mag >> fracBits;
+    uint64_t fracPart = mag & ((((uint64_t)1) << fracBits) - 1);
+    frac = (fracPart * scale + (((uint64_t)1) << (fracBits - 1))) >> fracBits;
+    if (frac >= scale) // rounding overflowed to the whole part
+    {
+        whole++;
+        frac -= scale;
+    }
+    return whole;
+}
+
+/** @brief Formats a fixed-point number from its whole and fractional parts,
+ * as [-]whole.frac, with \c decimals digits after the decimal point.
+ * Used by both the decimal and the Q-format types
+ */
+template <Flags flags=0, typename UVal>
+char* toStringFixed(char* buf, size_t bufsize, bool neg, UVal whole, uint32_t frac,
+    uint8_t decimals, uint8_t minDigits)
+{
+    if (!bufsize)
+        return nullptr;
+    char* bufend = buf + bufsize;
+    if ((flags & kDontNullTerminate) == 0)
+        bufend--; // reserve space for the terminating null
+    size_t fracLen = decimals ? decimals + 1 : 0;
+    if ((size_t)(bufend - buf) < neg + 1 + fracLen)
+    {
+        if ((flags & kDontNullTerminate) == 0)
+            *buf = 0;
+        return nullptr;
+    }
+    if (neg)
+        *(buf++) = '-';
+    // the whole part must leave space for the fractional part
+    buf = toString<kDontNullTerminate | 10>(buf, bufend - buf - fracLen, whole, minDigits);
+    if (!buf)
+        return nullptr;
+    if (decimals)
+    {
+        *(buf++) = '.';
+        buf = toStringDec<kDontNullTerminate>(buf, decimals, frac, decimals);
+    }
+    if ((flags & kDontNullTerminate) == 0)
+        *buf = 0;
+    return buf;
+}
+
+template <typename T>
+typename std::enable_if<std::is_signed<T>::value, typename std::make_unsigned<T>::type>::type
+magnitude(T val, bool& neg)
+{
+    typedef typename std::make_unsigned<T>::type UVal;
+    neg = val < 0;
+    return neg ? (UVal)0 - (UVal)val : (UVal)val;
+}
+
+template <typename T>
+typename std::enable_if<std::is_unsigned<T>::value, T>::type
+magnitude(T val, bool& neg)
+{
+    neg = false;
+    return val;
+}
+
+/** @brief An integer that holds a value scaled by 10^decimals, i.e.
+ * centi-degrees for \c decimals = 2. See fmtFixed()
+ */
+template <class T, uint8_t aDecimals>
+struct FixedFmt
+{
+    static_assert(std::is_integral<T>::value, "Fixed-point value must be an integer");
+    static_assert(aDecimals <= 9, "Fixed-point decimals must be at most 9");
+    enum: uint8_t { decimals = aDecimals };
+    T value;
+    uint8_t minDigits;
+    FixedFmt(T aVal, uint8_t aMinDigits): value(aVal), minDigits(aMinDigits){}
+};
+
+/**
+ * Specifies that an integer is a fixed-point number with \c decimals decimal
+ * places, i.e. fmtFixed<2>(-1234) is printed as -12.34. Only integer arithmetic
+ * is used, so no floating point code is pulled in.
+ * @param minDigits - the minimum number of digits of the whole part of the number
+ */
+template <uint8_t decimals, class T>
+FixedFmt<T, decimals> fmtFixed(T val, uint8_t minDigits=0)
+{
+    return FixedFmt<T, decimals>(val, minDigits);
+}
+
+template <class T, uint8_t decimals>
+constexpr size_t toStringMaxLen(FixedFmt<T, decimals> fp)
+{
+    // sign, whole part, decimal point, fractional part
+    return 1 + ((fp.minDigits > NumLenForBase<T, 10>::value)
+        ? fp.minDigits : (size_t)NumLenForBase<T, 10>::value) + (decimals ? decimals + 1 : 0);
+}
+
+template <Flags flags=0, class T, uint8_t decimals>
+char* toString(char* buf, size_t bufsize, FixedFmt<T, decimals> fp)
+{
+    constexpr uint32_t scale = pow10(decimals);
+    bool neg;
+    uint32_t frac;
+    auto whole = fixedSplitDec(magnitude(fp.value, neg), scale, frac);
+    return toStringFixed<flags>(buf, bufsize, neg, whole, frac, decimals, fp.minDigits);
+}
+
+/** @brief The number of decimal places needed to show the resolution of
+ * \c fracBits binary fractional bits, i.e. ceil(fracBits * log10(2)), max 9
+ */
+constexpr uint8_t qDefaultPrec(uint8_t fracBits)
+{
+    return ((fracBits * 1233 + 4095) >> 12) > 9 ? 9 : ((fracBits * 1233 + 4095) >> 12);
+}
+
+/** @brief A Q-format fixed-point number - an integer that holds a value scaled
+ * by 2^fracBits. See fmtQ()
+ */
+template <class T, uint8_t aFracBits, uint8_t aPrec>
+struct QFmt
+{
+    static_assert(std::is_integral<T>::value, "Q-format value must be an integer");
+    static_assert(aFracBits < sizeof(T) * 8 && aFracBits <= 32,
+        "Q-format must have less fractional bits than the integer size, and at most 32");
+    static_assert(aPrec <= 9, "Q-format precision must be at most 9");
+    enum: uint8_t { fracBits = aFracBits, prec = aPrec };
+    T value;
+    uint8_t minDigits;
+    QFmt(T aVal, uint8_t aMinDigits): value(aVal), minDigits(aMinDigits){}
+};
+
+/**
+ * Specifies that an integer is a Q-format fixed-point number with \c fracBits
+ * fractional bits, i.e. fmtQ<15>(int16_t) for Q15. It is printed as a decimal
+ * number with \c prec digits after the decimal point, with rounding.
+ * Only integer arithmetic is used, so no floating point code is pulled in.
+ * @param prec - the number of decimal places. By default, enough to show
+ * the resolution of the fractional bits
+ * @param minDigits - the minimum number of digits of the whole part of the number
+ */
+template <uint8_t fracBits, uint8_t prec=qDefaultPrec(fracBits), class T>
+QFmt<T, fracBits, prec> fmtQ(T val, uint8_t minDigits=0)
+{
+    return QFmt<T, fracBits, prec>(val, minDigits);
+}
+
+template <class T, uint8_t fracBits, uint8_t prec>
+constexpr size_t toStringMaxLen(QFmt<T, fracBits, prec> fp)
+{
+    return 1 + ((fp.minDigits > NumLenForBase<T, 10>::value)
+        ? fp.minDigits : (size_t)NumLenForBase<T, 10>::value) + (prec ? prec + 1 : 0);
+}
+
+template <Flags flags=0, class T, uint8_t fracBits, uint8_t prec>
+char* toString(char* buf, size_t bufsize, QFmt<T, fracBits, prec> fp)
+{
+    constexpr uint32_t scale = pow10(prec);
+    bool neg;
+    uint32_t frac;
+    auto whole = fixedSplitQ(magnitude(fp.value, neg), fracBits, scale, frac);
+    return toStringFixed<flags>(buf, bufsize, neg, whole, frac, prec, fp.minDigits);
+}
+
 template <uint8_t aFlags=0>
 struct RptChar
 {
@@ -485,6 +943,9 @@ RptChar<aFlags> rptChar(char ch, uint16_t count)
     return RptChar<aFlags>(ch, count);
 }
 
+template <uint8_t rptFlags>
+size_t toStringMaxLen(RptChar<rptFlags> val) { return val.count(); }
+
 template <Flags aFlags=0, uint8_t rptFlags>
 char* toString(char* buf, size_t bufsize, RptChar<rptFlags> val)
 {
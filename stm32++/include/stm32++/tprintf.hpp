@@ -24,33 +24,80 @@
     #define STM32PP_TPRINTF_SYNC_EXPAND_STEP 128
 #endif
 
-template <int InitialBufSize=64, typename... Args>
-size_t ftprintf(uint8_t fd, const char* fmtStr, Args... args)
+/** @brief Formats and prints to the current print sink.
+ * The length of the output is precomputed with formattedLength(), so the
+ * buffer is allocated only once. For synchronous sinks, if the output fits
+ * in \c InitialBufSize bytes, the buffer is allocated on the stack.
+ * Only if an argument type has no toStringMaxLen() overload, the buffer
+ * is grown on demand and the formatting is retried.
+ * If the sink supports it (see IPrintSink::reserve()), the output is
+ * formatted directly into the sink's transmit memory, so no buffer is
+ * allocated and nothing is copied.
+ * @param fmtStr Either a plain C string, or a compile-time format string
+ * created with the \c _fmt literal suffix, which is parsed at compile time
+ */
+template <int InitialBufSize=64, typename Fmt, typename... Args>
+size_t ftprintf(uint8_t fd, Fmt fmtStr, Args... args)
 {
     extern IPrintSink* gPrintSink;
-    char* staticBuf; // static buf
+    char* staticBuf = nullptr; // static buf
     char* buf;
-    size_t bufsize;
+
+    size_t maxLen = formattedLength(fmtStr, args...);
+    bool lenKnown = (maxLen != kLenUnknown);
+    size_t bufsize = lenKnown ? maxLen + 1 : InitialBufSize;
+    if (bufsize > STM32PP_TPRINTF_MAX_DYNAMIC_BUFSIZE)
+    {
+        return 0;
+    }
+    if (lenKnown && gPrintSink->canFormatInPlace())
+    {
+        // Format directly into the sink's transmit memory
+        buf = gPrintSink->reserve(bufsize);
+        if (!buf)
+        {
+            return 0;
+        }
+        char* ret = tsnprintf(buf, bufsize, fmtStr, args...);
+        assert(ret);
+        size_t size = ret ? ret - buf : 0;
+        gPrintSink->commit(buf, size);
+        return size;
+    }
 
     auto async = gPrintSink->waitReady();
     if (async)
     {
-        staticBuf = nullptr;
-        if (async->buf)
+        if (async->buf && async->bufSize >= bufsize)
         {
             buf = (char*)async->buf;
             bufsize = async->bufSize;
         }
         else
         {
-            buf = (char*)malloc(InitialBufSize);
-            bufsize = InitialBufSize;
+            // realloc(nullptr) is equivalent to malloc()
+            buf = (char*)realloc((void*)async->buf, bufsize);
+            if (!buf)
+            {
+                // realloc doesn't free the old buffer when it fails,
+                // so the sink's pointer remains valid
+                return 0;
+            }
+            async->buf = buf;
+            async->bufSize = bufsize;
         }
     }
+    else if (bufsize <= InitialBufSize)
+    {
+        buf = staticBuf = (char*)alloca(bufsize);
+    }
     else
     {
-        buf = staticBuf = (char*)alloca(InitialBufSize);
-        bufsize = InitialBufSize;
+        buf = (char*)malloc(bufsize);
+        if (!buf)
+        {
+            return 0;
+        }
     }
     char* ret;
     for(;;)
@@ -60,7 +107,9 @@ size_t ftprintf(uint8_t fd, const char* fmtStr, Args... args)
         {
             break;
         }
-        // tsnprintf() returned nullptr, have to increase buf size
+        // tsnprintf() returned nullptr, have to increase buf size.
+        // This can happen only if the max length was not known in advance
+        assert(!lenKnown);
         bufsize += async ? STM32PP_TPRINTF_ASYNC_EXPAND_STEP : STM32PP_TPRINTF_SYNC_EXPAND_STEP;
         if (bufsize > STM32PP_TPRINTF_MAX_DYNAMIC_BUFSIZE)
         {
@@ -71,15 +120,23 @@ size_t ftprintf(uint8_t fd, const char* fmtStr, Args... args)
             }
             return 0;
         }
-        buf = (buf == staticBuf)
+        char* newBuf = (buf == staticBuf)
             ? (char*)malloc(bufsize)
             : (char*)realloc(buf, bufsize);
-        if (!buf)
+        if (!newBuf)
         {
-            // If we are async, we did a realloc. When realloc fails,
-            // it doesn't free the old buffer, so the sink's pointer remains valid
+            if ((buf != staticBuf) && !async)
+            {
+                free(buf);
+            }
             return 0;
         }
+        buf = newBuf;
+        if (async)
+        {
+            async->buf = buf;
+            async->bufSize = bufsize;
+        }
     }
     assert(ret >= buf);
     size_t size = ret-buf;
@@ -98,12 +155,33 @@ size_t ftprintf(uint8_t fd, const char* fmtStr, Args... args)
     return size;
 }
 
-template <int InitialBufSize=64, typename ...Args>
-uint16_t tprintf(const char* fmtStr, Args... args)
+#ifdef STM32PP_TPRINTF_DEFERRED
+namespace binlog
+{
+template <int InitialBufSize, char... Chars, typename... Args>
+size_t fprint(uint8_t fd, FmtString<Chars...>, Args... args);
+}
+
+/** @brief In deferred logging mode, compile-time format strings are not
+ * formatted on the chip, but emitted as binary records (see binlog.hpp)
+ */
+template <int InitialBufSize=64, char... Chars, typename... Args>
+size_t ftprintf(uint8_t fd, FmtString<Chars...> fmtStr, Args... args)
+{
+    return binlog::fprint<InitialBufSize>(fd, fmtStr, args...);
+}
+#endif
+
+template <int InitialBufSize=64, typename Fmt, typename ...Args>
+uint16_t tprintf(Fmt fmtStr, Args... args)
 {
     return ftprintf<InitialBufSize>(1, fmtStr, args...);
 }
 
+#ifdef STM32PP_TPRINTF_DEFERRED
+    #include "binlog.hpp"
+#endif
+
 static inline void puts(const char* str, uint16_t len)
 {
     extern IPrintSink* gPrintSink;
@@ -7,8 +7,10 @@
 #define _TSNPRINTF_H
 
 #include "tostring.hpp"
+#include "fmtstring.hpp"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <alloca.h>
 char* tsnprintf(char* buf, size_t bufsize, const char* fmtStr);
 
@@ -71,4 +73,278 @@ char* tsnprintf(char* buf, size_t bufsize, const char* fmtStr, Val val, Args...
     return nullptr;
 }
 
+/** @brief Copies the literal segment [Pos, End) of a compile-time format string.
+ * \c bufend points to the last char of the buffer, which is reserved for
+ * the null terminator.
+ * @return The write position after the segment, or nullptr if the segment
+ * doesn't fit. In that case the buffer is filled and null-terminated
+ */
+template <class Fmt, size_t Pos, size_t End>
+static inline char* fmtCopyLiteral(char* buf, char* bufend)
+{
+    constexpr size_t kLen = End - Pos;
+    if (!kLen)
+    {
+        return buf;
+    }
+    size_t avail = bufend - buf;
+    if (avail < kLen)
+    {
+        memcpy(buf, Fmt::kStr + Pos, avail);
+        *bufend = 0;
+        return nullptr;
+    }
+    memcpy(buf, Fmt::kStr + Pos, kLen);
+    return buf + kLen;
+}
+
+template <class Val>
+struct FmtSpecIsInt
+{
+    enum: bool { value = std::is_integral<Val>::value && !std::is_same<Val, char>::value
+        && !std::is_same<Val, bool>::value };
+};
+
+/** @brief Converts a value according to the type, minDigits and precision of
+ * a placeholder spec - integers
+ */
+template <char type, uint8_t minDigits, uint8_t prec, typename Val>
+typename std::enable_if<FmtSpecIsInt<Val>::value, char*>::type
+fmtSpecValue(char* buf, size_t bufsize, Val val)
+{
+    static_assert(prec == 0, "tsnprintf: Precision can be specified only for floating point values");
+    typedef typename std::make_unsigned<Val>::type UVal;
+    enum: Flags { flags = kDontNullTerminate | fmtSpecBase(type) | (type == 'X' ? kUpperCase : 0) };
+    if (!type)
+    {
+        return toString<kDontNullTerminate>(buf, bufsize, val);
+    }
+    // Negative numbers are formatted in two's complement in non-decimal bases
+    if (fmtSpecBase(type) == 10 && std::is_signed<Val>::value && val < 0)
+    {
+        if (!bufsize)
+        {
+            return nullptr;
+        }
+        *buf = '-';
+        return toString<flags>(buf + 1, bufsize - 1, (UVal)(0 - (UVal)val), minDigits);
+    }
+    return toString<flags>(buf, bufsize, (UVal)val, minDigits);
+}
+
+// Floating point
+template <char type, uint8_t minDigits, uint8_t prec, typename Val>
+typename std::enable_if<std::is_floating_point<Val>::value, char*>::type
+fmtSpecValue(char* buf, size_t bufsize, Val val)
+{
+    static_assert(type == 0, "tsnprintf: Number format type can be specified only for integers");
+    return toString<kDontNullTerminate | prec>(buf, bufsize, val);
+}
+
+// Any other type - only width and alignment are applicable
+template <char type, uint8_t minDigits, uint8_t prec, typename Val>
+typename std::enable_if<!FmtSpecIsInt<Val>::value && !std::is_floating_point<Val>::value, char*>::type
+fmtSpecValue(char* buf, size_t bufsize, Val val)
+{
+    static_assert(type == 0 && prec == 0,
+        "tsnprintf: Only width and alignment can be specified for this type");
+    return toString<kDontNullTerminate>(buf, bufsize, val);
+}
+
+/** @brief Pads the string [start, end) with spaces to \c width chars
+ * @return The new end, or nullptr if the padding doesn't fit before \c bufend
+ */
+template <bool leftAlign, uint8_t width>
+char* fmtSpecPad(char* start, char* end, char* bufend)
+{
+    size_t len = end - start;
+    if (len >= width)
+    {
+        return end;
+    }
+    size_t pad = width - len;
+    if (pad > (size_t)(bufend + 1 - end))
+    {
+        return nullptr;
+    }
+    if (leftAlign)
+    {
+        memset(end, ' ', pad);
+    }
+    else
+    {
+        memmove(start + pad, start, len);
+        memset(start, ' ', pad);
+    }
+    return end + pad;
+}
+
+template <class Fmt, size_t Pos>
+char* fmtStaticPrint(char* buf, char* bufend)
+{
+    static_assert(Fmt::findPlaceholder(Pos) == Fmt::kLen,
+        "tsnprintf: Format string has more placeholders than arguments");
+    buf = fmtCopyLiteral<Fmt, Pos, Fmt::kLen>(buf, bufend);
+    if (!buf)
+    {
+        return nullptr;
+    }
+    *buf = 0;
+    return buf;
+}
+
+template <class Fmt, size_t Pos, typename Val, typename... Args>
+char* fmtStaticPrint(char* buf, char* bufend, Val val, Args... args)
+{
+    constexpr size_t kPlaceholder = Fmt::findPlaceholder(Pos);
+    static_assert(kPlaceholder < Fmt::kLen,
+        "tsnprintf: Format string has fewer placeholders than arguments");
+    buf = fmtCopyLiteral<Fmt, Pos, kPlaceholder>(buf, bufend);
+    if (!buf)
+    {
+        return nullptr;
+    }
+    constexpr FmtSpec kSpec = Fmt::spec(kPlaceholder);
+    static_assert(kSpec.valid, "tsnprintf: Invalid placeholder spec, "
+        "must be %{[<|>][width][d|x|X|o|b[minDigits]][.prec]}");
+    char* start = buf;
+    buf = fmtSpecValue<kSpec.type, kSpec.minDigits, kSpec.prec>(buf, bufend-buf+1, val);
+    if (buf && kSpec.width)
+    {
+        buf = fmtSpecPad<kSpec.leftAlign, kSpec.width>(start, buf, bufend);
+    }
+    if (!buf)
+    {
+        *bufend = 0;
+        return nullptr;
+    }
+    if (buf > bufend)
+    {
+        // The value took the place of the terminating null
+        assert(buf - bufend == 1);
+        *bufend = 0;
+        return nullptr;
+    }
+    return fmtStaticPrint<Fmt, kSpec.end>(buf, bufend, args...);
+}
+
+/** @brief Version of tsnprintf() that takes a compile-time format string,
+ * created with the \c _fmt literal suffix. The format string is split into
+ * literal segments and placeholders at compile time, and the number of
+ * placeholders is checked against the number of arguments.
+ * @return The address of the terminating null of the written string, or
+ * nullptr if the buffer was not large enough
+ */
+template <char... Chars, typename... Args>
+char* tsnprintf(char* buf, size_t bufsize, FmtString<Chars...>, Args... args)
+{
+    assert(buf);
+    assert(bufsize);
+    return fmtStaticPrint<FmtString<Chars...>, 0>(buf, buf+bufsize-1, args...);
+}
+
+enum: size_t { kLenUnknown = (size_t)-1 };
+
+// Selected if there is a toStringMaxLen() overload for the type
+template <typename Val>
+auto argMaxLen(const Val& val, int) -> decltype(toStringMaxLen(val))
+{
+    return toStringMaxLen(val);
+}
+
+// Fallback for types that have a toString(), but no toStringMaxLen() overload
+template <typename Val>
+size_t argMaxLen(const Val&, long) { return kLenUnknown; }
+
+static inline size_t argsMaxLen() { return 0; }
+
+template <typename Val, typename... Args>
+size_t argsMaxLen(Val val, Args... args)
+{
+    size_t len = argMaxLen(val, 0);
+    if (len == kLenUnknown)
+    {
+        return kLenUnknown;
+    }
+    size_t rest = argsMaxLen(args...);
+    return (rest == kLenUnknown) ? kLenUnknown : len + rest;
+}
+
+/** @brief Returns an upper bound of the length of the string that tsnprintf()
+ * produces for the given format string and arguments, excluding the
+ * terminating null. The bound is exact for the literal parts of the format
+ * string and for string arguments, and is a compile-time constant for
+ * numeric arguments.
+ * If the length of an argument can't be determined, because it has
+ * no toStringMaxLen() overload, \c kLenUnknown is returned.
+ */
+template <typename... Args>
+size_t formattedLength(const char* fmtStr, Args... args)
+{
+    size_t argsLen = argsMaxLen(args...);
+    // Each placeholder is counted as one char
+    return (argsLen == kLenUnknown) ? kLenUnknown : strlen(fmtStr) + argsLen;
+}
+
+template <char type, uint8_t minDigits, uint8_t prec, typename Val>
+typename std::enable_if<FmtSpecIsInt<Val>::value, size_t>::type
+fmtSpecMaxLen(Val val)
+{
+    typedef typename std::make_unsigned<Val>::type UVal;
+    if (!type)
+    {
+        return toStringMaxLen(val);
+    }
+    size_t len = NumLenForBase<UVal, fmtSpecBase(type)>::value;
+    if (len < minDigits)
+    {
+        len = minDigits;
+    }
+    return len + DigitConverter<fmtSpecBase(type)>::prefixLen + (fmtSpecBase(type) == 10 && std::is_signed<Val>::value);
+}
+
+template <char type, uint8_t minDigits, uint8_t prec, typename Val>
+typename std::enable_if<std::is_floating_point<Val>::value, size_t>::type
+fmtSpecMaxLen(Val val)
+{
+    return toStringMaxLen(val, 0, precFromFlags(prec));
+}
+
+template <char type, uint8_t minDigits, uint8_t prec, typename Val>
+typename std::enable_if<!FmtSpecIsInt<Val>::value && !std::is_floating_point<Val>::value, size_t>::type
+fmtSpecMaxLen(Val val)
+{
+    return argMaxLen(val, 0);
+}
+
+template <class Fmt, size_t Pos>
+size_t fmtArgsMaxLen() { return 0; }
+
+template <class Fmt, size_t Pos, typename Val, typename... Args>
+size_t fmtArgsMaxLen(Val val, Args... args)
+{
+    constexpr size_t kPlaceholder = Fmt::findPlaceholder(Pos);
+    constexpr FmtSpec kSpec = Fmt::spec(kPlaceholder);
+    size_t len = fmtSpecMaxLen<kSpec.type, kSpec.minDigits, kSpec.prec>(val);
+    if (len == kLenUnknown)
+    {
+        return kLenUnknown;
+    }
+    if (len < kSpec.width)
+    {
+        len = kSpec.width;
+    }
+    size_t rest = fmtArgsMaxLen<Fmt, kSpec.end>(args...);
+    return (rest == kLenUnknown) ? kLenUnknown : len + rest;
+}
+
+template <char... Chars, typename... Args>
+size_t formattedLength(FmtString<Chars...>, Args... args)
+{
+    size_t argsLen = fmtArgsMaxLen<FmtString<Chars...>, 0>(args...);
+    return (argsLen == kLenUnknown)
+        ? kLenUnknown
+        : FmtString<Chars...>::literalLen() + argsLen;
+}
+
 #endif
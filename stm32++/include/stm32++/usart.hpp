@@ -10,16 +10,15 @@
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/dma.h>
 #include <libopencm3/cm3/nvic.h>
-#include "tprintf.hpp"
+#include "log.hpp"
 #include "dma.hpp"
+#include "byteFifo.hpp"
+#include "dmaRxRing.hpp"
+#include "utils.hpp"
 #include <assert.h>
-#ifdef STM32PP_USART_DEBUG
-#define STM32PP_USART_LOG(fmtString,...) tprintf("%: " fmtString "\n", Self::periphName(), ##__VA_ARGS__)
-#else
-#define STM32PP_USART_LOG(fmtString,...)
-#endif
 
-#define STM32PP_LOG_DEBUG(fmtString,...) STM32PP_USART_LOG(fmtString, ##__VA_ARGS__)
+#define STM32PP_USART_LOG(fmtString,...) \
+    STM32PP_LOG(Usart, Debug, "%: " fmtString, Self::periphName(), ##__VA_ARGS__)
 
 STM32PP_PERIPH_INFO(USART1)
     enum: uint32_t { kPort = GPIOA };
@@ -210,6 +209,163 @@ public:
     }
 };
 
+/** @brief Mixin for interrupt-driven transmission. Sent data is queued in a
+ * software FIFO and the TXE interrupt handler moves it to the data register,
+ * one byte per interrupt, so the CPU is not stalled for the duration of the
+ * transmission. This is an alternative to the dma::Tx mixin, when the DMA
+ * channel of the USART is used by another peripheral, i.e. USART1 and I2C2
+ * share DMA1 channels 4 and 5.
+ * The USART interrupt handler must call \c txIsr(), and the USART interrupt
+ * must be enabled in the NVIC.
+ * sendBlocking() blocks only while the FIFO is full, so nsusart::PrintSink
+ * can be used on top of this mixin. It must not be called with interrupts
+ * disabled or from an interrupt with a priority higher than the USART's
+ * (numerically lower), if the FIFO may become full - send() should be used
+ * there, which never blocks.
+ * @param FifoSize The size of the Tx FIFO, must be a power of 2
+ */
+template <class Base, uint16_t FifoSize=256>
+class IntrTx: public Base
+{
+protected:
+    typedef Base Self;
+    ByteFifo<FifoSize> mTxFifo;
+public:
+    /** @brief Queues as much of the data as fits in the FIFO, without blocking
+     * @return The number of bytes queued
+     */
+    size_t send(const char* data, size_t len)
+    {
+        IntrDisable intrDisable; // serializes writers, and the update of CR1 with the ISR
+        len = mTxFifo.write(data, len);
+        if (len)
+        {
+            USART_CR1(Self::kPeriphId) |= USART_CR1_TXEIE;
+        }
+        return len;
+    }
+    void sendBlocking(const char* buf, size_t size)
+    {
+        while (size)
+        {
+            size_t sent = send(buf, size);
+            buf += sent;
+            size -= sent;
+        }
+    }
+    void sendBlocking(const char* str)
+    {
+        sendBlocking(str, strlen(str));
+    }
+    /** @brief Whether there is data in the FIFO or in the transmitter */
+    bool txBusy() const
+    {
+        return !mTxFifo.isEmpty() || !(USART_SR(Self::kPeriphId) & USART_SR_TC);
+    }
+    /** @brief Waits till all queued data is transmitted, i.e. before powerOff() */
+    void txFlush()
+    {
+        while (txBusy());
+    }
+    void txIsr()
+    {
+        if (!(USART_CR1(Self::kPeriphId) & USART_CR1_TXEIE) ||
+            !(USART_SR(Self::kPeriphId) & USART_SR_TXE))
+        {
+            return;
+        }
+        char ch;
+        if (mTxFifo.pop(ch))
+        {
+            USART_DR(Self::kPeriphId) = (uint8_t)ch;
+        }
+        else
+        {
+            USART_CR1(Self::kPeriphId) &= ~USART_CR1_TXEIE;
+        }
+    }
+};
+
+/** @brief Mixin for continuous reception by DMA in circular mode. Received
+ * data is stored in a ring buffer (see dma::RxRing), without CPU involvement
+ * per byte, and is published to the reader on the DMA half and full transfer
+ * interrupts (see dma::Rx::dmaRxStartStream()), and on the USART idle line
+ * interrupt, which signals the end of a burst. The reader uses the
+ * non-blocking read() and readLine().
+ * The DMA Rx channel interrupt handler must call \c dmaRxIsr(), and the USART
+ * interrupt handler must call \c rxIsr(). The USART interrupt must be enabled
+ * in the NVIC.
+ * @param Size The size of the ring buffer, must be a power of 2. Half of it
+ * must be able to hold the data received during the max latency of the DMA
+ * interrupt, and the reader must keep up, otherwise data is lost (see overruns())
+ */
+template <class Base, uint16_t Size=256, uint8_t Opts=dma::kDefaultOpts>
+class DmaRingRx: public dma::Rx<Base, Opts>
+{
+protected:
+    typedef dma::Rx<Base, Opts> RxBase;
+    typedef Base Self;
+    dma::RxRing<Size> mRxRing;
+    void rxUpdate()
+    {
+        mRxRing.update(DMA_CNDTR(Self::kDmaRxId, Self::kDmaRxChannel));
+    }
+    static void onStreamEvent(const void*, uint16_t, void* userp)
+    {
+        static_cast<DmaRingRx*>(userp)->rxUpdate();
+    }
+public:
+    /** @brief Starts the continuous reception. Any previously received data
+     * that has not been read is discarded
+     */
+    void rxStart()
+    {
+        mRxRing.reset();
+        USART_CR1(Self::kPeriphId) |= USART_CR1_IDLEIE;
+        RxBase::dmaRxStartStream(mRxRing.buffer(), Size, onStreamEvent, this);
+    }
+    void rxStop()
+    {
+        USART_CR1(Self::kPeriphId) &= ~USART_CR1_IDLEIE;
+        RxBase::dmaRxStop();
+    }
+    /** @brief Reads up to \c bufsize received bytes, without blocking
+     * @return The number of bytes read
+     */
+    size_t read(char* buf, size_t bufsize)
+    {
+        {
+            IntrDisable intrDisable; // update() must not be preempted by the ISRs
+            rxUpdate();
+        }
+        return mRxRing.read(buf, bufsize);
+    }
+    /** @brief Reads a received line, without blocking, see dma::RxRing::readLine()
+     * @return The length of the line, or -1 if no complete line was received
+     */
+    int readLine(char* buf, size_t bufsize)
+    {
+        {
+            IntrDisable intrDisable;
+            rxUpdate();
+        }
+        return mRxRing.readLine(buf, bufsize);
+    }
+    size_t rxAvailable() { return mRxRing.available(); }
+    uint32_t rxOverruns() const { return mRxRing.overruns(); }
+    /** @brief Must be called by the USART interrupt handler */
+    void rxIsr()
+    {
+        if (USART_SR(Self::kPeriphId) & USART_SR_IDLE)
+        {
+            // The IDLE flag is cleared by reading SR and then DR. The DMA has
+            // already taken the last byte from DR, so nothing is lost
+            (void)USART_DR(Self::kPeriphId);
+            rxUpdate();
+        }
+    }
+};
+
 template <class UsartDevice>
 class PrintSink: public UsartDevice, public IPrintSink
 {
@@ -20,7 +20,7 @@ struct HighestBitIdx { enum: uint8_t { value = 1 + HighestBitIdx<(val >> 1)>::va
 template<>
 struct HighestBitIdx<0> { enum: uint8_t { value = 0 }; };
 
-#ifndef STM32PP_NOT_EMBEDDED
+#if !defined(STM32PP_NOT_EMBEDDED) || defined(STM32PP_PERIPH_SIM)
 #include <libopencm3/cm3/cortex.h>
 
 /** @brief Scoped global disable of interrupts */
@@ -14,6 +14,8 @@
             tprintf("assert(%)\n", expr);
         }
         tprintf("at %:%\n========\n", file, line);
+        extern IPrintSink* gPrintSink;
+        gPrintSink->flush();
 
 #ifdef STM32PP_NOT_EMBEDDED
         abort();
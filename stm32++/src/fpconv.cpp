@@ -0,0 +1,596 @@
+/**
+ * Integer-only floating point to decimal conversion, based on the Grisu2
+ * algorithm by Florian Loitsch ("Printing Floating-Point Numbers Quickly
+ * and Accurately with Integers", PLDI 2010)
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#include <stm32++/tostring.hpp>
+
+namespace
+{
+/** A floating point number with a 64-bit significand: f * 2^e */
+struct DiyFp
+{
+    uint64_t f;
+    int e;
+    DiyFp() {}
+    DiyFp(uint64_t aF, int aE): f(aF), e(aE) {}
+    DiyFp operator-(const DiyFp& other) const { return DiyFp(f - other.f, e); }
+    /** The high 64 bits of the product, rounded. Uses only 32x32 bit
+     * multiplies, which are single instructions on Cortex-M3
+     */
+    DiyFp operator*(const DiyFp& other) const
+    {
+        uint64_t a = f >> 32, b = (uint32_t)f;
+        uint64_t c = other.f >> 32, d = (uint32_t)other.f;
+        uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+        uint64_t tmp = (bd >> 32) + (uint32_t)ad + (uint32_t)bc + (1U << 31);
+        return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + other.e + 64);
+    }
+    DiyFp normalize() const
+    {
+        int shift = __builtin_clzll(f);
+        return DiyFp(f << shift, e - shift);
+    }
+};
+
+struct CachedPower
+{
+    uint64_t f;
+    int16_t e;
+};
+
+/** Normalized 64-bit approximations of 10^-348, 10^-340, ..., 10^340.
+ * The small table covers only the range needed by float values
+ */
+const CachedPower kCachedPowers[] = {
+#ifndef STM32PP_FPCONV_SMALL_TABLE
+    { 0xfa8fd5a0081c0288ULL, -1220 }, // 1e-348
+    { 0xbaaee17fa23ebf76ULL, -1193 }, // 1e-340
+    { 0x8b16fb203055ac76ULL, -1166 }, // 1e-332
+    { 0xcf42894a5dce35eaULL, -1140 }, // 1e-324
+    { 0x9a6bb0aa55653b2dULL, -1113 }, // 1e-316
+    { 0xe61acf033d1a45dfULL, -1087 }, // 1e-308
+    { 0xab70fe17c79ac6caULL, -1060 }, // 1e-300
+    { 0xff77b1fcbebcdc4fULL, -1034 }, // 1e-292
+    { 0xbe5691ef416bd60cULL, -1007 }, // 1e-284
+    { 0x8dd01fad907ffc3cULL, -980 }, // 1e-276
+    { 0xd3515c2831559a83ULL, -954 }, // 1e-268
+    { 0x9d71ac8fada6c9b5ULL, -927 }, // 1e-260
+    { 0xea9c227723ee8bcbULL, -901 }, // 1e-252
+    { 0xaecc49914078536dULL, -874 }, // 1e-244
+    { 0x823c12795db6ce57ULL, -847 }, // 1e-236
+    { 0xc21094364dfb5637ULL, -821 }, // 1e-228
+    { 0x9096ea6f3848984fULL, -794 }, // 1e-220
+    { 0xd77485cb25823ac7ULL, -768 }, // 1e-212
+    { 0xa086cfcd97bf97f4ULL, -741 }, // 1e-204
+    { 0xef340a98172aace5ULL, -715 }, // 1e-196
+    { 0xb23867fb2a35b28eULL, -688 }, // 1e-188
+    { 0x84c8d4dfd2c63f3bULL, -661 }, // 1e-180
+    { 0xc5dd44271ad3cdbaULL, -635 }, // 1e-172
+    { 0x936b9fcebb25c996ULL, -608 }, // 1e-164
+    { 0xdbac6c247d62a584ULL, -582 }, // 1e-156
+    { 0xa3ab66580d5fdaf6ULL, -555 }, // 1e-148
+    { 0xf3e2f893dec3f126ULL, -529 }, // 1e-140
+    { 0xb5b5ada8aaff80b8ULL, -502 }, // 1e-132
+    { 0x87625f056c7c4a8bULL, -475 }, // 1e-124
+    { 0xc9bcff6034c13053ULL, -449 }, // 1e-116
+    { 0x964e858c91ba2655ULL, -422 }, // 1e-108
+    { 0xdff9772470297ebdULL, -396 }, // 1e-100
+    { 0xa6dfbd9fb8e5b88fULL, -369 }, // 1e-92
+    { 0xf8a95fcf88747d94ULL, -343 }, // 1e-84
+    { 0xb94470938fa89bcfULL, -316 }, // 1e-76
+    { 0x8a08f0f8bf0f156bULL, -289 }, // 1e-68
+    { 0xcdb02555653131b6ULL, -263 }, // 1e-60
+    { 0x993fe2c6d07b7facULL, -236 }, // 1e-52
+    { 0xe45c10c42a2b3b06ULL, -210 }, // 1e-44
+#endif
+    { 0xaa242499697392d3ULL, -183 }, // 1e-36
+    { 0xfd87b5f28300ca0eULL, -157 }, // 1e-28
+    { 0xbce5086492111aebULL, -130 }, // 1e-20
+    { 0x8cbccc096f5088ccULL, -103 }, // 1e-12
+    { 0xd1b71758e219652cULL, -77 }, // 1e-4
+    { 0x9c40000000000000ULL, -50 }, // 1e4
+    { 0xe8d4a51000000000ULL, -24 }, // 1e12
+    { 0xad78ebc5ac620000ULL, 3 }, // 1e20
+    { 0x813f3978f8940984ULL, 30 }, // 1e28
+    { 0xc097ce7bc90715b3ULL, 56 }, // 1e36
+    { 0x8f7e32ce7bea5c70ULL, 83 }, // 1e44
+    { 0xd5d238a4abe98068ULL, 109 }, // 1e52
+#ifndef STM32PP_FPCONV_SMALL_TABLE
+    { 0x9f4f2726179a2245ULL, 136 }, // 1e60
+    { 0xed63a231d4c4fb27ULL, 162 }, // 1e68
+    { 0xb0de65388cc8ada8ULL, 189 }, // 1e76
+    { 0x83c7088e1aab65dbULL, 216 }, // 1e84
+    { 0xc45d1df942711d9aULL, 242 }, // 1e92
+    { 0x924d692ca61be758ULL, 269 }, // 1e100
+    { 0xda01ee641a708deaULL, 295 }, // 1e108
+    { 0xa26da3999aef774aULL, 322 }, // 1e116
+    { 0xf209787bb47d6b85ULL, 348 }, // 1e124
+    { 0xb454e4a179dd1877ULL, 375 }, // 1e132
+    { 0x865b86925b9bc5c2ULL, 402 }, // 1e140
+    { 0xc83553c5c8965d3dULL, 428 }, // 1e148
+    { 0x952ab45cfa97a0b3ULL, 455 }, // 1e156
+    { 0xde469fbd99a05fe3ULL, 481 }, // 1e164
+    { 0xa59bc234db398c25ULL, 508 }, // 1e172
+    { 0xf6c69a72a3989f5cULL, 534 }, // 1e180
+    { 0xb7dcbf5354e9beceULL, 561 }, // 1e188
+    { 0x88fcf317f22241e2ULL, 588 }, // 1e196
+    { 0xcc20ce9bd35c78a5ULL, 614 }, // 1e204
+    { 0x98165af37b2153dfULL, 641 }, // 1e212
+    { 0xe2a0b5dc971f303aULL, 667 }, // 1e220
+    { 0xa8d9d1535ce3b396ULL, 694 }, // 1e228
+    { 0xfb9b7cd9a4a7443cULL, 720 }, // 1e236
+    { 0xbb764c4ca7a44410ULL, 747 }, // 1e244
+    { 0x8bab8eefb6409c1aULL, 774 }, // 1e252
+    { 0xd01fef10a657842cULL, 800 }, // 1e260
+    { 0x9b10a4e5e9913129ULL, 827 }, // 1e268
+    { 0xe7109bfba19c0c9dULL, 853 }, // 1e276
+    { 0xac2820d9623bf429ULL, 880 }, // 1e284
+    { 0x80444b5e7aa7cf85ULL, 907 }, // 1e292
+    { 0xbf21e44003acdd2dULL, 933 }, // 1e300
+    { 0x8e679c2f5e44ff8fULL, 960 }, // 1e308
+    { 0xd433179d9c8cb841ULL, 986 }, // 1e316
+    { 0x9e19db92b4e31ba9ULL, 1013 }, // 1e324
+    { 0xeb96bf6ebadf77d9ULL, 1039 }, // 1e332
+    { 0xaf87023b9bf0ee6bULL, 1066 }, // 1e340
+#endif
+};
+
+#ifdef STM32PP_FPCONV_SMALL_TABLE
+enum: int { kFirstCachedPower = 39 };
+#else
+enum: int { kFirstCachedPower = 0 };
+#endif
+enum: int { kCachedPowerCount = sizeof(kCachedPowers) / sizeof(kCachedPowers[0]) };
+
+/** Returns the cached power c = 10^-K, such that the exponent of the product
+ * of c and a normalized DiyFp with exponent \c e is in the range [-60, -32],
+ * or false if the power is not in the table
+ */
+bool cachedPower(int e, DiyFp& power, int& K)
+{
+    // k = ceil((-61 - e) * log10(2)), with log10(2) ~ 78913 / 2^18
+    int x = -61 - e;
+    int k = ((x * 78913) >> 18) + (x != 0) + 347;
+    int index = (k >> 3) + 1 - kFirstCachedPower;
+    if (index < 0 || index >= kCachedPowerCount)
+    {
+        return false;
+    }
+    K = -(-348 + (index + kFirstCachedPower) * 8);
+    power = DiyFp(kCachedPowers[index].f, kCachedPowers[index].e);
+    return true;
+}
+
+const uint32_t kPow10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+uint8_t digitCount(uint32_t val)
+{
+    uint8_t count = 1;
+    while (count < 10 && val >= kPow10[count])
+    {
+        count++;
+    }
+    return count;
+}
+
+/** Moves the last digit towards the exact value \c w, as long as the result
+ * stays in the rounding interval
+ */
+void grisuRound(char* digits, uint8_t len, uint64_t delta, uint64_t rest,
+    uint64_t tenKappa, uint64_t wpw)
+{
+    while (rest < wpw && delta - rest >= tenKappa &&
+           (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw))
+    {
+        digits[len - 1]--;
+        rest += tenKappa;
+    }
+}
+
+/** Generates the shortest digits in the rounding interval (Mp - delta, Mp] */
+void digitGen(const DiyFp& W, const DiyFp& Mp, uint64_t delta, FpDecimal& dec, int& K)
+{
+    const DiyFp one(((uint64_t)1) << -Mp.e, Mp.e);
+    const uint64_t wpw = (Mp - W).f;
+    uint32_t p1 = Mp.f >> -one.e;
+    uint64_t p2 = Mp.f & (one.f - 1);
+    int kappa = digitCount(p1);
+    uint8_t len = 0;
+    while (kappa > 0)
+    {
+        uint32_t div = kPow10[kappa - 1];
+        uint32_t digit = p1 / div;
+        p1 -= digit * div;
+        if (digit || len)
+        {
+            dec.digits[len++] = '0' + digit;
+        }
+        kappa--;
+        uint64_t rest = (((uint64_t)p1) << -one.e) + p2;
+        if (rest <= delta)
+        {
+            K += kappa;
+            grisuRound(dec.digits, len, delta, rest, ((uint64_t)kPow10[kappa]) << -one.e, wpw);
+            dec.len = len;
+            return;
+        }
+    }
+    for (uint64_t unit = 1;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+        unit *= 10;
+        char digit = p2 >> -one.e;
+        if (digit || len)
+        {
+            dec.digits[len++] = '0' + digit;
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta)
+        {
+            K += kappa;
+            // The error of W grows with the scaling by 10 per generated digit
+            grisuRound(dec.digits, len, delta, p2, one.f, wpw * unit);
+            dec.len = len;
+            return;
+        }
+    }
+}
+
+template <typename Val>
+struct FpTraits;
+
+template <>
+struct FpTraits<float>
+{
+    typedef uint32_t Bits;
+    enum: int { kMantBits = 23, kExpMask = 0xff, kBias = 127 + 23 };
+};
+
+template <>
+struct FpTraits<double>
+{
+    typedef uint64_t Bits;
+    enum: int { kMantBits = 52, kExpMask = 0x7ff, kBias = 1023 + 52 };
+};
+
+template <typename Val>
+void toDecimal(Val val, FpDecimal& dec)
+{
+    typedef FpTraits<Val> Traits;
+    typename Traits::Bits bits;
+    memcpy(&bits, &val, sizeof(bits));
+    dec.neg = bits >> (sizeof(bits) * 8 - 1);
+    int biasedExp = (bits >> Traits::kMantBits) & Traits::kExpMask;
+    uint64_t hiddenBit = ((uint64_t)1) << Traits::kMantBits;
+    uint64_t f = bits & (hiddenBit - 1);
+    if (biasedExp == Traits::kExpMask)
+    {
+        dec.kind = f ? FpDecimal::kNan : FpDecimal::kInf;
+        return;
+    }
+    dec.kind = FpDecimal::kFinite;
+    if (!biasedExp && !f)
+    {
+        dec.digits[0] = '0';
+        dec.len = 1;
+        dec.pointPos = 1;
+        return;
+    }
+    int e;
+    if (biasedExp)
+    {
+        f += hiddenBit;
+        e = biasedExp - Traits::kBias;
+    }
+    else
+    {
+        e = 1 - Traits::kBias;
+    }
+    // The boundaries of the rounding interval - halfway to the neighbouring
+    // values. The lower neighbour is closer if f is a power of 2
+    DiyFp plus = DiyFp((f << 1) + 1, e - 1).normalize();
+    DiyFp minus = (f == hiddenBit && biasedExp > 1)
+        ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    DiyFp power;
+    int K;
+    if (!cachedPower(plus.e, power, K))
+    {
+        // Only with the small table, for doubles out of the float range
+        if (plus.e > 0)
+        {
+            dec.kind = FpDecimal::kInf;
+        }
+        else
+        {
+            dec.digits[0] = '0';
+            dec.len = 1;
+            dec.pointPos = 1;
+        }
+        return;
+    }
+    DiyFp W = DiyFp(f, e).normalize() * power;
+    DiyFp Wp = plus * power;
+    DiyFp Wm = minus * power;
+    // Account for the imprecision of the cached power
+    Wm.f++;
+    Wp.f--;
+    digitGen(W, Wp, Wp.f - Wm.f, dec, K);
+    dec.pointPos = dec.len + K;
+}
+
+/** Rounds the digits to \c keep digits, half up. The decimal point position
+ * is updated if the rounding carries over to a new leading digit
+ */
+void roundDigits(FpDecimal& dec, int keep)
+{
+    if (keep >= dec.len)
+    {
+        return;
+    }
+    if (keep < 0)
+    {
+        dec.len = 0;
+        return;
+    }
+    bool roundUp = dec.digits[keep] >= '5';
+    dec.len = keep;
+    if (!roundUp)
+    {
+        return;
+    }
+    for (int i = keep - 1; i >= 0; i--)
+    {
+        if (dec.digits[i] != '9')
+        {
+            dec.digits[i]++;
+            return;
+        }
+        dec.len = i; // trailing 9 rounds to 0, drop it
+    }
+    // All digits were 9 - the result is 1 followed by zeroes
+    dec.digits[0] = '1';
+    dec.len = 1;
+    dec.pointPos++;
+}
+
+char digitAt(const FpDecimal& dec, int pos)
+{
+    return (pos >= 0 && pos < dec.len) ? dec.digits[pos] : '0';
+}
+
+/** Writes the exponent of the scientific notation, with at least two digits */
+char* putExponent(char* buf, int exp)
+{
+    *(buf++) = 'e';
+    *(buf++) = (exp < 0) ? '-' : '+';
+    if (exp < 0)
+    {
+        exp = -exp;
+    }
+    if (exp >= 100)
+    {
+        *(buf++) = '0' + exp / 100;
+        exp %= 100;
+    }
+    *(buf++) = '0' + exp / 10;
+    *(buf++) = '0' + exp % 10;
+    return buf;
+}
+
+uint8_t exponentLen(int exp)
+{
+    return (exp <= -100 || exp >= 100) ? 5 : 4;
+}
+
+/** Checks that \c len chars fit in the buffer, and null-terminates the
+ * buffer if they don't
+ */
+bool fits(char* buf, size_t bufsize, size_t len, bool nullTerminate)
+{
+    if (bufsize >= len + nullTerminate)
+    {
+        return true;
+    }
+    if (bufsize && nullTerminate)
+    {
+        *buf = 0;
+    }
+    return false;
+}
+
+char* putSpecial(char* buf, size_t bufsize, const FpDecimal& dec, bool nullTerminate)
+{
+    const char* str = (dec.kind == FpDecimal::kNan) ? "nan" : "inf";
+    bool neg = dec.neg && (dec.kind == FpDecimal::kInf);
+    if (!fits(buf, bufsize, 3 + neg, nullTerminate))
+    {
+        return nullptr;
+    }
+    if (neg)
+    {
+        *(buf++) = '-';
+    }
+    memcpy(buf, str, 3);
+    buf += 3;
+    if (nullTerminate)
+    {
+        *buf = 0;
+    }
+    return buf;
+}
+}
+
+void fpToDecimal(float val, FpDecimal& dec) { toDecimal(val, dec); }
+void fpToDecimal(double val, FpDecimal& dec) { toDecimal(val, dec); }
+
+char* fpPutFixed(char* buf, size_t bufsize, const FpDecimal& aDec, uint8_t prec,
+    uint8_t minDigits, bool nullTerminate)
+{
+    if (aDec.kind != FpDecimal::kFinite)
+    {
+        return putSpecial(buf, bufsize, aDec, nullTerminate);
+    }
+    FpDecimal dec = aDec;
+    size_t fracLen = prec ? prec + 1 : 0;
+    size_t len;
+    roundDigits(dec, dec.pointPos + prec);
+    // Too large numbers are shown in scientific notation, so that the
+    // output length is bounded (see toStringMaxLen()). The check is done
+    // after the rounding, which can add a digit to the whole part
+    bool sci = dec.pointPos > kFpMaxWholeDigits;
+    if (sci)
+    {
+        // d.ddde+XX, with prec digits after the point
+        dec = aDec;
+        roundDigits(dec, prec + 1);
+        len = dec.neg + 1 + fracLen + exponentLen(dec.pointPos - 1);
+    }
+    else
+    {
+        int wholeLen = (dec.pointPos > 0) ? dec.pointPos : 1;
+        if (wholeLen < minDigits)
+        {
+            wholeLen = minDigits;
+        }
+        len = dec.neg + wholeLen + fracLen;
+    }
+    if (!fits(buf, bufsize, len, nullTerminate))
+    {
+        return nullptr;
+    }
+    if (dec.neg)
+    {
+        *(buf++) = '-';
+    }
+    if (sci)
+    {
+        *(buf++) = digitAt(dec, 0);
+        if (prec)
+        {
+            *(buf++) = '.';
+            for (int i = 1; i <= prec; i++)
+            {
+                *(buf++) = digitAt(dec, i);
+            }
+        }
+        buf = putExponent(buf, dec.pointPos - 1);
+    }
+    else
+    {
+        for (int pad = minDigits - ((dec.pointPos > 0) ? dec.pointPos : 1); pad > 0; pad--)
+        {
+            *(buf++) = '0';
+        }
+        if (dec.pointPos <= 0)
+        {
+            *(buf++) = '0';
+        }
+        for (int i = 0; i < dec.pointPos; i++)
+        {
+            *(buf++) = digitAt(dec, i);
+        }
+        if (prec)
+        {
+            *(buf++) = '.';
+            for (int i = 0; i < prec; i++)
+            {
+                *(buf++) = digitAt(dec, dec.pointPos + i);
+            }
+        }
+    }
+    if (nullTerminate)
+    {
+        *buf = 0;
+    }
+    return buf;
+}
+
+char* fpPutShortest(char* buf, size_t bufsize, const FpDecimal& dec, bool nullTerminate)
+{
+    if (dec.kind != FpDecimal::kFinite)
+    {
+        return putSpecial(buf, bufsize, dec, nullTerminate);
+    }
+    int pointPos = dec.pointPos;
+    int len = dec.len;
+    size_t outLen;
+    enum { kFixed, kSmall, kSci } form;
+    if (pointPos > kFpMaxWholeDigits || pointPos <= -5)
+    {
+        form = kSci; // d[.ddd]e+XX
+        outLen = len + (len > 1) + exponentLen(pointPos - 1);
+    }
+    else if (pointPos <= 0)
+    {
+        form = kSmall; // 0.000ddd
+        outLen = 2 - pointPos + len;
+    }
+    else
+    {
+        form = kFixed; // ddd.ddd, or ddd000.0
+        outLen = ((pointPos >= len) ? pointPos + 1 : len) + 1;
+    }
+    if (!fits(buf, bufsize, outLen + dec.neg, nullTerminate))
+    {
+        return nullptr;
+    }
+    if (dec.neg)
+    {
+        *(buf++) = '-';
+    }
+    switch (form)
+    {
+    case kSci:
+        *(buf++) = dec.digits[0];
+        if (len > 1)
+        {
+            *(buf++) = '.';
+            memcpy(buf, dec.digits + 1, len - 1);
+            buf += len - 1;
+        }
+        buf = putExponent(buf, pointPos - 1);
+        break;
+    case kSmall:
+        *(buf++) = '0';
+        *(buf++) = '.';
+        for (int i = pointPos; i < 0; i++)
+        {
+            *(buf++) = '0';
+        }
+        memcpy(buf, dec.digits, len);
+        buf += len;
+        break;
+    case kFixed:
+        for (int i = 0; i < pointPos; i++)
+        {
+            *(buf++) = digitAt(dec, i);
+        }
+        *(buf++) = '.';
+        if (pointPos >= len)
+        {
+            *(buf++) = '0';
+        }
+        else
+        {
+            memcpy(buf, dec.digits + pointPos, len - pointPos);
+            buf += len - pointPos;
+        }
+        break;
+    }
+    if (nullTerminate)
+    {
+        *buf = 0;
+    }
+    return buf;
+}
@@ -1,22 +1,24 @@
 #include <stm32++/printSink.hpp>
 #ifndef STM32PP_NOT_EMBEDDED
-    #include <stm32++/semihosting.hpp>
+    #include <stm32++/shostPrint.hpp>
 #else
     #include <unistd.h>
 #endif
 
+#ifndef STM32PP_NOT_EMBEDDED
+// Buffered, to reduce the number of semihosting calls. See shostPrint.hpp
+// for the build options
+typedef shost::BufferedPrintSink<> DefaultPrintSink;
+#else
 struct DefaultPrintSink: public IPrintSink
 {
     IPrintSink::BufferInfo* waitReady() { return nullptr; }
     void print(const char* str, size_t len, int fd)
     {
-#ifndef STM32PP_NOT_EMBEDDED
-        shost::fputs(str, len, fd);
-#else
         ::write(fd, str, len);
-#endif
     }
 };
+#endif
 
 DefaultPrintSink gDefaultPrintSink;
 IPrintSink* gPrintSink = &gDefaultPrintSink;
@@ -11,8 +11,10 @@ static_assert(sizeof(size_t) == sizeof(void*), "");
 namespace shost
 {
 
+#ifndef STM32PP_SHOST_MOCK_BKPT
 /** Single-argument wrapper for the BKPT instruction. Note that some commands
- * use a second argument in r2
+ * use a second argument in r2. Host tests define STM32PP_SHOST_MOCK_BKPT
+ * and provide their own implementation
  */
 size_t bkpt(size_t cmd, size_t arg1)
 {
@@ -28,6 +30,7 @@ size_t bkpt(size_t cmd, size_t arg1)
     );
     return ret;
 }
+#endif
 
 void write(const void* buf, size_t bufsize, int fd)
 {
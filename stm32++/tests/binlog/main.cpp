@@ -0,0 +1,111 @@
+#include <stm32++/binlogDecoder.hpp>
+#include <stdio.h>
+
+// Checks that the binary records emitted by tprintf() in deferred mode are
+// decoded to the same text that the normal formatting produces. The format
+// strings are loaded from the binlog_fmt section of this test's own executable
+
+struct CapturePrintSink: public IPrintSink
+{
+    std::string output;
+    BufferInfo* waitReady() { return nullptr; }
+    void print(const char* str, size_t len, int) { output.append(str, len); }
+};
+
+CapturePrintSink captureSink;
+binlog::Decoder decoder;
+extern IPrintSink* gPrintSink;
+
+void check(const std::string& actual, const char* expected)
+{
+    if (actual != expected)
+    {
+        printf("ERROR: expected '%s', actual: '%s'\n", expected, actual.c_str());
+        exit(1);
+    }
+    printf("PASS: %s\n", expected);
+}
+
+template <typename Fmt, typename... Args>
+void expect(const char* fmt, Fmt binFmt, Args... args)
+{
+    char expected[256];
+    tsnprintf(expected, sizeof(expected), binFmt, args...);
+    captureSink.output.clear();
+    tprintf(binFmt, args...);
+    if (captureSink.output[0] != binlog::kRecordStart)
+    {
+        printf("ERROR: tprintf() didn't emit a binary record for '%s'\n", fmt);
+        exit(1);
+    }
+    std::string text;
+    size_t consumed = decoder.decode(captureSink.output.data(), captureSink.output.size(), text);
+    if (consumed != captureSink.output.size())
+    {
+        printf("ERROR: decoder didn't consume the whole record of '%s'\n", fmt);
+        exit(1);
+    }
+    check(text, expected);
+}
+
+#define EXPECT(fmtString, ...) expect(fmtString, fmtString##_fmt, ##__VA_ARGS__)
+
+int main()
+{
+    if (!decoder.loadElf("/proc/self/exe"))
+    {
+        printf("ERROR: Could not load the binlog_fmt section\n");
+        return 1;
+    }
+    gPrintSink = &captureSink;
+    EXPECT("no args");
+    EXPECT("this is a float: %", 123.4567);
+    EXPECT("this is a negative float: %", -0.5f);
+    EXPECT("this is a fmtFp<prec: 3>(minDigits: 4): %", fmtFp<3>(123.4567, 4));
+    EXPECT("this is a shortest float: % %", fmtFp<kShortest>(0.1f), fmtFp<kShortest>(1e-20));
+    EXPECT("this is an int: '%'", fmtInt(1234, 6, 8));
+    EXPECT("specs: |%{8}|%{<6}|%{x4}|%{d5}|%{X}|%{8.2}|", 1234, "ab", 255, (int16_t)-42, (int8_t)-1, 3.14159);
+    EXPECT("these are ints: % % % % %", (int8_t)-5, (uint16_t)65535, -100000, 4000000000u, -(1LL << 40));
+    EXPECT("this is a hex16(32767): %", fmtHex<kUpperCase>(32767));
+    EXPECT("this is a hex16(32767) no prefix: %", fmtHex<kNoPrefix>(32767));
+    EXPECT("this is an octal: %", fmtInt<8>(1234567));
+    EXPECT("this is a bin(127): %", fmtBin(127));
+    EXPECT("this is a pointer: %", (void*)0x2000abcd);
+    EXPECT("this is a string: '%'", "test message");
+    EXPECT("this is a dollar: %", '$');
+    EXPECT("this is a line: %", rptChar('-', 10));
+    EXPECT("this is a fixed: %", fmtFixed<2>(-1234, 3));
+    EXPECT("this is a Q15: %", fmtQ<15>((int16_t)-16384));
+    EXPECT("this is a Q16.16: %", fmtQ<16, 3>(205887u));
+
+    // Mixed text and records, fed to the decoder in small chunks
+    captureSink.output.clear();
+    tprintf("text line\n");
+    tprintf("record % of %\n"_fmt, 1, 2);
+    tprintf("another text line\n");
+    tprintf("record % of %\n"_fmt, 2, 2);
+    std::string text;
+    std::string pending;
+    for (char ch: captureSink.output)
+    {
+        pending += ch;
+        pending.erase(0, decoder.decode(pending.data(), pending.size(), text));
+    }
+    check(text, "text line\nrecord 1 of 2\nanother text line\nrecord 2 of 2\n");
+    if (!pending.empty())
+    {
+        printf("ERROR: decoder left %zu bytes unconsumed\n", pending.size());
+        return 1;
+    }
+    // A record with an invalid format string id is passed through as text
+    const std::string corrupted("\x1e\x04\xff\xff\xff\x0f text");
+    text.clear();
+    decoder.decode(corrupted.data(), corrupted.size(), text);
+    if (text != corrupted)
+    {
+        printf("ERROR: invalid record was not passed through as text\n");
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
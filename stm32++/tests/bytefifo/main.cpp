@@ -0,0 +1,52 @@
+#include <stm32++/byteFifo.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "check.hpp"
+
+ByteFifo<64> fifo;
+std::string output;
+
+// Simulates the transmit interrupt - moves a few bytes out of the FIFO
+void txIsr(int count)
+{
+    char ch;
+    while (count-- && fifo.pop(ch))
+    {
+        output += ch;
+    }
+}
+
+int main()
+{
+    char ch;
+    check("Empty FIFO", fifo.isEmpty() && fifo.size() == 0 && !fifo.pop(ch));
+    check("write() stores only what fits", fifo.write(std::string(100, 'x').c_str(), 100) == 64);
+    check("Full FIFO", fifo.bytesFree() == 0 && fifo.write("y", 1) == 0);
+    txIsr(64);
+    check("All bytes are read back", output == std::string(64, 'x') && fifo.isEmpty());
+
+    // Stream through the FIFO, with writes and reads of random sizes, so that
+    // the counters wrap around the buffer and the 16-bit range many times
+    output.clear();
+    std::string input;
+    for (uint32_t i = 0; input.size() < 300000; i++)
+    {
+        input += "line " + std::to_string(i) + "\n";
+    }
+    srand(1);
+    size_t pos = 0;
+    while (pos < input.size())
+    {
+        size_t len = std::min((size_t)(rand() % 50), input.size() - pos);
+        pos += fifo.write(input.c_str() + pos, len);
+        if (fifo.size() > 64)
+        {
+            check("FIFO size is within bounds", false);
+        }
+        txIsr(rand() % 40);
+    }
+    txIsr(64);
+    check("Streamed data is received in order, without loss", output == input);
+    return 0;
+}
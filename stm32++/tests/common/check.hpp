@@ -0,0 +1,26 @@
+/**
+ * Result reporting shared by the host-side tests
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#ifndef STM32PP_TESTS_CHECK_HPP
+#define STM32PP_TESTS_CHECK_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** @brief Prints the outcome of a test step, and exits with an error code
+ * if it failed
+ */
+inline void check(const char* name, bool ok)
+{
+    if (!ok)
+    {
+        printf("ERROR: %s\n", name);
+        exit(1);
+    }
+    printf("PASS: %s\n", name);
+}
+
+#endif
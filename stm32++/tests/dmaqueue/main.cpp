@@ -0,0 +1,88 @@
+#include <stm32++/dmaQueue.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <deque>
+#include "check.hpp"
+
+// Tests the contract of XferQueue itself. Starting the transfers on a DMA
+// channel is done by the dma::Tx and dma::Rx mixins, which are tested with
+// the simulated peripherals in tests/periphsim
+
+const char data[] = "0123456789";
+std::string callbackLog;
+
+void logCallback(const void* xferData, void* userp)
+{
+    callbackLog += *(const char*)xferData;
+    callbackLog += (const char*)userp;
+}
+
+int main()
+{
+    dma::XferQueue<> queue;
+    dma::XferQueue<>::Xfer done;
+    check("Queue of depth 2 is empty initially", queue.isEmpty() && !queue.isFull() &&
+        queue.count() == 0 && queue.kDepth == 2);
+    check("Transfer pushed to an empty queue must be started by the caller", queue.push(data, 3));
+    check("Second transfer is queued behind it", !queue.push(data + 3, 2) && queue.isFull() && queue.count() == 2);
+    check("Front is the transfer in progress", queue.front().data == data && queue.front().size == 3);
+    const dma::XferQueue<>::Xfer* next = queue.pop(done);
+    check("Pop returns the completed transfer", done.data == data && done.size == 3 && queue.completed() == 1);
+    check("Pop returns the next transfer to start", next && next->data == data + 3 && next->size == 2 &&
+        &queue.front() == next);
+    check("Pop of the last transfer returns nullptr", !queue.pop(done) && done.data == data + 3 &&
+        queue.isEmpty() && queue.completed() == 2);
+    check("Transfer pushed to a drained queue must be started again", queue.push(data + 5, 1));
+    queue.push(data + 6, 1);
+    queue.clear();
+    check("Clear empties the queue", queue.isEmpty() && queue.completed() == 2);
+    check("Transfer pushed to a cleared queue must be started", queue.push(data, 1));
+
+    // Random interleaving of pushes and completions on a deeper queue, so that
+    // the indexes wrap around many times, compared against a reference queue
+    dma::XferQueue<4> deepQueue;
+    dma::XferQueue<4>::Xfer deepDone;
+    std::deque<const char*> expected;
+    bool ok = true;
+    uint32_t pushed = 0;
+    srand(1);
+    for (int i = 0; i < 10000; i++)
+    {
+        if (!deepQueue.isFull() && (rand() & 1))
+        {
+            const char* xfer = data + pushed % 10;
+            ok &= deepQueue.push(xfer, 1) == expected.empty();
+            expected.push_back(xfer);
+            pushed++;
+        }
+        else if (!deepQueue.isEmpty())
+        {
+            auto deepNext = deepQueue.pop(deepDone);
+            ok &= deepDone.data == expected.front();
+            expected.pop_front();
+            ok &= expected.empty() ? !deepNext : (deepNext && deepNext->data == expected.front());
+        }
+        ok &= deepQueue.count() == expected.size();
+    }
+    check("Transfers complete in the order in which they were queued", ok);
+    check("Completion count", deepQueue.completed() == pushed - expected.size());
+
+    // The queue carries the callback and user pointer of each transfer, to
+    // be invoked by the interrupt handler after the next one is started
+    dma::XferQueue<4> cbQueue;
+    dma::XferQueue<4>::Xfer cbDone;
+    cbQueue.push(data + 1, 1, logCallback, (void*)"a");
+    cbQueue.push(data + 2, 1);
+    cbQueue.push(data + 3, 1, logCallback, (void*)"c");
+    while (!cbQueue.isEmpty())
+    {
+        cbQueue.pop(cbDone);
+        if (cbDone.callback)
+        {
+            cbDone.callback(cbDone.data, cbDone.userp);
+        }
+    }
+    check("Callbacks and user pointers are kept with their transfers", callbackLog == "1a3c");
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <stm32++/dmaRegistry.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include "check.hpp"
+
+enum: uint32_t { kDma1 = 0x40020000, kDma2 = 0x40020400 };
+
+// Peripherals with the members of the dma::Tx and dma::Rx mixins that the registry uses
+template <uint32_t Dma, uint8_t Chan, bool Shared=false>
+struct TxDev
+{
+    enum: uint32_t { kDmaTxId = Dma };
+    enum: uint8_t { kDmaTxChannel = Chan };
+    static constexpr bool kDmaTxShared = Shared;
+    void dmaTxStop() {}
+};
+
+template <uint32_t Dma, uint8_t Chan, bool Shared=false>
+struct RxDev
+{
+    enum: uint32_t { kDmaRxId = Dma };
+    enum: uint8_t { kDmaRxChannel = Chan };
+    static constexpr bool kDmaRxShared = Shared;
+    void dmaRxStop() {}
+};
+
+template <uint8_t TxChan, uint8_t RxChan, bool Shared=false>
+struct TxRxDev: TxDev<kDma1, TxChan, Shared>, RxDev<kDma1, RxChan, Shared> {};
+
+struct NoDmaDev {};
+
+typedef TxRxDev<4, 5> Usart1;
+typedef TxRxDev<7, 6> Usart2;
+typedef TxRxDev<5, 4> Spi2;
+typedef TxRxDev<4, 5, true> Usart1Shared;
+typedef TxRxDev<5, 4, true> Spi2Shared;
+typedef RxDev<kDma1, 1> Adc1;
+typedef RxDev<kDma2, 1> Dma2Dev;
+
+static_assert(HasTxDma<Usart1>::value && HasRxDma<Usart1>::value, "TxRx device not detected");
+static_assert(!HasTxDma<Adc1>::value && HasRxDma<Adc1>::value, "Rx-only device not detected");
+static_assert(!HasTxDma<NoDmaDev>::value && !HasRxDma<NoDmaDev>::value, "Device without DMA detected");
+
+static_assert(!dma::channelsConflict<>(), "Empty set");
+static_assert(!dma::channelsConflict<Usart1, Usart2, Adc1, NoDmaDev>(), "Distinct channels");
+static_assert(dma::channelsConflict<Usart1, Spi2>(), "USART1 Tx and SPI2 Rx both use DMA1 channel 4");
+static_assert(dma::channelsConflict<Usart1, Usart2, TxDev<kDma1, 6>>(), "Tx and Rx on the same channel");
+static_assert(dma::channelsConflict<Adc1, RxDev<kDma1, 1>>(), "Two Rx devices on the same channel");
+static_assert(!dma::channelsConflict<Adc1, Dma2Dev>(), "Same channel number on different controllers");
+static_assert(!dma::channelsConflict<Usart1Shared, Spi2Shared>(), "Channels shared by both devices");
+static_assert(dma::channelsConflict<Usart1Shared, Spi2>(), "Channel shared by only one of the devices");
+
+template struct dma::ChannelRegistry<Usart1, Usart2, Adc1, Dma2Dev>;
+
+void testLock()
+{
+    typedef dma::ChannelLock<kDma1, 4> Lock;
+    int usart, spi;
+    check("Initially the channel is free", Lock::owner == nullptr);
+    check("tryAcquire() of a free channel succeeds", Lock::tryAcquire(&usart) && Lock::isOwner(&usart));
+    check("The owner can acquire the channel again", Lock::tryAcquire(&usart));
+    check("tryAcquire() of a channel owned by another peripheral fails",
+        !Lock::tryAcquire(&spi) && Lock::isOwner(&usart));
+    Lock::release(&spi);
+    check("release() by a non-owner is ignored", Lock::isOwner(&usart));
+    check("Locks of different channels are independent", dma::ChannelLock<kDma1, 5>::tryAcquire(&spi));
+    Lock::release(&usart);
+    check("release() by the owner frees the channel", Lock::owner == nullptr);
+    Lock::acquire(&spi);
+    check("acquire() of a free channel", Lock::isOwner(&spi));
+}
+
+int main()
+{
+    testLock();
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <stm32++/log.hpp>
+#include <stdio.h>
+#include <string>
+#include <algorithm>
+
+struct CaptureSink: public IPrintSink
+{
+    std::string output;
+    BufferInfo* waitReady() { return nullptr; }
+    void print(const char* str, size_t len, int) { output.append(str, len); }
+};
+
+CaptureSink captureSink;
+IPrintSink* gPrintSink = &captureSink;
+int evalCount = 0;
+
+int countedArg()
+{
+    evalCount++;
+    return 42;
+}
+
+void check(const char* name, const char* expected)
+{
+    if (captureSink.output != expected)
+    {
+        printf("ERROR: %s: expected '%s', actual: '%s'\n", name, expected, captureSink.output.c_str());
+        exit(1);
+    }
+    printf("PASS: %s\n", name);
+    captureSink.output.clear();
+}
+
+// The format string of a call that is not compiled in must not be in the executable
+bool executableContains(std::string str)
+{
+    FILE* file = fopen("/proc/self/exe", "rb");
+    if (!file)
+    {
+        printf("ERROR: Can't open the executable\n");
+        exit(1);
+    }
+    std::string image;
+    char buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0)
+    {
+        image.append(buf, len);
+    }
+    fclose(file);
+    return image.find(str) != std::string::npos;
+}
+
+int main()
+{
+    STM32PP_LOG(App, Info, "info: %", countedArg());
+    STM32PP_LOG(App, Error, "error");
+    check("enabled levels", "info: 42\nerror\n");
+
+    STM32PP_LOG(App, Debug, "debug removed at compile time: %", countedArg());
+    STM32PP_LOG(Dma, Info, "dma info removed at compile time");
+    STM32PP_LOG(Dma, Warning, "dma warning");
+    check("compile-time threshold", "dma warning\n");
+    if (evalCount != 1)
+    {
+        printf("ERROR: Arguments of a removed call were evaluated\n");
+        return 1;
+    }
+    // Search for the format string of the removed call, without having it
+    // as a string literal in this source file
+    std::string removed = "emit elipmoc ta devomer gubed";
+    std::reverse(removed.begin(), removed.end());
+    std::string kept = "ofni";
+    std::reverse(kept.begin(), kept.end());
+    if (executableContains(removed) || !executableContains(kept + ": "))
+    {
+        printf("ERROR: Format string of a removed call is in the executable\n");
+        return 1;
+    }
+    printf("PASS: format strings of removed calls are not in the executable\n");
+
+    nslog::setLevel(nslog::kModApp, nslog::kLevelWarning);
+    STM32PP_LOG(App, Info, "info silenced at runtime");
+    STM32PP_LOG(App, Warning, "warning");
+    nslog::setLevel(nslog::kModApp, nslog::kLevelNone);
+    STM32PP_LOG(App, Error, "error silenced at runtime");
+    check("runtime level", "warning\n");
+    return 0;
+}
@@ -0,0 +1,42 @@
+// Log record header with a simulated clock and exception number
+#include <stdint.h>
+struct TestClock
+{
+    int64_t now = 0;
+    int64_t ticks() { return now; }
+    int64_t microtime() { return now / 72; }
+};
+uint16_t testIpsr = 0;
+#define STM32PP_LOG_TIMESTAMP 1
+#define STM32PP_LOG_CLOCK TestClock
+#define STM32PP_LOG_IPSR() testIpsr
+#include <stm32++/log.hpp>
+#include <stdio.h>
+#include <string>
+
+struct CaptureSink: public IPrintSink
+{
+    std::string output;
+    BufferInfo* waitReady() { return nullptr; }
+    void print(const char* str, size_t len, int fd) { output.append(str, len); }
+};
+
+CaptureSink captureSink;
+IPrintSink* gPrintSink = &captureSink;
+
+int main()
+{
+    nslog::LogClock<>::clock.now = 1234567;
+    STM32PP_LOG(App, Warning, "thread mode");
+    nslog::LogClock<>::clock.now = 123456789012;
+    testIpsr = 27;
+    STM32PP_LOG(App, Error, "in isr: %", 5);
+    const char* expected = "[   1234567   0] thread mode\n[123456789012  27] in isr: 5\n";
+    if (captureSink.output != expected)
+    {
+        printf("ERROR: expected '%s', actual: '%s'\n", expected, captureSink.output.c_str());
+        return 1;
+    }
+    printf("PASS: timestamp header\n");
+    return 0;
+}
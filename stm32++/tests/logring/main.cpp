@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <set>
+
+// Simulates interrupts at the points where a ring writer can be preempted
+static void preemptPoint();
+#define STM32PP_LOGRING_PREEMPT_POINT() preemptPoint()
+#include <stm32++/dmaPrint.hpp>
+#include <stm32++/tprintf.hpp>
+
+// Simulated device with the dma::Tx interface
+struct SimDmaTx
+{
+    const char* txData = nullptr;
+    uint16_t txSize = 0;
+    bool tcFlag = false;
+    bool busy = false;
+    void dmaTxStart(const void* data, uint16_t size)
+    {
+        assert(!busy);
+        txData = (const char*)data;
+        txSize = size;
+        busy = true;
+    }
+    bool txBusy() const { return busy; }
+    void dmaTxIsr()
+    {
+        if (!tcFlag)
+            return;
+        tcFlag = false;
+        busy = false;
+    }
+};
+
+dma::RingPrintSink<SimDmaTx, 256> sink;
+IPrintSink* gPrintSink = &sink;
+std::string output;
+uint32_t msgCount = 0;
+int isrDepth = 0;
+uint64_t isrCount = 0;
+
+// Transfers the data of the DMA transfer in progress and invokes the ISR
+void completeTransfer()
+{
+    if (!sink.txBusy())
+        return;
+    output.append(sink.txData, sink.txSize);
+    sink.tcFlag = true;
+    sink.dmaTxIsr();
+}
+
+std::string makeMsg(uint32_t seq)
+{
+    std::string msg = "#" + std::to_string(seq) + ":";
+    uint32_t len = (seq * 7919) % 90;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        msg += (char)('a' + (seq + i) % 26);
+    }
+    return msg + "\n";
+}
+
+// Every other message is formatted by tprintf() directly in the ring buffer
+void printMsg()
+{
+    uint32_t seq = msgCount++;
+    auto msg = makeMsg(seq);
+    if (seq & 1)
+    {
+        sink.print(msg.c_str(), msg.size(), 1);
+    }
+    else
+    {
+        size_t bodyStart = msg.find(':') + 1;
+        auto body = msg.substr(bodyStart, msg.size() - bodyStart - 1);
+        tprintf("#%:%\n"_fmt, seq, body.c_str());
+    }
+}
+
+static void preemptPoint()
+{
+    if (isrDepth >= 3)
+        return;
+    int r = rand() % 8;
+    if (r > 1)
+        return;
+    isrDepth++;
+    isrCount++;
+    if (r == 0)
+        printMsg(); // logging from an interrupt handler
+    else
+        completeTransfer(); // DMA transfer complete interrupt
+    isrDepth--;
+}
+
+int main()
+{
+    srand(1234);
+    for (int i = 0; i < 200000; i++)
+    {
+        printMsg();
+        // Drain at a random rate, so that the ring buffer is sometimes full
+        int drains = rand() % 3;
+        for (int j = 0; j < drains; j++)
+        {
+            completeTransfer();
+        }
+    }
+    while (sink.txBusy())
+    {
+        completeTransfer();
+    }
+    if (sink.ring().hasData())
+    {
+        printf("ERROR: Ring buffer has data, but no transfer is in progress\n");
+        return 1;
+    }
+
+    std::set<uint32_t> received;
+    size_t pos = 0;
+    while (pos < output.size())
+    {
+        size_t end = output.find('\n', pos);
+        if (end == std::string::npos || output[pos] != '#')
+        {
+            printf("ERROR: Corrupt output at offset %zu\n", pos);
+            return 1;
+        }
+        uint32_t seq = strtoul(output.c_str() + pos + 1, nullptr, 10);
+        if (output.compare(pos, end + 1 - pos, makeMsg(seq)) != 0)
+        {
+            printf("ERROR: Message %u is corrupt\n", seq);
+            return 1;
+        }
+        if (!received.insert(seq).second)
+        {
+            printf("ERROR: Message %u received twice\n", seq);
+            return 1;
+        }
+        pos = end + 1;
+    }
+    printf("messages: %u, received: %zu, dropped: %u, simulated interrupts: %llu\n",
+        msgCount, received.size(), sink.dropped(), (unsigned long long)isrCount);
+    if (received.size() + sink.dropped() != msgCount)
+    {
+        printf("ERROR: Received + dropped messages don't add up to the printed ones\n");
+        return 1;
+    }
+    if (!sink.dropped() || received.size() < msgCount / 2)
+    {
+        printf("ERROR: Test did not exercise both the overrun and the normal path\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <stm32++/dmaMemCopy.hpp>
+#include <stm32++/dmaRegistry.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "check.hpp"
+
+typedef dma::MemCopy<3> Copier;
+
+struct Usart3Tx
+{
+    enum: uint32_t { kDmaTxId = 1 };
+    enum: uint8_t { kDmaTxChannel = 2 };
+    static constexpr bool kDmaTxShared = false;
+    void dmaTxStop() {}
+};
+struct Usart3Rx
+{
+    enum: uint32_t { kDmaRxId = 1 };
+    enum: uint8_t { kDmaRxChannel = 3 };
+    static constexpr bool kDmaRxShared = false;
+    void dmaRxStop() {}
+};
+static_assert(HasMemDma<Copier>::value && !HasTxDma<Copier>::value, "MemCopy channel not detected");
+static_assert(!dma::channelsConflict<Copier, Usart3Tx>(), "Different channels");
+static_assert(dma::channelsConflict<Copier, Usart3Rx>(), "MemCopy on the channel of a peripheral");
+static_assert(!dma::channelsConflict<Copier, dma::MemCopy<3, 2>>(), "Same channel on different controllers");
+
+std::string callbackLog;
+void onDone(const void* data, void* userp)
+{
+    callbackLog += (const char*)userp;
+    callbackLog += ':';
+    callbackLog.append((const char*)data, 4);
+    callbackLog += ';';
+}
+
+int main()
+{
+    Copier copier;
+    copier.init();
+    char buf[16];
+    memset(buf, 0, sizeof(buf));
+    check("copy()", copier.copy(buf, "0123456789", 10, onDone, (void*)"copy"));
+    copier.wait();
+    check("Copied data", memcmp(buf, "0123456789\0", 11) == 0);
+    check("fill()", copier.fill(buf + 2, 'x', 5, onDone, (void*)"fill"));
+    check("Filled data", memcmp(buf, "01xxxxx789\0", 11) == 0);
+    check("Zero-size copy", copier.copy(buf + 8, "abc", 0, onDone, (void*)"empty"));
+    check("Callbacks are called with the destination, in order",
+        callbackLog == std::string("copy:0123;fill:xxxx;empty:89\0\0;", 31));
+    check("Not busy after completion", !copier.busy());
+    return 0;
+}
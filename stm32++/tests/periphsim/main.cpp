@@ -0,0 +1,432 @@
+#include <stm32++/usart.hpp>
+#include <stm32++/adc.hpp>
+#include <stm32++/i2c.hpp>
+#include <stm32++/spi.hpp>
+#include <stm32++/dmaMemCopy.hpp>
+#include <stm32++/drivers/ms5611.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "check.hpp"
+
+typedef dma::Tx<nsusart::Usart<USART1>> UsartDmaTx;
+typedef nsusart::DmaRingRx<nsusart::Usart<USART2>, 64> UsartRingRx;
+typedef nsusart::IntrTx<nsusart::Usart<USART3>, 16> UsartIntrTx;
+
+void testUsartDmaTx()
+{
+    sim::board().reset();
+    UsartDmaTx usart;
+    sim::setIrqHandler(NVIC_DMA1_CHANNEL4_IRQ, [&]() { usart.dmaTxIsr(); });
+    usart.init(nsusart::kOptEnableTx, 115200);
+    uint64_t start = sim::now();
+    check("usart dma: queue first buffer", usart.dmaTxQueue("hello ", 6));
+    check("usart dma: queue second buffer", usart.dmaTxQueue("world", 5));
+    check("usart dma: third buffer rejected when queue is full", !usart.dmaTxQueue("!", 1));
+    check("usart dma: transfer is asynchronous", sim::board().usart1.output().size() < 2);
+    bool done = sim::runUntil([&]() { return !usart.txBusy() && (USART1_SR & USART_SR_TC); });
+    check("usart dma: transfers complete", done);
+    check("usart dma: output", sim::board().usart1.output() == "hello world");
+    check("usart dma: one interrupt per buffer", sim::isrCount(NVIC_DMA1_CHANNEL4_IRQ) == 2);
+    // 11 frames of 10 bits at 115200 baud
+    check("usart dma: output takes the time of the frames", sim::now() - start >= 11 * 10 * 625);
+    // The second buffer is started by the DMA interrupt of the first, within
+    // the time the USART takes to send the byte in its shift register
+    check("usart dma: no idle frame between the buffers", sim::now() - start < 12 * 10 * 625);
+}
+
+void testUsartRingRx()
+{
+    sim::board().reset();
+    UsartRingRx usart;
+    sim::setIrqHandler(NVIC_DMA1_CHANNEL6_IRQ, [&]() { usart.dmaRxIsr(); });
+    sim::setIrqHandler(NVIC_USART2_IRQ, [&]() { usart.rxIsr(); });
+    usart.init(nsusart::kOptEnableRx, 115200);
+    nvic_enable_irq(NVIC_USART2_IRQ);
+    usart.rxStart();
+    sim::board().usart2.inject("first line\nsecond");
+    char buf[32];
+    check("usart ring rx: nothing before the data arrives", usart.readLine(buf, sizeof(buf)) < 0);
+    sim::runUntil([]() { return sim::board().usart2.rxDone(); });
+    check("usart ring rx: line received", usart.readLine(buf, sizeof(buf)) == 10 &&
+        strcmp(buf, "first line") == 0);
+    // The rest is published by the idle line interrupt
+    sim::runUntil([&]() { return sim::isrCount(NVIC_USART2_IRQ) > 0; });
+    size_t len = usart.read(buf, sizeof(buf));
+    check("usart ring rx: rest received after idle line", len == 6 && memcmp(buf, "second", 6) == 0);
+    check("usart ring rx: no overruns", usart.rxOverruns() == 0);
+    usart.rxStop();
+}
+
+void testUsartIntrTx()
+{
+    sim::board().reset();
+    UsartIntrTx usart;
+    sim::setIrqHandler(NVIC_USART3_IRQ, [&]() { usart.txIsr(); });
+    usart.init(nsusart::kOptEnableTx, 1000000);
+    nvic_enable_irq(NVIC_USART3_IRQ);
+    const char* msg = "interrupt-driven transmission, longer than the fifo";
+    // sendBlocking() and txFlush() would spin on the FIFO in RAM, where time
+    // doesn't advance
+    for (size_t len = strlen(msg), sent = 0; sent < len;)
+    {
+        size_t n = usart.send(msg + sent, len - sent);
+        sent += n;
+        if (!n)
+        {
+            sim::run(100);
+        }
+    }
+    sim::runUntil([&]() { return !usart.txBusy(); });
+    check("usart intr tx: output", sim::board().usart3.output() == msg);
+    check("usart intr tx: one interrupt per byte",
+        sim::isrCount(NVIC_USART3_IRQ) >= strlen(msg));
+}
+
+struct AdcStream
+{
+    std::vector<uint16_t> samples;
+    uint32_t calls = 0;
+    static void onData(const void* data, uint16_t size, void* userp)
+    {
+        auto self = static_cast<AdcStream*>(userp);
+        self->calls++;
+        auto samples = static_cast<const uint16_t*>(data);
+        self->samples.insert(self->samples.end(), samples, samples + size / 2);
+    }
+};
+
+void testAdcStream()
+{
+    sim::board().reset();
+    nsadc::Adc<ADC1> adc;
+    sim::setIrqHandler(NVIC_DMA1_CHANNEL1_IRQ, [&]() { adc.dmaRxIsr(); });
+    uint16_t next = 100;
+    sim::board().adc1.source = [&](uint8_t) { return next++; };
+    adc.init(nsadc::kOptContConv | nsadc::kOptNoVref);
+    uint8_t chans[] = { 1 };
+    adc.setChannels(chans, 1, 500000u);
+    uint16_t buf[8];
+    AdcStream stream;
+    adc.startStream(buf, 8, AdcStream::onData, &stream);
+    sim::runUntil([&]() { return stream.calls >= 4; });
+    adc.stopStream();
+    bool sequential = stream.samples.size() == 16;
+    for (size_t i = 0; sequential && i < stream.samples.size(); i++)
+    {
+        sequential = (stream.samples[i] == 100 + i);
+    }
+    check("adc stream: halves delivered in order", sequential);
+}
+
+void testI2c()
+{
+    sim::board().reset();
+    sim::I2cMemSlave sensor(0x77);
+    sensor.regs[0xa2] = 0x12;
+    sensor.regs[0xa3] = 0x34;
+    sim::board().i2c1.attach(sensor);
+    nsi2c::I2c<I2C1> i2c;
+    i2c.init();
+    check("i2c: register address written", i2c.startSend(0x77));
+    i2c.sendByte(0xa2);
+    check("i2c: repeated start for reading", i2c.startRecv(0x77, true));
+    uint8_t data[2];
+    i2c.recv(data, 2);
+    i2c.stop();
+    sim::runUntil([]() { return !sim::board().i2c1.busBusy(); });
+    check("i2c: registers read", data[0] == 0x12 && data[1] == 0x34);
+    check("i2c: transaction ended", sensor.stops == 1 && sim::board().i2c1.transactions() == 1);
+    check("i2c: device detected", i2c.isDeviceConnected(0x77));
+    check("i2c: missing device not detected", !i2c.isDeviceConnected(0x10));
+    sim::board().i2c1.detach(sensor);
+}
+
+// Holds the bus low after \c stickAfter bytes are written to it
+struct StuckSlave: public sim::I2cMemSlave
+{
+    uint32_t stickAfter;
+    StuckSlave(uint8_t addr, uint32_t aStickAfter): I2cMemSlave(addr), stickAfter(aStickAfter) {}
+    virtual bool onWrite(uint8_t data)
+    {
+        bool ack = I2cMemSlave::onWrite(data);
+        if (bytesWritten == stickAfter)
+        {
+            sim::board().i2c1.setBusStuck(true);
+        }
+        return ack;
+    }
+};
+
+struct I2cResults
+{
+    std::string statuses;
+    static void onDone(uint8_t status, void* userp)
+    {
+        static_cast<I2cResults*>(userp)->statuses += (char)('0' + status);
+    }
+};
+
+void testI2cIntr()
+{
+    sim::board().reset();
+    sim::I2cMemSlave sensor(0x77);
+    for (int i = 0; i < 16; i++)
+    {
+        sensor.regs[0x20 + i] = 0xc0 + i;
+    }
+    sim::board().i2c1.attach(sensor);
+    typedef nsi2c::IntrMaster<nsi2c::I2c<I2C1>> I2c;
+    I2c i2c;
+    sim::setIrqHandler(NVIC_I2C1_EV_IRQ, [&]() { i2c.evIsr(); });
+    sim::setIrqHandler(NVIC_I2C1_ER_IRQ, [&]() { i2c.erIsr(); });
+    i2c.init();
+    I2cResults results;
+    const uint8_t cmd[] = { 0x10, 0xa1, 0xa2, 0xa3 };
+    uint8_t reg = 0x20;
+    uint8_t rx1[1], rx2[2], rx3[3], rx7[7];
+    check("i2c intr: write queued", i2c.write(0x77, cmd, sizeof(cmd), I2cResults::onDone, &results));
+    check("i2c intr: 1-byte read queued", i2c.writeRead(0x77, &reg, 1, rx1, 1, I2cResults::onDone, &results));
+    check("i2c intr: 2-byte read queued", i2c.writeRead(0x77, &reg, 1, rx2, 2, I2cResults::onDone, &results));
+    check("i2c intr: 3-byte read queued", i2c.writeRead(0x77, &reg, 1, rx3, 3, I2cResults::onDone, &results));
+    check("i2c intr: queue full", !i2c.read(0x77, rx7, 7));
+    check("i2c intr: transactions are asynchronous", i2c.busy() && results.statuses.empty());
+    sim::runUntil([&]() { return i2c.queue(0x77, &reg, 1, rx7, 7, I2cResults::onDone, &results); });
+    check("i2c intr: missing device queued", sim::runUntil([&]() {
+        return i2c.read(0x10, rx1, 1, I2cResults::onDone, &results); }));
+    sim::runUntil([&]() { return !i2c.busy(); });
+    check("i2c intr: all completed, the missing device NACKed", results.statuses == "000001");
+    check("i2c intr: data written", memcmp(sensor.regs + 0x10, cmd + 1, 3) == 0);
+    check("i2c intr: 1, 2 and 3 bytes read", rx1[0] == 0xc0 && rx2[0] == 0xc0 &&
+        rx2[1] == 0xc1 && rx3[0] == 0xc0 && rx3[2] == 0xc2);
+    bool nread = true;
+    for (int i = 0; i < 7; i++)
+    {
+        nread &= (rx7[i] == 0xc0 + i);
+    }
+    check("i2c intr: N bytes read", nread);
+    // Only the requested bytes are clocked out of the slave, i.e. NACKed in time
+    check("i2c intr: no extra bytes read", sensor.bytesRead == 1 + 2 + 3 + 7);
+    sim::runUntil([]() { return !sim::board().i2c1.busBusy(); });
+    check("i2c intr: bus released", sim::board().i2c1.transactions() == 6);
+    // A transaction that doesn't progress is aborted by poll()
+    nvic_disable_irq(NVIC_I2C1_EV_IRQ);
+    i2c.read(0x77, rx2, 2, I2cResults::onDone, &results);
+    i2c.poll();
+    check("i2c intr: no timeout too early", i2c.busy());
+    sim::run(rcc_ahb_frequency / 1000 * (nsi2c::kTimeoutMs + 2));
+    i2c.poll();
+    check("i2c intr: timeout", !i2c.busy() && results.statuses.back() == '0' + nsi2c::kXferTimeout);
+    nvic_enable_irq(NVIC_I2C1_EV_IRQ);
+    sim::board().i2c1.detach(sensor);
+
+    // The bus gets stuck while the STOP of a transaction is pending. The next
+    // transaction must not wait for it in the ISR, but time out in poll()
+    StuckSlave stuck(0x42, 2);
+    sim::board().i2c1.attach(stuck);
+    const uint8_t first[] = { 0x10, 0x01 };
+    const uint8_t second[] = { 0x10, 0x02 };
+    results.statuses.clear();
+    i2c.write(0x42, first, 2, I2cResults::onDone, &results);
+    i2c.write(0x42, second, 2, I2cResults::onDone, &results);
+    sim::runUntil([&]() { i2c.poll(); return !i2c.busy(); }, rcc_ahb_frequency);
+    check("i2c intr: stuck bus times out", results.statuses == "04");
+    sim::board().i2c1.setBusStuck(false);
+    i2c.write(0x42, second, 2, I2cResults::onDone, &results);
+    sim::runUntil([&]() { i2c.poll(); return !i2c.busy(); }, rcc_ahb_frequency);
+    check("i2c intr: controller recovered", results.statuses == "040" && stuck.regs[0x10] == 0x02);
+    sim::board().i2c1.detach(stuck);
+}
+
+void testI2cDmaRx()
+{
+    sim::board().reset();
+    sim::I2cMemSlave sensor(0x68);
+    for (int i = 0; i < 16; i++)
+    {
+        sensor.regs[0x40 + i] = 0x80 + i;
+    }
+    sim::board().i2c1.attach(sensor);
+    dma::Rx<nsi2c::I2c<I2C1>> i2c;
+    sim::setIrqHandler(NVIC_DMA1_CHANNEL7_IRQ, [&]() { i2c.dmaRxIsr(); });
+    i2c.init();
+    const uint16_t sizes[] = { 1, 2, 12 };
+    uint32_t expectRead = 0;
+    for (auto size: sizes)
+    {
+        uint8_t buf[12] = {};
+        check("i2c dma rx: read started", nsi2c::dmaReadRegs(i2c, 0x68, 0x42, buf, size));
+        sim::runUntil([&]() { return !i2c.dmaRxBusy() && !sim::board().i2c1.busBusy(); });
+        bool ok = true;
+        for (int i = 0; i < size; i++)
+        {
+            ok &= (buf[i] == 0x82 + i);
+        }
+        check("i2c dma rx: registers read", ok);
+        expectRead += size;
+        // The last byte was NACKed in time, and the STOP followed
+        check("i2c dma rx: no extra bytes read", sensor.bytesRead == expectRead &&
+            sensor.stops == sim::board().i2c1.transactions());
+    }
+    // A second read while the first is in progress is rejected, without
+    // disturbing the first
+    uint8_t buf[8] = {}, buf2[8];
+    uint32_t readBefore = sensor.bytesRead;
+    check("i2c dma rx: first of back-to-back reads started", nsi2c::dmaReadRegs(i2c, 0x68, 0x42, buf, 8));
+    check("i2c dma rx: second read rejected while busy", !nsi2c::dmaReadRegs(i2c, 0x68, 0x40, buf2, 8));
+    sim::runUntil([&]() { return !i2c.dmaRxBusy() && !sim::board().i2c1.busBusy(); }, rcc_ahb_frequency / 100);
+    check("i2c dma rx: first read not aborted", buf[0] == 0x82 && buf[7] == 0x89 &&
+        sensor.bytesRead == readBefore + 8 && sensor.stops == sim::board().i2c1.transactions());
+    check("i2c dma rx: missing device", !nsi2c::dmaReadRegs(i2c, 0x10, 0x42, nullptr, 4));
+    check("i2c dma rx: bus released after failure", !i2c.dmaRxBusy() &&
+        sim::runUntil([]() { return !sim::board().i2c1.busBusy(); }));
+    sim::board().i2c1.detach(sensor);
+}
+
+// Responds to the PROM read commands of an MS5611
+struct Ms5611Sim: public sim::I2cSlave
+{
+    uint16_t prom[8] = { 0, 40127, 36924, 23317, 23282, 33464, 28312, 0x0000 };
+    uint8_t cmd = 0;
+    uint8_t byteIdx = 0;
+    uint32_t promReads = 0;
+    Ms5611Sim(): I2cSlave(0x77) {}
+    virtual void onStart() { byteIdx = 0; }
+    virtual bool onWrite(uint8_t data) { cmd = data; return true; }
+    virtual uint8_t onRead()
+    {
+        if (cmd < 0xa0 || cmd > 0xae)
+        {
+            return 0;
+        }
+        promReads += (byteIdx == 0);
+        uint16_t word = prom[(cmd - 0xa0) / 2];
+        return (byteIdx++ == 0) ? (word >> 8) : (word & 0xff);
+    }
+};
+
+void testI2cSteps()
+{
+    sim::board().reset();
+    Ms5611Sim sensor;
+    typedef MS5611<nsi2c::I2c<I2C2>> Sensor;
+    for (uint8_t crc = 0; crc < 16; crc++)
+    {
+        sensor.prom[7] = crc;
+        if (Sensor::crc4(sensor.prom))
+        {
+            break;
+        }
+    }
+    sim::board().i2c2.attach(sensor);
+    nsi2c::I2c<I2C2> i2c;
+    i2c.init();
+    Sensor sens(i2c);
+    check("i2c steps: ms5611 calibration loaded, crc ok", sens.init());
+    check("i2c steps: ms5611 prom read in one list", sensor.promReads == 8);
+    sim::board().i2c2.detach(sensor);
+
+    sim::I2cMemSlave mem(0x50);
+    mem.regs[0x31] = 0x5a;
+    sim::board().i2c2.attach(mem);
+    const uint8_t reg31 = 0x31;
+    uint8_t rx1[1], rx5[5];
+    const nsi2c::Step polledSteps[] = {
+        { 0x50, &reg31, 1, rx1, 1, 0 },
+        { 0x50, &reg31, 1, rx5, 5, 0 }
+    };
+    check("i2c steps: polled list", i2c.transfer(polledSteps, 2) && rx1[0] == 0x5a && rx5[0] == 0x5a);
+    check("i2c steps: polled reads NACKed in time", mem.bytesRead == 6 && mem.stops == 2);
+    check("i2c steps: no CR1 writes while STOP is pending", sim::board().i2c2.pendingCr1Writes() == 0);
+    const nsi2c::Step missing[] = { { 0x10, &reg31, 1, rx1, 1, 0 } };
+    uint64_t nackStart = sim::now();
+    check("i2c steps: missing device", !i2c.transfer(missing, 1));
+    check("i2c steps: address NACK fails without waiting for the timeout",
+        sim::now() - nackStart < (uint64_t)nsi2c::kTimeoutMs * rcc_ahb_frequency / 1000);
+    check("i2c steps: device found after a NACK", i2c.isDeviceConnected(0x20) == false &&
+        i2c.findFirstDevice(0x10) == 0x50);
+    nsi2c::IntrMaster<nsi2c::I2c<I2C2>> intrI2c;
+    sim::setIrqHandler(NVIC_I2C2_EV_IRQ, [&]() { intrI2c.evIsr(); });
+    sim::setIrqHandler(NVIC_I2C2_ER_IRQ, [&]() { intrI2c.erIsr(); });
+    intrI2c.init();
+    const uint8_t write[] = { 0x30, 0x77 };
+    const uint8_t reg = 0x30;
+    uint8_t data[2] = {};
+    const nsi2c::Step steps[] = {
+        { 0x50, write, 2, nullptr, 0, 500 },
+        { 0x50, &reg, 1, data, 2, 0 }
+    };
+    I2cResults results;
+    uint64_t start = sim::now();
+    check("i2c steps: list queued", intrI2c.queueSteps(steps, 2, I2cResults::onDone, &results));
+    sim::runUntil([&]() { intrI2c.poll(); return !intrI2c.busy(); });
+    check("i2c steps: one callback for the list", results.statuses == "0");
+    check("i2c steps: data read back", data[0] == 0x77 && data[1] == 0x5a);
+    check("i2c steps: delay between steps", sim::now() - start >= 500 * (rcc_ahb_frequency / 1000000));
+    sim::board().i2c2.detach(mem);
+}
+
+void testSpi()
+{
+    sim::board().reset();
+    nsspi::SpiMaster<SPI1> spi;
+    sim::board().spi1.slave = [](uint16_t mosi) { return mosi ^ 0xff; };
+    spi.init(nsspi::Baudrate(1000000), nsspi::k8BitFrame);
+    spi.send(0x5a);
+    check("spi: slave response", spi.recv() == 0xa5);
+    spi.waitComplete();
+    check("spi: frame sent", sim::board().spi1.mosi().size() == 1 && sim::board().spi1.mosi()[0] == 0x5a);
+    sim::board().spi1.slave = nullptr;
+}
+
+std::string copyLog;
+void onCopyDone(const void*, void* userp)
+{
+    copyLog += (const char*)userp;
+}
+
+void testMemCopy()
+{
+    sim::board().reset();
+    dma::MemCopy<1, 2> copier;
+    sim::setIrqHandler(NVIC_DMA2_CHANNEL1_IRQ, [&]() { copier.isr(); });
+    copier.init();
+    uint32_t src[16];
+    for (int i = 0; i < 16; i++)
+    {
+        src[i] = i * 0x01010101;
+    }
+    uint32_t dst[16] = {};
+    char fillBuf[33];
+    memset(fillBuf, 0, sizeof(fillBuf));
+    check("memcopy: copy queued", copier.copy(dst, src, sizeof(src), onCopyDone, (void*)"c"));
+    check("memcopy: fill queued", copier.fill(fillBuf, 0xab, 33, onCopyDone, (void*)"f"));
+    check("memcopy: operations are asynchronous", copier.busy() && copyLog.empty());
+    sim::runUntil([&]() { return !copier.busy(); });
+    check("memcopy: data copied", memcmp(dst, src, sizeof(src)) == 0);
+    bool filled = true;
+    for (auto ch: fillBuf)
+    {
+        filled &= ((uint8_t)ch == 0xab);
+    }
+    check("memcopy: buffer filled", filled);
+    check("memcopy: callbacks in order", copyLog == "cf");
+    check("memcopy: words used for the aligned copy", sim::board().dma2.transfers(1) == 16 + 33);
+}
+
+int main()
+{
+    setvbuf(stdout, nullptr, _IONBF, 0); // keep the output if the simulator aborts
+    testUsartDmaTx();
+    testUsartRingRx();
+    testUsartIntrTx();
+    testAdcStream();
+    testI2c();
+    testI2cIntr();
+    testI2cDmaRx();
+    testI2cSteps();
+    testSpi();
+    testMemCopy();
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include <stm32++/rtt.hpp>
+#include <stm32++/rttReader.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+
+// The debugger's view of the memory of this process
+class ProcessMemory: public rtt::IMemory
+{
+public:
+    virtual bool read(uint64_t addr, void* buf, size_t len)
+    {
+        memcpy(buf, (const void*)addr, len);
+        return true;
+    }
+    virtual bool write(uint64_t addr, const void* data, size_t len)
+    {
+        if (len == 4)
+        {
+            uint32_t val;
+            memcpy(&val, data, 4);
+            __atomic_store_n((uint32_t*)addr, val, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            memcpy((void*)addr, data, len);
+        }
+        return true;
+    }
+};
+
+// Memory image of a 32-bit target
+class ImageMemory: public rtt::IMemory
+{
+public:
+    uint64_t base;
+    std::vector<uint8_t> data;
+    ImageMemory(uint64_t aBase, size_t size): base(aBase), data(size) {}
+    bool valid(uint64_t addr, size_t len) { return addr >= base && addr + len <= base + data.size(); }
+    virtual bool read(uint64_t addr, void* buf, size_t len)
+    {
+        if (!valid(addr, len))
+        {
+            return false;
+        }
+        memcpy(buf, &data[addr - base], len);
+        return true;
+    }
+    virtual bool write(uint64_t addr, const void* buf, size_t len)
+    {
+        if (!valid(addr, len))
+        {
+            return false;
+        }
+        memcpy(&data[addr - base], buf, len);
+        return true;
+    }
+    void put32(uint64_t addr, uint32_t val) { write(addr, &val, 4); }
+};
+
+// The sink surrounded by memory that the reader has to search
+template <class Sink>
+struct SinkInRam
+{
+    char before[100];
+    Sink sink;
+    char after[100];
+    SinkInRam()
+    {
+        memset(before, 0, sizeof(before));
+        memcpy(before + 50, "SEGGER RTX", 10); // near miss
+        memset(after, 0xff, sizeof(after));
+    }
+};
+
+ProcessMemory gMem;
+
+void testFind()
+{
+    SinkInRam<rtt::PrintSink<64, 16>> ram;
+    rtt::Reader reader(gMem, sizeof(void*));
+    check("find() fails in memory without a control block", !reader.find((uint64_t)ram.before, sizeof(ram.before)));
+    // Small chunks, so that the id crosses chunk boundaries
+    check("find() in memory with a control block", reader.find((uint64_t)&ram, sizeof(ram), 37));
+    check("find() returns the address of the control block",
+        reader.address() == (uint64_t)&ram.sink.controlBlock());
+    check("Buffer counts", reader.numUpBuffers() == 1 && reader.numDownBuffers() == 1);
+}
+
+// Writes random-length messages and polls at random times. The received data
+// must be the messages that were not dropped, in order and without gaps
+void testStream()
+{
+    rtt::PrintSink<64, 16> sink;
+    rtt::Reader reader(gMem, sizeof(void*));
+    check("attach() to the control block", reader.attach((uint64_t)&sink.controlBlock()));
+    std::string expected;
+    std::string received;
+    uint32_t dropped = 0;
+    bool wrapped = false;
+    srand(1);
+    for (int i = 0; i < 20000; i++)
+    {
+        std::string msg = "#" + std::to_string(i) + ":" + std::string(rand() % 40, 'a' + i % 26) + "\n";
+        auto& up = sink.controlBlock().up[0];
+        uint32_t freeBytes = up.bytesFree(up.rdOff, up.wrOff);
+        uint32_t wrBefore = up.wrOff;
+        sink.print(msg.c_str(), msg.size(), 1);
+        if (msg.size() <= freeBytes)
+        {
+            expected += msg;
+            wrapped |= up.wrOff < wrBefore;
+        }
+        else
+        {
+            dropped++;
+        }
+        if (rand() % 3 == 0)
+        {
+            reader.read(0, received);
+        }
+    }
+    reader.read(0, received);
+    check("Messages that don't fit are dropped and counted", dropped && sink.dropped() == dropped);
+    check("Writes wrap around the end of the buffer", wrapped);
+    check("The received data equals the messages that were not dropped", received == expected);
+}
+
+void testTrim()
+{
+    rtt::PrintSink<16, 16, rtt::kModeNoBlockTrim> sink;
+    rtt::Reader reader(gMem, sizeof(void*));
+    reader.attach((uint64_t)&sink.controlBlock());
+    sink.print("0123456789", 10, 1);
+    sink.print("abcdefghij", 10, 1);
+    std::string received;
+    reader.read(0, received);
+    check("Trim mode writes as much as fits", received == "0123456789abcde" && sink.dropped() == 1);
+}
+
+void testBlock()
+{
+    rtt::PrintSink<16, 16, rtt::kModeBlockIfFull> sink;
+    rtt::Reader reader(gMem, sizeof(void*));
+    reader.attach((uint64_t)&sink.controlBlock());
+    std::string expected;
+    for (int i = 0; i < 1000; i++)
+    {
+        expected += "message " + std::to_string(i) + "\n";
+    }
+    volatile bool done = false;
+    std::string received;
+    std::thread host([&]()
+    {
+        while (!done)
+        {
+            reader.read(0, received);
+        }
+        reader.read(0, received);
+    });
+    // Messages longer than the buffer are written in parts
+    for (size_t pos = 0; pos < expected.size(); pos += 40)
+    {
+        size_t len = std::min((size_t)40, expected.size() - pos);
+        sink.print(expected.c_str() + pos, len, 1);
+    }
+    done = true;
+    host.join();
+    check("Block mode waits for the host and loses nothing", received == expected && sink.dropped() == 0);
+}
+
+void testDown()
+{
+    rtt::PrintSink<16, 16> sink;
+    rtt::Reader reader(gMem, sizeof(void*));
+    reader.attach((uint64_t)&sink.controlBlock());
+    char buf[32];
+    check("read() returns 0 when there is no input", sink.read(buf, sizeof(buf)) == 0);
+    std::string sent;
+    std::string got;
+    for (int i = 0; i < 10; i++)
+    {
+        const char* data = "command 123;";
+        int written = reader.write(0, data, 12);
+        sent.append(data, written);
+        size_t len = sink.read(buf, 7);
+        got.append(buf, len);
+    }
+    size_t len;
+    while ((len = sink.read(buf, sizeof(buf))))
+    {
+        got.append(buf, len);
+    }
+    check("The host can't write more than the free space in the down buffer", sent.size() < 120);
+    check("Data written by the host is received by the target", got == sent && sent.size() > 50);
+}
+
+// Control block of a 32-bit target, with the up buffer wrapped around
+void testImage()
+{
+    enum: uint32_t { kBase = 0x20000000, kCb = kBase + 0x123, kUpBuf = kBase + 0x400, kDownBuf = kBase + 0x500 };
+    ImageMemory mem(kBase, 0x1000);
+    memcpy(&mem.data[kCb - kBase], "SEGGER RTT", 10);
+    mem.put32(kCb + 16, 1);
+    mem.put32(kCb + 20, 1);
+    // up[0]: name, buf, size, wrOff, rdOff, flags
+    uint32_t up = kCb + 24;
+    mem.put32(up + 4, kUpBuf);
+    mem.put32(up + 8, 16);
+    mem.put32(up + 12, 3);
+    mem.put32(up + 16, 10);
+    memcpy(&mem.data[kUpBuf - kBase], "ld\nxxxxxxxHello ", 16);
+    uint32_t down = up + 24;
+    mem.put32(down + 4, kDownBuf);
+    mem.put32(down + 8, 8);
+
+    rtt::Reader reader(mem);
+    check("find() in a 32-bit memory image", reader.find(kBase, 0x1000) && reader.address() == kCb);
+    std::string received;
+    check("read() from a 32-bit memory image", reader.read(0, received) && received == "Hello ld\n");
+    uint32_t rdOff;
+    memcpy(&rdOff, &mem.data[up + 16 - kBase], 4);
+    check("read() updates the read offset of the target", rdOff == 3);
+    check("write() to a 32-bit memory image", reader.write(0, "abcdefghij", 10) == 7);
+    uint32_t wrOff;
+    memcpy(&wrOff, &mem.data[down + 12 - kBase], 4);
+    check("write() updates the write offset of the target",
+        wrOff == 7 && memcmp(&mem.data[kDownBuf - kBase], "abcdefg", 7) == 0);
+    mem.put32(up + 12, 16);
+    check("read() rejects an invalid descriptor", !reader.read(0, received));
+}
+
+int main()
+{
+    testFind();
+    testStream();
+    testTrim();
+    testBlock();
+    testDown();
+    testImage();
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stm32++/dmaRxRing.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "check.hpp"
+
+enum: uint16_t { kSize = 64 };
+dma::RxRing<kSize> ring;
+uint16_t cndtr = kSize; // remaining transfer count of the simulated DMA channel
+uint32_t isrCount = 0;
+
+// Simulates the DMA receiving a byte in circular mode, and the half and full
+// transfer interrupts
+void dmaReceive(char ch)
+{
+    uint16_t pos = kSize - cndtr;
+    ring.buffer()[pos] = ch;
+    if (--cndtr == 0)
+    {
+        cndtr = kSize;
+    }
+    if (pos == kSize / 2 - 1 || pos == kSize - 1)
+    {
+        isrCount++;
+        ring.update(cndtr);
+    }
+}
+
+// A burst of data, followed by an idle line interrupt
+void receiveBurst(const std::string& data)
+{
+    for (char ch: data)
+    {
+        dmaReceive(ch);
+    }
+    isrCount++;
+    ring.update(cndtr);
+}
+
+int main()
+{
+    char buf[128];
+    check("Nothing to read initially", ring.read(buf, sizeof(buf)) == 0 && ring.readLine(buf, sizeof(buf)) == -1);
+    receiveBurst("hello");
+    check("The idle interrupt publishes a short burst", ring.available() == 5);
+    check("Incomplete line is not returned", ring.readLine(buf, sizeof(buf)) == -1);
+    receiveBurst(" world\r");
+    check("Line terminated by CR", ring.readLine(buf, sizeof(buf)) == 11 && strcmp(buf, "hello world") == 0);
+    receiveBurst("\nsecond\n\nthird\r\n");
+    check("The LF of CRLF is skipped, even if received later",
+        ring.readLine(buf, sizeof(buf)) == 6 && strcmp(buf, "second") == 0);
+    check("Empty line", ring.readLine(buf, sizeof(buf)) == 0 && buf[0] == 0);
+    check("Line terminated by CRLF", ring.readLine(buf, sizeof(buf)) == 5 && strcmp(buf, "third") == 0);
+    check("CRLF is consumed completely", ring.readLine(buf, sizeof(buf)) == -1 && ring.available() == 0);
+    receiveBurst("0123456789abcdef");
+    check("Line longer than the caller's buffer is returned in parts",
+        ring.readLine(buf, 11) == 10 && strcmp(buf, "0123456789") == 0 &&
+        ring.readLine(buf, 11) == -1 && ring.read(buf, sizeof(buf)) == 6 && memcmp(buf, "abcdef", 6) == 0);
+
+    // Stream lines of random length, the DMA wraps around the buffer many times
+    std::string input, output;
+    srand(1);
+    for (uint32_t i = 0; i < 20000; i++)
+    {
+        std::string line = std::to_string(i) + ":" + std::string(rand() % 20, 'a' + i % 26);
+        input += line + "\n";
+        receiveBurst(line + "\n");
+        int len;
+        while ((len = ring.readLine(buf, sizeof(buf))) >= 0)
+        {
+            output.append(buf, len);
+            output += '\n';
+        }
+    }
+    check("Streamed lines are received in order, without loss", output == input && ring.overruns() == 0);
+
+    // Long bursts are published by the half and full transfer interrupts
+    isrCount = 0;
+    std::string data;
+    for (int i = 0; i < 200; i++)
+    {
+        data += (char)('A' + i % 26);
+    }
+    output.clear();
+    for (char ch: data)
+    {
+        dmaReceive(ch);
+        size_t len = ring.read(buf, sizeof(buf));
+        output.append(buf, len);
+    }
+    check("Data is published at half and full transfer, without an idle interrupt",
+        output.size() >= data.size() - kSize / 2 && data.compare(0, output.size(), output) == 0);
+    check("Two interrupts per buffer", isrCount == 200 / (kSize / 2));
+    receiveBurst("");
+    ring.read(buf, sizeof(buf));
+
+    // The reader falls behind by more than the buffer size
+    receiveBurst(std::string(kSize - 8, 'x'));
+    receiveBurst("0123456789abcdef");
+    size_t len = ring.read(buf, sizeof(buf));
+    check("Overrun is detected, and the newest half of the buffer is kept",
+        ring.overruns() == 1 && len == kSize / 2 && memcmp(buf + len - 16, "0123456789abcdef", 16) == 0);
+    return 0;
+}
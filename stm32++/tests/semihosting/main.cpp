@@ -0,0 +1,89 @@
+#include <stm32++/shostPrint.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "check.hpp"
+
+// Mock of the semihosting trap - records the SYS_WRITE output of each file descriptor
+std::string output[3];
+uint32_t trapCount = 0;
+
+namespace shost
+{
+size_t bkpt(size_t cmd, size_t arg1)
+{
+    trapCount++;
+    if (cmd != SYS_WRITE)
+    {
+        printf("ERROR: Unexpected semihosting call %zu\n", cmd);
+        exit(1);
+    }
+    auto msg = (size_t*)arg1;
+    output[msg[0]].append((const char*)msg[1], msg[2]);
+    return 0;
+}
+}
+
+void reset()
+{
+    output[1].clear();
+    output[2].clear();
+    trapCount = 0;
+}
+
+// Prints lines in several fragments each, as tprintf() does for separate calls
+template <class Sink>
+std::string printLines(Sink& sink, int count)
+{
+    std::string expected;
+    for (int i = 0; i < count; i++)
+    {
+        std::string num = std::to_string(i);
+        const char* frags[] = { "line ", num.c_str(), ": ", "some text", "\n" };
+        for (auto frag: frags)
+        {
+            sink.print(frag, strlen(frag), 1);
+            expected += frag;
+        }
+    }
+    return expected;
+}
+
+int main()
+{
+    {
+        reset();
+        shost::BufferedPrintSink<256, 0> sink;
+        auto expected = printLines(sink, 100);
+        check("line buffered output", output[1] == expected);
+        check("line buffered: one trap per line", trapCount == 100);
+        printf("  %zu print() calls, %u traps\n", (size_t)500, trapCount);
+    }
+    {
+        reset();
+        shost::BufferedPrintSink<256, 200> sink;
+        auto expected = printLines(sink, 100);
+        sink.flush();
+        check("watermark output", output[1] == expected);
+        check("watermark: one trap per ~200 bytes", trapCount <= expected.size() / 200 + 1);
+        printf("  %zu bytes, %u traps\n", expected.size(), trapCount);
+    }
+    {
+        reset();
+        shost::BufferedPrintSink<64, 64> sink;
+        sink.print("abc", 3, 1);
+        check("no flush before full", trapCount == 0);
+        std::string large(100, 'x');
+        sink.print(large.c_str(), large.size(), 1);
+        check("large string written directly after the buffered data",
+            output[1] == "abc" + large && trapCount == 2);
+        sink.print("out", 3, 1);
+        sink.print("err", 3, 2);
+        check("switching fd flushes the buffered output", output[1] == "abc" + large + "out" && output[2].empty());
+        sink.flush();
+        check("explicit flush", output[2] == "err" && trapCount == 4);
+        sink.flush();
+        check("flush of empty buffer doesn't trap", trapCount == 4);
+    }
+    return 0;
+}
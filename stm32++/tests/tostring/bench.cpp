@@ -0,0 +1,71 @@
+#include <stm32++/tostring.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+// Compares the decimal fast path of toString() with the generic
+// DigitConverter path, for 8, 16, 32 and 64-bit values
+
+enum { kValues = 4096, kRounds = 500 };
+volatile size_t gSink; // prevents the conversion from being optimized out
+
+template <typename Val, typename Func>
+double nsPerCall(const std::vector<Val>& values, Func func)
+{
+    char buf[32];
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; round++)
+    {
+        for (auto val: values)
+        {
+            total += func(buf, sizeof(buf), val) - buf;
+            asm volatile("" : : "r"(buf) : "memory");
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    gSink = total;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (kRounds * values.size());
+}
+
+// Both paths are called out-of-line, so that the comparison is not skewed
+// by the compiler inlining one of them, but not the other
+template <typename Val>
+__attribute__((noinline)) char* genericConv(char* buf, size_t size, Val val)
+{
+    return toStringGeneric(buf, size, val);
+}
+
+template <typename Val>
+__attribute__((noinline)) char* fastConv(char* buf, size_t size, Val val)
+{
+    return toString(buf, size, val);
+}
+
+template <typename Val>
+void bench(const char* name)
+{
+    // Random values with a uniformly distributed bit length, so that all
+    // digit counts are represented
+    std::vector<Val> values;
+    for (int i = 0; i < kValues; i++)
+    {
+        uint64_t val = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+        values.push_back((Val)(val >> (rand() % 64)));
+    }
+    double generic = nsPerCall(values, genericConv<Val>);
+    double fast = nsPerCall(values, fastConv<Val>);
+    printf("%-9s %10.1f %8.1f %6.2fx\n", name, generic, fast, generic / fast);
+}
+
+int main()
+{
+    srand(1);
+    printf("type      generic(ns) fast(ns) speedup\n");
+    bench<uint8_t>("uint8_t");
+    bench<uint16_t>("uint16_t");
+    bench<uint32_t>("uint32_t");
+    bench<uint64_t>("uint64_t");
+    return 0;
+}
@@ -0,0 +1,261 @@
+#include <stm32++/tostring.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+
+// Cross-checks the integer conversions against snprintf()
+
+void fail(const char* expected, const char* actual)
+{
+    printf("ERROR: expected '%s', actual: '%s'\n", expected, actual);
+    exit(1);
+}
+
+// Random value with a random bit length, so that all digit counts are covered
+uint64_t randVal(uint8_t bits)
+{
+    uint64_t val = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+    uint8_t len = rand() % (bits + 1);
+    return len ? (val & (~0ULL >> (64 - len))) : 0;
+}
+
+template <typename Val>
+void checkUnsigned(Val val)
+{
+    char expected[32], actual[32];
+    snprintf(expected, sizeof(expected), "%" PRIu64, (uint64_t)val);
+    if (!toString(actual, sizeof(actual), val) || strcmp(expected, actual))
+        fail(expected, actual);
+    // same output as the generic path, with padding
+    char generic[32];
+    uint8_t minDigits = rand() % 12;
+    uint8_t minLen = rand() % 16;
+    toStringGeneric(generic, sizeof(generic), val, minDigits, minLen);
+    if (!toString(actual, sizeof(actual), val, minDigits, minLen) || strcmp(generic, actual))
+        fail(generic, actual);
+}
+
+template <typename Val>
+void checkSigned(Val val)
+{
+    char expected[32], actual[32];
+    snprintf(expected, sizeof(expected), "%" PRId64, (int64_t)val);
+    if (!toString(actual, sizeof(actual), val) || strcmp(expected, actual))
+        fail(expected, actual);
+}
+
+template <Flags flags=6, typename Val>
+void expectFp(const char* expected, Val val, uint8_t minDigits=0)
+{
+    char actual[64];
+    if (!toString<flags>(actual, sizeof(actual), val, minDigits) || strcmp(expected, actual))
+        fail(expected, actual);
+}
+
+// Number of significant digits of the shortest %e representation that
+// converts back to the same value
+template <typename Val>
+int shortestDigits(Val val, Val(*parse)(const char*, char**))
+{
+    char buf[64];
+    for (int prec = 0; ; prec++)
+    {
+        snprintf(buf, sizeof(buf), "%.*e", prec, (double)val);
+        if (parse(buf, nullptr) == val)
+            return prec + 1;
+    }
+}
+
+int sigDigits(const char* str)
+{
+    int count = 0;
+    bool leading = true;
+    int trailingZeros = 0;
+    for (; *str && *str != 'e'; str++)
+    {
+        if (*str < '0' || *str > '9')
+            continue;
+        if (leading && *str == '0')
+            continue;
+        leading = false;
+        count++;
+        trailingZeros = (*str == '0') ? trailingZeros + 1 : 0;
+    }
+    return count - trailingZeros;
+}
+
+// Shortest conversion of random bit patterns must convert back to the same
+// value. Grisu2 finds the shortest representation in ~99.9% of cases - it
+// may be longer if the shortest one is exactly on a rounding boundary
+template <typename Val, typename Bits>
+void checkRoundTrip(const char* name, Val(*parse)(const char*, char**))
+{
+    enum { kCount = 200000 };
+    int notShortest = 0;
+    for (int i = 0; i < kCount; i++)
+    {
+        Bits bits = (Bits)randVal(64) ^ ((Bits)rand() << (sizeof(Bits) * 8 - 16));
+        Val val;
+        memcpy(&val, &bits, sizeof(val));
+        if (val != val || val - val != 0) // nan or inf
+            continue;
+        char str[64];
+        if (!toString<kShortest>(str, sizeof(str), val))
+            fail("(conversion)", "nullptr");
+        Val back = parse(str, nullptr);
+        if (memcmp(&back, &val, sizeof(val)))
+        {
+            char expected[64];
+            snprintf(expected, sizeof(expected), "%.17g", (double)val);
+            fail(expected, str);
+        }
+        notShortest += (sigDigits(str) > shortestDigits(val, parse));
+    }
+    if (notShortest > kCount / 100)
+    {
+        printf("ERROR: %s: %d conversions were not the shortest\n", name, notShortest);
+        exit(1);
+    }
+    printf("PASS: %s round-trip, %d of %d not the shortest\n", name, notShortest, kCount);
+}
+
+void checkFloats()
+{
+    expectFp<kShortest>("0.1", 0.1f);
+    expectFp<kShortest>("0.1", 0.1);
+    expectFp<kShortest>("-123.4567", -123.4567);
+    expectFp<kShortest>("100.0", 100.0f);
+    expectFp<kShortest>("0.0", 0.0);
+    expectFp<kShortest>("-0.0", -0.0);
+    expectFp<kShortest>("0.00001", 0.00001);
+    expectFp<kShortest>("1e-06", 0.000001);
+    expectFp<kShortest>("123456789012.0", 123456789012.0);
+    expectFp<kShortest>("1.23456789012e+12", 1234567890120.0);
+    expectFp<kShortest>("1.7976931348623157e+308", 1.7976931348623157e308);
+    expectFp<kShortest>("5e-324", 4.9406564584124654e-324);
+    expectFp<kShortest>("1e-45", 1.4e-45f);
+    expectFp<kShortest>("3.4028235e+38", 3.4028235e38f);
+    expectFp<kShortest>("inf", 1.0 / 0.0);
+    expectFp<kShortest>("-inf", -1.0 / 0.0);
+    expectFp<kShortest>("nan", 0.0 / 0.0);
+    expectFp("123.456700", 123.4567);
+    expectFp("0123.456700", 123.4567, 4);
+    expectFp<2>("0.13", 0.125);
+    expectFp<3>("-0.000", -0.0001);
+    expectFp<3>("1.000", 0.9999);
+    expectFp("0.000001", 0.0000006);
+    expectFp("0.000000", 0.0000004);
+    expectFp("4294967296.000000", 4294967296.0);
+    expectFp("1.000000e+20", 1e20);
+    expectFp<3>("1.000e+12", 999999999999.9996);
+    expectFp<2>("-0.00", -2.5e-300);
+    printf("PASS: floating point special cases\n");
+
+    // Fixed precision matches printf(), except for the rounding of ties,
+    // which is done on the shortest digits, rather than on the exact binary value
+    for (int i = 0; i < 100000; i++)
+    {
+        double val = (double)(int64_t)randVal(36) / (double)(randVal(20) | 1);
+        char expected[64], actual[64];
+        snprintf(expected, sizeof(expected), "%.6f", val);
+        toString(actual, sizeof(actual), val);
+        if (strcmp(expected, actual) && fabs(strtod(expected, nullptr) - strtod(actual, nullptr)) > 1.5e-6)
+            fail(expected, actual);
+    }
+    printf("PASS: fixed precision compared to printf\n");
+
+    checkRoundTrip<float, uint32_t>("float", strtof);
+    checkRoundTrip<double, uint64_t>("double", strtod);
+}
+
+int main()
+{
+    srand(1);
+    const uint32_t edges[] = { 0, 1, 9, 10, 99, 100, 999, 1000, 9999, 10000,
+        65535, 65536, 99999999, 100000000, 999999999, 1000000000, 4294967295u };
+    for (auto val: edges)
+    {
+        checkUnsigned(val);
+        checkSigned((int32_t)val);
+        checkSigned(-(int32_t)val);
+    }
+    const uint64_t edges64[] = { 4294967296ULL, 999999999999ULL, 1000000000000ULL,
+        999999999999999999ULL, 1000000000000000000ULL, 1000000000000000001ULL,
+        9999999999999999999ULL, 10000000000000000000ULL, 18446744073709551615ULL };
+    for (auto val: edges64)
+    {
+        checkUnsigned(val);
+        checkSigned((int64_t)val);
+        checkSigned(-(int64_t)val);
+    }
+    // Values around the multiples of powers of 10, where the split into
+    // 9-digit chunks could go wrong
+    for (uint64_t pow = 10; pow <= 10000000000000000000ULL; pow *= 10)
+    {
+        for (uint64_t mult = 1; mult < 10 && mult <= UINT64_MAX / pow; mult++)
+        {
+            uint64_t val = mult * pow;
+            checkUnsigned(val - 1);
+            checkUnsigned(val);
+            checkUnsigned(val + 1);
+        }
+        if (pow > UINT64_MAX / 10)
+            break;
+    }
+    for (int i = 0; i < 1000000; i++)
+    {
+        checkUnsigned((uint8_t)randVal(8));
+        checkUnsigned((uint16_t)randVal(16));
+        checkUnsigned((uint32_t)randVal(32));
+        checkUnsigned(randVal(64));
+        checkSigned((int8_t)randVal(8));
+        checkSigned((int16_t)randVal(16));
+        checkSigned((int32_t)randVal(32));
+        checkSigned((int64_t)randVal(64));
+    }
+    printf("PASS: decimal conversion of random values\n");
+
+    // Fixed-point, compared to printf() formatting of the same value. The Q-format
+    // values are exactly representable as double and formatted with as many
+    // decimals as fractional bits, so there is no rounding to differ in
+    for (int i = 0; i < 100000; i++)
+    {
+        char expected[32], actual[32];
+        int32_t val = (int32_t)randVal(32);
+        uint32_t mag = val < 0 ? 0u - (uint32_t)val : val;
+        snprintf(expected, sizeof(expected), "%s%u.%03u", val < 0 ? "-" : "", mag / 1000, mag % 1000);
+        if (!toString(actual, sizeof(actual), fmtFixed<3>(val)) || strcmp(expected, actual))
+            fail(expected, actual);
+        snprintf(expected, sizeof(expected), "%.7f", val / 128.0);
+        if (!toString(actual, sizeof(actual), fmtQ<7, 7>(val)) || strcmp(expected, actual))
+            fail(expected, actual);
+    }
+    char fixedBuf[16];
+    toString(fixedBuf, sizeof(fixedBuf), fmtQ<8, 2>(0x1ff)); // 1.996 rounds up to the whole part
+    if (strcmp(fixedBuf, "2.00"))
+        fail("2.00", fixedBuf);
+    toString(fixedBuf, sizeof(fixedBuf), fmtFixed<0>((int8_t)-128));
+    if (strcmp(fixedBuf, "-128"))
+        fail("-128", fixedBuf);
+    if (toString(fixedBuf, 6, fmtFixed<2>(-1234)) || toString(fixedBuf, 2, fmtFixed<2>(5)))
+        fail("(nullptr)", fixedBuf);
+    printf("PASS: fixed-point conversion\n");
+
+    checkFloats();
+
+    // Truncation: the conversion must fail without writing past the buffer
+    char buf[8];
+    if (toString(buf, 5, 12345u) || buf[0] != 0)
+        fail("(nullptr)", buf);
+    if (!toString(buf, 6, 12345u) || strcmp(buf, "12345"))
+        fail("12345", buf);
+    if (toString<kDontNullTerminate>(buf, 4, 12345u))
+        fail("(nullptr)", buf);
+    if (toString(buf, sizeof(buf), 5u, 0, 8))
+        fail("(nullptr)", buf);
+    if (!toString(buf, sizeof(buf), 5u, 3, 7) || strcmp(buf, "    005"))
+        fail("    005", buf);
+    printf("PASS: truncation\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <stm32++/tsnprintf.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+// Compares the runtime-parsed and the compile-time parsed format string
+// paths of tsnprintf(), on the same cases as the tprintf test
+
+enum { kIterations = 1000000 };
+volatile size_t gSink; // prevents the formatting from being optimized out
+
+template <typename Fmt, typename... Args>
+double nsPerCall(Fmt fmt, Args... args)
+{
+    char buf[256];
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; i++)
+    {
+        char* end = tsnprintf(buf, sizeof(buf), fmt, args...);
+        total += end - buf;
+        // Don't let the compiler fold the formatting of constant args out of the loop
+        asm volatile("" : : "r"(buf) : "memory");
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    gSink = total;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / kIterations;
+}
+
+// Prints only the first line of multi-line format strings
+#define BENCH(fmtString, ...)                                       \
+    do {                                                            \
+        double rt = nsPerCall(fmtString, ##__VA_ARGS__);            \
+        double st = nsPerCall(fmtString##_fmt, ##__VA_ARGS__);      \
+        printf("%8.1f %8.1f %6.2fx  %.*s\n", rt, st, rt / st,       \
+            (int)strcspn(fmtString, "\n"), fmtString);              \
+    } while(0)
+
+int main()
+{
+    printf("runtime(ns) static(ns) speedup  format\n");
+    BENCH("this is a float: %", 123.4567);
+    BENCH("this is a fmtFp<prec: 6>(minDigits: 4): %", fmtFp<6>(123.4567, 4));
+    BENCH("this is an int: '%'", fmtInt(1234, 6, 8));
+    BENCH("this is a hex8(127): %", fmtHex(127));
+    BENCH("this is a hex16(32767): %", fmtHex<kUpperCase>(32767));
+    BENCH("this is a hex16(32767) no prefix: %", fmtHex<kNoPrefix>(32767));
+    BENCH("this is an octal: %", fmtInt<8>(1234567));
+    BENCH("this is a bin(127): %", fmtBin(127));
+    BENCH("this is a string: %", "'test message'");
+    BENCH("this is a dollar: %", '$');
+    BENCH("this is a float: %\n"
+          "this is a fmtFp<prec: 6>(minDigits: 4): %\n"
+          "this is a hex8(127): %\n"
+          "this is a hex16(32767): %\n"
+          "this is a bin(127): %\n"
+          "this is a string: '%'\n"
+          "this is a dollar: %\n",
+          123.4567, fmtFp<6>(123.4567, 4),
+          fmtHex8(127), fmtHex16(32767),
+          fmtBin(127), "test message", '$');
+    return 0;
+}
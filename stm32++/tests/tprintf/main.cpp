@@ -5,6 +5,7 @@
 struct MyPrintSink: public IPrintSink
 {
     const char* expectedString = nullptr;
+    BufferInfo* waitReady() { return nullptr; }
     void print(const char *str, size_t len, int fd)
     {
         if (strcmp(str, expectedString))
@@ -21,32 +22,77 @@ struct MyPrintSink: public IPrintSink
 
 MyPrintSink myPrintSink;
 
-template <typename... Args>
-void expect(const char* expected, const char* fmtString, Args... args)
+extern IPrintSink* gPrintSink;
+
+// A type that has a toString() overload, but no toStringMaxLen() one
+struct NoMaxLen {};
+template <Flags flags=0>
+char* toString(char* buf, size_t bufsize, NoMaxLen)
+{
+    return toString<flags>(buf, bufsize,
+        "a custom type whose output is longer than the initial tprintf buffer");
+}
+
+template <typename Fmt, typename... Args>
+void expect(const char* expected, Fmt fmtString, Args... args)
 {
     auto savedSink = gPrintSink;
     gPrintSink = &myPrintSink;
     myPrintSink.expectedString = expected;
+    size_t maxLen = formattedLength(fmtString, args...);
+    if (maxLen < strlen(expected))
+    {
+        printf("ERROR: formattedLength() returned %zu, less than the length of '%s'\n", maxLen, expected);
+        exit(1);
+    }
     tprintf(fmtString, args...);
     gPrintSink = savedSink;
 }
 
+// Checks both the runtime-parsed and the compile-time parsed format string
+#define EXPECT(expected, fmtString, ...) \
+    expect(expected, fmtString, ##__VA_ARGS__); \
+    expect(expected, fmtString##_fmt, ##__VA_ARGS__)
+
+// Placeholder specs are supported only by compile-time format strings
+#define EXPECT_FMT(expected, fmtString, ...) \
+    expect(expected, fmtString##_fmt, ##__VA_ARGS__)
+
 
 int main()
 {
-    expect("this is a float: 123.456700", "this is a float: %", 123.4567);
-    expect("this is a fmtFp<prec: 6>(minDigits: 4): 0123.456700",
+    EXPECT("this is a float: 123.456700", "this is a float: %", 123.4567);
+    EXPECT("this is a fmtFp<prec: 6>(minDigits: 4): 0123.456700",
            "this is a fmtFp<prec: 6>(minDigits: 4): %",
            fmtFp<6>(123.4567, 4));
-    expect("this is an int: '  001234'", "this is an int: '%'", fmtInt(1234, 6, 8));
-    expect("this is a hex8(127): 0x7f", "this is a hex8(127): %", fmtHex(127));
-    expect("this is a hex16(32767): 0x7FFF", "this is a hex16(32767): %", fmtHex<kUpperCase>(32767));
-    expect("this is a hex16(32767) no prefix: 7fff", "this is a hex16(32767) no prefix: %", fmtHex<kNoPrefix>(32767));
+    EXPECT("this is a shortest float: 0.1 1e-20",
+           "this is a shortest float: % %",
+           fmtFp<kShortest>(0.1f), fmtFp<kShortest>(1e-20));
+    EXPECT("this is an int: '  001234'", "this is an int: '%'", fmtInt(1234, 6, 8));
+    EXPECT("this is a hex8(127): 0x7f", "this is a hex8(127): %", fmtHex(127));
+    EXPECT("this is a hex16(32767): 0x7FFF", "this is a hex16(32767): %", fmtHex<kUpperCase>(32767));
+    EXPECT("this is a hex16(32767) no prefix: 7fff", "this is a hex16(32767) no prefix: %", fmtHex<kNoPrefix>(32767));
 
-    expect("this is an octal: OCT4553207", "this is an octal: %", fmtInt<8>(1234567));
-    expect("this is a bin(127): 0b01111111", "this is a bin(127): %", fmtBin(127));
-    expect("this is a string: 'test message'", "this is a string: %", "'test message'");
-    expect("this is a dollar: $", "this is a dollar: %", '$');
+    EXPECT("this is an octal: OCT4553207", "this is an octal: %", fmtInt<8>(1234567));
+    EXPECT("this is a bin(127): 0b01111111", "this is a bin(127): %", fmtBin(127));
+    EXPECT("this is a string: 'test message'", "this is a string: %", "'test message'");
+    EXPECT("this is a dollar: $", "this is a dollar: %", '$');
+    EXPECT("this is a fixed: -12.34 C", "this is a fixed: % C", fmtFixed<2>(-1234));
+    EXPECT("this is a fixed: 1013.25 mbar", "this is a fixed: % mbar", fmtFixed<2>(101325u));
+    EXPECT("this is a Q15: -0.50000", "this is a Q15: %", fmtQ<15>((int16_t)-16384));
+    EXPECT("this is a Q16.16: 003.142", "this is a Q16.16: %", fmtQ<16, 3>(205887, 3));
+    EXPECT("custom: a custom type whose output is longer than the initial tprintf buffer",
+           "custom: %", NoMaxLen());
+    EXPECT_FMT("width: |    1234|", "width: |%{8}|", 1234);
+    EXPECT_FMT("left: |ab    |", "left: |%{<6}|", "ab");
+    EXPECT_FMT("right: |     c|", "right: |%{>6}|", 'c');
+    EXPECT_FMT("hex: 0x00ff 0xFF 0xff", "hex: %{x4} %{X} %{x}", 255, 255u, (int8_t)-1);
+    EXPECT_FMT("bin: 0b0101", "bin: %{b4}", (uint8_t)5);
+    EXPECT_FMT("dec: -00042 |      -00042|", "dec: %{d5} |%{12d5}|", -42, (int64_t)-42);
+    EXPECT_FMT("float: |    3.14|-1.500  |", "float: |%{8.2}|%{<8.3}|", 3.14159, -1.5f);
+    EXPECT_FMT("fixed: |12.34     |", "fixed: |%{<10}|", fmtFixed<2>(1234));
+    EXPECT_FMT("table: temp    |  21.50|0x1A2B", "table: %{<8}|%{7.2}|%{X4}",
+               "temp", 21.5f, (uint16_t)0x1a2b);
 
     tprintf("this is a float: %\n"
             "this is a fmtFp<prec: 6>(minDigits: 4): %\n"
@@ -58,4 +104,23 @@ int main()
             123.4567, fmtFp<6>(123.4567, 4),
             fmtHex8(127), fmtHex16(32767),
             fmtBin(127), "test message", '$');
+
+    char buf[16];
+    if (tsnprintf(buf, sizeof(buf), "this does not fit"_fmt) || strcmp(buf, "this does not f"))
+    {
+        printf("ERROR: Truncated literal not handled correctly: '%s'\n", buf);
+        return 1;
+    }
+    if (tsnprintf(buf, sizeof(buf), "value: %"_fmt, 123456789) || strcmp(buf, "value: 12345678"))
+    {
+        printf("ERROR: Truncated value not handled correctly: '%s'\n", buf);
+        return 1;
+    }
+    if (tsnprintf(buf, sizeof(buf), "value: %{10}"_fmt, 1))
+    {
+        printf("ERROR: Truncated padding not handled correctly: '%s'\n", buf);
+        return 1;
+    }
+    printf("PASS: truncation\n");
+    return 0;
 }
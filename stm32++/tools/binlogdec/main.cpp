@@ -0,0 +1,54 @@
+/**
+ * Decodes the output of a firmware built in deferred logging mode
+ * (optBinLog / STM32PP_TPRINTF_DEFERRED) back to text.
+ * Usage: binlogdec <firmware.elf> [log-file]
+ * If no log file is given, the log is read from stdin, e.g. from the serial port:
+ * \code stty -F /dev/ttyUSB0 115200 raw && binlogdec firmware.elf < /dev/ttyUSB0 \endcode
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#include <stm32++/binlogDecoder.hpp>
+#include <unistd.h>
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s <firmware.elf> [log-file]\n", argv[0]);
+        return 1;
+    }
+    binlog::Decoder decoder;
+    if (!decoder.loadElf(argv[1]))
+    {
+        fprintf(stderr, "Could not load format strings from the binlog_fmt section of '%s'\n", argv[1]);
+        return 2;
+    }
+    FILE* input = stdin;
+    if (argc == 3)
+    {
+        input = fopen(argv[2], "rb");
+        if (!input)
+        {
+            fprintf(stderr, "Could not open log file '%s'\n", argv[2]);
+            return 3;
+        }
+    }
+    std::string pending;
+    std::string text;
+    char buf[512];
+    ssize_t len;
+    // Read whatever is available, so that a live log is printed without delay
+    while ((len = read(fileno(input), buf, sizeof(buf))) > 0)
+    {
+        pending.append(buf, len);
+        size_t consumed = decoder.decode(pending.data(), pending.size(), text);
+        pending.erase(0, consumed);
+        fwrite(text.data(), 1, text.size(), stdout);
+        fflush(stdout);
+        text.clear();
+    }
+    // Output an incomplete record at the end as is
+    fwrite(pending.data(), 1, pending.size(), stdout);
+    return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * Terminal for the RTT memory-ring debug channel (see rtt.hpp), via OpenOCD.
+ * The memory of the running target is accessed via OpenOCD's Tcl RPC port,
+ * so OpenOCD must be running, i.e. started by ocmd.sh. Output of up buffer 0
+ * is printed to stdout, and stdin is sent to down buffer 0.
+ * Usage: rttread [ram-start ram-size [poll-interval-ms]]
+ * The defaults are the RAM of the STM32F103 (0x20000000, 0x5000) and 10 ms.
+ * @author Alexander Vassilev
+ * @copyright BSD License
+ */
+
+#include <stm32++/rttReader.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/** @brief Memory access via the \c read_memory and \c write_memory commands
+ * of OpenOCD's Tcl RPC server. Commands and responses are terminated by 0x1a.
+ */
+class OpenOcdMemory: public rtt::IMemory
+{
+protected:
+    enum: uint32_t { kMaxReadLen = 1024 };
+    int mSock = -1;
+    std::string mResponse;
+    bool command(const std::string& cmd)
+    {
+        std::string msg = cmd + '\x1a';
+        if (send(mSock, msg.data(), msg.size(), 0) != (ssize_t)msg.size())
+        {
+            return false;
+        }
+        mResponse.clear();
+        char buf[1024];
+        for (;;)
+        {
+            ssize_t len = recv(mSock, buf, sizeof(buf), 0);
+            if (len <= 0)
+            {
+                return false;
+            }
+            mResponse.append(buf, len);
+            if (mResponse.back() == '\x1a')
+            {
+                mResponse.pop_back();
+                return true;
+            }
+        }
+    }
+public:
+    bool connect(uint16_t port=6666)
+    {
+        mSock = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return mSock >= 0 && ::connect(mSock, (sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+    virtual bool read(uint64_t addr, void* buf, size_t len)
+    {
+        auto out = (uint8_t*)buf;
+        while (len)
+        {
+            size_t chunk = (len > kMaxReadLen) ? (size_t)kMaxReadLen : len;
+            char cmd[64];
+            snprintf(cmd, sizeof(cmd), "read_memory 0x%llx 8 %zu", (unsigned long long)addr, chunk);
+            if (!command(cmd))
+            {
+                return false;
+            }
+            const char* pos = mResponse.c_str();
+            for (size_t i = 0; i < chunk; i++)
+            {
+                char* end;
+                unsigned long val = strtoul(pos, &end, 0);
+                if (end == pos)
+                {
+                    return false; // error message instead of data
+                }
+                out[i] = val;
+                pos = end;
+            }
+            out += chunk;
+            addr += chunk;
+            len -= chunk;
+        }
+        return true;
+    }
+    virtual bool write(uint64_t addr, const void* data, size_t len)
+    {
+        char num[16];
+        std::string cmd;
+        snprintf(num, sizeof(num), "0x%llx", (unsigned long long)addr);
+        if (len == 4 && (addr & 3) == 0)
+        {
+            uint32_t val;
+            memcpy(&val, data, 4);
+            cmd = cmd + "write_memory " + num + " 32 {";
+            snprintf(num, sizeof(num), "0x%x", val);
+            cmd += num;
+        }
+        else
+        {
+            cmd = cmd + "write_memory " + num + " 8 {";
+            for (size_t i = 0; i < len; i++)
+            {
+                snprintf(num, sizeof(num), "0x%x ", ((const uint8_t*)data)[i]);
+                cmd += num;
+            }
+        }
+        cmd += '}';
+        // A successful write_memory returns an empty string
+        return command(cmd) && mResponse.empty();
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    if (argc != 1 && argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "Usage: %s [ram-start ram-size [poll-interval-ms]]\n", argv[0]);
+        return 1;
+    }
+    uint64_t start = (argc > 1) ? strtoull(argv[1], nullptr, 0) : 0x20000000;
+    uint64_t size = (argc > 2) ? strtoull(argv[2], nullptr, 0) : 0x5000;
+    useconds_t interval = ((argc > 3) ? atoi(argv[3]) : 10) * 1000;
+
+    OpenOcdMemory mem;
+    if (!mem.connect())
+    {
+        fprintf(stderr, "Could not connect to the OpenOCD Tcl port, is OpenOCD running?\n");
+        return 2;
+    }
+    rtt::Reader reader(mem);
+    // The control block is initialized at runtime, so it may not exist yet
+    while (!reader.find(start, size))
+    {
+        usleep(500000);
+    }
+    fprintf(stderr, "RTT control block found at 0x%llx\n", (unsigned long long)reader.address());
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    std::string text;
+    std::string input;
+    for (;;)
+    {
+        if (!reader.read(0, text))
+        {
+            fprintf(stderr, "Error reading the up buffer\n");
+            return 3;
+        }
+        fwrite(text.data(), 1, text.size(), stdout);
+        fflush(stdout);
+        text.clear();
+
+        char buf[256];
+        ssize_t len = ::read(STDIN_FILENO, buf, sizeof(buf));
+        if (len > 0)
+        {
+            input.append(buf, len);
+        }
+        if (!input.empty() && reader.numDownBuffers() > 0)
+        {
+            int written = reader.write(0, input.data(), input.size());
+            if (written < 0)
+            {
+                fprintf(stderr, "Error writing the down buffer\n");
+                return 3;
+            }
+            input.erase(0, written);
+        }
+        usleep(interval);
+    }
+}
@@ -71,7 +71,15 @@ if (optCustomOffset)
     set(linkerOffsetArg "-Ttext=${optCustomOffset}")
 endif()
 
-set(exeLinkerFlags "-nostartfiles -T${optLinkScript} ${linkerOffsetArg} ${linkDirs}")
+set(optBinLog 0 CACHE BOOL
+"Deferred logging: tprintf() with _fmt format strings emits binary records instead of text.\n\
+The format strings are not loaded on the chip, and the output is decoded on the host by binlogdec")
+if (optBinLog)
+    add_definitions(-DSTM32PP_TPRINTF_DEFERRED)
+    set(binlogLinkerArg "-T${CMAKE_CURRENT_LIST_DIR}/binlog.ld")
+endif()
+
+set(exeLinkerFlags "-nostartfiles -T${optLinkScript} ${binlogLinkerArg} ${linkerOffsetArg} ${linkDirs}")
 
 if (NOT "${exeLinkerFlags}" STREQUAL "${CMAKE_EXE_LINKER_FLAGS}")
     message(STATUS "EXE linker flags changed")
@@ -113,6 +121,7 @@ if (optUseOpencm3)
         "${STM32PP_SRCPATH}/semihosting.cpp"
         "${STM32PP_SRCPATH}/printSink.cpp"
         "${STM32PP_SRCPATH}/tsnprintf.cpp"
+        "${STM32PP_SRCPATH}/fpconv.cpp"
     )
 endif()
 